@@ -26,6 +26,7 @@ static void syntax(void)
 {
     printf("Syntax: avifdec [options] input.avif output.[jpg|jpeg|png|y4m]\n");
     printf("        avifdec --info    input.avif\n");
+    printf("        avifdec --probe   input.avif\n");
     printf("Options:\n");
     printf("    -h,--help         : Show syntax help\n");
     printf("    -V,--version      : Show the version number\n");
@@ -42,16 +43,38 @@ static void syntax(void)
     printf("                        avifdec will use --index to choose which layer to decode (in progressive order).\n");
     printf("    --no-strict       : Disable strict decoding, which disables strict validation checks and errors\n");
     printf("    -i,--info         : Decode all frames and display all image information instead of saving to disk\n");
+    printf("    --probe           : Display the image information like --info, without decoding any frame\n");
     printf("    --ignore-icc      : If the input file contains an embedded ICC profile, ignore it (no-op if absent)\n");
     printf("    --size-limit C    : Specifies the image size limit (in total pixels) that should be tolerated.\n");
     printf("                        Default: %u, set to a smaller value to further restrict.\n", AVIF_DEFAULT_IMAGE_SIZE_LIMIT);
     printf("  --dimension-limit C : Specifies the image dimension limit (width or height) that should be tolerated.\n");
     printf("                        Default: %u, set to 0 to ignore.\n", AVIF_DEFAULT_IMAGE_DIMENSION_LIMIT);
+    printf("    --read-ahead K    : Read up to K KiB of the upcoming frames of image sequences on a background thread\n");
+    printf("                        while the current frame is decoded. Default: 0 (disabled)\n");
     printf("    --                : Signals the end of options. Everything after this is interpreted as file names.\n");
     printf("\n");
     avifPrintVersions();
 }
 
+// Same as avifDecoderSetIOFile(), reading readAheadBytes ahead if not zero.
+static avifResult setIOFile(avifDecoder * decoder, const char * filename, size_t readAheadBytes)
+{
+    if (readAheadBytes == 0) {
+        return avifDecoderSetIOFile(decoder, filename);
+    }
+    avifIO * io = avifIOCreateFileReader(filename);
+    if (!io) {
+        return AVIF_RESULT_IO_ERROR;
+    }
+    avifIO * prefetchIO = avifIOCreatePrefetchReader(io, readAheadBytes);
+    if (!prefetchIO) {
+        fprintf(stderr, "WARNING: libavif was built without thread support, --read-ahead is ignored\n");
+        prefetchIO = io;
+    }
+    avifDecoderSetIO(decoder, prefetchIO);
+    return AVIF_RESULT_OK;
+}
+
 int main(int argc, char * argv[])
 {
     const char * inputFilename = NULL;
@@ -62,6 +85,7 @@ int main(int argc, char * argv[])
     int pngCompressionLevel = -1; // -1 is a sentinel to avifPNGWrite() to skip calling png_set_compression_level()
     avifCodecChoice codecChoice = AVIF_CODEC_CHOICE_AUTO;
     avifBool infoOnly = AVIF_FALSE;
+    avifBool probeOnly = AVIF_FALSE;
     avifChromaUpsampling chromaUpsampling = AVIF_CHROMA_UPSAMPLING_AUTOMATIC;
     avifBool ignoreICC = AVIF_FALSE;
     avifBool rawColor = AVIF_FALSE;
@@ -69,6 +93,7 @@ int main(int argc, char * argv[])
     avifStrictFlags strictFlags = AVIF_STRICT_ENABLED;
     uint32_t frameIndex = 0;
     uint32_t imageSizeLimit = AVIF_DEFAULT_IMAGE_SIZE_LIMIT;
+    size_t readAheadBytes = 0;
     uint32_t imageDimensionLimit = AVIF_DEFAULT_IMAGE_DIMENSION_LIMIT;
 
     if (argc < 2) {
@@ -177,6 +202,9 @@ int main(int argc, char * argv[])
             strictFlags = AVIF_STRICT_DISABLED;
         } else if (!strcmp(arg, "-i") || !strcmp(arg, "--info")) {
             infoOnly = AVIF_TRUE;
+        } else if (!strcmp(arg, "--probe")) {
+            infoOnly = AVIF_TRUE;
+            probeOnly = AVIF_TRUE;
         } else if (!strcmp(arg, "--ignore-icc")) {
             ignoreICC = AVIF_TRUE;
         } else if (!strcmp(arg, "--size-limit")) {
@@ -195,6 +223,14 @@ int main(int argc, char * argv[])
                 return 1;
             }
             imageDimensionLimit = (uint32_t)value;
+        } else if (!strcmp(arg, "--read-ahead")) {
+            NEXTARG();
+            unsigned long value = strtoul(arg, NULL, 10);
+            if (value > SIZE_MAX / 1024) {
+                fprintf(stderr, "ERROR: invalid read-ahead size: %s\n", arg);
+                return 1;
+            }
+            readAheadBytes = (size_t)value * 1024;
         } else if (arg[0] == '-') {
             fprintf(stderr, "ERROR: unrecognized option %s\n\n", arg);
             syntax();
@@ -233,15 +269,15 @@ int main(int argc, char * argv[])
         decoder->imageDimensionLimit = imageDimensionLimit;
         decoder->strictFlags = strictFlags;
         decoder->allowProgressive = allowProgressive;
-        avifResult result = avifDecoderSetIOFile(decoder, inputFilename);
+        avifResult result = setIOFile(decoder, inputFilename, readAheadBytes);
         if (result != AVIF_RESULT_OK) {
             fprintf(stderr, "Cannot open file for read: %s\n", inputFilename);
             avifDecoderDestroy(decoder);
             return 1;
         }
-        result = avifDecoderParse(decoder);
+        result = probeOnly ? avifDecoderProbe(decoder) : avifDecoderParse(decoder);
         if (result == AVIF_RESULT_OK) {
-            printf("Image decoded: %s\n", inputFilename);
+            printf("Image %s: %s\n", probeOnly ? "probed" : "decoded", inputFilename);
             avifContainerDump(decoder);
 
             printf(" * %" PRIu64 " timescales per second, %2.2f seconds (%" PRIu64 " timescales), %d frame%s\n",
@@ -250,6 +286,10 @@ int main(int argc, char * argv[])
                    decoder->durationInTimescales,
                    decoder->imageCount,
                    (decoder->imageCount == 1) ? "" : "s");
+            if (probeOnly) {
+                avifDecoderDestroy(decoder);
+                return 0;
+            }
             if (decoder->imageCount > 1) {
                 printf(" * %s Frames: (%u expected frames)\n",
                        (decoder->progressiveState != AVIF_PROGRESSIVE_STATE_UNAVAILABLE) ? "Progressive Image" : "Image Sequence",
@@ -304,7 +344,7 @@ int main(int argc, char * argv[])
     decoder->strictFlags = strictFlags;
     decoder->allowProgressive = allowProgressive;
 
-    avifResult result = avifDecoderSetIOFile(decoder, inputFilename);
+    avifResult result = setIOFile(decoder, inputFilename, readAheadBytes);
     if (result != AVIF_RESULT_OK) {
         fprintf(stderr, "Cannot open file for read: %s\n", inputFilename);
         returnCode = 1;
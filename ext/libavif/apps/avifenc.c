@@ -10,9 +10,15 @@
 
 #include <assert.h>
 #include <inttypes.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(AVIF_PTHREADS_ENABLED)
+#include <pthread.h>
+#endif
 
 #if defined(_WIN32)
 // for setmode()
@@ -27,6 +33,9 @@
     }                                                                 \
     arg = argv[++argIndex]
 
+#define AVIF_MIN(a, b) (((a) < (b)) ? (a) : (b))
+#define AVIF_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
 typedef struct avifInputFile
 {
     const char * filename;
@@ -53,6 +62,14 @@ static void syntax(void)
     printf("    -V,--version                      : Show the version number\n");
     printf("    -j,--jobs J                       : Number of jobs (worker threads, default: 1. Use \"all\" to use all available cores)\n");
     printf("    -o,--output FILENAME              : Instead of using the last filename given as output, use this filename\n");
+    printf("    --batch                           : Encode each input file to its own AVIF file, named after the input with the .avif extension,\n");
+    printf("                                        in the directory given with -o or next to the input. Files are encoded in parallel, sharing\n");
+    printf("                                        the -j threads between files and encoder threads depending on image size. Prints one JSON line\n");
+    printf("                                        per file. Nothing is encoded if two inputs would have the same output filename. --stdin, --grid,\n");
+    printf("                                        --crop and --clap are not allowed\n");
+    printf("    --batch-list FILENAME             : Implies --batch. Also encode the files listed in FILENAME, one per line (lines starting with # are ignored)\n");
+    printf("    --batch-memory MB                 : Batch mode only. Do not start a file while the estimated memory use of the files in progress would\n");
+    printf("                                        exceed MB megabytes (default: 0, unlimited)\n");
     printf("    -l,--lossless                     : Set all defaults to encode losslessly, and emit warnings when settings/input don't allow for it\n");
     printf("    -d,--depth D                      : Output depth [8,10,12]. (JPEG/PNG only; For y4m or stdin, depth is retained)\n");
     printf("    -y,--yuv FORMAT                   : Output format [default=auto, 444, 422, 420, 400]. Ignored for y4m or stdin (y4m format is retained)\n");
@@ -414,6 +431,844 @@ static avifBool avifImageSplitGrid(const avifImage * gridSplitImage, uint32_t gr
     return AVIF_TRUE;
 }
 
+// ---------------------------------------------------------------------------
+// Batch mode: each input file is encoded to its own AVIF file. Files are handed out to a pool of
+// workers from a shared queue (largest first), and the -j thread budget is split between the
+// number of files encoded at once and the threads given to each encoder, depending on image size.
+
+// Images below this many pixels per thread do not benefit from more encoder threads; it is
+// better to encode several of them side by side.
+#define BATCH_PIXELS_PER_THREAD (1024 * 1024)
+// Rough peak memory use per pixel and per byte of sample (decoded RGB rows, YUVA planes and the
+// AV1 encoder's internal frames), measured with aom on 8-bit 4032x3024 JPEG input.
+#define BATCH_BYTES_PER_PIXEL 16
+
+typedef struct avifBatchSettings
+{
+    avifPixelFormat requestedFormat;
+    int requestedDepth;
+    avifChromaDownsampling chromaDownsampling;
+    avifBool ignoreICC;
+    avifBool ignoreExif;
+    avifBool ignoreXMP;
+    const avifRWData * iccOverride;
+    const avifRWData * exifOverride;
+    const avifRWData * xmpOverride;
+    avifColorPrimaries colorPrimaries;
+    avifTransferCharacteristics transferCharacteristics;
+    avifMatrixCoefficients matrixCoefficients;
+    avifBool cicpExplicitlySet;
+    avifRange yuvRange;
+    avifBool premultiplyAlpha;
+    int paspCount;
+    const uint32_t * paspValues;
+    uint8_t irotAngle;
+    uint8_t imirMode;
+
+    avifCodecChoice codecChoice;
+    int speed;
+    int minQuantizer;
+    int maxQuantizer;
+    int minQuantizerAlpha;
+    int maxQuantizerAlpha;
+    int tileRowsLog2;
+    int tileColsLog2;
+    avifBool autoTiling;
+    const char ** advancedOptions; // "key=value" strings given with -a
+    int advancedOptionsCount;
+
+    const char * outputDirectory; // NULL to write each output next to its input
+} avifBatchSettings;
+
+typedef struct avifBatchFile
+{
+    const char * inputFilename;
+    char * outputFilename;
+    uint32_t width;  // 0 if the header could not be probed
+    uint32_t height; // 0 if the header could not be probed
+    uint32_t depth;
+    int threads;   // minimum encoder threads for this file
+    size_t memory; // estimated peak memory use, in bytes
+} avifBatchFile;
+
+typedef struct avifBatch
+{
+    const avifBatchSettings * settings;
+    avifBatchFile * files; // sorted by decreasing size
+    int filesCount;
+    int nextFile;
+    int freeThreads;
+    size_t freeMemory; // SIZE_MAX if unlimited
+    int activeFiles;
+    int failedFiles;
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+} avifBatch;
+
+static void avifBatchLock(avifBatch * batch)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_lock(&batch->mutex);
+#else
+    (void)batch;
+#endif
+}
+
+static void avifBatchUnlock(avifBatch * batch)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_unlock(&batch->mutex);
+#else
+    (void)batch;
+#endif
+}
+
+static double avifNowMs(void)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+#else
+    return (double)clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+static uint32_t readU16BE(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t readU32BE(const uint8_t * p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Reads the image dimensions and sample depth from the file header, without decoding anything.
+// Returns AVIF_FALSE if the file cannot be read or its format is not recognized.
+static avifBool avifBatchProbeFile(avifBatchFile * file)
+{
+    FILE * f = fopen(file->inputFilename, "rb");
+    if (!f) {
+        return AVIF_FALSE;
+    }
+    avifBool found = AVIF_FALSE;
+    uint8_t header[64];
+    const size_t headerSize = fread(header, 1, sizeof(header), f);
+    if ((headerSize >= 26) && !memcmp(header, "\x89PNG\r\n\x1a\n", 8) && !memcmp(&header[12], "IHDR", 4)) {
+        file->width = readU32BE(&header[16]);
+        file->height = readU32BE(&header[20]);
+        file->depth = header[24];
+        found = AVIF_TRUE;
+    } else if ((headerSize >= 10) && !memcmp(header, "YUV4MPEG2 ", 10)) {
+        header[headerSize - 1] = 0;
+        const char * token = strchr((const char *)header, ' ');
+        while (token) {
+            ++token;
+            if (*token == 'W') {
+                file->width = (uint32_t)atoi(token + 1);
+            } else if (*token == 'H') {
+                file->height = (uint32_t)atoi(token + 1);
+            } else if ((*token == 'C') && strstr(token, "p1")) { // C420p10, C444p12 etc.
+                file->depth = 16;
+            }
+            token = strchr(token, ' ');
+        }
+        found = (file->width > 0) && (file->height > 0);
+    } else if ((headerSize >= 4) && (header[0] == 0xFF) && (header[1] == 0xD8)) {
+        // Walk the JPEG markers up to the first SOFn segment, skipping Exif/XMP/ICC payloads.
+        long offset = 2;
+        uint8_t marker[10];
+        while (!found && !fseek(f, offset, SEEK_SET) && (fread(marker, 1, 4, f) == 4) && (marker[0] == 0xFF)) {
+            const uint8_t type = marker[1];
+            const uint32_t segmentSize = readU16BE(&marker[2]);
+            if ((type >= 0xC0) && (type <= 0xCF) && (type != 0xC4) && (type != 0xC8) && (type != 0xCC)) {
+                if (fread(&marker[4], 1, 5, f) == 5) {
+                    file->depth = marker[4];
+                    file->height = readU16BE(&marker[5]);
+                    file->width = readU16BE(&marker[7]);
+                    found = AVIF_TRUE;
+                }
+                break;
+            }
+            if ((type == 0xD9) || (type == 0xDA) || (segmentSize < 2)) {
+                break;
+            }
+            offset += 2 + (long)segmentSize;
+        }
+    }
+    fclose(f);
+    return found && (file->width > 0) && (file->height > 0);
+}
+
+// Builds the output filename: the input filename with its extension replaced by ".avif", in
+// outputDirectory if set, next to the input otherwise.
+static char * avifBatchOutputFilename(const char * inputFilename, const char * outputDirectory)
+{
+    const char * basename = inputFilename;
+    for (const char * p = inputFilename; *p; ++p) {
+        if ((*p == '/') || (*p == '\\')) {
+            basename = p + 1;
+        }
+    }
+    const char * dot = strrchr(basename, '.');
+    const size_t stemLength = dot ? (size_t)(dot - basename) : strlen(basename);
+
+    const char * prefix = inputFilename;
+    size_t prefixLength = (size_t)(basename - inputFilename);
+    const char * separator = "";
+    if (outputDirectory) {
+        prefix = outputDirectory;
+        prefixLength = strlen(outputDirectory);
+        if ((prefixLength > 0) && (outputDirectory[prefixLength - 1] != '/') && (outputDirectory[prefixLength - 1] != '\\')) {
+            separator = "/";
+        }
+    }
+
+    const size_t size = prefixLength + strlen(separator) + stemLength + sizeof(".avif");
+    char * outputFilename = malloc(size);
+    if (outputFilename) {
+        snprintf(outputFilename, size, "%.*s%s%.*s.avif", (int)prefixLength, prefix, separator, (int)stemLength, basename);
+    }
+    return outputFilename;
+}
+
+static void printJSONString(const char * str)
+{
+    putchar('"');
+    for (const unsigned char * p = (const unsigned char *)str; *p; ++p) {
+        if ((*p == '"') || (*p == '\\')) {
+            printf("\\%c", *p);
+        } else if (*p < 0x20) {
+            printf("\\u%04x", *p);
+        } else {
+            putchar(*p);
+        }
+    }
+    putchar('"');
+}
+
+// Encodes one file of the batch. Returns the output size in bytes, or 0 on failure, in which case
+// *error is set to a short description.
+static size_t avifBatchEncodeFile(const avifBatchSettings * settings,
+                                  avifEncoder * encoder,
+                                  const avifBatchFile * file,
+                                  int threads,
+                                  avifImage * image,
+                                  const char ** error)
+{
+    image->colorPrimaries = settings->colorPrimaries;
+    image->transferCharacteristics = settings->transferCharacteristics;
+    image->matrixCoefficients = settings->matrixCoefficients;
+    image->yuvRange = settings->yuvRange;
+    image->alphaPremultiplied = settings->premultiplyAlpha;
+
+    if (!file->outputFilename) {
+        *error = "out of memory";
+        return 0;
+    }
+    if (avifReadImage(file->inputFilename,
+                      settings->requestedFormat,
+                      settings->requestedDepth,
+                      settings->chromaDownsampling,
+                      settings->ignoreICC,
+                      settings->ignoreExif,
+                      settings->ignoreXMP,
+                      image,
+                      NULL,
+                      NULL,
+                      NULL) == AVIF_APP_FILE_FORMAT_UNKNOWN) {
+        *error = "cannot read input";
+        return 0;
+    }
+    if ((image->matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) && (image->yuvFormat != AVIF_PIXEL_FORMAT_YUV444)) {
+        *error = "matrixCoefficients may not be set to identity (0) when subsampling";
+        return 0;
+    }
+
+    if (settings->iccOverride->size) {
+        avifImageSetProfileICC(image, settings->iccOverride->data, settings->iccOverride->size);
+    }
+    if (settings->exifOverride->size) {
+        avifImageSetMetadataExif(image, settings->exifOverride->data, settings->exifOverride->size);
+    }
+    if (settings->xmpOverride->size) {
+        avifImageSetMetadataXMP(image, settings->xmpOverride->data, settings->xmpOverride->size);
+    }
+    if (!image->icc.size && !settings->cicpExplicitlySet && (image->colorPrimaries == AVIF_COLOR_PRIMARIES_UNSPECIFIED) &&
+        (image->transferCharacteristics == AVIF_TRANSFER_CHARACTERISTICS_UNSPECIFIED)) {
+        image->colorPrimaries = AVIF_COLOR_PRIMARIES_BT709;
+        image->transferCharacteristics = AVIF_TRANSFER_CHARACTERISTICS_SRGB;
+    }
+    if (settings->paspCount == 2) {
+        image->transformFlags |= AVIF_TRANSFORM_PASP;
+        image->pasp.hSpacing = settings->paspValues[0];
+        image->pasp.vSpacing = settings->paspValues[1];
+    }
+    if (settings->irotAngle != 0xff) {
+        image->transformFlags |= AVIF_TRANSFORM_IROT;
+        image->irot.angle = settings->irotAngle;
+    }
+    if (settings->imirMode != 0xff) {
+        image->transformFlags |= AVIF_TRANSFORM_IMIR;
+        image->imir.mode = settings->imirMode;
+    }
+
+    size_t outputSize = 0;
+    avifRWData raw = AVIF_DATA_EMPTY;
+    encoder->maxThreads = threads;
+    const avifResult result = avifEncoderWrite(encoder, image, &raw);
+    if (result != AVIF_RESULT_OK) {
+        *error = encoder->diag.error[0] ? encoder->diag.error : avifResultToString(result);
+    } else {
+        FILE * f = fopen(file->outputFilename, "wb");
+        if (!f) {
+            *error = "cannot open output for write";
+        } else {
+            if (fwrite(raw.data, 1, raw.size, f) != raw.size) {
+                *error = "cannot write output";
+            } else {
+                outputSize = raw.size;
+            }
+            fclose(f);
+        }
+    }
+    avifRWDataFree(&raw);
+    return outputSize;
+}
+
+static avifEncoder * avifBatchCreateEncoder(const avifBatchSettings * settings)
+{
+    avifEncoder * encoder = avifEncoderCreate();
+    if (!encoder) {
+        return NULL;
+    }
+    encoder->minQuantizer = settings->minQuantizer;
+    encoder->maxQuantizer = settings->maxQuantizer;
+    encoder->minQuantizerAlpha = settings->minQuantizerAlpha;
+    encoder->maxQuantizerAlpha = settings->maxQuantizerAlpha;
+    encoder->tileRowsLog2 = settings->tileRowsLog2;
+    encoder->tileColsLog2 = settings->tileColsLog2;
+    encoder->autoTiling = settings->autoTiling;
+    encoder->codecChoice = settings->codecChoice;
+    encoder->speed = settings->speed;
+    // The files are encoded one after the other with this encoder, so the codec instances are
+    // kept from one file to the next one when they can be.
+    encoder->reuseCodecs = AVIF_TRUE;
+    return encoder;
+}
+
+// The codec-specific options are consumed by each encode, so they are set again for every file.
+static void avifBatchSetAdvancedOptions(const avifBatchSettings * settings, avifEncoder * encoder)
+{
+    for (int i = 0; i < settings->advancedOptionsCount; ++i) {
+        char * key = strdup(settings->advancedOptions[i]);
+        char * value = strchr(key, '=');
+        if (value) {
+            *value = 0;
+            ++value;
+        } else {
+            value = "";
+        }
+        avifEncoderSetCodecSpecificOption(encoder, key, value);
+        free(key);
+    }
+}
+
+// Worker loop. Files are admitted in queue order: the next file waits until enough threads and
+// memory are free, unless nothing else is running, so that a large file cannot be starved by the
+// small ones behind it. A file gets more threads than its minimum when the remaining files
+// cannot use the free ones anyway (the tail of the batch).
+static void * avifBatchWorker(void * userData)
+{
+    avifBatch * batch = (avifBatch *)userData;
+    const avifBatchSettings * settings = batch->settings;
+    avifEncoder * encoder = avifBatchCreateEncoder(settings);
+
+    for (;;) {
+        avifBatchLock(batch);
+        avifBatchFile * file = NULL;
+        int threads = 0;
+        size_t reservedMemory = 0;
+        while (batch->nextFile < batch->filesCount) {
+            avifBatchFile * candidate = &batch->files[batch->nextFile];
+            if ((batch->activeFiles == 0) || ((candidate->threads <= batch->freeThreads) && (candidate->memory <= batch->freeMemory))) {
+                const int remainingFiles = batch->filesCount - batch->nextFile;
+                file = candidate;
+                threads = AVIF_MAX(candidate->threads, batch->freeThreads / remainingFiles);
+                threads = AVIF_MAX(1, AVIF_MIN(threads, batch->freeThreads));
+                ++batch->nextFile;
+                ++batch->activeFiles;
+                batch->freeThreads -= threads;
+                if (batch->freeMemory != SIZE_MAX) {
+                    reservedMemory = AVIF_MIN(candidate->memory, batch->freeMemory);
+                    batch->freeMemory -= reservedMemory;
+                }
+                break;
+            }
+#if defined(AVIF_PTHREADS_ENABLED)
+            pthread_cond_wait(&batch->cond, &batch->mutex);
+#endif
+        }
+        avifBatchUnlock(batch);
+        if (!file) {
+            break;
+        }
+
+        const double startMs = avifNowMs();
+        const char * error = NULL;
+        size_t outputSize = 0;
+        avifImage * image = avifImageCreateEmpty();
+        if (!encoder || !image) {
+            error = "out of memory";
+        } else {
+            avifBatchSetAdvancedOptions(settings, encoder);
+            outputSize = avifBatchEncodeFile(settings, encoder, file, threads, image, &error);
+            avifEncoderReset(encoder);
+        }
+        const double elapsedMs = avifNowMs() - startMs;
+
+        avifBatchLock(batch);
+        printf("{\"input\":");
+        printJSONString(file->inputFilename);
+        printf(",\"output\":");
+        printJSONString(file->outputFilename ? file->outputFilename : "");
+        if (error) {
+            printf(",\"status\":\"error\",\"error\":");
+            printJSONString(error);
+        } else {
+            printf(",\"status\":\"ok\",\"width\":%u,\"height\":%u,\"depth\":%u,\"format\":\"%s\",\"bytes\":" AVIF_FMT_ZU,
+                   image->width,
+                   image->height,
+                   image->depth,
+                   avifPixelFormatToString(image->yuvFormat),
+                   outputSize);
+        }
+        printf(",\"threads\":%d,\"ms\":%.1f}\n", threads, elapsedMs);
+        fflush(stdout);
+        if (error) {
+            ++batch->failedFiles;
+        }
+        --batch->activeFiles;
+        batch->freeThreads += threads;
+        if (batch->freeMemory != SIZE_MAX) {
+            batch->freeMemory += reservedMemory;
+        }
+#if defined(AVIF_PTHREADS_ENABLED)
+        pthread_cond_broadcast(&batch->cond);
+#endif
+        avifBatchUnlock(batch);
+
+        if (image) {
+            avifImageDestroy(image);
+        }
+    }
+
+    if (encoder) {
+        avifEncoderDestroy(encoder);
+    }
+    return NULL;
+}
+
+static int avifBatchCompareFiles(const void * a, const void * b)
+{
+    const avifBatchFile * fileA = (const avifBatchFile *)a;
+    const avifBatchFile * fileB = (const avifBatchFile *)b;
+    if (fileA->memory != fileB->memory) {
+        return (fileA->memory < fileB->memory) ? 1 : -1;
+    }
+    return strcmp(fileA->inputFilename, fileB->inputFilename);
+}
+
+static int avifBatchCompareOutputFilenames(const void * a, const void * b)
+{
+    const avifBatchFile * fileA = *(const avifBatchFile * const *)a;
+    const avifBatchFile * fileB = *(const avifBatchFile * const *)b;
+    return strcmp(fileA->outputFilename, fileB->outputFilename);
+}
+
+// Returns AVIF_FALSE and prints an error if two files of the batch would be encoded to the same
+// output file, such as photo.jpg and photo.png, or the same input listed twice. Filenames are
+// compared as given, before any file is written.
+static avifBool avifBatchCheckOutputFilenames(const avifBatchFile * files, int filesCount)
+{
+    const avifBatchFile ** sorted = malloc(filesCount * sizeof(const avifBatchFile *));
+    if (!sorted) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return AVIF_FALSE;
+    }
+    for (int i = 0; i < filesCount; ++i) {
+        if (!files[i].outputFilename) {
+            fprintf(stderr, "ERROR: Out of memory\n");
+            free(sorted);
+            return AVIF_FALSE;
+        }
+        sorted[i] = &files[i];
+    }
+    qsort(sorted, filesCount, sizeof(const avifBatchFile *), avifBatchCompareOutputFilenames);
+
+    avifBool unique = AVIF_TRUE;
+    for (int i = 1; i < filesCount; ++i) {
+        if (!strcmp(sorted[i - 1]->outputFilename, sorted[i]->outputFilename)) {
+            fprintf(stderr,
+                    "ERROR: %s and %s would both be encoded to %s\n",
+                    sorted[i - 1]->inputFilename,
+                    sorted[i]->inputFilename,
+                    sorted[i]->outputFilename);
+            unique = AVIF_FALSE;
+        }
+    }
+    free(sorted);
+    return unique;
+}
+
+// Encodes every input file independently with at most jobs threads in total and, if memoryLimit is
+// not 0, an estimated peak memory use of at most memoryLimit bytes (a single file is always
+// admitted). Prints one JSON line per file to stdout. Returns the number of files that failed, or -1
+// if the batch could not be started.
+static int avifBatchEncode(const avifBatchSettings * settings, const avifInputFile * inputFiles, int filesCount, int jobs, size_t memoryLimit)
+{
+    avifBatch batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.settings = settings;
+    batch.files = calloc(filesCount, sizeof(avifBatchFile));
+    if (!batch.files) {
+        fprintf(stderr, "ERROR: Out of memory\n");
+        return -1;
+    }
+    batch.filesCount = filesCount;
+    batch.freeThreads = jobs;
+    batch.freeMemory = memoryLimit ? memoryLimit : SIZE_MAX;
+
+    for (int i = 0; i < filesCount; ++i) {
+        avifBatchFile * file = &batch.files[i];
+        file->inputFilename = inputFiles[i].filename;
+        file->outputFilename = avifBatchOutputFilename(file->inputFilename, settings->outputDirectory);
+        if (avifBatchProbeFile(file)) {
+            const uint64_t pixels = (uint64_t)file->width * file->height;
+            uint32_t bytesPerSample = ((file->depth > 8) || (settings->requestedDepth > 8)) ? 2 : 1;
+            file->threads = (int)AVIF_MIN((pixels + BATCH_PIXELS_PER_THREAD - 1) / BATCH_PIXELS_PER_THREAD, (uint64_t)jobs);
+            file->memory = (size_t)AVIF_MIN(pixels * BATCH_BYTES_PER_PIXEL * bytesPerSample, (uint64_t)SIZE_MAX);
+        } else {
+            // Unknown size: admit it on its own. It most likely fails early anyway.
+            file->threads = 1;
+            file->memory = SIZE_MAX;
+        }
+        file->threads = AVIF_MAX(file->threads, 1);
+    }
+    if (!avifBatchCheckOutputFilenames(batch.files, filesCount)) {
+        for (int i = 0; i < filesCount; ++i) {
+            free(batch.files[i].outputFilename);
+        }
+        free(batch.files);
+        return -1;
+    }
+    // Largest first, so that the big files do not end up alone at the tail of the batch.
+    qsort(batch.files, filesCount, sizeof(avifBatchFile), avifBatchCompareFiles);
+
+    int workersCount = 1;
+#if defined(AVIF_PTHREADS_ENABLED)
+    workersCount = AVIF_MIN(jobs, filesCount);
+    pthread_t * workers = calloc(workersCount, sizeof(pthread_t));
+    int startedCount = 0;
+    pthread_mutex_init(&batch.mutex, NULL);
+    pthread_cond_init(&batch.cond, NULL);
+    if (workers) {
+        for (; startedCount < workersCount; ++startedCount) {
+            if (pthread_create(&workers[startedCount], NULL, avifBatchWorker, &batch)) {
+                break;
+            }
+        }
+    }
+    if (startedCount == 0) {
+        avifBatchWorker(&batch);
+    }
+    for (int i = 0; i < startedCount; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    pthread_cond_destroy(&batch.cond);
+    pthread_mutex_destroy(&batch.mutex);
+#else
+    avifBatchWorker(&batch);
+#endif
+    (void)workersCount;
+
+    for (int i = 0; i < filesCount; ++i) {
+        free(batch.files[i].outputFilename);
+    }
+    free(batch.files);
+    return batch.failedFiles;
+}
+
+// Appends the non-empty lines of listFilename that do not start with '#' to input->files, growing
+// it as needed. The returned buffer holds the filenames and must outlive input->files.
+static char * readBatchList(const char * listFilename, avifInput * input, int * filesCapacity, uint64_t duration)
+{
+    avifRWData list = AVIF_DATA_EMPTY;
+    if (!readEntireFile(listFilename, &list)) {
+        return NULL;
+    }
+    char * text = malloc(list.size + 1);
+    if (!text) {
+        avifRWDataFree(&list);
+        return NULL;
+    }
+    memcpy(text, list.data, list.size);
+    text[list.size] = 0;
+    avifRWDataFree(&list);
+
+    char * line = text;
+    while (*line) {
+        char * end = line + strcspn(line, "\r\n");
+        const avifBool last = (*end == 0);
+        *end = 0;
+        if ((line[0] != 0) && (line[0] != '#')) {
+            if (input->filesCount == *filesCapacity) {
+                const int capacity = *filesCapacity * 2 + 16;
+                avifInputFile * files = realloc(input->files, sizeof(avifInputFile) * capacity);
+                if (!files) {
+                    free(text);
+                    return NULL;
+                }
+                input->files = files;
+                *filesCapacity = capacity;
+            }
+            input->files[input->filesCount].filename = line;
+            input->files[input->filesCount].duration = duration;
+            ++input->filesCount;
+        }
+        if (last) {
+            break;
+        }
+        line = end + 1;
+    }
+    return text;
+}
+
+// Number of frames of an image sequence that are allocated once and recycled between the reader
+// thread and the encoder: one being encoded, the others being read ahead.
+#define FRAME_POOL_SIZE 4
+
+typedef struct avifReaderFrame
+{
+    avifImage * image;
+    avifInputFile * file;
+    avifBool failed;
+} avifReaderFrame;
+
+// Reads the frames following the first one of an image sequence ahead of the encoder, so that
+// reading (from a pipe for example) overlaps encoding. Without pthreads the frames are read when
+// the encoder asks for them.
+typedef struct avifFrameReader
+{
+    avifInput * input;
+    const avifImage * firstImage; // the CICP of the frames defaults to this one
+    avifBool ignoreICC;
+    avifBool ignoreExif;
+    avifBool ignoreXMP;
+    avifChromaDownsampling chromaDownsampling;
+
+    avifReaderFrame frames[FRAME_POOL_SIZE];
+    int readIndex;  // next frame to encode
+    int readyCount; // frames read and not released by the encoder yet
+    avifBool done;  // no more frames will be read
+    avifBool stop;  // the encoder gave up
+
+    // Throughput statistics
+    int framesRead;
+    double readMs;
+    double readWaitMs; // the reader waited for the encoder to release a frame
+    int framesEncoded;
+    double encodeMs;
+    double encodeWaitMs; // the encoder waited for the reader
+
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_t thread;
+    avifBool threadStarted;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+} avifFrameReader;
+
+// Reads the next frame into frame. Returns AVIF_FALSE at the end of the input.
+static avifBool avifFrameReaderReadFrame(avifFrameReader * reader, avifReaderFrame * frame)
+{
+    avifInputFile * file = avifInputGetNextFile(reader->input);
+    if (!file) {
+        return AVIF_FALSE;
+    }
+    avifImage * image = frame->image;
+    if (!reader->input->useStdin && !reader->input->frameIter) {
+        // Only y4mRead() checks that the planes of the recycled frame fit the next one.
+        avifImageFreePlanes(image, AVIF_PLANES_ALL);
+    }
+    image->colorPrimaries = reader->firstImage->colorPrimaries;
+    image->transferCharacteristics = reader->firstImage->transferCharacteristics;
+    image->matrixCoefficients = reader->firstImage->matrixCoefficients;
+    image->yuvRange = reader->firstImage->yuvRange;
+    image->alphaPremultiplied = reader->firstImage->alphaPremultiplied;
+
+    const double startMs = avifNowMs();
+    const avifAppFileFormat format = avifInputReadImage(reader->input,
+                                                        reader->ignoreICC,
+                                                        reader->ignoreExif,
+                                                        reader->ignoreXMP,
+                                                        image,
+                                                        NULL,
+                                                        NULL,
+                                                        reader->chromaDownsampling);
+    reader->readMs += avifNowMs() - startMs;
+    frame->file = file;
+    frame->failed = (format == AVIF_APP_FILE_FORMAT_UNKNOWN);
+    if (!frame->failed) {
+        ++reader->framesRead;
+    }
+    return AVIF_TRUE;
+}
+
+#if defined(AVIF_PTHREADS_ENABLED)
+static void * avifFrameReaderThread(void * userData)
+{
+    avifFrameReader * reader = (avifFrameReader *)userData;
+    pthread_mutex_lock(&reader->mutex);
+    for (;;) {
+        const double waitStartMs = avifNowMs();
+        while (!reader->stop && (reader->readyCount == FRAME_POOL_SIZE)) {
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+        }
+        reader->readWaitMs += avifNowMs() - waitStartMs;
+        if (reader->stop) {
+            break;
+        }
+        // The frames not ready yet are only touched by this thread.
+        avifReaderFrame * frame = &reader->frames[(reader->readIndex + reader->readyCount) % FRAME_POOL_SIZE];
+        pthread_mutex_unlock(&reader->mutex);
+        const avifBool read = avifFrameReaderReadFrame(reader, frame);
+        pthread_mutex_lock(&reader->mutex);
+        if (read) {
+            ++reader->readyCount;
+        }
+        if (!read || frame->failed) {
+            reader->done = AVIF_TRUE;
+        }
+        pthread_cond_broadcast(&reader->cond);
+        if (reader->done) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    return NULL;
+}
+#endif
+
+// Starts reading the remaining frames of input. The caller must not touch input until
+// avifFrameReaderDestroy(). reader must be zero-initialized.
+static avifBool avifFrameReaderStart(avifFrameReader * reader,
+                                     avifInput * input,
+                                     const avifImage * firstImage,
+                                     avifBool ignoreICC,
+                                     avifBool ignoreExif,
+                                     avifBool ignoreXMP,
+                                     avifChromaDownsampling chromaDownsampling)
+{
+    reader->input = input;
+    reader->firstImage = firstImage;
+    reader->ignoreICC = ignoreICC;
+    reader->ignoreExif = ignoreExif;
+    reader->ignoreXMP = ignoreXMP;
+    reader->chromaDownsampling = chromaDownsampling;
+    for (int i = 0; i < FRAME_POOL_SIZE; ++i) {
+        reader->frames[i].image = avifImageCreateEmpty();
+        if (!reader->frames[i].image) {
+            return AVIF_FALSE;
+        }
+    }
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    if (pthread_create(&reader->thread, NULL, avifFrameReaderThread, reader) != 0) {
+        pthread_cond_destroy(&reader->cond);
+        pthread_mutex_destroy(&reader->mutex);
+        return AVIF_FALSE;
+    }
+    reader->threadStarted = AVIF_TRUE;
+#endif
+    return AVIF_TRUE;
+}
+
+// Returns the next frame to encode, or NULL at the end of the input. The frame belongs to the
+// reader and must be given back with avifFrameReaderRelease() once encoded.
+static avifReaderFrame * avifFrameReaderNext(avifFrameReader * reader)
+{
+    const double waitStartMs = avifNowMs();
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_lock(&reader->mutex);
+    while (!reader->done && (reader->readyCount == 0)) {
+        pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+    const avifBool ready = (reader->readyCount > 0);
+    pthread_mutex_unlock(&reader->mutex);
+#else
+    const avifBool ready = !reader->done && avifFrameReaderReadFrame(reader, &reader->frames[reader->readIndex]);
+    reader->done = !ready;
+#endif
+    reader->encodeWaitMs += avifNowMs() - waitStartMs;
+    return ready ? &reader->frames[reader->readIndex] : NULL;
+}
+
+static void avifFrameReaderRelease(avifFrameReader * reader)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_lock(&reader->mutex);
+    reader->readIndex = (reader->readIndex + 1) % FRAME_POOL_SIZE;
+    --reader->readyCount;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+#else
+    (void)reader;
+#endif
+}
+
+static void avifFrameReaderPrintStats(const avifFrameReader * reader)
+{
+    // The slower stage is the bottleneck. The faster one waits for it.
+    printf(" * Reader:  %d frames in %.2f s (%.1f frames/s), waited %.2f s for the encoder\n",
+           reader->framesRead,
+           reader->readMs / 1000.0,
+           (reader->readMs > 0.0) ? reader->framesRead * 1000.0 / reader->readMs : 0.0,
+           reader->readWaitMs / 1000.0);
+    printf(" * Encoder: %d frames in %.2f s (%.1f frames/s), waited %.2f s for the reader\n",
+           reader->framesEncoded,
+           reader->encodeMs / 1000.0,
+           (reader->encodeMs > 0.0) ? reader->framesEncoded * 1000.0 / reader->encodeMs : 0.0,
+           reader->encodeWaitMs / 1000.0);
+}
+
+static void avifFrameReaderDestroy(avifFrameReader * reader)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    if (reader->threadStarted) {
+        pthread_mutex_lock(&reader->mutex);
+        reader->stop = AVIF_TRUE;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+        pthread_join(reader->thread, NULL);
+        pthread_cond_destroy(&reader->cond);
+        pthread_mutex_destroy(&reader->mutex);
+        reader->threadStarted = AVIF_FALSE;
+    }
+#endif
+    for (int i = 0; i < FRAME_POOL_SIZE; ++i) {
+        if (reader->frames[i].image) {
+            avifImageDestroy(reader->frames[i].image);
+            reader->frames[i].image = NULL;
+        }
+    }
+}
+
 int main(int argc, char * argv[])
 {
     if (argc < 2) {
@@ -454,9 +1309,16 @@ int main(int argc, char * argv[])
     avifBool ignoreExif = AVIF_FALSE;
     avifBool ignoreXMP = AVIF_FALSE;
     avifBool ignoreICC = AVIF_FALSE;
+    avifBool batch = AVIF_FALSE;
+    const char * batchListFilename = NULL;
+    char * batchListText = NULL;
+    int batchMemoryMB = 0;
+    const char ** advancedOptions = malloc(sizeof(const char *) * argc);
+    int advancedOptionsCount = 0;
     avifEncoder * encoder = avifEncoderCreate();
     avifImage * image = NULL;
-    avifImage * nextImage = NULL;
+    avifFrameReader frameReader;
+    memset(&frameReader, 0, sizeof(frameReader));
     avifRWData raw = AVIF_DATA_EMPTY;
     avifRWData exifOverride = AVIF_DATA_EMPTY;
     avifRWData xmpOverride = AVIF_DATA_EMPTY;
@@ -523,6 +1385,20 @@ int main(int argc, char * argv[])
         } else if (!strcmp(arg, "-o") || !strcmp(arg, "--output")) {
             NEXTARG();
             outputFilename = arg;
+        } else if (!strcmp(arg, "--batch")) {
+            batch = AVIF_TRUE;
+        } else if (!strcmp(arg, "--batch-list")) {
+            NEXTARG();
+            batchListFilename = arg;
+            batch = AVIF_TRUE;
+        } else if (!strcmp(arg, "--batch-memory")) {
+            NEXTARG();
+            batchMemoryMB = atoi(arg);
+            if (batchMemoryMB < 0) {
+                fprintf(stderr, "ERROR: Invalid batch memory limit: %s\n", arg);
+                returnCode = 1;
+                goto cleanup;
+            }
         } else if (!strcmp(arg, "-d") || !strcmp(arg, "--depth")) {
             NEXTARG();
             input.requestedDepth = atoi(arg);
@@ -724,6 +1600,7 @@ int main(int argc, char * argv[])
             }
             avifEncoderSetCodecSpecificOption(encoder, tempBuffer, value);
             free(tempBuffer);
+            advancedOptions[advancedOptionsCount++] = arg; // kept for the encoders of batch mode
         } else if (!strcmp(arg, "--ignore-exif")) {
             ignoreExif = AVIF_TRUE;
         } else if (!strcmp(arg, "--ignore-xmp")) {
@@ -805,6 +1682,84 @@ int main(int argc, char * argv[])
         ++argIndex;
     }
 
+    if (batch) {
+        if (input.useStdin || (gridDimsCount > 0) || (clapCount > 0)) {
+            fprintf(stderr, "ERROR: --stdin, --grid, --crop and --clap cannot be used with --batch\n");
+            returnCode = 1;
+            goto cleanup;
+        }
+        if (batchListFilename) {
+            int filesCapacity = argc;
+            batchListText = readBatchList(batchListFilename, &input, &filesCapacity, outputTiming.duration);
+            if (!batchListText) {
+                fprintf(stderr, "ERROR: Unable to read batch list: %s\n", batchListFilename);
+                returnCode = 1;
+                goto cleanup;
+            }
+        }
+        if (input.filesCount < 1) {
+            syntax();
+            returnCode = 1;
+            goto cleanup;
+        }
+        if ((matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) && (input.requestedFormat != AVIF_PIXEL_FORMAT_NONE) &&
+            (input.requestedFormat != AVIF_PIXEL_FORMAT_YUV444)) {
+            // Same as the single image path below.
+            matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_BT601;
+        }
+        if (!autoTiling) {
+            tileRowsLog2 = AVIF_MAX(tileRowsLog2, 0);
+            tileColsLog2 = AVIF_MAX(tileColsLog2, 0);
+        } else if ((tileRowsLog2 >= 0) || (tileColsLog2 >= 0)) {
+            fprintf(stderr, "ERROR: --autotiling is specified but --tilerowslog2 or --tilecolslog2 is also specified\n");
+            returnCode = 1;
+            goto cleanup;
+        }
+
+        avifBatchSettings settings;
+        memset(&settings, 0, sizeof(settings));
+        settings.requestedFormat = input.requestedFormat;
+        settings.requestedDepth = input.requestedDepth;
+        settings.chromaDownsampling = chromaDownsampling;
+        settings.ignoreICC = ignoreICC;
+        settings.ignoreExif = ignoreExif;
+        settings.ignoreXMP = ignoreXMP;
+        settings.iccOverride = &iccOverride;
+        settings.exifOverride = &exifOverride;
+        settings.xmpOverride = &xmpOverride;
+        settings.colorPrimaries = colorPrimaries;
+        settings.transferCharacteristics = transferCharacteristics;
+        settings.matrixCoefficients = matrixCoefficients;
+        settings.cicpExplicitlySet = cicpExplicitlySet;
+        settings.yuvRange = requestedRange;
+        settings.premultiplyAlpha = premultiplyAlpha;
+        settings.paspCount = paspCount;
+        settings.paspValues = paspValues;
+        settings.irotAngle = irotAngle;
+        settings.imirMode = imirMode;
+        settings.codecChoice = codecChoice;
+        settings.speed = speed;
+        settings.minQuantizer = minQuantizer;
+        settings.maxQuantizer = maxQuantizer;
+        settings.minQuantizerAlpha = minQuantizerAlpha;
+        settings.maxQuantizerAlpha = maxQuantizerAlpha;
+        settings.tileRowsLog2 = tileRowsLog2;
+        settings.tileColsLog2 = tileColsLog2;
+        settings.autoTiling = autoTiling;
+        settings.advancedOptions = advancedOptions;
+        settings.advancedOptionsCount = advancedOptionsCount;
+        settings.outputDirectory = outputFilename;
+
+        const int failedFiles = avifBatchEncode(&settings, input.files, input.filesCount, jobs, (size_t)batchMemoryMB * 1024 * 1024);
+        if (failedFiles > 0) {
+            fprintf(stderr, "ERROR: %d of %d files failed to encode\n", failedFiles, input.filesCount);
+            returnCode = 1;
+        } else if (failedFiles < 0) {
+            returnCode = 1;
+        }
+        goto cleanup;
+    }
+
     stdinFile.filename = "(stdin)";
     stdinFile.duration = outputTiming.duration;
 
@@ -1087,7 +2042,7 @@ int main(int argc, char * argv[])
                 fprintf(stderr,
                         "ERROR: Image grid range mismatch, [%s] vs [%s]: %s\n",
                         (image->yuvRange == AVIF_RANGE_FULL) ? "Full" : "Limited",
-                        (nextImage->yuvRange == AVIF_RANGE_FULL) ? "Full" : "Limited",
+                        (cellImage->yuvRange == AVIF_RANGE_FULL) ? "Full" : "Limited",
                         nextFile->filename);
                 returnCode = 1;
                 goto cleanup;
@@ -1194,11 +2149,19 @@ int main(int argc, char * argv[])
         }
 
         // Not generating a single-image grid: Use all remaining input files as subsequent frames.
+        // They are read ahead by another thread into a small pool of recycled images.
+        if (!avifFrameReaderStart(&frameReader, &input, image, ignoreICC, ignoreExif, ignoreXMP, chromaDownsampling)) {
+            fprintf(stderr, "ERROR: Failed to start reading the image sequence\n");
+            returnCode = 1;
+            goto cleanup;
+        }
 
-        avifInputFile * nextFile;
+        avifReaderFrame * nextFrame;
         int nextImageIndex = -1;
-        while ((nextFile = avifInputGetNextFile(&input)) != NULL) {
+        while ((nextFrame = avifFrameReaderNext(&frameReader)) != NULL) {
             ++nextImageIndex;
+            const avifInputFile * nextFile = nextFrame->file;
+            const avifImage * nextImage = nextFrame->image;
 
             uint64_t nextDurationInTimescales = nextFile->duration ? nextFile->duration : outputTiming.duration;
 
@@ -1208,19 +2171,7 @@ int main(int argc, char * argv[])
                    outputTiming.timescale,
                    nextFile->filename);
 
-            if (nextImage) {
-                avifImageDestroy(nextImage);
-            }
-            nextImage = avifImageCreateEmpty();
-            nextImage->colorPrimaries = image->colorPrimaries;
-            nextImage->transferCharacteristics = image->transferCharacteristics;
-            nextImage->matrixCoefficients = image->matrixCoefficients;
-            nextImage->yuvRange = image->yuvRange;
-            nextImage->alphaPremultiplied = image->alphaPremultiplied;
-
-            avifAppFileFormat nextInputFormat =
-                avifInputReadImage(&input, ignoreICC, ignoreExif, ignoreXMP, nextImage, NULL, NULL, chromaDownsampling);
-            if (nextInputFormat == AVIF_APP_FILE_FORMAT_UNKNOWN) {
+            if (nextFrame->failed) {
                 returnCode = 1;
                 goto cleanup;
             }
@@ -1271,12 +2222,19 @@ int main(int argc, char * argv[])
                 goto cleanup;
             }
 
+            const double encodeStartMs = avifNowMs();
             avifResult nextImageResult = avifEncoderAddImage(encoder, nextImage, nextDurationInTimescales, AVIF_ADD_IMAGE_FLAG_NONE);
+            frameReader.encodeMs += avifNowMs() - encodeStartMs;
             if (nextImageResult != AVIF_RESULT_OK) {
                 fprintf(stderr, "ERROR: Failed to encode image: %s\n", avifResultToString(nextImageResult));
                 returnCode = 1;
                 goto cleanup;
             }
+            ++frameReader.framesEncoded;
+            avifFrameReaderRelease(&frameReader);
+        }
+        if (nextImageIndex >= 0) {
+            avifFrameReaderPrintStats(&frameReader);
         }
     }
 
@@ -1324,13 +2282,13 @@ cleanup:
     if (gridSplitImage) {
         avifImageDestroy(gridSplitImage);
     }
-    if (nextImage) {
-        avifImageDestroy(nextImage);
-    }
+    avifFrameReaderDestroy(&frameReader);
     avifRWDataFree(&raw);
     avifRWDataFree(&exifOverride);
     avifRWDataFree(&xmpOverride);
     avifRWDataFree(&iccOverride);
     free((void *)input.files);
+    free(batchListText);
+    free((void *)advancedOptions);
     return returnCode;
 }
@@ -39,9 +39,75 @@ static void my_error_exit(j_common_ptr cinfo)
 #define AVIF_LIBJPEG_DCT_v_scaled_size DCT_scaled_size
 #endif
 
+// Lookup tables from the 8-bit full range samples of libjpeg to the depth and range of the avifImage.
+typedef struct avifJPEGSampleTable
+{
+    avifBool identity; // True if the samples are copied as is (8-bit full range).
+    uint16_t y[256];
+    uint16_t uv[256];
+} avifJPEGSampleTable;
+
+// Returns numerator / denominator rounded to the nearest integer, halves away from zero.
+static int avifJPEGRoundedDivide(int numerator, int denominator)
+{
+    return (numerator >= 0) ? ((numerator + denominator / 2) / denominator) : -((-numerator + denominator / 2) / denominator);
+}
+
+// Converts the average of count 8-bit full range samples summing to sum, to the depth and range of avif,
+// with a single rounding. Chroma is scaled around its midpoint, so that neutral chroma (128) stays
+// neutral (1 << (depth - 1)).
+static uint16_t avifJPEGConvertSample(const avifImage * avif, avifBool chroma, uint32_t sum, uint32_t count)
+{
+    const int maxValue = (1 << avif->depth) - 1;
+    const int divisor = 255 * (int)count;
+    const int limitedUnit = 1 << (avif->depth - 8); // 1 in 8-bit limited range
+    int v;
+    if (chroma) {
+        const int centered = (int)sum - 128 * (int)count;
+        const int scale = (avif->yuvRange == AVIF_RANGE_LIMITED) ? 224 * limitedUnit : maxValue;
+        v = avifJPEGRoundedDivide(centered * scale, divisor) + (1 << (avif->depth - 1));
+    } else if (avif->yuvRange == AVIF_RANGE_LIMITED) {
+        v = avifJPEGRoundedDivide((int)sum * 219 * limitedUnit, divisor) + 16 * limitedUnit;
+    } else {
+        v = avifJPEGRoundedDivide((int)sum * maxValue, divisor);
+    }
+    return (uint16_t)AVIF_MIN(AVIF_MAX(v, 0), maxValue);
+}
+
+static void avifJPEGInitSampleTable(avifJPEGSampleTable * table, const avifImage * avif)
+{
+    table->identity = (avif->depth == 8) && (avif->yuvRange == AVIF_RANGE_FULL);
+    for (uint32_t i = 0; i < 256; ++i) {
+        table->y[i] = avifJPEGConvertSample(avif, AVIF_FALSE, i, 1);
+        table->uv[i] = avifJPEGConvertSample(avif, AVIF_TRUE, i, 1);
+    }
+}
+
+static void avifJPEGSetSample(const avifImage * avif, uint8_t * row, uint32_t x, uint16_t value)
+{
+    if (avif->depth > 8) {
+        ((uint16_t *)row)[x] = value;
+    } else {
+        row[x] = (uint8_t)value;
+    }
+}
+
+// Writes the first width samples of src to row, through lut unless table->identity is true.
+static void avifJPEGStoreRow(const avifImage * avif, const avifJPEGSampleTable * table, const uint16_t lut[256], uint8_t * row, const JSAMPLE * src, uint32_t width)
+{
+    if (table->identity) {
+        memcpy(row, src, width);
+        return;
+    }
+    for (uint32_t x = 0; x < width; ++x) {
+        avifJPEGSetSample(avif, row, x, lut[src[x]]);
+    }
+}
+
 // An internal function used by avifJPEGReadCopy(), this is the shared libjpeg decompression code
-// for all paths avifJPEGReadCopy() takes.
-static avifBool avifJPEGCopyPixels(avifImage * avif, struct jpeg_decompress_struct * cinfo)
+// for all paths avifJPEGReadCopy() takes, except when the chroma has to be resampled.
+// The samples are converted through table to the depth and range of avif.
+static avifBool avifJPEGCopyPixels(avifImage * avif, struct jpeg_decompress_struct * cinfo, const avifJPEGSampleTable * table)
 {
     cinfo->raw_data_out = TRUE;
     jpeg_start_decompress(cinfo);
@@ -90,6 +156,10 @@ static avifBool avifJPEGCopyPixels(avifImage * avif, struct jpeg_decompress_stru
 
     int workComponents = avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV400 ? 1 : cinfo->num_components;
 
+    avifPixelFormatInfo info;
+    avifGetPixelFormatInfo(avif->yuvFormat, &info);
+    const uint32_t uvWidth = (avif->width + info.chromaShiftX) >> info.chromaShiftX;
+
     // count of already-read lines (for each channel)
     int alreadyRead[3] = { 0, 0, 0 };
     while (cinfo->output_scanline < cinfo->output_height) {
@@ -97,10 +167,15 @@ static avifBool avifJPEGCopyPixels(avifImage * avif, struct jpeg_decompress_stru
 
         for (int i = 0; i < workComponents; ++i) {
             int linesRead = AVIF_MIN(targetRead[i] - alreadyRead[i], linesPerCall[i]);
+            const avifBool chroma = (targetChannel[i] != AVIF_CHAN_Y) && (cinfo->jpeg_color_space == JCS_YCbCr);
+            const uint32_t width = (targetChannel[i] == AVIF_CHAN_Y) ? avif->width : uvWidth;
             for (int j = 0; j < linesRead; ++j) {
-                memcpy(&avif->yuvPlanes[targetChannel[i]][avif->yuvRowBytes[targetChannel[i]] * (alreadyRead[i] + j)],
-                       buffer[i][j],
-                       avif->yuvRowBytes[targetChannel[i]]);
+                avifJPEGStoreRow(avif,
+                                 table,
+                                 chroma ? table->uv : table->y,
+                                 &avif->yuvPlanes[targetChannel[i]][avif->yuvRowBytes[targetChannel[i]] * (alreadyRead[i] + j)],
+                                 buffer[i][j],
+                                 width);
             }
             alreadyRead[i] += linesPerCall[i];
         }
@@ -108,6 +183,65 @@ static avifBool avifJPEGCopyPixels(avifImage * avif, struct jpeg_decompress_stru
     return AVIF_TRUE;
 }
 
+// Decodes the YCbCr samples of the JPEG upsampled to 4:4:4 by libjpeg, without any color
+// conversion, and averages the chroma samples down to avif->yuvFormat. This is what
+// avifImageRGBToYUV() would do with the RGB samples, minus the rounding of the RGB round trip.
+static avifBool avifJPEGCopyResampledPixels(avifImage * avif, struct jpeg_decompress_struct * cinfo, const avifJPEGSampleTable * table)
+{
+    cinfo->out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(cinfo);
+
+    avif->width = cinfo->output_width;
+    avif->height = cinfo->output_height;
+    if (avifImageAllocatePlanes(avif, AVIF_PLANES_YUV) != AVIF_RESULT_OK) {
+        return AVIF_FALSE;
+    }
+
+    avifPixelFormatInfo info;
+    avifGetPixelFormatInfo(avif->yuvFormat, &info);
+    const uint32_t uvWidth = (avif->width + info.chromaShiftX) >> info.chromaShiftX;
+    // Two rows are kept for 4:2:0.
+    JSAMPARRAY buffer = (*cinfo->mem->alloc_sarray)((j_common_ptr)cinfo, JPOOL_IMAGE, cinfo->output_width * 3, 2);
+
+    for (uint32_t y = 0; y < avif->height; y += 1 + info.chromaShiftY) {
+        const uint32_t rows = AVIF_MIN(1u + info.chromaShiftY, avif->height - y);
+        for (uint32_t r = 0; r < rows; ++r) {
+            jpeg_read_scanlines(cinfo, &buffer[r], 1);
+            uint8_t * row = &avif->yuvPlanes[AVIF_CHAN_Y][(size_t)avif->yuvRowBytes[AVIF_CHAN_Y] * (y + r)];
+            for (uint32_t x = 0; x < avif->width; ++x) {
+                avifJPEGSetSample(avif, row, x, table->y[buffer[r][x * 3]]);
+            }
+        }
+        if (info.monochrome) {
+            continue;
+        }
+
+        const uint32_t uvY = y >> info.chromaShiftY;
+        uint8_t * rowU = &avif->yuvPlanes[AVIF_CHAN_U][(size_t)avif->yuvRowBytes[AVIF_CHAN_U] * uvY];
+        uint8_t * rowV = &avif->yuvPlanes[AVIF_CHAN_V][(size_t)avif->yuvRowBytes[AVIF_CHAN_V] * uvY];
+        for (uint32_t uvX = 0; uvX < uvWidth; ++uvX) {
+            const uint32_t x = uvX << info.chromaShiftX;
+            const uint32_t columns = AVIF_MIN(1u + info.chromaShiftX, avif->width - x);
+            if ((rows == 1) && (columns == 1)) {
+                avifJPEGSetSample(avif, rowU, uvX, table->uv[buffer[0][x * 3 + 1]]);
+                avifJPEGSetSample(avif, rowV, uvX, table->uv[buffer[0][x * 3 + 2]]);
+                continue;
+            }
+            uint32_t sumU = 0;
+            uint32_t sumV = 0;
+            for (uint32_t r = 0; r < rows; ++r) {
+                for (uint32_t c = 0; c < columns; ++c) {
+                    sumU += buffer[r][(x + c) * 3 + 1];
+                    sumV += buffer[r][(x + c) * 3 + 2];
+                }
+            }
+            avifJPEGSetSample(avif, rowU, uvX, avifJPEGConvertSample(avif, AVIF_TRUE, sumU, rows * columns));
+            avifJPEGSetSample(avif, rowV, uvX, avifJPEGConvertSample(avif, AVIF_TRUE, sumV, rows * columns));
+        }
+    }
+    return AVIF_TRUE;
+}
+
 static avifBool avifJPEGHasCompatibleMatrixCoefficients(avifMatrixCoefficients matrixCoefficients)
 {
     switch (matrixCoefficients) {
@@ -121,11 +255,18 @@ static avifBool avifJPEGHasCompatibleMatrixCoefficients(avifMatrixCoefficients m
 
 // This attempts to copy the internal representation of the JPEG directly into avifImage without
 // YUV->RGB conversion. If it returns AVIF_FALSE, a typical RGB->YUV conversion is required.
-static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct * cinfo)
+// YCbCr and grayscale samples are scaled to the requested depth and range on the fly. YCbCr
+// samplings that do not match the requested format (or that have no AVIF equivalent, such as
+// 4:1:1 or 4:4:0) are resampled, unless sharp YUV downsampling was requested.
+static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct * cinfo, avifChromaDownsampling chromaDownsampling)
 {
-    if ((avif->depth != 8) || (avif->yuvRange != AVIF_RANGE_FULL)) {
+    if ((avif->depth != 8) && (avif->depth != 10) && (avif->depth != 12)) {
         return AVIF_FALSE;
     }
+    // RGB samples are only copied as is.
+    const avifBool identity = (avif->depth == 8) && (avif->yuvRange == AVIF_RANGE_FULL);
+    avifJPEGSampleTable table;
+    avifJPEGInitSampleTable(&table, avif);
 
     if (cinfo->jpeg_color_space == JCS_YCbCr) {
         // Import from YUV: must use compatible matrixCoefficients.
@@ -152,7 +293,7 @@ static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct
                 }
                 if (avif->yuvFormat == jpegFormat) {
                     cinfo->out_color_space = JCS_YCbCr;
-                    return avifJPEGCopyPixels(avif, cinfo);
+                    return avifJPEGCopyPixels(avif, cinfo, &table);
                 }
             }
 
@@ -160,7 +301,15 @@ static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct
             if ((avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV400) && (cinfo->comp_info[0].h_samp_factor == cinfo->max_h_samp_factor &&
                                                                   cinfo->comp_info[0].v_samp_factor == cinfo->max_v_samp_factor)) {
                 cinfo->out_color_space = JCS_YCbCr;
-                return avifJPEGCopyPixels(avif, cinfo);
+                return avifJPEGCopyPixels(avif, cinfo, &table);
+            }
+
+            // YUV->YUV with another sampling: resample the chroma planes.
+            if (avif->yuvFormat == AVIF_PIXEL_FORMAT_NONE) {
+                avif->yuvFormat = AVIF_APP_DEFAULT_PIXEL_FORMAT;
+            }
+            if ((avif->yuvFormat != AVIF_PIXEL_FORMAT_YUV420) || (chromaDownsampling != AVIF_CHROMA_DOWNSAMPLING_SHARP_YUV)) {
+                return avifJPEGCopyResampledPixels(avif, cinfo, &table);
             }
         }
     } else if (cinfo->jpeg_color_space == JCS_GRAYSCALE) {
@@ -173,33 +322,43 @@ static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct
                 if ((avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV400) || (avif->yuvFormat == AVIF_PIXEL_FORMAT_NONE)) {
                     avif->yuvFormat = AVIF_PIXEL_FORMAT_YUV400;
                     cinfo->out_color_space = JCS_GRAYSCALE;
-                    return avifJPEGCopyPixels(avif, cinfo);
+                    return avifJPEGCopyPixels(avif, cinfo, &table);
                 }
 
                 // Grayscale->YUV: copy Y, fill UV with monochrome value.
                 if ((avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) || (avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV422) ||
                     (avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV420)) {
                     cinfo->out_color_space = JCS_GRAYSCALE;
-                    if (!avifJPEGCopyPixels(avif, cinfo)) {
+                    if (!avifJPEGCopyPixels(avif, cinfo, &table)) {
                         return AVIF_FALSE;
                     }
 
                     avifPixelFormatInfo info;
                     avifGetPixelFormatInfo(avif->yuvFormat, &info);
+                    uint32_t uvWidth = (avif->width + info.chromaShiftX) >> info.chromaShiftX;
                     uint32_t uvHeight = (avif->height + info.chromaShiftY) >> info.chromaShiftY;
-                    memset(avif->yuvPlanes[AVIF_CHAN_U], 128, avif->yuvRowBytes[AVIF_CHAN_U] * uvHeight);
-                    memset(avif->yuvPlanes[AVIF_CHAN_V], 128, avif->yuvRowBytes[AVIF_CHAN_V] * uvHeight);
+                    if (table.identity) {
+                        memset(avif->yuvPlanes[AVIF_CHAN_U], 128, avif->yuvRowBytes[AVIF_CHAN_U] * uvHeight);
+                        memset(avif->yuvPlanes[AVIF_CHAN_V], 128, avif->yuvRowBytes[AVIF_CHAN_V] * uvHeight);
+                    } else {
+                        for (uint32_t y = 0; y < uvHeight; ++y) {
+                            for (uint32_t x = 0; x < uvWidth; ++x) {
+                                avifJPEGSetSample(avif, &avif->yuvPlanes[AVIF_CHAN_U][(size_t)avif->yuvRowBytes[AVIF_CHAN_U] * y], x, table.uv[128]);
+                                avifJPEGSetSample(avif, &avif->yuvPlanes[AVIF_CHAN_V][(size_t)avif->yuvRowBytes[AVIF_CHAN_V] * y], x, table.uv[128]);
+                            }
+                        }
+                    }
 
                     return AVIF_TRUE;
                 }
             }
 
             // Grayscale->RGB: copy Y to G, duplicate to B and R.
-            if ((avif->matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) &&
+            if (identity && (avif->matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) &&
                 ((avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) || (avif->yuvFormat == AVIF_PIXEL_FORMAT_NONE))) {
                 avif->yuvFormat = AVIF_PIXEL_FORMAT_YUV444;
                 cinfo->out_color_space = JCS_GRAYSCALE;
-                if (!avifJPEGCopyPixels(avif, cinfo)) {
+                if (!avifJPEGCopyPixels(avif, cinfo, &table)) {
                     return AVIF_FALSE;
                 }
 
@@ -211,14 +370,14 @@ static avifBool avifJPEGReadCopy(avifImage * avif, struct jpeg_decompress_struct
         }
     } else if (cinfo->jpeg_color_space == JCS_RGB) {
         // RGB->RGB: subsample not allowed.
-        if ((avif->matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) &&
+        if (identity && (avif->matrixCoefficients == AVIF_MATRIX_COEFFICIENTS_IDENTITY) &&
             ((avif->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) || (avif->yuvFormat == AVIF_PIXEL_FORMAT_NONE)) &&
             (cinfo->comp_info[0].h_samp_factor == 1 && cinfo->comp_info[0].v_samp_factor == 1 &&
              cinfo->comp_info[1].h_samp_factor == 1 && cinfo->comp_info[1].v_samp_factor == 1 &&
              cinfo->comp_info[2].h_samp_factor == 1 && cinfo->comp_info[2].v_samp_factor == 1)) {
             avif->yuvFormat = AVIF_PIXEL_FORMAT_YUV444;
             cinfo->out_color_space = JCS_RGB;
-            return avifJPEGCopyPixels(avif, cinfo);
+            return avifJPEGCopyPixels(avif, cinfo, &table);
         }
     }
 
@@ -334,7 +493,7 @@ avifBool avifJPEGRead(const char * inputFilename,
     // JPEG doesn't have alpha. Prevent confusion.
     avif->alphaPremultiplied = AVIF_FALSE;
 
-    if (avifJPEGReadCopy(avif, &cinfo)) {
+    if (avifJPEGReadCopy(avif, &cinfo, chromaDownsampling)) {
         // JPEG pixels were successfully copied without conversion. Notify the enduser.
 
         assert(inputFilename); // JPEG read doesn't support stdin
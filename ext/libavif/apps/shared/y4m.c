@@ -348,7 +348,15 @@ avifBool y4mRead(const char * inputFilename, avifImage * avif, avifAppSourceTimi
         *sourceTiming = frame.sourceTiming;
     }
 
-    avifImageFreePlanes(avif, AVIF_PLANES_ALL);
+    // Keep the planes of the previous frame if they have the same layout, so that a caller
+    // reading a whole sequence into the same avifImage does not reallocate them for each frame.
+    const avifBool reusePlanes = avif->yuvPlanes[AVIF_CHAN_Y] && avif->imageOwnsYUVPlanes && (avif->width == (uint32_t)frame.width) &&
+                                 (avif->height == (uint32_t)frame.height) && (avif->depth == (uint32_t)frame.depth) &&
+                                 (avif->yuvFormat == frame.format) &&
+                                 (frame.hasAlpha ? (avif->alphaPlane && avif->imageOwnsAlphaPlane) : !avif->alphaPlane);
+    if (!reusePlanes) {
+        avifImageFreePlanes(avif, AVIF_PLANES_ALL);
+    }
     avif->width = frame.width;
     avif->height = frame.height;
     avif->depth = frame.depth;
@@ -62,6 +62,21 @@ extern "C" {
 #define AVIF_VERSION \
     ((AVIF_VERSION_MAJOR * 1000000) + (AVIF_VERSION_MINOR * 10000) + (AVIF_VERSION_PATCH * 100) + AVIF_VERSION_DEVEL)
 
+// Features of this copy of libavif that are not part of any released version yet. Downstream
+// projects can check for them with #if defined(...).
+#define AVIF_HAVE_DECODER_REUSE_CODECS 1
+#define AVIF_HAVE_ENCODER_RESET 1
+#define AVIF_HAVE_ENCODER_REUSE_CODECS 1
+#define AVIF_HAVE_DECODER_FRAME_CACHE 1
+#define AVIF_HAVE_DECODER_PROBE 1
+#define AVIF_HAVE_IO_PREFETCH 1
+#define AVIF_HAVE_ALPHA_RANGE 1
+#define AVIF_HAVE_DECODER_REGION 1
+#define AVIF_HAVE_RGB_FLOAT_INPUT 1
+#define AVIF_HAVE_IMAGE_SCALE 1
+#define AVIF_HAVE_PLANE_ALLOCATOR 1
+#define AVIF_HAVE_PROGRESS 1
+
 typedef int avifBool;
 #define AVIF_TRUE 1
 #define AVIF_FALSE 0
@@ -151,7 +166,8 @@ typedef enum avifResult
     AVIF_RESULT_NOT_IMPLEMENTED,  // a requested code path is not (yet) implemented
     AVIF_RESULT_OUT_OF_MEMORY,
     AVIF_RESULT_CANNOT_CHANGE_SETTING, // a setting that can't change is changed during encoding
-    AVIF_RESULT_INCOMPATIBLE_IMAGE     // the image is incompatible with already encoded images
+    AVIF_RESULT_INCOMPATIBLE_IMAGE,    // the image is incompatible with already encoded images
+    AVIF_RESULT_CANCELED               // the avifProgressFunc of the encoder or decoder returned AVIF_FALSE
 } avifResult;
 
 AVIF_API const char * avifResultToString(avifResult result);
@@ -421,6 +437,58 @@ AVIF_API avifBool avifCleanApertureBoxConvertCropRect(avifCleanApertureBox * cla
                                                       avifPixelFormat yuvFormat,
                                                       avifDiagnostics * diag);
 
+// ---------------------------------------------------------------------------
+// avifPlaneAllocator
+
+struct avifPlaneAllocator;
+struct avifImage;
+
+// Returns a buffer of at least size bytes for a plane of image, whose width, height, depth and
+// yuvFormat are set, or NULL on failure.
+typedef void * (*avifPlaneAllocatorAllocateFunc)(struct avifPlaneAllocator * allocator, const struct avifImage * image, size_t size);
+// Gives back a buffer returned by allocate().
+typedef void (*avifPlaneAllocatorReleaseFunc)(struct avifPlaneAllocator * allocator, void * plane);
+// Frees the allocator itself. All its buffers must have been released.
+typedef void (*avifPlaneAllocatorDestroyFunc)(struct avifPlaneAllocator * allocator);
+
+typedef struct avifPlaneAllocatorStats
+{
+    uint64_t allocationCount;       // buffers returned by allocate()
+    uint64_t reuseCount;            // buffers returned by allocate() without allocating memory
+    uint64_t releaseCount;          // buffers given back to release()
+    uint64_t systemAllocationCount; // memory allocations made by the allocator
+    uint64_t systemAllocatedBytes;  // total size of these memory allocations
+    size_t bytesInUse;              // size of the buffers allocated and not released yet
+    size_t bytesPooled;             // size of the buffers released and kept for reuse
+    size_t peakBytes;               // largest bytesInUse + bytesPooled so far
+} avifPlaneAllocatorStats;
+
+typedef void (*avifPlaneAllocatorGetStatsFunc)(struct avifPlaneAllocator * allocator, avifPlaneAllocatorStats * stats);
+
+// Allocates the planes owned by the avifImage instances that point to it, see
+// avifImage.planeAllocator. This is useful to recycle the plane buffers of image sequences, which
+// are otherwise allocated and freed for each frame.
+typedef struct avifPlaneAllocator
+{
+    avifPlaneAllocatorAllocateFunc allocate;
+    avifPlaneAllocatorReleaseFunc release;
+    avifPlaneAllocatorDestroyFunc destroy;
+    avifPlaneAllocatorGetStatsFunc getStats; // optional
+
+    // The contents of this are defined by the avifPlaneAllocator implementation.
+    void * data;
+} avifPlaneAllocator;
+
+// Creates an allocator that keeps the released buffers in a pool keyed by the width, height, depth
+// and yuvFormat of their image and by their size, and hands them out again for the next image of
+// the same kind. At most maxPooledBytes are kept (SIZE_MAX for no limit); the buffers of other
+// image kinds are freed first when the limit is reached. The buffers are aligned to 64 bytes.
+// The pool is thread-safe if libavif was built with thread support.
+AVIF_API avifPlaneAllocator * avifPlanePoolCreate(size_t maxPooledBytes);
+AVIF_API void avifPlaneAllocatorDestroy(avifPlaneAllocator * allocator);
+// Sets all counters of stats to 0 if the allocator does not implement getStats().
+AVIF_API void avifPlaneAllocatorGetStats(avifPlaneAllocator * allocator, avifPlaneAllocatorStats * stats);
+
 // ---------------------------------------------------------------------------
 // avifImage
 
@@ -443,6 +511,12 @@ typedef struct avifImage
     avifBool imageOwnsAlphaPlane;
     avifBool alphaPremultiplied;
 
+    // If not NULL, the planes owned by this image are allocated and released by this allocator
+    // instead of avifAlloc() and avifFree(). It is not owned by the image and must outlive its
+    // planes. Only change it while the image owns no planes. Images created internally from this
+    // one (such as the padded copies made by avifEncoderAddImage()) use the same allocator.
+    avifPlaneAllocator * planeAllocator;
+
     // ICC Profile
     avifRWData icc;
 
@@ -472,6 +546,14 @@ typedef struct avifImage
     // Metadata - set with avifImageSetMetadata*() before write, check .size>0 for existence after read
     avifRWData exif;
     avifRWData xmp;
+
+    // Smallest and largest alpha samples, recorded by avifImageRGBToYUV() while writing the alpha
+    // plane, so that the caller can free an opaque alpha plane before encoding without scanning it.
+    // alphaRangeKnown is cleared when the alpha plane is allocated, freed or replaced, but not when
+    // alphaPlane is modified by other means. avifEncoderAddImage() does not rely on these fields.
+    avifBool alphaRangeKnown;
+    uint32_t alphaMin;
+    uint32_t alphaMax;
 } avifImage;
 
 AVIF_API avifImage * avifImageCreate(uint32_t width, uint32_t height, uint32_t depth, avifPixelFormat yuvFormat);
@@ -493,6 +575,12 @@ AVIF_API avifResult avifImageAllocatePlanes(avifImage * image, avifPlanesFlags p
 AVIF_API void avifImageFreePlanes(avifImage * image, avifPlanesFlags planes);           // Ignores already-freed planes
 AVIF_API void avifImageStealPlanes(avifImage * dstImage, avifImage * srcImage, avifPlanesFlags planes);
 
+// Scales the YUV and alpha planes in-place to dstWidth x dstHeight, with libyuv's box filter. The
+// planes are scaled in parallel with up to maxThreads threads. Planes owned by the image are freed,
+// the others are left untouched and replaced by planes owned by the image.
+// Returns AVIF_RESULT_NOT_IMPLEMENTED if libavif was built without libyuv.
+AVIF_API avifResult avifImageScale(avifImage * image, uint32_t dstWidth, uint32_t dstHeight, int maxThreads, avifDiagnostics * diag);
+
 // ---------------------------------------------------------------------------
 // Understanding maxThreads
 //
@@ -587,7 +675,8 @@ typedef struct avifRGBImage
 {
     uint32_t width;                        // must match associated avifImage
     uint32_t height;                       // must match associated avifImage
-    uint32_t depth;                        // legal depths [8, 10, 12, 16]. if depth>8, pixels must be uint16_t internally
+    uint32_t depth;                        // legal depths [8, 10, 12, 16]. if depth>8, pixels must be uint16_t internally.
+                                           // 32 is legal with isFloat only, for float pixels.
     avifRGBFormat format;                  // all channels are always full range
     avifChromaUpsampling chromaUpsampling; // How to upsample from 4:2:0 or 4:2:2 UV when converting to RGB (ignored for 4:4:4 and 4:0:0).
                                            // Ignored when converting to YUV. Defaults to AVIF_CHROMA_UPSAMPLING_AUTOMATIC.
@@ -598,7 +687,9 @@ typedef struct avifRGBImage
     avifBool ignoreAlpha; // Used for XRGB formats, treats formats containing alpha (such as ARGB) as if they were RGB, treating
                           // the alpha bits as if they were all 1.
     avifBool alphaPremultiplied; // indicates if RGB value is pre-multiplied by alpha. Default: false
-    avifBool isFloat; // indicates if RGBA values are in half float (f16) format. Valid only when depth == 16. Default: false
+    avifBool isFloat; // indicates if RGBA values are in half float (f16) format when depth == 16, or in float (f32)
+                      // format when depth == 32. Float values are clamped to [0, 1] by avifImageRGBToYUV(). f32 is not
+                      // supported by avifImageYUVToRGB(). Valid only when depth is 16 or 32. Default: false
 
     uint8_t * pixels;
     uint32_t rowBytes;
@@ -624,6 +715,10 @@ AVIF_API avifResult avifImageYUVToRGB(const avifImage * image, avifRGBImage * rg
 AVIF_API avifResult avifRGBImagePremultiplyAlpha(avifRGBImage * rgb);
 AVIF_API avifResult avifRGBImageUnpremultiplyAlpha(avifRGBImage * rgb);
 
+// Returns AVIF_TRUE if rgb has no alpha channel or if all its alpha samples are opaque. Useful to
+// find out whether the alpha plane of the avifImage is needed before calling avifImageRGBToYUV().
+AVIF_API avifBool avifRGBImageIsOpaque(const avifRGBImage * rgb);
+
 // ---------------------------------------------------------------------------
 // YUV Utils
 
@@ -711,8 +806,25 @@ typedef struct avifIO
 
 AVIF_API avifIO * avifIOCreateMemoryReader(const uint8_t * data, size_t size);
 AVIF_API avifIO * avifIOCreateFileReader(const char * filename);
+// Wraps underlyingIO, which is owned by the returned avifIO, and reads the upcoming samples of image
+// sequences and progressive images on a background thread while the current one is decoded. At most
+// byteBudget bytes are read ahead. The samples to read are known from the sample table, so this
+// works with any underlyingIO; it is most useful when reads are slow, as with network storage.
+// Returns NULL if libavif was built without thread support, in which case underlyingIO is still owned
+// by the caller.
+AVIF_API avifIO * avifIOCreatePrefetchReader(avifIO * underlyingIO, size_t byteBudget);
 AVIF_API void avifIODestroy(avifIO * io);
 
+// ---------------------------------------------------------------------------
+// avifProgressFunc
+
+// Called by avifEncoder and avifDecoder as the work of a call progresses, with done out of total
+// units of work finished so far (see avifEncoder.progressFunc and avifDecoder.progressFunc). The
+// units are whole AV1 codec calls: the AV1 codecs offer no hook from inside the encoding or
+// decoding of one frame, so a single large cell or tile is reported at once. Return AVIF_FALSE to
+// stop the work as soon as possible: the call then fails with AVIF_RESULT_CANCELED.
+typedef avifBool (*avifProgressFunc)(void * userData, uint32_t done, uint32_t total);
+
 // ---------------------------------------------------------------------------
 // avifDecoder
 
@@ -865,6 +977,37 @@ typedef struct avifDecoder
     // Strict flags. Defaults to AVIF_STRICT_ENABLED. See avifStrictFlag definitions above.
     avifStrictFlags strictFlags;
 
+    // If this is true, the AV1 codec instances are not destroyed by avifDecoderParse() and
+    // avifDecoderReset() but kept alive, and reused for the next file or frame decoded with this
+    // avifDecoder if they were created with the same codecChoice, maxThreads and imageSizeLimit.
+    // This avoids the codec setup cost (worker threads, frame buffers) when many files are decoded
+    // in a row with the same avifDecoder, such as in batch processing. Defaults to false.
+    avifBool reuseCodecs;
+
+    // Maximum number of bytes of decoded frames kept by the decoder for random access in image
+    // sequences. When it is not 0, every frame decoded by avifDecoderNextImage() or
+    // avifDecoderNthImage() is also kept in a cache, and the least recently requested frames are
+    // dropped once their total size would exceed this value. A cached frame is returned by
+    // avifDecoderNthImage() as a copy, without decoding again from the nearest keyframe, which makes
+    // going back and forth in a sequence (such as scrubbing a timeline) cheap. The cache is ignored
+    // if allowIncremental is set. The cache is emptied by avifDecoderParse() and avifDecoderReset().
+    // Defaults to 0 (no cache).
+    uint64_t frameCacheSize;
+
+    // If not NULL, the planes of decoder->image, of the decoded tiles and of the cached frames are
+    // allocated by this allocator (see avifImage.planeAllocator), so that the buffers of an image
+    // sequence are recycled from frame to frame. It is not owned by the decoder and must outlive it.
+    // Set it before avifDecoderParse(). Defaults to NULL (avifAlloc()).
+    avifPlaneAllocator * planeAllocator;
+
+    // If not NULL, called by avifDecoderNextImage(), avifDecoderNthImage() and avifDecoderRead*()
+    // after each decoded tile of a frame, with the number of decoded tiles (color and alpha) out of
+    // the tile count of the frame. If it returns AVIF_FALSE, the call returns AVIF_RESULT_CANCELED,
+    // decoder->image is left incomplete and the decoder must be reset with avifDecoderReset() before
+    // decoding again. progressUserData is passed as is. Defaults to NULL.
+    avifProgressFunc progressFunc;
+    void * progressUserData;
+
     // --------------------------------------------------------------------------------------------
     // Outputs
 
@@ -940,6 +1083,10 @@ AVIF_API avifResult avifDecoderReadFile(avifDecoder * decoder, avifImage * image
 // to reset the internal decoder back to before the first frame. Calling either
 // avifDecoderSetSource() or avifDecoderParse() will automatically Reset the decoder.
 //
+// The same avifDecoder can be used to decode several files one after the other, by calling
+// avifDecoderSetIO*() and avifDecoderParse() again. Set avifDecoder.reuseCodecs to keep the
+// underlying AV1 codec instances warm between files.
+//
 // avifDecoderSetSource() allows you not only to choose whether to parse tracks or
 // items in a file containing both, but switch between sources without having to
 // Parse again. Normally AVIF_DECODER_SOURCE_AUTO is enough for the common path.
@@ -952,6 +1099,11 @@ AVIF_API void avifDecoderSetIO(avifDecoder * decoder, avifIO * io);
 AVIF_API avifResult avifDecoderSetIOMemory(avifDecoder * decoder, const uint8_t * data, size_t size);
 AVIF_API avifResult avifDecoderSetIOFile(avifDecoder * decoder, const char * filename);
 AVIF_API avifResult avifDecoderParse(avifDecoder * decoder);
+// Same as avifDecoderParse() but never instantiates an AV1 codec. Only the container boxes and the
+// few bytes of the first sample needed for the CICP values are read. On success, decoder->image
+// holds everything but the pixels (dimensions, depth, yuvFormat, CICP, ICC, Exif, XMP), as do
+// decoder->alphaPresent and decoder->imageCount. Call avifDecoderReset() before decoding frames.
+AVIF_API avifResult avifDecoderProbe(avifDecoder * decoder);
 AVIF_API avifResult avifDecoderNextImage(avifDecoder * decoder);
 AVIF_API avifResult avifDecoderNthImage(avifDecoder * decoder, uint32_t frameIndex);
 AVIF_API avifResult avifDecoderReset(avifDecoder * decoder);
@@ -977,6 +1129,15 @@ AVIF_API avifResult avifDecoderNthImageTiming(const avifDecoder * decoder, uint3
 // WARNING: Experimental feature.
 AVIF_API uint32_t avifDecoderDecodedRowCount(const avifDecoder * decoder);
 
+// Decodes the pixels within rect of the first image into image, which gets the dimensions of rect
+// and the other properties of decoder->image. rect is in the coordinates of the reconstructed image,
+// before any clap, irot or imir transformation, and follows the same rules as in
+// avifImageSetViewRect(). For grid images, only the samples of the cells intersecting rect are read
+// and decoded, and the next avifDecoderNextImage() call decodes the first image again. For other
+// images, this is avifDecoderNthImage(decoder, 0) followed by a copy of rect.
+// This function may be used after a successful call (AVIF_RESULT_OK) to avifDecoderParse().
+AVIF_API avifResult avifDecoderDecodeRegion(avifDecoder * decoder, const avifCropRect * rect, avifImage * image);
+
 // ---------------------------------------------------------------------------
 // avifExtent
 
@@ -1024,6 +1185,21 @@ struct avifCodecSpecificOptions;
 //   a combination of settings are tweaked to simulate this speed range.
 // * Some encoder settings can be changed after encoding starts. Changes will take effect in the next
 //   call to avifEncoderAddImage().
+// * If progressFunc is not NULL, avifEncoderAddImage() and avifEncoderAddImageGrid() call it before
+//   and after the encoding of each cell (color, then alpha) of the frame, with the number of
+//   encoded cells out of the number of cells to encode. avifEncoderFinish() calls it likewise for
+//   each flushed codec. If it returns AVIF_FALSE, the call returns AVIF_RESULT_CANCELED. The
+//   encoder must then be reset with avifEncoderReset() or destroyed, as the frame may be partially
+//   encoded.
+// * If frameDeadlineMs is not 0, the cells of a frame that are encoded more than frameDeadlineMs
+//   milliseconds after the start of its avifEncoderAddImage() or avifEncoderAddImageGrid() call
+//   are encoded at the fastest speed the codec can switch to while encoding, instead of the
+//   requested speed. The next frame starts again at the requested speed. A cell already being
+//   encoded when the deadline passes is finished at its speed. This bounds the encoding time of
+//   grids, alpha and image sequences without failing. The deadline is only checked between cells,
+//   as no codec can change its speed in the middle of a frame: a frame made of a single cell (a
+//   still image without grid nor alpha, or the first cell of any frame) is always encoded at the
+//   requested speed, however long it takes. Only libaom supports this, other codecs ignore it.
 typedef struct avifEncoder
 {
     // Defaults to AVIF_CODEC_CHOICE_AUTO: Preference determined by order in availableCodecs table (avif.c)
@@ -1042,6 +1218,21 @@ typedef struct avifEncoder
     int tileRowsLog2;
     int tileColsLog2;
     avifBool autoTiling;
+    uint32_t frameDeadlineMs; // 0 to disable (default)
+
+    // If this is true, the AV1 codec instances that encoded a single image without grid are kept
+    // alive after their flush and reused by the next avifEncoderAddImage() after
+    // avifEncoderReset(), if codecChoice, maxThreads, speed, keyframeInterval and timescale did not
+    // change and the next image is also a single image of the same dimensions, depth and format.
+    // This avoids the codec setup cost when many images are encoded in a row with the same
+    // avifEncoder, at the cost of keeping the instances in memory until the next image. The
+    // codec-specific options of the previous image stay in effect in a reused instance. Only libaom
+    // supports this, other codecs are recreated. Defaults to false.
+    avifBool reuseCodecs;
+
+    // progress and cancellation (see Notes above)
+    avifProgressFunc progressFunc;
+    void * progressUserData;
 
     // stats from the most recent write
     avifIOStats ioStats;
@@ -1093,6 +1284,13 @@ AVIF_API avifResult avifEncoderAddImageGrid(avifEncoder * encoder,
                                             avifAddImageFlags addImageFlags);
 AVIF_API avifResult avifEncoderFinish(avifEncoder * encoder, avifRWData * output);
 
+// Discards all images added to the encoder and any encoding state, so that the same avifEncoder can
+// be used to encode another image or image sequence. All settings are kept, but the codec-specific
+// options are consumed by each avifEncoderAddImage() call and must be set again. The AV1 codec
+// instances are recreated by the next avifEncoderAddImage() call, unless reuseCodecs is set and they
+// can be reused.
+AVIF_API avifResult avifEncoderReset(avifEncoder * encoder);
+
 // Codec-specific, optional "advanced" tuning settings, in the form of string key/value pairs,
 // to be consumed by the codec in the next avifEncoderAddImage() call.
 // See the codec documentation to know if a setting is persistent or applied only to the next frame.
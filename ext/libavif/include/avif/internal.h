@@ -92,7 +92,10 @@ typedef struct avifAlphaParams
 } avifAlphaParams;
 
 avifBool avifFillAlpha(const avifAlphaParams * const params);
-avifBool avifReformatAlpha(const avifAlphaParams * const params);
+// If not NULL, *dstMinAlpha and *dstMaxAlpha are set to the smallest and largest written samples.
+avifBool avifReformatAlpha(const avifAlphaParams * const params, uint32_t * dstMinAlpha, uint32_t * dstMaxAlpha);
+// Returns AVIF_TRUE if image has no alpha plane or if all its alpha samples are (1 << depth) - 1.
+avifBool avifImageIsOpaque(const avifImage * image);
 
 typedef enum avifReformatMode
 {
@@ -186,17 +189,6 @@ avifBool avifDimensionsTooLarge(uint32_t width, uint32_t height, uint32_t imageS
 // unit tests.
 void avifSetTileConfiguration(int threads, uint32_t width, uint32_t height, int * tileRowsLog2, int * tileColsLog2);
 
-// ---------------------------------------------------------------------------
-// Scaling
-
-// This scales the YUV/A planes in-place.
-avifBool avifImageScale(avifImage * image,
-                        uint32_t dstWidth,
-                        uint32_t dstHeight,
-                        uint32_t imageSizeLimit,
-                        uint32_t imageDimensionLimit,
-                        avifDiagnostics * diag);
-
 // ---------------------------------------------------------------------------
 // Grid AVIF images
 
@@ -204,6 +196,12 @@ avifBool avifImageScale(avifImage * image,
 // The image contains imageW*imageH pixels. The tiles are of tileW*tileH pixels each.
 avifBool avifAreGridDimensionsValid(avifPixelFormat yuvFormat, uint32_t imageW, uint32_t imageH, uint32_t tileW, uint32_t tileH, avifDiagnostics * diag);
 
+// ---------------------------------------------------------------------------
+// Planes
+
+// Frees plane, one of the planes owned by image, with image->planeAllocator or avifFree().
+void avifImageReleasePlane(const avifImage * image, void * plane);
+
 // ---------------------------------------------------------------------------
 // Metadata
 
@@ -213,6 +211,16 @@ avifResult avifGetExifTiffHeaderOffset(const avifRWData * exif, uint32_t * offse
 // image->imir on success. Returns AVIF_RESULT_INVALID_EXIF_PAYLOAD on failure.
 avifResult avifImageExtractExifOrientationToIrotImir(avifImage * image);
 
+// ---------------------------------------------------------------------------
+// Read-ahead
+
+// Declares a byte range an avifIO created by avifIOCreatePrefetchReader() should read ahead. Ranges
+// are read ahead in the order they are declared. Returns AVIF_FALSE if io is not such a reader or if
+// its byte budget is reached, counting the ranges read ahead but not read yet. avifIOPrefetchDiscard()
+// drops all the declared ranges, such as after a seek.
+avifBool avifIOPrefetch(avifIO * io, uint64_t offset, size_t size);
+void avifIOPrefetchDiscard(avifIO * io);
+
 // ---------------------------------------------------------------------------
 // avifCodecDecodeInput
 
@@ -234,11 +242,17 @@ typedef struct avifDecodeSample
 } avifDecodeSample;
 AVIF_ARRAY_DECLARE(avifDecodeSampleArray, avifDecodeSample, sample);
 
+struct avifSampleIndex;
+
 typedef struct avifCodecDecodeInput
 {
     avifDecodeSampleArray samples;
     avifBool allLayers; // if true, the underlying codec must decode all layers, not just the best layer
     avifBool alpha;     // if true, this is decoding an alpha plane
+
+    // If not NULL, the samples come from a track and are located on demand with this index instead
+    // of being stored one by one. samples then only holds the sample currently being read or decoded.
+    struct avifSampleIndex * sampleIndex;
 } avifCodecDecodeInput;
 
 avifCodecDecodeInput * avifCodecDecodeInputCreate(void);
@@ -291,6 +305,9 @@ typedef enum avifEncoderChange
     AVIF_ENCODER_CHANGE_MAX_QUANTIZER_ALPHA = (1u << 3),
     AVIF_ENCODER_CHANGE_TILE_ROWS_LOG2 = (1u << 4),
     AVIF_ENCODER_CHANGE_TILE_COLS_LOG2 = (1u << 5),
+    // Not a setting change: avifEncoder.frameDeadlineMs has passed for the frame being encoded, so
+    // the codec should switch to its fastest speed until a call without this flag.
+    AVIF_ENCODER_CHANGE_DEADLINE_PASSED = (1u << 6),
 
     AVIF_ENCODER_CHANGE_CODEC_SPECIFIC = (1u << 31)
 } avifEncoderChange;
@@ -339,6 +356,8 @@ typedef struct avifCodec
                                           //
     uint8_t operatingPoint;               // Operating point, defaults to 0.
     avifBool allLayers;                   // if true, the underlying codec must decode all layers, not just the best layer
+    avifBool keepAfterFlush;              // encoder: set by libavif to keep the codec usable after flushing a single image
+    avifBool reusable;                    // encoder: set by the codec when it can encode another single image after that flush
 
     avifCodecGetNextImageFunc getNextImage;
     avifCodecEncodeImageFunc encodeImage;
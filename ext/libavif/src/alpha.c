@@ -31,13 +31,18 @@ avifBool avifFillAlpha(const avifAlphaParams * const params)
     return AVIF_TRUE;
 }
 
-avifBool avifReformatAlpha(const avifAlphaParams * const params)
+avifBool avifReformatAlpha(const avifAlphaParams * const params, uint32_t * dstMinAlpha, uint32_t * dstMaxAlpha)
 {
     const int srcMaxChannel = (1 << params->srcDepth) - 1;
     const int dstMaxChannel = (1 << params->dstDepth) - 1;
     const float srcMaxChannelF = (float)srcMaxChannel;
     const float dstMaxChannelF = (float)dstMaxChannel;
 
+    // The range of the written samples is tracked along the copy, which is cheaper than scanning
+    // the destination plane again to know whether it is opaque.
+    uint32_t minAlpha = (uint32_t)dstMaxChannel;
+    uint32_t maxAlpha = 0;
+
     if (params->srcDepth == params->dstDepth) {
         // no depth rescale
 
@@ -47,9 +52,16 @@ avifBool avifReformatAlpha(const avifAlphaParams * const params)
             for (uint32_t j = 0; j < params->height; ++j) {
                 uint8_t * srcRow = &params->srcPlane[params->srcOffsetBytes + (j * params->srcRowBytes)];
                 uint8_t * dstRow = &params->dstPlane[params->dstOffsetBytes + (j * params->dstRowBytes)];
+                uint16_t rowMin = 0xFFFF;
+                uint16_t rowMax = 0;
                 for (uint32_t i = 0; i < params->width; ++i) {
-                    *((uint16_t *)&dstRow[i * params->dstPixelBytes]) = *((uint16_t *)&srcRow[i * params->srcPixelBytes]);
+                    const uint16_t alpha = *((uint16_t *)&srcRow[i * params->srcPixelBytes]);
+                    *((uint16_t *)&dstRow[i * params->dstPixelBytes]) = alpha;
+                    rowMin = AVIF_MIN(rowMin, alpha);
+                    rowMax = AVIF_MAX(rowMax, alpha);
                 }
+                minAlpha = AVIF_MIN(minAlpha, rowMin);
+                maxAlpha = AVIF_MAX(maxAlpha, rowMax);
             }
         } else {
             // no depth rescale, uint8_t -> uint8_t
@@ -57,9 +69,16 @@ avifBool avifReformatAlpha(const avifAlphaParams * const params)
             for (uint32_t j = 0; j < params->height; ++j) {
                 uint8_t * srcRow = &params->srcPlane[params->srcOffsetBytes + (j * params->srcRowBytes)];
                 uint8_t * dstRow = &params->dstPlane[params->dstOffsetBytes + (j * params->dstRowBytes)];
+                uint8_t rowMin = 0xFF;
+                uint8_t rowMax = 0;
                 for (uint32_t i = 0; i < params->width; ++i) {
-                    dstRow[i * params->dstPixelBytes] = srcRow[i * params->srcPixelBytes];
+                    const uint8_t alpha = srcRow[i * params->srcPixelBytes];
+                    dstRow[i * params->dstPixelBytes] = alpha;
+                    rowMin = AVIF_MIN(rowMin, alpha);
+                    rowMax = AVIF_MAX(rowMax, alpha);
                 }
+                minAlpha = AVIF_MIN(minAlpha, rowMin);
+                maxAlpha = AVIF_MAX(maxAlpha, rowMax);
             }
         }
     } else {
@@ -78,6 +97,8 @@ avifBool avifReformatAlpha(const avifAlphaParams * const params)
                         int dstAlpha = (int)(0.5f + (alphaF * dstMaxChannelF));
                         dstAlpha = AVIF_CLAMP(dstAlpha, 0, dstMaxChannel);
                         *((uint16_t *)&dstRow[i * params->dstPixelBytes]) = (uint16_t)dstAlpha;
+                        minAlpha = AVIF_MIN(minAlpha, (uint32_t)dstAlpha);
+                        maxAlpha = AVIF_MAX(maxAlpha, (uint32_t)dstAlpha);
                     }
                 }
             } else {
@@ -92,6 +113,8 @@ avifBool avifReformatAlpha(const avifAlphaParams * const params)
                         int dstAlpha = (int)(0.5f + (alphaF * dstMaxChannelF));
                         dstAlpha = AVIF_CLAMP(dstAlpha, 0, dstMaxChannel);
                         dstRow[i * params->dstPixelBytes] = (uint8_t)dstAlpha;
+                        minAlpha = AVIF_MIN(minAlpha, (uint32_t)dstAlpha);
+                        maxAlpha = AVIF_MAX(maxAlpha, (uint32_t)dstAlpha);
                     }
                 }
             }
@@ -109,14 +132,176 @@ avifBool avifReformatAlpha(const avifAlphaParams * const params)
                     int dstAlpha = (int)(0.5f + (alphaF * dstMaxChannelF));
                     dstAlpha = AVIF_CLAMP(dstAlpha, 0, dstMaxChannel);
                     *((uint16_t *)&dstRow[i * params->dstPixelBytes]) = (uint16_t)dstAlpha;
+                    minAlpha = AVIF_MIN(minAlpha, (uint32_t)dstAlpha);
+                    maxAlpha = AVIF_MAX(maxAlpha, (uint32_t)dstAlpha);
                 }
             }
         }
     }
 
+    if (dstMinAlpha) {
+        *dstMinAlpha = minAlpha;
+    }
+    if (dstMaxAlpha) {
+        *dstMaxAlpha = maxAlpha;
+    }
+    return AVIF_TRUE;
+}
+
+// Returns AVIF_TRUE if all the width*height samples at plane (pixelBytes apart, in rows rowBytes apart)
+// are equal to (1 << depth) - 1. Samples are uint16_t if depth > 8.
+static avifBool avifAlphaIsOpaque(const uint8_t * plane, uint32_t rowBytes, uint32_t pixelBytes, uint32_t depth, uint32_t width, uint32_t height)
+{
+    // Samples are reduced without branches in chunks, which compilers vectorize, and the scan
+    // stops after the first chunk containing a sample that is not maxChannel.
+    const uint32_t chunkSize = 64;
+    if (depth > 8) {
+        const uint16_t maxChannel = (uint16_t)((1 << depth) - 1);
+        for (uint32_t j = 0; j < height; ++j) {
+            const uint8_t * row = &plane[j * rowBytes];
+            for (uint32_t chunkStart = 0, chunkEnd; chunkStart < width; chunkStart = chunkEnd) {
+                chunkEnd = ((width - chunkStart) > chunkSize) ? (chunkStart + chunkSize) : width;
+                uint16_t chunkAnd = 0xFFFF;
+                uint16_t chunkOr = 0;
+                for (uint32_t i = chunkStart; i < chunkEnd; ++i) {
+                    const uint16_t alpha = *((const uint16_t *)&row[i * pixelBytes]);
+                    chunkAnd &= alpha;
+                    chunkOr |= alpha;
+                }
+                if ((chunkAnd != maxChannel) || (chunkOr != maxChannel)) {
+                    return AVIF_FALSE;
+                }
+            }
+        }
+    } else {
+        for (uint32_t j = 0; j < height; ++j) {
+            const uint8_t * row = &plane[j * rowBytes];
+            for (uint32_t chunkStart = 0, chunkEnd; chunkStart < width; chunkStart = chunkEnd) {
+                chunkEnd = ((width - chunkStart) > chunkSize) ? (chunkStart + chunkSize) : width;
+                uint8_t chunkAnd = 0xFF;
+                for (uint32_t i = chunkStart; i < chunkEnd; ++i) {
+                    chunkAnd &= row[i * pixelBytes];
+                }
+                if (chunkAnd != 0xFF) {
+                    return AVIF_FALSE;
+                }
+            }
+        }
+    }
     return AVIF_TRUE;
 }
 
+avifBool avifImageIsOpaque(const avifImage * image)
+{
+    if (!image->alphaPlane) {
+        return AVIF_TRUE;
+    }
+    return avifAlphaIsOpaque(image->alphaPlane, image->alphaRowBytes, avifImageUsesU16(image) ? 2 : 1, image->depth, image->width, image->height);
+}
+
+avifBool avifRGBImageIsOpaque(const avifRGBImage * rgb)
+{
+    if (!avifRGBFormatHasAlpha(rgb->format) || rgb->ignoreAlpha || !rgb->pixels) {
+        return AVIF_TRUE;
+    }
+    if (rgb->isFloat && (rgb->depth == 32)) {
+        const uint32_t pixelBytes = avifRGBImagePixelSize(rgb);
+        const uint32_t alphaOffset = ((rgb->format == AVIF_RGB_FORMAT_ARGB) || (rgb->format == AVIF_RGB_FORMAT_ABGR)) ? 0 : 12;
+        for (uint32_t j = 0; j < rgb->height; ++j) {
+            const uint8_t * row = &rgb->pixels[alphaOffset + (j * rgb->rowBytes)];
+            for (uint32_t i = 0; i < rgb->width; ++i) {
+                if (!(*((const float *)&row[i * pixelBytes]) >= 1.0f)) {
+                    return AVIF_FALSE;
+                }
+            }
+        }
+        return AVIF_TRUE;
+    }
+    if (rgb->isFloat) {
+        // Half float 1.0.
+        const uint32_t pixelBytes = avifRGBImagePixelSize(rgb);
+        const uint32_t alphaOffset = ((rgb->format == AVIF_RGB_FORMAT_ARGB) || (rgb->format == AVIF_RGB_FORMAT_ABGR)) ? 0 : 6;
+        for (uint32_t j = 0; j < rgb->height; ++j) {
+            const uint8_t * row = &rgb->pixels[alphaOffset + (j * rgb->rowBytes)];
+            for (uint32_t i = 0; i < rgb->width; ++i) {
+                if (*((const uint16_t *)&row[i * pixelBytes]) != 0x3C00) {
+                    return AVIF_FALSE;
+                }
+            }
+        }
+        return AVIF_TRUE;
+    }
+    const uint32_t channelBytes = (rgb->depth > 8) ? 2 : 1;
+    const uint32_t alphaOffset = ((rgb->format == AVIF_RGB_FORMAT_ARGB) || (rgb->format == AVIF_RGB_FORMAT_ABGR)) ? 0 : (channelBytes * 3);
+    return avifAlphaIsOpaque(rgb->pixels + alphaOffset, rgb->rowBytes, avifRGBImagePixelSize(rgb), rgb->depth, rgb->width, rgb->height);
+}
+
+// The kernels below process one row of four-channel pixels, where alphaIndex is the position of the
+// alpha sample in a pixel and colorIndex the position of the first of the three color samples. They
+// are called with constant indices so that they get inlined per layout, and they have no branch per
+// pixel, so that compilers vectorize them.
+//
+// Premultiplication rounds c * a / maxChannel to the nearest integer. Because maxChannel is
+// (1 << depth) - 1, the division of x = c * a + maxChannel / 2 is computed exactly as
+// (x + (x >> depth) + 1) >> depth for all the values that x can take.
+static inline void avifPremultiplyRow8(uint8_t * row, uint32_t width, uint32_t alphaIndex, uint32_t colorIndex)
+{
+    for (uint32_t i = 0; i < width; ++i) {
+        uint8_t * pixel = &row[i * 4];
+        const uint32_t a = pixel[alphaIndex];
+        for (uint32_t c = colorIndex; c < colorIndex + 3; ++c) {
+            const uint32_t x = pixel[c] * a + 127;
+            pixel[c] = (uint8_t)((x + (x >> 8) + 1) >> 8);
+        }
+    }
+}
+
+static inline void avifPremultiplyRow16(uint8_t * row, uint32_t width, uint32_t depth, uint32_t alphaIndex, uint32_t colorIndex)
+{
+    const uint32_t maxChannel = (1u << depth) - 1;
+    for (uint32_t i = 0; i < width; ++i) {
+        uint16_t * pixel = (uint16_t *)&row[i * 8];
+        const uint32_t a = AVIF_MIN(pixel[alphaIndex], maxChannel);
+        for (uint32_t c = colorIndex; c < colorIndex + 3; ++c) {
+            const uint32_t x = pixel[c] * a + (maxChannel >> 1);
+            pixel[c] = (uint16_t)((x + (x >> depth) + 1) >> depth);
+        }
+    }
+}
+
+// Unpremultiplication rounds c * maxChannel / a to the nearest integer, halves up like avifRoundf(),
+// with one division per pixel instead of one per sample. In double precision, c * (maxChannel / a)
+// is off by far less than 1e-6, and any c * maxChannel / a that is not a half integer is at least
+// 1 / (2 * a) > 1e-6 away from one, so adding 1e-6 to the rounding offset gives the exact result.
+static inline void avifUnpremultiplyRow8(uint8_t * row, uint32_t width, uint32_t alphaIndex, uint32_t colorIndex)
+{
+    for (uint32_t i = 0; i < width; ++i) {
+        uint8_t * pixel = &row[i * 4];
+        const uint32_t a = pixel[alphaIndex];
+        // A zero alpha sample gives zero color samples.
+        const double scale = a ? (255.0 / a) : 0.0;
+        for (uint32_t c = colorIndex; c < colorIndex + 3; ++c) {
+            const double value = pixel[c] * scale + (0.5 + 1e-6);
+            pixel[c] = (uint8_t)AVIF_MIN(value, 255.0);
+        }
+    }
+}
+
+static inline void avifUnpremultiplyRow16(uint8_t * row, uint32_t width, uint32_t depth, uint32_t alphaIndex, uint32_t colorIndex)
+{
+    const uint32_t maxChannel = (1u << depth) - 1;
+    const double maxChannelD = (double)maxChannel;
+    for (uint32_t i = 0; i < width; ++i) {
+        uint16_t * pixel = (uint16_t *)&row[i * 8];
+        const uint32_t a = AVIF_MIN(pixel[alphaIndex], maxChannel);
+        const double scale = a ? (maxChannelD / a) : 0.0;
+        for (uint32_t c = colorIndex; c < colorIndex + 3; ++c) {
+            const double value = pixel[c] * scale + (0.5 + 1e-6);
+            pixel[c] = (uint16_t)AVIF_MIN(value, maxChannelD);
+        }
+    }
+}
+
 avifResult avifRGBImagePremultiplyAlpha(avifRGBImage * rgb)
 {
     // no data
@@ -136,95 +321,23 @@ avifResult avifRGBImagePremultiplyAlpha(avifRGBImage * rgb)
 
     assert(rgb->depth >= 8 && rgb->depth <= 16);
 
-    uint32_t max = (1 << rgb->depth) - 1;
-    float maxF = (float)max;
-
-    if (rgb->depth > 8) {
-        if (rgb->format == AVIF_RGB_FORMAT_RGBA || rgb->format == AVIF_RGB_FORMAT_BGRA) {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint16_t * pixel = (uint16_t *)&row[i * 8];
-                    uint16_t a = pixel[3];
-                    if (a >= max) {
-                        // opaque is no-op
-                        continue;
-                    } else if (a == 0) {
-                        // result must be zero
-                        pixel[0] = 0;
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                    } else {
-                        // a < maxF is always true now, so we don't need clamp here
-                        pixel[0] = (uint16_t)avifRoundf((float)pixel[0] * (float)a / maxF);
-                        pixel[1] = (uint16_t)avifRoundf((float)pixel[1] * (float)a / maxF);
-                        pixel[2] = (uint16_t)avifRoundf((float)pixel[2] * (float)a / maxF);
-                    }
-                }
-            }
-        } else {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint16_t * pixel = (uint16_t *)&row[i * 8];
-                    uint16_t a = pixel[0];
-                    if (a >= max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                        pixel[3] = 0;
-                    } else {
-                        pixel[1] = (uint16_t)avifRoundf((float)pixel[1] * (float)a / maxF);
-                        pixel[2] = (uint16_t)avifRoundf((float)pixel[2] * (float)a / maxF);
-                        pixel[3] = (uint16_t)avifRoundf((float)pixel[3] * (float)a / maxF);
-                    }
-                }
-            }
-        }
-    } else {
-        if (rgb->format == AVIF_RGB_FORMAT_RGBA || rgb->format == AVIF_RGB_FORMAT_BGRA) {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint8_t * pixel = &row[i * 4];
-                    uint8_t a = pixel[3];
-                    // uint8_t can't exceed 255
-                    if (a == max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[0] = 0;
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                    } else {
-                        pixel[0] = (uint8_t)avifRoundf((float)pixel[0] * (float)a / maxF);
-                        pixel[1] = (uint8_t)avifRoundf((float)pixel[1] * (float)a / maxF);
-                        pixel[2] = (uint8_t)avifRoundf((float)pixel[2] * (float)a / maxF);
-                    }
-                }
+    const avifBool alphaFirst = (rgb->format == AVIF_RGB_FORMAT_ARGB) || (rgb->format == AVIF_RGB_FORMAT_ABGR);
+    for (uint32_t j = 0; j < rgb->height; ++j) {
+        uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
+        if (rgb->depth > 8) {
+            if (alphaFirst) {
+                avifPremultiplyRow16(row, rgb->width, rgb->depth, 0, 1);
+            } else {
+                avifPremultiplyRow16(row, rgb->width, rgb->depth, 3, 0);
             }
         } else {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint8_t * pixel = &row[i * 4];
-                    uint8_t a = pixel[0];
-                    if (a == max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                        pixel[3] = 0;
-                    } else {
-                        pixel[1] = (uint8_t)avifRoundf((float)pixel[1] * (float)a / maxF);
-                        pixel[2] = (uint8_t)avifRoundf((float)pixel[2] * (float)a / maxF);
-                        pixel[3] = (uint8_t)avifRoundf((float)pixel[3] * (float)a / maxF);
-                    }
-                }
+            if (alphaFirst) {
+                avifPremultiplyRow8(row, rgb->width, 0, 1);
+            } else {
+                avifPremultiplyRow8(row, rgb->width, 3, 0);
             }
         }
     }
-
     return AVIF_RESULT_OK;
 }
 
@@ -247,104 +360,22 @@ avifResult avifRGBImageUnpremultiplyAlpha(avifRGBImage * rgb)
 
     assert(rgb->depth >= 8 && rgb->depth <= 16);
 
-    uint32_t max = (1 << rgb->depth) - 1;
-    float maxF = (float)max;
-
-    if (rgb->depth > 8) {
-        if (rgb->format == AVIF_RGB_FORMAT_RGBA || rgb->format == AVIF_RGB_FORMAT_BGRA) {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint16_t * pixel = (uint16_t *)&row[i * 8];
-                    uint16_t a = pixel[3];
-                    if (a >= max) {
-                        // opaque is no-op
-                        continue;
-                    } else if (a == 0) {
-                        // prevent division by zero
-                        pixel[0] = 0;
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                    } else {
-                        float c1 = avifRoundf((float)pixel[0] * maxF / (float)a);
-                        float c2 = avifRoundf((float)pixel[1] * maxF / (float)a);
-                        float c3 = avifRoundf((float)pixel[2] * maxF / (float)a);
-                        pixel[0] = (uint16_t)AVIF_MIN(c1, maxF);
-                        pixel[1] = (uint16_t)AVIF_MIN(c2, maxF);
-                        pixel[2] = (uint16_t)AVIF_MIN(c3, maxF);
-                    }
-                }
-            }
-        } else {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint16_t * pixel = (uint16_t *)&row[i * 8];
-                    uint16_t a = pixel[0];
-                    if (a >= max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                        pixel[3] = 0;
-                    } else {
-                        float c1 = avifRoundf((float)pixel[1] * maxF / (float)a);
-                        float c2 = avifRoundf((float)pixel[2] * maxF / (float)a);
-                        float c3 = avifRoundf((float)pixel[3] * maxF / (float)a);
-                        pixel[1] = (uint16_t)AVIF_MIN(c1, maxF);
-                        pixel[2] = (uint16_t)AVIF_MIN(c2, maxF);
-                        pixel[3] = (uint16_t)AVIF_MIN(c3, maxF);
-                    }
-                }
-            }
-        }
-    } else {
-        if (rgb->format == AVIF_RGB_FORMAT_RGBA || rgb->format == AVIF_RGB_FORMAT_BGRA) {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint8_t * pixel = &row[i * 4];
-                    uint8_t a = pixel[3];
-                    if (a == max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[0] = 0;
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                    } else {
-                        float c1 = avifRoundf((float)pixel[0] * maxF / (float)a);
-                        float c2 = avifRoundf((float)pixel[1] * maxF / (float)a);
-                        float c3 = avifRoundf((float)pixel[2] * maxF / (float)a);
-                        pixel[0] = (uint8_t)AVIF_MIN(c1, maxF);
-                        pixel[1] = (uint8_t)AVIF_MIN(c2, maxF);
-                        pixel[2] = (uint8_t)AVIF_MIN(c3, maxF);
-                    }
-                }
+    const avifBool alphaFirst = (rgb->format == AVIF_RGB_FORMAT_ARGB) || (rgb->format == AVIF_RGB_FORMAT_ABGR);
+    for (uint32_t j = 0; j < rgb->height; ++j) {
+        uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
+        if (rgb->depth > 8) {
+            if (alphaFirst) {
+                avifUnpremultiplyRow16(row, rgb->width, rgb->depth, 0, 1);
+            } else {
+                avifUnpremultiplyRow16(row, rgb->width, rgb->depth, 3, 0);
             }
         } else {
-            for (uint32_t j = 0; j < rgb->height; ++j) {
-                uint8_t * row = &rgb->pixels[j * rgb->rowBytes];
-                for (uint32_t i = 0; i < rgb->width; ++i) {
-                    uint8_t * pixel = &row[i * 4];
-                    uint8_t a = pixel[0];
-                    if (a == max) {
-                        continue;
-                    } else if (a == 0) {
-                        pixel[1] = 0;
-                        pixel[2] = 0;
-                        pixel[3] = 0;
-                    } else {
-                        float c1 = avifRoundf((float)pixel[1] * maxF / (float)a);
-                        float c2 = avifRoundf((float)pixel[2] * maxF / (float)a);
-                        float c3 = avifRoundf((float)pixel[3] * maxF / (float)a);
-                        pixel[1] = (uint8_t)AVIF_MIN(c1, maxF);
-                        pixel[2] = (uint8_t)AVIF_MIN(c2, maxF);
-                        pixel[3] = (uint8_t)AVIF_MIN(c3, maxF);
-                    }
-                }
+            if (alphaFirst) {
+                avifUnpremultiplyRow8(row, rgb->width, 0, 1);
+            } else {
+                avifUnpremultiplyRow8(row, rgb->width, 3, 0);
             }
         }
     }
-
     return AVIF_RESULT_OK;
 }
@@ -100,6 +100,7 @@ const char * avifResultToString(avifResult result)
         case AVIF_RESULT_OUT_OF_MEMORY:                 return "Out of memory";
         case AVIF_RESULT_CANNOT_CHANGE_SETTING:         return "Cannot change some setting during encoding";
         case AVIF_RESULT_INCOMPATIBLE_IMAGE:            return "The image is incompatible with already encoded images";
+        case AVIF_RESULT_CANCELED:                      return "Canceled by the progress callback";
         case AVIF_RESULT_UNKNOWN_ERROR:
         default:
             break;
@@ -169,16 +170,10 @@ static void avifImageCopyNoAlloc(avifImage * dstImage, const avifImage * srcImag
     dstImage->imir = srcImage->imir;
 }
 
-avifResult avifImageCopy(avifImage * dstImage, const avifImage * srcImage, avifPlanesFlags planes)
+// Allocates the given planes of dstImage and copies the samples of srcImage into them. dstImage
+// must have the dimensions, depth and format of srcImage.
+static avifResult avifImageCopyPlanes(avifImage * dstImage, const avifImage * srcImage, avifPlanesFlags planes)
 {
-    avifImageFreePlanes(dstImage, AVIF_PLANES_ALL);
-    avifImageCopyNoAlloc(dstImage, srcImage);
-
-    avifImageSetProfileICC(dstImage, srcImage->icc.data, srcImage->icc.size);
-
-    avifRWDataSet(&dstImage->exif, srcImage->exif.data, srcImage->exif.size);
-    avifImageSetMetadataXMP(dstImage, srcImage->xmp.data, srcImage->xmp.size);
-
     if ((planes & AVIF_PLANES_YUV) && srcImage->yuvPlanes[AVIF_CHAN_Y]) {
         const avifResult allocationResult = avifImageAllocatePlanes(dstImage, AVIF_PLANES_YUV);
         if (allocationResult != AVIF_RESULT_OK) {
@@ -194,7 +189,7 @@ avifResult avifImageCopy(avifImage * dstImage, const avifImage * srcImage, avifP
             if (!srcImage->yuvRowBytes[yuvPlane]) {
                 // plane is absent. If we're copying from a source without
                 // them, mimic the source image's state by removing our copy.
-                avifFree(dstImage->yuvPlanes[yuvPlane]);
+                avifImageReleasePlane(dstImage, dstImage->yuvPlanes[yuvPlane]);
                 dstImage->yuvPlanes[yuvPlane] = NULL;
                 dstImage->yuvRowBytes[yuvPlane] = 0;
                 continue;
@@ -218,10 +213,26 @@ avifResult avifImageCopy(avifImage * dstImage, const avifImage * srcImage, avifP
             uint8_t * dstAlphaRow = &dstImage->alphaPlane[j * dstImage->alphaRowBytes];
             memcpy(dstAlphaRow, srcAlphaRow, dstImage->alphaRowBytes);
         }
+        dstImage->alphaRangeKnown = srcImage->alphaRangeKnown;
+        dstImage->alphaMin = srcImage->alphaMin;
+        dstImage->alphaMax = srcImage->alphaMax;
     }
     return AVIF_RESULT_OK;
 }
 
+avifResult avifImageCopy(avifImage * dstImage, const avifImage * srcImage, avifPlanesFlags planes)
+{
+    avifImageFreePlanes(dstImage, AVIF_PLANES_ALL);
+    avifImageCopyNoAlloc(dstImage, srcImage);
+
+    avifImageSetProfileICC(dstImage, srcImage->icc.data, srcImage->icc.size);
+
+    avifRWDataSet(&dstImage->exif, srcImage->exif.data, srcImage->exif.size);
+    avifImageSetMetadataXMP(dstImage, srcImage->xmp.data, srcImage->xmp.size);
+
+    return avifImageCopyPlanes(dstImage, srcImage, planes);
+}
+
 avifResult avifImageSetViewRect(avifImage * dstImage, const avifImage * srcImage, const avifCropRect * rect)
 {
     avifPixelFormatInfo formatInfo;
@@ -272,6 +283,26 @@ void avifImageSetMetadataXMP(avifImage * image, const uint8_t * xmp, size_t xmpS
     avifRWDataSet(&image->xmp, xmp, xmpSize);
 }
 
+static void * avifImageAllocatePlane(const avifImage * image, size_t size)
+{
+    if (image->planeAllocator) {
+        return image->planeAllocator->allocate(image->planeAllocator, image, size);
+    }
+    return avifAlloc(size);
+}
+
+void avifImageReleasePlane(const avifImage * image, void * plane)
+{
+    if (!plane) {
+        return;
+    }
+    if (image->planeAllocator) {
+        image->planeAllocator->release(image->planeAllocator, plane);
+    } else {
+        avifFree(plane);
+    }
+}
+
 avifResult avifImageAllocatePlanes(avifImage * image, avifPlanesFlags planes)
 {
     if (image->width == 0 || image->height == 0) {
@@ -302,7 +333,7 @@ avifResult avifImageAllocatePlanes(avifImage * image, avifPlanesFlags planes)
         image->imageOwnsYUVPlanes = AVIF_TRUE;
         if (!image->yuvPlanes[AVIF_CHAN_Y]) {
             image->yuvRowBytes[AVIF_CHAN_Y] = (uint32_t)fullRowBytes;
-            image->yuvPlanes[AVIF_CHAN_Y] = avifAlloc(fullSize);
+            image->yuvPlanes[AVIF_CHAN_Y] = avifImageAllocatePlane(image, fullSize);
             if (!image->yuvPlanes[AVIF_CHAN_Y]) {
                 return AVIF_RESULT_OUT_OF_MEMORY;
             }
@@ -311,14 +342,14 @@ avifResult avifImageAllocatePlanes(avifImage * image, avifPlanesFlags planes)
         if (image->yuvFormat != AVIF_PIXEL_FORMAT_YUV400) {
             if (!image->yuvPlanes[AVIF_CHAN_U]) {
                 image->yuvRowBytes[AVIF_CHAN_U] = (uint32_t)uvRowBytes;
-                image->yuvPlanes[AVIF_CHAN_U] = avifAlloc(uvSize);
+                image->yuvPlanes[AVIF_CHAN_U] = avifImageAllocatePlane(image, uvSize);
                 if (!image->yuvPlanes[AVIF_CHAN_U]) {
                     return AVIF_RESULT_OUT_OF_MEMORY;
                 }
             }
             if (!image->yuvPlanes[AVIF_CHAN_V]) {
                 image->yuvRowBytes[AVIF_CHAN_V] = (uint32_t)uvRowBytes;
-                image->yuvPlanes[AVIF_CHAN_V] = avifAlloc(uvSize);
+                image->yuvPlanes[AVIF_CHAN_V] = avifImageAllocatePlane(image, uvSize);
                 if (!image->yuvPlanes[AVIF_CHAN_V]) {
                     return AVIF_RESULT_OUT_OF_MEMORY;
                 }
@@ -327,9 +358,10 @@ avifResult avifImageAllocatePlanes(avifImage * image, avifPlanesFlags planes)
     }
     if (planes & AVIF_PLANES_A) {
         image->imageOwnsAlphaPlane = AVIF_TRUE;
+        image->alphaRangeKnown = AVIF_FALSE;
         if (!image->alphaPlane) {
             image->alphaRowBytes = (uint32_t)fullRowBytes;
-            image->alphaPlane = avifAlloc(fullSize);
+            image->alphaPlane = avifImageAllocatePlane(image, fullSize);
             if (!image->alphaPlane) {
                 return AVIF_RESULT_OUT_OF_MEMORY;
             }
@@ -342,9 +374,9 @@ void avifImageFreePlanes(avifImage * image, avifPlanesFlags planes)
 {
     if ((planes & AVIF_PLANES_YUV) && (image->yuvFormat != AVIF_PIXEL_FORMAT_NONE)) {
         if (image->imageOwnsYUVPlanes) {
-            avifFree(image->yuvPlanes[AVIF_CHAN_Y]);
-            avifFree(image->yuvPlanes[AVIF_CHAN_U]);
-            avifFree(image->yuvPlanes[AVIF_CHAN_V]);
+            avifImageReleasePlane(image, image->yuvPlanes[AVIF_CHAN_Y]);
+            avifImageReleasePlane(image, image->yuvPlanes[AVIF_CHAN_U]);
+            avifImageReleasePlane(image, image->yuvPlanes[AVIF_CHAN_V]);
         }
         image->yuvPlanes[AVIF_CHAN_Y] = NULL;
         image->yuvRowBytes[AVIF_CHAN_Y] = 0;
@@ -356,11 +388,12 @@ void avifImageFreePlanes(avifImage * image, avifPlanesFlags planes)
     }
     if (planes & AVIF_PLANES_A) {
         if (image->imageOwnsAlphaPlane) {
-            avifFree(image->alphaPlane);
+            avifImageReleasePlane(image, image->alphaPlane);
         }
         image->alphaPlane = NULL;
         image->alphaRowBytes = 0;
         image->imageOwnsAlphaPlane = AVIF_FALSE;
+        image->alphaRangeKnown = AVIF_FALSE;
     }
 }
 
@@ -368,6 +401,25 @@ void avifImageStealPlanes(avifImage * dstImage, avifImage * srcImage, avifPlanes
 {
     avifImageFreePlanes(dstImage, planes);
 
+    if (dstImage->planeAllocator != srcImage->planeAllocator) {
+        // The planes owned by srcImage can only be released by its allocator. Copy them instead.
+        avifPlanesFlags copiedPlanes = 0;
+        if ((planes & AVIF_PLANES_YUV) && srcImage->imageOwnsYUVPlanes) {
+            copiedPlanes |= AVIF_PLANES_YUV;
+            dstImage->yuvFormat = srcImage->yuvFormat;
+        }
+        if ((planes & AVIF_PLANES_A) && srcImage->imageOwnsAlphaPlane) {
+            copiedPlanes |= AVIF_PLANES_A;
+        }
+        if (copiedPlanes) {
+            if (avifImageCopyPlanes(dstImage, srcImage, copiedPlanes) != AVIF_RESULT_OK) {
+                avifImageFreePlanes(dstImage, copiedPlanes);
+            }
+            avifImageFreePlanes(srcImage, copiedPlanes);
+            planes &= ~copiedPlanes;
+        }
+    }
+
     if (planes & AVIF_PLANES_YUV) {
         dstImage->yuvPlanes[AVIF_CHAN_Y] = srcImage->yuvPlanes[AVIF_CHAN_Y];
         dstImage->yuvRowBytes[AVIF_CHAN_Y] = srcImage->yuvRowBytes[AVIF_CHAN_Y];
@@ -396,6 +448,11 @@ void avifImageStealPlanes(avifImage * dstImage, avifImage * srcImage, avifPlanes
 
         dstImage->imageOwnsAlphaPlane = srcImage->imageOwnsAlphaPlane;
         srcImage->imageOwnsAlphaPlane = AVIF_FALSE;
+
+        dstImage->alphaRangeKnown = srcImage->alphaRangeKnown;
+        dstImage->alphaMin = srcImage->alphaMin;
+        dstImage->alphaMax = srcImage->alphaMax;
+        srcImage->alphaRangeKnown = AVIF_FALSE;
     }
 }
 
@@ -443,6 +500,9 @@ uint32_t avifRGBImagePixelSize(const avifRGBImage * rgb)
     if (rgb->format == AVIF_RGB_FORMAT_RGB_565) {
         return 2;
     }
+    if (rgb->depth == 32) {
+        return avifRGBFormatChannelCount(rgb->format) * 4;
+    }
     return avifRGBFormatChannelCount(rgb->format) * ((rgb->depth > 8) ? 2 : 1);
 }
 
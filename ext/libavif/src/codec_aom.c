@@ -64,6 +64,13 @@ struct avifCodecInternal
     avifPixelFormatInfo formatInfo;
     aom_img_fmt_t aomFormat;
     avifBool monochromeEnabled;
+    // Mid-gray U and V plane given to libaom when monochrome is requested but not enabled. It is
+    // kept across frames and grid cells and only refilled when a larger plane or another depth is
+    // needed.
+    uint8_t * monoUVPlane;
+    uint32_t monoUVRowBytes;
+    uint32_t monoUVHeight;
+    uint32_t monoUVDepth;
     // Whether cfg.rc_end_usage was set with an
     // avifEncoderSetCodecSpecificOption(encoder, "end-usage", value) call.
     avifBool endUsageSet;
@@ -73,6 +80,12 @@ struct avifCodecInternal
     // Whether 'tuning' (of the specified distortion metric) was set with an
     // avifEncoderSetCodecSpecificOption(encoder, "tune", value) call.
     avifBool tuningSet;
+    // The cpu-used value matching avifEncoder.speed, the fastest cpu-used value of the usage libaom
+    // was initialized with, and the cpu-used value currently set. The latter is raised to the
+    // fastest value while AVIF_ENCODER_CHANGE_DEADLINE_PASSED is set.
+    int cpuUsed;
+    int fastestCpuUsed;
+    int currentCpuUsed;
 #endif
 };
 
@@ -88,6 +101,7 @@ static void aomCodecDestroyInternal(avifCodec * codec)
     if (codec->internal->encoderInitialized) {
         aom_codec_destroy(&codec->internal->encoder);
     }
+    avifFree(codec->internal->monoUVPlane);
 #endif
 
     avifFree(codec->internal);
@@ -425,6 +439,20 @@ static const struct aomOptionDef aomOptionDefs[] = {
     { "film-grain-test", AV1E_SET_FILM_GRAIN_TEST_VECTOR, AVIF_AOM_OPTION_INT, NULL },
     // Film grain table file
     { "film-grain-table", AV1E_SET_FILM_GRAIN_TABLE, AVIF_AOM_OPTION_STR, NULL },
+    // Quantization matrices and their minimal level
+    { "enable-qm", AV1E_SET_ENABLE_QM, AVIF_AOM_OPTION_UINT, NULL },
+    { "qm-min", AV1E_SET_QM_MIN, AVIF_AOM_OPTION_UINT, NULL },
+    // Coding tools searched by the encoder, mostly used to trade compression for encoding speed
+    { "enable-restoration", AV1E_SET_ENABLE_RESTORATION, AVIF_AOM_OPTION_UINT, NULL },
+    { "enable-tx64", AV1E_SET_ENABLE_TX64, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-rect-partitions", AV1E_SET_ENABLE_RECT_PARTITIONS, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-ab-partitions", AV1E_SET_ENABLE_AB_PARTITIONS, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-1to4-partitions", AV1E_SET_ENABLE_1TO4_PARTITIONS, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-filter-intra", AV1E_SET_ENABLE_FILTER_INTRA, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-smooth-intra", AV1E_SET_ENABLE_SMOOTH_INTRA, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-paeth-intra", AV1E_SET_ENABLE_PAETH_INTRA, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-angle-delta", AV1E_SET_ENABLE_ANGLE_DELTA, AVIF_AOM_OPTION_INT, NULL },
+    { "enable-intrabc", AV1E_SET_ENABLE_INTRABC, AVIF_AOM_OPTION_INT, NULL },
 
     // Sentinel
     { NULL, 0, AVIF_AOM_OPTION_NUL, NULL }
@@ -523,6 +551,22 @@ static avifBool avifProcessAOMOptionsPostInit(avifCodec * codec, avifBool alpha)
 
 static avifBool aomCodecEncodeFinish(avifCodec * codec, avifCodecEncodeOutput * output);
 
+// Sets all samples of a chroma plane to 0.5.
+static void avifFillMonoUVPlane(uint8_t * plane, int stride, uint32_t width, uint32_t height, uint32_t depth)
+{
+    if (depth > 8) {
+        const uint16_t half = (uint16_t)(1 << (depth - 1));
+        for (uint32_t j = 0; j < height; ++j) {
+            uint16_t * dstRow = (uint16_t *)&plane[(size_t)j * stride];
+            for (uint32_t i = 0; i < width; ++i) {
+                dstRow[i] = half;
+            }
+        }
+    } else {
+        memset(plane, 128, (size_t)height * stride);
+    }
+}
+
 static avifResult aomCodecEncodeImage(avifCodec * codec,
                                       avifEncoder * encoder,
                                       const avifImage * image,
@@ -536,6 +580,26 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
     struct aom_codec_enc_cfg * cfg = &codec->internal->cfg;
     avifBool quantizerUpdated = AVIF_FALSE;
 
+    if (codec->internal->encoderInitialized && codec->reusable) {
+        // The instance was kept after the flush of the previous single image. It can encode another
+        // single image of the same dimensions and format, unless an option only applied at setup
+        // is given.
+        codec->reusable = AVIF_FALSE;
+        avifBool preInitOption = AVIF_FALSE;
+        for (uint32_t i = 0; i < codec->csOptions->count; ++i) {
+            if (avifKeyEqualsName(codec->csOptions->entries[i].key, "end-usage", alpha)) {
+                preInitOption = AVIF_TRUE;
+            }
+        }
+        if (preInitOption || !(addImageFlags & AVIF_ADD_IMAGE_FLAG_SINGLE) || (cfg->g_w != image->width) ||
+            (cfg->g_h != image->height) || (cfg->g_bit_depth != image->depth) ||
+            (codec->internal->aomFormat != avifImageCalcAOMFmt(image, alpha)) ||
+            (!alpha && (codec->internal->formatInfo.monochrome != (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV400)))) {
+            aom_codec_destroy(&codec->internal->encoder);
+            codec->internal->encoderInitialized = AVIF_FALSE;
+        }
+    }
+
     if (!codec->internal->encoderInitialized) {
         // Map encoder speed to AOM usage + CpuUsed:
         // Speed  0: GoodQuality CpuUsed 0
@@ -594,6 +658,25 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
             }
         }
 
+        // Speeds 7 to 9 are only available in realtime mode, or in all intra mode with recent
+        // versions of libaom, and the usage cannot change once libaom is initialized.
+        int fastestCpuUsed = 6;
+        if (aomUsage == AOM_USAGE_REALTIME) {
+            fastestCpuUsed = 9;
+        }
+#if defined(AOM_USAGE_ALL_INTRA) && defined(ALL_INTRA_HAS_SPEEDS_7_TO_9)
+        if (aomUsage == AOM_USAGE_ALL_INTRA) {
+            fastestCpuUsed = 9;
+        }
+#endif
+        if ((aomVersion < aomVersion_2_0_0) && (image->depth > 8)) {
+            fastestCpuUsed = 6;
+        }
+        // libaom defaults to cpu-used 0 in good quality and all intra modes.
+        codec->internal->cpuUsed = (aomCpuUsed == -1) ? 0 : aomCpuUsed;
+        codec->internal->fastestCpuUsed = AVIF_MAX(codec->internal->cpuUsed, fastestCpuUsed);
+        codec->internal->currentCpuUsed = codec->internal->cpuUsed;
+
         codec->internal->aomFormat = avifImageCalcAOMFmt(image, alpha);
         if (codec->internal->aomFormat == AOM_IMG_FMT_NONE) {
             return AVIF_RESULT_UNKNOWN_ERROR;
@@ -805,6 +888,15 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
         }
     }
 
+    const int cpuUsed = (encoderChanges & AVIF_ENCODER_CHANGE_DEADLINE_PASSED) ? codec->internal->fastestCpuUsed
+                                                                                : codec->internal->cpuUsed;
+    if (cpuUsed != codec->internal->currentCpuUsed) {
+        if (aom_codec_control(&codec->internal->encoder, AOME_SET_CPUUSED, cpuUsed) != AOM_CODEC_OK) {
+            return AVIF_RESULT_UNKNOWN_ERROR;
+        }
+        codec->internal->currentCpuUsed = cpuUsed;
+    }
+
 #if defined(AOM_USAGE_ALL_INTRA)
     if (quantizerUpdated && cfg->g_usage == AOM_USAGE_ALL_INTRA && !codec->internal->endUsageSet && !codec->internal->cqLevelSet) {
         // The default rc_end_usage in all intra mode is AOM_Q, which requires cq-level to
@@ -926,7 +1018,6 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
         aom_codec_control(&codec->internal->encoder, AV1E_SET_CHROMA_SAMPLE_POSITION, aomImage.csp);
     }
 
-    unsigned char * monoUVPlane = NULL;
     if (monochromeRequested && !codec->internal->monochromeEnabled) {
         // The user requested monochrome (via alpha or YUV400) but libaom cannot currently support
         // monochrome (see chroma_check comment above). Manually set UV planes to 0.5.
@@ -935,29 +1026,24 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
         uint32_t monoUVWidth = (image->width + 1) >> 1;
         uint32_t monoUVHeight = (image->height + 1) >> 1;
 
-        // Allocate the U plane if necessary.
-        if (!aomImageAllocated) {
+        if (aomImageAllocated) {
+            // Set the U plane allocated by aom_img_alloc() to 0.5.
+            avifFillMonoUVPlane(aomImage.planes[1], aomImage.stride[1], monoUVWidth, monoUVHeight, image->depth);
+        } else {
+            // Reuse the cached U plane if it is large enough, otherwise replace it.
             uint32_t channelSize = avifImageUsesU16(image) ? 2 : 1;
             uint32_t monoUVRowBytes = channelSize * monoUVWidth;
-            size_t monoUVSize = (size_t)monoUVHeight * monoUVRowBytes;
-
-            monoUVPlane = avifAlloc(monoUVSize);
-            aomImage.planes[1] = monoUVPlane;
-            aomImage.stride[1] = monoUVRowBytes;
-        }
-        // Set the U plane to 0.5.
-        if (image->depth > 8) {
-            const uint16_t half = 1 << (image->depth - 1);
-            for (uint32_t j = 0; j < monoUVHeight; ++j) {
-                uint16_t * dstRow = (uint16_t *)&aomImage.planes[1][(size_t)j * aomImage.stride[1]];
-                for (uint32_t i = 0; i < monoUVWidth; ++i) {
-                    dstRow[i] = half;
-                }
+            if (!codec->internal->monoUVPlane || (codec->internal->monoUVDepth != image->depth) ||
+                (codec->internal->monoUVRowBytes < monoUVRowBytes) || (codec->internal->monoUVHeight < monoUVHeight)) {
+                avifFree(codec->internal->monoUVPlane);
+                codec->internal->monoUVPlane = avifAlloc((size_t)monoUVHeight * monoUVRowBytes);
+                codec->internal->monoUVRowBytes = monoUVRowBytes;
+                codec->internal->monoUVHeight = monoUVHeight;
+                codec->internal->monoUVDepth = image->depth;
+                avifFillMonoUVPlane(codec->internal->monoUVPlane, monoUVRowBytes, monoUVWidth, monoUVHeight, image->depth);
             }
-        } else {
-            const uint8_t half = 128;
-            size_t planeSize = (size_t)monoUVHeight * aomImage.stride[1];
-            memset(aomImage.planes[1], half, planeSize);
+            aomImage.planes[1] = codec->internal->monoUVPlane;
+            aomImage.stride[1] = (int)codec->internal->monoUVRowBytes;
         }
         // Make the V plane the same as the U plane.
         aomImage.planes[2] = aomImage.planes[1];
@@ -969,7 +1055,6 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
         encodeFlags |= AOM_EFLAG_FORCE_KF;
     }
     aom_codec_err_t encodeErr = aom_codec_encode(&codec->internal->encoder, &aomImage, 0, 1, encodeFlags);
-    avifFree(monoUVPlane);
     if (aomImageAllocated) {
         aom_img_free(&aomImage);
     }
@@ -998,6 +1083,14 @@ static avifResult aomCodecEncodeImage(avifCodec * codec,
         if (!aomCodecEncodeFinish(codec, output)) {
             return AVIF_RESULT_UNKNOWN_ERROR;
         }
+#if defined(AOM_USAGE_ALL_INTRA)
+        if (codec->keepAfterFlush && (cfg->g_usage == AOM_USAGE_ALL_INTRA)) {
+            // In all intra mode without lag, libaom accepts another frame after the flush and codes
+            // it as a new key frame, so the instance can encode the next single image.
+            codec->reusable = AVIF_TRUE;
+            return AVIF_RESULT_OK;
+        }
+#endif
         aom_codec_destroy(&codec->internal->encoder);
         codec->internal->encoderInitialized = AVIF_FALSE;
     }
@@ -3,6 +3,7 @@
 
 #include "avif/internal.h"
 
+#include <assert.h>
 #include <limits.h>
 #include <stdio.h>
 #include <string.h>
@@ -155,3 +156,339 @@ avifIO * avifIOCreateFileReader(const char * filename)
     avifRWDataRealloc(&reader->buffer, 1024);
     return (avifIO *)reader;
 }
+
+// --------------------------------------------------------------------------------------
+// avifIOPrefetchReader
+
+#if defined(AVIF_PTHREADS_ENABLED)
+
+#include <pthread.h>
+
+typedef enum avifPrefetchBlockState
+{
+    AVIF_PREFETCH_BLOCK_PENDING = 0, // waiting for the read-ahead thread
+    AVIF_PREFETCH_BLOCK_LOADING,     // being read by the read-ahead thread
+    AVIF_PREFETCH_BLOCK_READY,       // data holds the bytes read
+    AVIF_PREFETCH_BLOCK_FAILED       // the underlying read failed, read again synchronously
+} avifPrefetchBlockState;
+
+typedef struct avifPrefetchBlock
+{
+    uint64_t offset;
+    size_t size;
+    avifRWData data;
+    avifPrefetchBlockState state;
+    avifBool discard; // dropped while LOADING, freed by the read-ahead thread
+} avifPrefetchBlock;
+AVIF_ARRAY_DECLARE(avifPrefetchBlockArray, avifPrefetchBlock, block);
+AVIF_ARRAY_DECLARE(avifPrefetchOffsetArray, uint64_t, offset);
+
+typedef struct avifIOPrefetchReader
+{
+    avifIO io; // this must be the first member for easy casting to avifIO*
+    avifIO * underlyingIO;
+    size_t byteBudget;
+
+    // Guards everything below. The underlying avifIO is only accessed with ioMutex held, so that
+    // synchronous reads and the read-ahead thread do not interfere.
+    pthread_mutex_t mutex;
+    pthread_mutex_t ioMutex;
+    pthread_cond_t cond;
+    pthread_t thread;
+    avifBool threadStarted;
+    avifBool quit;
+
+    avifPrefetchBlockArray blocks;   // sorted by offset, looked up by binary search
+    size_t blockBytes;               // sum of the sizes of blocks
+    avifPrefetchOffsetArray pending; // offsets of the blocks in declaration order, read ahead from pendingHead
+    uint32_t pendingHead;
+
+    avifRWData buffer; // returned by the last call to read()
+} avifIOPrefetchReader;
+
+// Returns the index of the first block whose offset is not below offset, or blocks->count.
+static uint32_t avifPrefetchBlockLowerBound(const avifPrefetchBlockArray * blocks, uint64_t offset)
+{
+    uint32_t low = 0;
+    uint32_t high = blocks->count;
+    while (low < high) {
+        const uint32_t middle = low + (high - low) / 2;
+        if (blocks->block[middle].offset < offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Returns the block starting at offset, if any.
+static avifPrefetchBlock * avifPrefetchBlockAt(avifPrefetchBlockArray * blocks, uint64_t offset, uint32_t * blockIndex)
+{
+    const uint32_t i = avifPrefetchBlockLowerBound(blocks, offset);
+    if ((i == blocks->count) || (blocks->block[i].offset != offset)) {
+        return NULL;
+    }
+    *blockIndex = i;
+    return &blocks->block[i];
+}
+
+// Returns the block containing [offset:offset+size[, if any. Blocks are samples, which do not
+// overlap, so only the last block starting at or before offset can contain it.
+static avifPrefetchBlock * avifPrefetchBlockFind(avifPrefetchBlockArray * blocks, uint64_t offset, size_t size, uint32_t * blockIndex)
+{
+    uint32_t i = avifPrefetchBlockLowerBound(blocks, offset);
+    if ((i == blocks->count) || (blocks->block[i].offset != offset)) {
+        if (i == 0) {
+            return NULL;
+        }
+        --i;
+    }
+    avifPrefetchBlock * block = &blocks->block[i];
+    if ((offset - block->offset) > block->size || (size > block->size - (offset - block->offset))) {
+        return NULL;
+    }
+    *blockIndex = i;
+    return block;
+}
+
+static void avifPrefetchBlockRemove(avifIOPrefetchReader * reader, uint32_t blockIndex)
+{
+    avifPrefetchBlockArray * blocks = &reader->blocks;
+    avifRWDataFree(&blocks->block[blockIndex].data);
+    reader->blockBytes -= blocks->block[blockIndex].size;
+    memmove(&blocks->block[blockIndex], &blocks->block[blockIndex + 1], (blocks->count - blockIndex - 1) * sizeof(avifPrefetchBlock));
+    avifArrayPop(blocks);
+}
+
+static void * avifIOPrefetchReaderThread(void * arg)
+{
+    avifIOPrefetchReader * reader = (avifIOPrefetchReader *)arg;
+    pthread_mutex_lock(&reader->mutex);
+    while (!reader->quit) {
+        if (reader->pendingHead == reader->pending.count) {
+            reader->pendingHead = 0;
+            reader->pending.count = 0;
+            pthread_cond_wait(&reader->cond, &reader->mutex);
+            continue;
+        }
+        const uint64_t offset = reader->pending.offset[reader->pendingHead++];
+        uint32_t blockIndex;
+        avifPrefetchBlock * next = avifPrefetchBlockAt(&reader->blocks, offset, &blockIndex);
+        if (!next || (next->state != AVIF_PREFETCH_BLOCK_PENDING)) {
+            // Already read synchronously, discarded, or declared twice.
+            continue;
+        }
+        next->state = AVIF_PREFETCH_BLOCK_LOADING;
+        const size_t size = next->size;
+        pthread_mutex_unlock(&reader->mutex);
+
+        // The block may move in the array while the mutex is released, so the data is read into a
+        // local buffer and the block is looked up again afterwards.
+        avifRWData data = AVIF_DATA_EMPTY;
+        pthread_mutex_lock(&reader->ioMutex);
+        avifROData contents;
+        const avifResult result = reader->underlyingIO->read(reader->underlyingIO, 0, offset, size, &contents);
+        if (result == AVIF_RESULT_OK) {
+            avifRWDataSet(&data, contents.data, contents.size);
+        }
+        pthread_mutex_unlock(&reader->ioMutex);
+
+        pthread_mutex_lock(&reader->mutex);
+        // A LOADING block is neither removed nor replaced by the other functions.
+        avifPrefetchBlock * block = avifPrefetchBlockAt(&reader->blocks, offset, &blockIndex);
+        assert(block && (block->state == AVIF_PREFETCH_BLOCK_LOADING));
+        if (block->discard) {
+            avifPrefetchBlockRemove(reader, blockIndex);
+        } else {
+            block->data = data;
+            data.data = NULL;
+            block->state = (result == AVIF_RESULT_OK) ? AVIF_PREFETCH_BLOCK_READY : AVIF_PREFETCH_BLOCK_FAILED;
+        }
+        avifRWDataFree(&data);
+        pthread_cond_broadcast(&reader->cond);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+    return NULL;
+}
+
+static avifResult avifIOPrefetchReaderRead(struct avifIO * io, uint32_t readFlags, uint64_t offset, size_t size, avifROData * out)
+{
+    if (readFlags != 0) {
+        // Unsupported readFlags
+        return AVIF_RESULT_IO_ERROR;
+    }
+
+    avifIOPrefetchReader * reader = (avifIOPrefetchReader *)io;
+    pthread_mutex_lock(&reader->mutex);
+    uint32_t blockIndex;
+    avifPrefetchBlock * block;
+    while ((block = avifPrefetchBlockFind(&reader->blocks, offset, size, &blockIndex)) != NULL &&
+           (block->state == AVIF_PREFETCH_BLOCK_LOADING)) {
+        pthread_cond_wait(&reader->cond, &reader->mutex);
+    }
+    if (block && (block->state == AVIF_PREFETCH_BLOCK_READY)) {
+        const size_t start = (size_t)(offset - block->offset);
+        if ((start == 0) && (size == block->size)) {
+            // Consumed entirely: take the bytes without copying them.
+            avifRWDataFree(&reader->buffer);
+            reader->buffer = block->data;
+            block->data.data = NULL;
+            block->data.size = 0;
+            avifPrefetchBlockRemove(reader, blockIndex);
+        } else {
+            const size_t available = (block->data.size > start) ? (block->data.size - start) : 0;
+            avifRWDataSet(&reader->buffer, block->data.data + start, AVIF_MIN(size, available));
+            if (size == block->size - start) {
+                // Read up to its end: the block will not be needed again.
+                avifPrefetchBlockRemove(reader, blockIndex);
+            }
+        }
+        pthread_mutex_unlock(&reader->mutex);
+        out->data = reader->buffer.data;
+        out->size = reader->buffer.size;
+        return AVIF_RESULT_OK;
+    }
+    if (block) {
+        // Not read ahead yet, or the read failed: read it synchronously below.
+        avifPrefetchBlockRemove(reader, blockIndex);
+    }
+    pthread_mutex_unlock(&reader->mutex);
+
+    pthread_mutex_lock(&reader->ioMutex);
+    avifROData contents;
+    const avifResult result = reader->underlyingIO->read(reader->underlyingIO, 0, offset, size, &contents);
+    if (result == AVIF_RESULT_OK) {
+        avifRWDataSet(&reader->buffer, contents.data, contents.size);
+    }
+    pthread_mutex_unlock(&reader->ioMutex);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+    out->data = reader->buffer.data;
+    out->size = reader->buffer.size;
+    return AVIF_RESULT_OK;
+}
+
+static void avifIOPrefetchReaderDestroy(struct avifIO * io)
+{
+    avifIOPrefetchReader * reader = (avifIOPrefetchReader *)io;
+    if (reader->threadStarted) {
+        pthread_mutex_lock(&reader->mutex);
+        reader->quit = AVIF_TRUE;
+        pthread_cond_broadcast(&reader->cond);
+        pthread_mutex_unlock(&reader->mutex);
+        pthread_join(reader->thread, NULL);
+    }
+    for (uint32_t i = 0; i < reader->blocks.count; ++i) {
+        avifRWDataFree(&reader->blocks.block[i].data);
+    }
+    avifArrayDestroy(&reader->blocks);
+    avifArrayDestroy(&reader->pending);
+    avifRWDataFree(&reader->buffer);
+    pthread_cond_destroy(&reader->cond);
+    pthread_mutex_destroy(&reader->ioMutex);
+    pthread_mutex_destroy(&reader->mutex);
+    avifIODestroy(reader->underlyingIO);
+    avifFree(io);
+}
+
+static avifBool avifIOPrefetchReaderDeclare(avifIOPrefetchReader * reader, uint64_t offset, size_t size)
+{
+    pthread_mutex_lock(&reader->mutex);
+    const uint32_t i = avifPrefetchBlockLowerBound(&reader->blocks, offset);
+    if ((i < reader->blocks.count) && (reader->blocks.block[i].offset == offset)) {
+        // Declared already, maybe discarded since then but still being read.
+        reader->blocks.block[i].discard = AVIF_FALSE;
+        pthread_mutex_unlock(&reader->mutex);
+        return AVIF_TRUE;
+    }
+    if (size > reader->byteBudget - reader->blockBytes) {
+        pthread_mutex_unlock(&reader->mutex);
+        return AVIF_FALSE;
+    }
+    avifArrayPushPtr(&reader->blocks);
+    memmove(&reader->blocks.block[i + 1], &reader->blocks.block[i], (reader->blocks.count - i - 1) * sizeof(avifPrefetchBlock));
+    avifPrefetchBlock * block = &reader->blocks.block[i];
+    memset(block, 0, sizeof(avifPrefetchBlock));
+    block->offset = offset;
+    block->size = size;
+    block->state = AVIF_PREFETCH_BLOCK_PENDING;
+    reader->blockBytes += size;
+    avifArrayPush(&reader->pending, &offset);
+    if (!reader->threadStarted) {
+        reader->threadStarted = (pthread_create(&reader->thread, NULL, avifIOPrefetchReaderThread, reader) == 0);
+    }
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->mutex);
+    return AVIF_TRUE;
+}
+
+static void avifIOPrefetchReaderDiscard(avifIOPrefetchReader * reader)
+{
+    pthread_mutex_lock(&reader->mutex);
+    reader->pendingHead = 0;
+    reader->pending.count = 0;
+    uint32_t i = 0;
+    while (i < reader->blocks.count) {
+        avifPrefetchBlock * block = &reader->blocks.block[i];
+        if (block->state == AVIF_PREFETCH_BLOCK_LOADING) {
+            block->discard = AVIF_TRUE;
+            ++i;
+        } else {
+            avifPrefetchBlockRemove(reader, i);
+        }
+    }
+    pthread_mutex_unlock(&reader->mutex);
+}
+
+#endif // defined(AVIF_PTHREADS_ENABLED)
+
+avifIO * avifIOCreatePrefetchReader(avifIO * underlyingIO, size_t byteBudget)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    avifIOPrefetchReader * reader = avifAlloc(sizeof(avifIOPrefetchReader));
+    memset(reader, 0, sizeof(avifIOPrefetchReader));
+    reader->io.destroy = avifIOPrefetchReaderDestroy;
+    reader->io.read = avifIOPrefetchReaderRead;
+    reader->io.sizeHint = underlyingIO->sizeHint;
+    reader->io.persistent = AVIF_FALSE;
+    reader->underlyingIO = underlyingIO;
+    reader->byteBudget = byteBudget;
+    pthread_mutex_init(&reader->mutex, NULL);
+    pthread_mutex_init(&reader->ioMutex, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    avifArrayCreate(&reader->blocks, sizeof(avifPrefetchBlock), 16);
+    avifArrayCreate(&reader->pending, sizeof(uint64_t), 16);
+    return (avifIO *)reader;
+#else
+    (void)underlyingIO;
+    (void)byteBudget;
+    return NULL;
+#endif
+}
+
+avifBool avifIOPrefetch(avifIO * io, uint64_t offset, size_t size)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    if (io && (io->read == avifIOPrefetchReaderRead)) {
+        return avifIOPrefetchReaderDeclare((avifIOPrefetchReader *)io, offset, size);
+    }
+#else
+    (void)io;
+    (void)offset;
+    (void)size;
+#endif
+    return AVIF_FALSE;
+}
+
+void avifIOPrefetchDiscard(avifIO * io)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    if (io && (io->read == avifIOPrefetchReaderRead)) {
+        avifIOPrefetchReaderDiscard((avifIOPrefetchReader *)io);
+    }
+#else
+    (void)io;
+#endif
+}
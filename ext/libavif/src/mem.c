@@ -1,9 +1,15 @@
 // Copyright 2019 Joe Drago. All rights reserved.
 // SPDX-License-Identifier: BSD-2-Clause
 
-#include "avif/avif.h"
+#include "avif/internal.h"
 
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(AVIF_PTHREADS_ENABLED)
+#include <pthread.h>
+#endif
 
 void * avifAlloc(size_t size)
 {
@@ -18,3 +24,231 @@ void avifFree(void * p)
 {
     free(p);
 }
+
+// --------------------------------------------------------------------------------------
+// avifPlaneAllocator
+
+void avifPlaneAllocatorDestroy(avifPlaneAllocator * allocator)
+{
+    if (allocator && allocator->destroy) {
+        allocator->destroy(allocator);
+    }
+}
+
+void avifPlaneAllocatorGetStats(avifPlaneAllocator * allocator, avifPlaneAllocatorStats * stats)
+{
+    memset(stats, 0, sizeof(avifPlaneAllocatorStats));
+    if (allocator && allocator->getStats) {
+        allocator->getStats(allocator, stats);
+    }
+}
+
+// --------------------------------------------------------------------------------------
+// avifPlanePool
+
+#define AVIF_PLANE_POOL_ALIGNMENT 64
+
+typedef struct avifPlanePoolKey
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+    avifPixelFormat yuvFormat;
+    size_t size;
+} avifPlanePoolKey;
+
+// Stored right before each plane handed out by the pool.
+typedef struct avifPlanePoolHeader
+{
+    void * allocation; // the block returned by avifAlloc(), which starts at or before this header
+    avifPlanePoolKey key;
+    struct avifPlanePoolHeader * next; // in the free list of its bucket
+} avifPlanePoolHeader;
+
+// The released planes of one key, most recently released first.
+typedef struct avifPlanePoolBucket
+{
+    avifPlanePoolKey key;
+    avifPlanePoolHeader * freePlanes;
+} avifPlanePoolBucket;
+AVIF_ARRAY_DECLARE(avifPlanePoolBucketArray, avifPlanePoolBucket, bucket);
+
+typedef struct avifPlanePool
+{
+    avifPlaneAllocator allocator; // this must be the first member for easy casting to avifPlaneAllocator*
+    size_t maxPooledBytes;
+    avifPlanePoolBucketArray buckets;
+    avifPlaneAllocatorStats stats;
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_t mutex; // guards buckets and stats
+#endif
+} avifPlanePool;
+
+static void avifPlanePoolLock(avifPlanePool * pool)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_lock(&pool->mutex);
+#else
+    (void)pool;
+#endif
+}
+
+static void avifPlanePoolUnlock(avifPlanePool * pool)
+{
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_unlock(&pool->mutex);
+#else
+    (void)pool;
+#endif
+}
+
+static avifBool avifPlanePoolKeyEquals(const avifPlanePoolKey * a, const avifPlanePoolKey * b)
+{
+    return (a->width == b->width) && (a->height == b->height) && (a->depth == b->depth) && (a->yuvFormat == b->yuvFormat) &&
+           (a->size == b->size);
+}
+
+// Returns the bucket of key, or NULL if there is none.
+static avifPlanePoolBucket * avifPlanePoolFindBucket(avifPlanePool * pool, const avifPlanePoolKey * key)
+{
+    for (uint32_t i = 0; i < pool->buckets.count; ++i) {
+        if (avifPlanePoolKeyEquals(&pool->buckets.bucket[i].key, key)) {
+            return &pool->buckets.bucket[i];
+        }
+    }
+    return NULL;
+}
+
+// Frees the most recently released plane of bucket. The pool must be locked.
+static void avifPlanePoolFreeOne(avifPlanePool * pool, avifPlanePoolBucket * bucket)
+{
+    avifPlanePoolHeader * header = bucket->freePlanes;
+    bucket->freePlanes = header->next;
+    pool->stats.bytesPooled -= header->key.size;
+    avifFree(header->allocation);
+}
+
+static void * avifPlanePoolAllocate(avifPlaneAllocator * allocator, const avifImage * image, size_t size)
+{
+    avifPlanePool * pool = (avifPlanePool *)allocator;
+    // Room for the header and the alignment padding in front of the plane.
+    const size_t headerSize = sizeof(avifPlanePoolHeader) + AVIF_PLANE_POOL_ALIGNMENT - 1;
+    if (size > SIZE_MAX - headerSize) {
+        return NULL;
+    }
+    avifPlanePoolKey key;
+    key.width = image->width;
+    key.height = image->height;
+    key.depth = image->depth;
+    key.yuvFormat = image->yuvFormat;
+    key.size = size;
+
+    avifPlanePoolLock(pool);
+    ++pool->stats.allocationCount;
+    pool->stats.bytesInUse += size;
+    avifPlanePoolBucket * bucket = avifPlanePoolFindBucket(pool, &key);
+    if (bucket && bucket->freePlanes) {
+        avifPlanePoolHeader * header = bucket->freePlanes;
+        bucket->freePlanes = header->next;
+        pool->stats.bytesPooled -= size;
+        ++pool->stats.reuseCount;
+        avifPlanePoolUnlock(pool);
+        return (uint8_t *)header + sizeof(avifPlanePoolHeader);
+    }
+    ++pool->stats.systemAllocationCount;
+    pool->stats.systemAllocatedBytes += headerSize + size;
+    pool->stats.peakBytes = AVIF_MAX(pool->stats.peakBytes, pool->stats.bytesInUse + pool->stats.bytesPooled);
+    avifPlanePoolUnlock(pool);
+
+    uint8_t * allocation = avifAlloc(headerSize + size);
+    const uintptr_t planeAddress = ((uintptr_t)allocation + sizeof(avifPlanePoolHeader) + AVIF_PLANE_POOL_ALIGNMENT - 1) &
+                                   ~(uintptr_t)(AVIF_PLANE_POOL_ALIGNMENT - 1);
+    uint8_t * plane = allocation + (planeAddress - (uintptr_t)allocation);
+    avifPlanePoolHeader * header = (avifPlanePoolHeader *)(plane - sizeof(avifPlanePoolHeader));
+    header->allocation = allocation;
+    header->key = key;
+    header->next = NULL;
+    return plane;
+}
+
+static void avifPlanePoolRelease(avifPlaneAllocator * allocator, void * plane)
+{
+    avifPlanePool * pool = (avifPlanePool *)allocator;
+    avifPlanePoolHeader * header = (avifPlanePoolHeader *)((uint8_t *)plane - sizeof(avifPlanePoolHeader));
+    const size_t size = header->key.size;
+
+    avifPlanePoolLock(pool);
+    ++pool->stats.releaseCount;
+    pool->stats.bytesInUse -= size;
+    // Make room by freeing the planes of other kinds of images first, as a sequence usually keeps
+    // the same kind from frame to frame.
+    for (uint32_t i = 0; (i < pool->buckets.count) && (pool->stats.bytesPooled + size > pool->maxPooledBytes); ++i) {
+        avifPlanePoolBucket * other = &pool->buckets.bucket[i];
+        if (avifPlanePoolKeyEquals(&other->key, &header->key)) {
+            continue;
+        }
+        while (other->freePlanes && (pool->stats.bytesPooled + size > pool->maxPooledBytes)) {
+            avifPlanePoolFreeOne(pool, other);
+        }
+    }
+    avifPlanePoolBucket * bucket = NULL;
+    if (pool->stats.bytesPooled + size <= pool->maxPooledBytes) {
+        bucket = avifPlanePoolFindBucket(pool, &header->key);
+        if (!bucket) {
+            bucket = (avifPlanePoolBucket *)avifArrayPushPtr(&pool->buckets);
+            bucket->key = header->key;
+            bucket->freePlanes = NULL;
+        }
+    }
+    if (bucket) {
+        header->next = bucket->freePlanes;
+        bucket->freePlanes = header;
+        pool->stats.bytesPooled += size;
+        avifPlanePoolUnlock(pool);
+    } else {
+        avifPlanePoolUnlock(pool);
+        avifFree(header->allocation);
+    }
+}
+
+static void avifPlanePoolGetStats(avifPlaneAllocator * allocator, avifPlaneAllocatorStats * stats)
+{
+    avifPlanePool * pool = (avifPlanePool *)allocator;
+    avifPlanePoolLock(pool);
+    *stats = pool->stats;
+    avifPlanePoolUnlock(pool);
+}
+
+static void avifPlanePoolDestroy(avifPlaneAllocator * allocator)
+{
+    avifPlanePool * pool = (avifPlanePool *)allocator;
+    for (uint32_t i = 0; i < pool->buckets.count; ++i) {
+        while (pool->buckets.bucket[i].freePlanes) {
+            avifPlanePoolFreeOne(pool, &pool->buckets.bucket[i]);
+        }
+    }
+    avifArrayDestroy(&pool->buckets);
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_destroy(&pool->mutex);
+#endif
+    avifFree(pool);
+}
+
+avifPlaneAllocator * avifPlanePoolCreate(size_t maxPooledBytes)
+{
+    avifPlanePool * pool = (avifPlanePool *)avifAlloc(sizeof(avifPlanePool));
+    memset(pool, 0, sizeof(avifPlanePool));
+    if (!avifArrayCreate(&pool->buckets, sizeof(avifPlanePoolBucket), 4)) {
+        avifFree(pool);
+        return NULL;
+    }
+    pool->maxPooledBytes = maxPooledBytes;
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_mutex_init(&pool->mutex, NULL);
+#endif
+    pool->allocator.allocate = avifPlanePoolAllocate;
+    pool->allocator.release = avifPlanePoolRelease;
+    pool->allocator.destroy = avifPlanePoolDestroy;
+    pool->allocator.getStats = avifPlanePoolGetStats;
+    return (avifPlaneAllocator *)pool;
+}
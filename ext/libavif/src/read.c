@@ -357,6 +357,104 @@ typedef struct avifTrack
 } avifTrack;
 AVIF_ARRAY_DECLARE(avifTrackArray, avifTrack, track);
 
+// ---------------------------------------------------------------------------
+// avifSampleIndex
+
+// Number of samples between two checkpoints of an avifSampleIndex.
+#define AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL 128
+
+// Position of a sample in a track, from which the position of the following ones can be derived.
+typedef struct avifSampleIndexCheckpoint
+{
+    uint64_t offset;       // Offset of the sample in the file
+    uint32_t chunkIndex;   // Index of the chunk containing the sample
+    uint32_t indexInChunk; // Index of the sample in its chunk
+} avifSampleIndexCheckpoint;
+AVIF_ARRAY_DECLARE(avifSampleIndexCheckpointArray, avifSampleIndexCheckpoint, checkpoint);
+
+// Locates the samples of a track from its sample table (chunk offsets, sample-to-chunk and sample
+// sizes) on demand, instead of keeping an avifDecodeSample per sample. Only the position of every
+// AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL-th sample is stored.
+typedef struct avifSampleIndex
+{
+    const avifSampleTable * sampleTable; // Owned by an avifTrack
+    uint32_t sampleCount;
+    avifSampleIndexCheckpointArray checkpoints;
+    avifBool syncSamplesSorted;  // True if sampleTable->syncSamples can be binary-searched
+    uint32_t currentSampleIndex; // Index of the sample held by avifCodecDecodeInput::samples
+} avifSampleIndex;
+
+static uint32_t avifSampleTableGetSampleSize(const avifSampleTable * sampleTable, uint32_t sampleIndex)
+{
+    return sampleTable->allSamplesSize ? sampleTable->allSamplesSize : sampleTable->sampleSizes.sampleSize[sampleIndex].size;
+}
+
+static uint32_t avifGetSampleCountOfChunk(const avifSampleTableSampleToChunkArray * sampleToChunks, uint32_t chunkIndex);
+
+static avifBool avifSampleIndexIsSync(const avifSampleIndex * index, uint32_t sampleIndex)
+{
+    if (sampleIndex == 0) {
+        // Assume frame 0 is sync, just in case the stss box is absent in the BMFF. (Unnecessary?)
+        return AVIF_TRUE;
+    }
+
+    const avifSyncSampleArray * syncSamples = &index->sampleTable->syncSamples;
+    const uint32_t sampleNumber = sampleIndex + 1; // sampleNumber is 1-based
+    if (!index->syncSamplesSorted) {
+        for (uint32_t i = 0; i < syncSamples->count; ++i) {
+            if (syncSamples->syncSample[i].sampleNumber == sampleNumber) {
+                return AVIF_TRUE;
+            }
+        }
+        return AVIF_FALSE;
+    }
+
+    uint32_t lo = 0;
+    uint32_t hi = syncSamples->count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (syncSamples->syncSample[mid].sampleNumber < sampleNumber) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo < syncSamples->count) && (syncSamples->syncSample[lo].sampleNumber == sampleNumber);
+}
+
+// Fills everything but the data of the sample at sampleIndex, walking from the previous checkpoint.
+static void avifSampleIndexLocate(const avifSampleIndex * index, uint32_t sampleIndex, avifDecodeSample * sample)
+{
+    const avifSampleTable * sampleTable = index->sampleTable;
+    const avifSampleIndexCheckpoint * checkpoint = &index->checkpoints.checkpoint[sampleIndex / AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL];
+    uint64_t offset = checkpoint->offset;
+    uint32_t chunkIndex = checkpoint->chunkIndex;
+    uint32_t indexInChunk = checkpoint->indexInChunk;
+    uint32_t chunkSampleCount = avifGetSampleCountOfChunk(&sampleTable->sampleToChunks, chunkIndex);
+    for (uint32_t i = sampleIndex - (sampleIndex % AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL); i < sampleIndex; ++i) {
+        if (++indexInChunk < chunkSampleCount) {
+            offset += avifSampleTableGetSampleSize(sampleTable, i);
+        } else {
+            ++chunkIndex;
+            indexInChunk = 0;
+            offset = sampleTable->chunks.chunk[chunkIndex].offset;
+            chunkSampleCount = avifGetSampleCountOfChunk(&sampleTable->sampleToChunks, chunkIndex);
+        }
+    }
+
+    memset(sample, 0, sizeof(avifDecodeSample));
+    sample->offset = offset;
+    sample->size = avifSampleTableGetSampleSize(sampleTable, sampleIndex);
+    sample->spatialID = AVIF_SPATIAL_ID_UNSET; // Not filtering by spatial_id
+    sample->sync = avifSampleIndexIsSync(index, sampleIndex);
+}
+
+static void avifSampleIndexDestroy(avifSampleIndex * index)
+{
+    avifArrayDestroy(&index->checkpoints);
+    avifFree(index);
+}
+
 // ---------------------------------------------------------------------------
 // avifCodecDecodeInput
 
@@ -383,9 +481,58 @@ void avifCodecDecodeInputDestroy(avifCodecDecodeInput * decodeInput)
         }
     }
     avifArrayDestroy(&decodeInput->samples);
+    if (decodeInput->sampleIndex) {
+        avifSampleIndexDestroy(decodeInput->sampleIndex);
+    }
     avifFree(decodeInput);
 }
 
+static uint32_t avifCodecDecodeInputGetSampleCount(const avifCodecDecodeInput * decodeInput)
+{
+    return decodeInput->sampleIndex ? decodeInput->sampleIndex->sampleCount : decodeInput->samples.count;
+}
+
+static avifBool avifCodecDecodeInputIsSync(const avifCodecDecodeInput * decodeInput, uint32_t sampleIndex)
+{
+    if (decodeInput->sampleIndex) {
+        return avifSampleIndexIsSync(decodeInput->sampleIndex, sampleIndex);
+    }
+    return decodeInput->samples.sample[sampleIndex].sync;
+}
+
+// Returns the sample at sampleIndex, to be read and decoded. A sample located on demand replaces
+// the previously returned one, along with its data.
+static avifDecodeSample * avifCodecDecodeInputGetSample(avifCodecDecodeInput * decodeInput, uint32_t sampleIndex)
+{
+    avifSampleIndex * index = decodeInput->sampleIndex;
+    if (!index) {
+        return &decodeInput->samples.sample[sampleIndex];
+    }
+
+    avifDecodeSample * sample = &decodeInput->samples.sample[0];
+    if (index->currentSampleIndex != sampleIndex) {
+        if (sample->ownsData) {
+            avifRWDataFree((avifRWData *)&sample->data);
+        }
+        avifSampleIndexLocate(index, sampleIndex, sample);
+        index->currentSampleIndex = sampleIndex;
+    }
+    return sample;
+}
+
+// Returns the sample at sampleIndex without changing the sample held by decodeInput. scratch is
+// used as storage for a sample located on demand, without its data.
+static const avifDecodeSample * avifCodecDecodeInputPeekSample(const avifCodecDecodeInput * decodeInput,
+                                                               uint32_t sampleIndex,
+                                                               avifDecodeSample * scratch)
+{
+    if (!decodeInput->sampleIndex) {
+        return &decodeInput->samples.sample[sampleIndex];
+    }
+    avifSampleIndexLocate(decodeInput->sampleIndex, sampleIndex, scratch);
+    return scratch;
+}
+
 // Returns how many samples are in the chunk.
 static uint32_t avifGetSampleCountOfChunk(const avifSampleTableSampleToChunkArray * sampleToChunks, uint32_t chunkIndex)
 {
@@ -428,6 +575,19 @@ static avifBool avifCodecDecodeInputFillFromSampleTable(avifCodecDecodeInput * d
         }
     }
 
+    avifSampleIndex * index = (avifSampleIndex *)avifAlloc(sizeof(avifSampleIndex));
+    memset(index, 0, sizeof(avifSampleIndex));
+    index->sampleTable = sampleTable;
+    index->currentSampleIndex = UINT32_MAX;
+    decodeInput->sampleIndex = index;
+    if (!avifArrayCreate(&index->checkpoints, sizeof(avifSampleIndexCheckpoint), 1)) {
+        return AVIF_FALSE;
+    }
+    // Slot for the sample currently being read or decoded, see avifCodecDecodeInputGetSample().
+    avifDecodeSample * currentSample = (avifDecodeSample *)avifArrayPushPtr(&decodeInput->samples);
+    memset(currentSample, 0, sizeof(avifDecodeSample));
+
+    // Validate the samples and remember the position of one in every AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL.
     uint32_t sampleSizeIndex = 0;
     for (uint32_t chunkIndex = 0; chunkIndex < sampleTable->chunks.count; ++chunkIndex) {
         avifSampleTableChunk * chunk = &sampleTable->chunks.chunk[chunkIndex];
@@ -442,22 +602,28 @@ static avifBool avifCodecDecodeInputFillFromSampleTable(avifCodecDecodeInput * d
 
         uint64_t sampleOffset = chunk->offset;
         for (uint32_t sampleIndex = 0; sampleIndex < sampleCount; ++sampleIndex) {
-            uint32_t sampleSize = sampleTable->allSamplesSize;
+            if ((sampleTable->allSamplesSize == 0) && (sampleSizeIndex >= sampleTable->sampleSizes.count)) {
+                // We've run out of samples to sum
+                avifDiagnosticsPrintf(diag, "Truncated sample table");
+                return AVIF_FALSE;
+            }
+            if (sampleSizeIndex == UINT32_MAX) {
+                avifDiagnosticsPrintf(diag, "Sample table contains too many samples");
+                return AVIF_FALSE;
+            }
+            uint32_t sampleSize = avifSampleTableGetSampleSize(sampleTable, sampleSizeIndex);
             if (sampleSize == 0) {
-                if (sampleSizeIndex >= sampleTable->sampleSizes.count) {
-                    // We've run out of samples to sum
-                    avifDiagnosticsPrintf(diag, "Truncated sample table");
-                    return AVIF_FALSE;
-                }
-                avifSampleTableSampleSize * sampleSizePtr = &sampleTable->sampleSizes.sampleSize[sampleSizeIndex];
-                sampleSize = sampleSizePtr->size;
+                // Every sample must have some data
+                avifDiagnosticsPrintf(diag, "Sample table contains an empty sample");
+                return AVIF_FALSE;
             }
 
-            avifDecodeSample * sample = (avifDecodeSample *)avifArrayPushPtr(&decodeInput->samples);
-            sample->offset = sampleOffset;
-            sample->size = sampleSize;
-            sample->spatialID = AVIF_SPATIAL_ID_UNSET; // Not filtering by spatial_id
-            sample->sync = AVIF_FALSE;                 // to potentially be set to true following the outer loop
+            if ((sampleSizeIndex % AVIF_SAMPLE_INDEX_CHECKPOINT_INTERVAL) == 0) {
+                avifSampleIndexCheckpoint * checkpoint = (avifSampleIndexCheckpoint *)avifArrayPushPtr(&index->checkpoints);
+                checkpoint->offset = sampleOffset;
+                checkpoint->chunkIndex = chunkIndex;
+                checkpoint->indexInChunk = sampleIndex;
+            }
 
             if (sampleSize > UINT64_MAX - sampleOffset) {
                 avifDiagnosticsPrintf(diag,
@@ -475,19 +641,16 @@ static avifBool avifCodecDecodeInputFillFromSampleTable(avifCodecDecodeInput * d
             ++sampleSizeIndex;
         }
     }
+    index->sampleCount = sampleSizeIndex;
 
-    // Mark appropriate samples as sync
-    for (uint32_t syncSampleIndex = 0; syncSampleIndex < sampleTable->syncSamples.count; ++syncSampleIndex) {
-        uint32_t frameIndex = sampleTable->syncSamples.syncSample[syncSampleIndex].sampleNumber - 1; // sampleNumber is 1-based
-        if (frameIndex < decodeInput->samples.count) {
-            decodeInput->samples.sample[frameIndex].sync = AVIF_TRUE;
+    index->syncSamplesSorted = AVIF_TRUE;
+    for (uint32_t syncSampleIndex = 1; syncSampleIndex < sampleTable->syncSamples.count; ++syncSampleIndex) {
+        if (sampleTable->syncSamples.syncSample[syncSampleIndex - 1].sampleNumber >=
+            sampleTable->syncSamples.syncSample[syncSampleIndex].sampleNumber) {
+            index->syncSamplesSorted = AVIF_FALSE;
+            break;
         }
     }
-
-    // Assume frame 0 is sync, just in case the stss box is absent in the BMFF. (Unnecessary?)
-    if (decodeInput->samples.count > 0) {
-        decodeInput->samples.sample[0].sync = AVIF_TRUE;
-    }
     return AVIF_TRUE;
 }
 
@@ -648,6 +811,7 @@ typedef struct avifTile
     uint32_t width;  // Either avifTrack.width or avifDecoderItem.width
     uint32_t height; // Either avifTrack.height or avifDecoderItem.height
     uint8_t operatingPoint;
+    avifBool layered; // True if the avifDecoderItem has an a1lx or lsel property
 } avifTile;
 AVIF_ARRAY_DECLARE(avifTileArray, avifTile, tile);
 
@@ -693,6 +857,12 @@ typedef struct avifMeta
     // AVIF, this should point at an av01 type item containing color planes, and all other items
     // are ignored unless they refer to this item in some way (alpha plane, EXIF/XMP metadata).
     uint32_t primaryItemID;
+
+    // Hash table from item IDs to items, so that avifMetaFindItem() does not scan all the items. Uses
+    // open addressing with linear probing. Each slot holds an index into items plus one, or 0 if
+    // empty. itemIndexTableSize is a power of two, kept above twice the number of items.
+    uint32_t * itemIndexTable;
+    uint32_t itemIndexTableSize;
 } avifMeta;
 
 static void avifMetaDestroy(avifMeta * meta);
@@ -727,18 +897,58 @@ static void avifMetaDestroy(avifMeta * meta)
     avifArrayDestroy(&meta->items);
     avifArrayDestroy(&meta->properties);
     avifRWDataFree(&meta->idat);
+    if (meta->itemIndexTable) {
+        avifFree(meta->itemIndexTable);
+    }
     avifFree(meta);
 }
 
+static uint32_t avifMetaItemIndexSlot(uint32_t itemID, uint32_t tableSize)
+{
+    // Fibonacci hashing; tableSize is a power of two.
+    return (uint32_t)(itemID * 2654435769u) & (tableSize - 1);
+}
+
+// Adds meta->items.item[itemIndex] to meta->itemIndexTable, growing the table if needed.
+static void avifMetaIndexItem(avifMeta * meta, uint32_t itemIndex)
+{
+    if ((uint64_t)meta->items.count * 2 > meta->itemIndexTableSize) {
+        const uint32_t tableSize = meta->itemIndexTableSize ? meta->itemIndexTableSize * 2 : 64;
+        if (meta->itemIndexTable) {
+            avifFree(meta->itemIndexTable);
+        }
+        meta->itemIndexTable = (uint32_t *)avifAlloc(sizeof(uint32_t) * tableSize);
+        memset(meta->itemIndexTable, 0, sizeof(uint32_t) * tableSize);
+        meta->itemIndexTableSize = tableSize;
+        // Rehash all the items but the new one, which is added below.
+        for (uint32_t i = 0; i < meta->items.count; ++i) {
+            if (i != itemIndex) {
+                avifMetaIndexItem(meta, i);
+            }
+        }
+    }
+
+    uint32_t slot = avifMetaItemIndexSlot(meta->items.item[itemIndex].id, meta->itemIndexTableSize);
+    while (meta->itemIndexTable[slot] != 0) {
+        slot = (slot + 1) & (meta->itemIndexTableSize - 1);
+    }
+    meta->itemIndexTable[slot] = itemIndex + 1;
+}
+
 static avifDecoderItem * avifMetaFindItem(avifMeta * meta, uint32_t itemID)
 {
     if (itemID == 0) {
         return NULL;
     }
 
-    for (uint32_t i = 0; i < meta->items.count; ++i) {
-        if (meta->items.item[i].id == itemID) {
-            return &meta->items.item[i];
+    if (meta->itemIndexTableSize) {
+        uint32_t slot = avifMetaItemIndexSlot(itemID, meta->itemIndexTableSize);
+        while (meta->itemIndexTable[slot] != 0) {
+            avifDecoderItem * item = &meta->items.item[meta->itemIndexTable[slot] - 1];
+            if (item->id == itemID) {
+                return item;
+            }
+            slot = (slot + 1) & (meta->itemIndexTableSize - 1);
         }
     }
 
@@ -751,6 +961,7 @@ static avifDecoderItem * avifMetaFindItem(avifMeta * meta, uint32_t itemID)
     }
     item->id = itemID;
     item->meta = meta;
+    avifMetaIndexItem(meta, meta->items.count - 1);
     return item;
 
 error:
@@ -760,6 +971,38 @@ error:
     return NULL;
 }
 
+// The settings an AV1 codec instance was created with. An idle codec instance may only be reused
+// with the exact same settings (see avifDecoder::reuseCodecs).
+typedef struct avifDecoderCodecSettings
+{
+    avifCodecChoice codecChoice;
+    int maxThreads;
+    uint32_t imageSizeLimit;
+    uint8_t operatingPoint;
+} avifDecoderCodecSettings;
+
+typedef struct avifDecoderIdleCodec
+{
+    avifCodec * codec;
+    avifDecoderCodecSettings settings;
+} avifDecoderIdleCodec;
+AVIF_ARRAY_DECLARE(avifDecoderIdleCodecArray, avifDecoderIdleCodec, idleCodec);
+
+// Upper bound of the number of codec instances kept alive for reuse by a single avifDecoder.
+#define AVIF_MAX_IDLE_CODEC_COUNT 4
+
+// A copy of a decoded frame kept for avifDecoderNthImage() (see avifDecoder::frameCacheSize).
+typedef struct avifDecoderCachedFrame
+{
+    uint32_t imageIndex;
+    avifImage * image;
+    uint64_t size;                         // Number of bytes of the planes of image
+    struct avifDecoderCachedFrame * newer; // Next frame in the least recently used order, or NULL
+    struct avifDecoderCachedFrame * older; // Previous frame in the least recently used order, or NULL
+} avifDecoderCachedFrame;
+
+AVIF_ARRAY_DECLARE(avifImageIndexArray, uint32_t, imageIndex);
+
 typedef struct avifDecoderData
 {
     avifMeta * meta; // The root-level meta box
@@ -781,6 +1024,22 @@ typedef struct avifDecoderData
                                                //
     // "The colour information property takes precedence over any colour information in the image
     // bitstream, i.e. if the property is present, colour information in the bitstream shall be ignored."
+
+    avifDecoderCodecSettings codecSettings; // Settings of the codec instances created by the last avifDecoderFlush()
+    avifDecoderIdleCodecArray idleCodecs;   // Codec instances kept for reuse if avifDecoder::reuseCodecs is set
+
+    avifImageIndexArray keyframes;              // Sorted indices of the frames for which avifDecoderIsKeyframe() is true
+    avifBool keyframesIndexed;                  // True once keyframes is built, on the first seek of avifDecoderNthImage()
+    avifDecoderCachedFrame ** cachedFrames;     // Decoded frames kept if avifDecoder::frameCacheSize is set, by image index
+    avifDecoderCachedFrame * oldestCachedFrame; // Least recently decoded or requested frame of cachedFrames
+    avifDecoderCachedFrame * newestCachedFrame; // Most recently decoded or requested frame of cachedFrames
+    uint64_t cachedFramesSize;                  // Sum of the sizes of cachedFrames
+    avifBool imageFromCache;                    // True if avifDecoder's image was copied from cachedFrames.
+    int codecImageIndex;                        // If imageFromCache, the index of the last frame output by the codec.
+    avifPlaneAllocator * planeAllocator;        // Shallow copy of avifDecoder::planeAllocator, used by the tile images
+    uint32_t prefetchFirstImageIndex;           // firstImageIndex of the last avifDecoderPrefetchSamples() call
+    uint32_t prefetchImageIndex;                // Frame and tile of the first sample not declared to the prefetching avifIO
+    unsigned int prefetchTileIndex;
 } avifDecoderData;
 
 static void avifDecoderDataDestroy(avifDecoderData * data);
@@ -796,6 +1055,12 @@ static avifDecoderData * avifDecoderDataCreate()
     if (!avifArrayCreate(&data->tiles, sizeof(avifTile), 8)) {
         goto error;
     }
+    if (!avifArrayCreate(&data->idleCodecs, sizeof(avifDecoderIdleCodec), 2)) {
+        goto error;
+    }
+    if (!avifArrayCreate(&data->keyframes, sizeof(uint32_t), 1)) {
+        goto error;
+    }
     return data;
 
 error:
@@ -803,17 +1068,67 @@ error:
     return NULL;
 }
 
-static void avifDecoderDataResetCodec(avifDecoderData * data)
+// Detaches the codec of the tile at tileIndex. Tiles may share a single codec instance (see
+// avifDecoderFlush()), so the same pointer is also forgotten by all the following tiles. If keepIdle
+// is true, the codec instance is kept in data->idleCodecs for a later avifDecoderDataAcquireCodec()
+// call, otherwise it is destroyed.
+static void avifDecoderDataReleaseTileCodec(avifDecoderData * data, unsigned int tileIndex, avifBool keepIdle)
+{
+    avifCodec * codec = data->tiles.tile[tileIndex].codec;
+    if (!codec) {
+        return;
+    }
+    for (unsigned int i = tileIndex; i < data->tiles.count; ++i) {
+        if (data->tiles.tile[i].codec == codec) {
+            data->tiles.tile[i].codec = NULL;
+        }
+    }
+
+    // Codecs outputting all layers may still hold undelivered frames, so they are never reused.
+    if (keepIdle && !codec->allLayers && (data->idleCodecs.count < AVIF_MAX_IDLE_CODEC_COUNT)) {
+        avifDecoderIdleCodec * idleCodec = (avifDecoderIdleCodec *)avifArrayPushPtr(&data->idleCodecs);
+        idleCodec->codec = codec;
+        idleCodec->settings = data->codecSettings;
+        idleCodec->settings.operatingPoint = codec->operatingPoint;
+        return;
+    }
+    avifCodecDestroy(codec);
+}
+
+static void avifDecoderDataDestroyIdleCodecs(avifDecoderData * data)
+{
+    for (uint32_t i = 0; i < data->idleCodecs.count; ++i) {
+        avifCodecDestroy(data->idleCodecs.idleCodec[i].codec);
+    }
+    data->idleCodecs.count = 0;
+}
+
+static void avifDecoderDataClearFrameCache(avifDecoderData * data)
+{
+    while (data->oldestCachedFrame) {
+        avifDecoderCachedFrame * frame = data->oldestCachedFrame;
+        data->oldestCachedFrame = frame->newer;
+        avifImageDestroy(frame->image);
+        avifFree(frame);
+    }
+    data->newestCachedFrame = NULL;
+    // Sized with avifDecoder::imageCount, which may change after avifDecoderReset().
+    if (data->cachedFrames) {
+        avifFree(data->cachedFrames);
+        data->cachedFrames = NULL;
+    }
+    data->cachedFramesSize = 0;
+    data->imageFromCache = AVIF_FALSE;
+}
+
+static void avifDecoderDataResetCodec(avifDecoderData * data, avifBool keepIdle)
 {
     for (unsigned int i = 0; i < data->tiles.count; ++i) {
         avifTile * tile = &data->tiles.tile[i];
         if (tile->image) {
             avifImageFreePlanes(tile->image, AVIF_PLANES_ALL); // forget any pointers into codec image buffers
         }
-        if (tile->codec) {
-            avifCodecDestroy(tile->codec);
-            tile->codec = NULL;
-        }
+        avifDecoderDataReleaseTileCodec(data, i, keepIdle);
     }
     data->decodedColorTileCount = 0;
     data->decodedAlphaTileCount = 0;
@@ -826,6 +1141,7 @@ static avifTile * avifDecoderDataCreateTile(avifDecoderData * data, uint32_t wid
     if (!tile->image) {
         goto error;
     }
+    tile->image->planeAllocator = data->planeAllocator;
     tile->input = avifCodecDecodeInputCreate();
     if (!tile->input) {
         goto error;
@@ -833,6 +1149,7 @@ static avifTile * avifDecoderDataCreateTile(avifDecoderData * data, uint32_t wid
     tile->width = width;
     tile->height = height;
     tile->operatingPoint = operatingPoint;
+    tile->layered = AVIF_FALSE;
     return tile;
 
 error:
@@ -861,10 +1178,7 @@ static void avifDecoderDataClearTiles(avifDecoderData * data)
             avifCodecDecodeInputDestroy(tile->input);
             tile->input = NULL;
         }
-        if (tile->codec) {
-            avifCodecDestroy(tile->codec);
-            tile->codec = NULL;
-        }
+        avifDecoderDataReleaseTileCodec(data, i, AVIF_FALSE);
         if (tile->image) {
             avifImageDestroy(tile->image);
             tile->image = NULL;
@@ -892,6 +1206,10 @@ static void avifDecoderDataDestroy(avifDecoderData * data)
     avifArrayDestroy(&data->tracks);
     avifDecoderDataClearTiles(data);
     avifArrayDestroy(&data->tiles);
+    avifDecoderDataDestroyIdleCodecs(data);
+    avifArrayDestroy(&data->idleCodecs);
+    avifArrayDestroy(&data->keyframes);
+    avifDecoderDataClearFrameCache(data);
     avifFree(data);
 }
 
@@ -993,6 +1311,11 @@ static uint8_t avifDecoderItemOperatingPoint(const avifDecoderItem * item)
     return 0; // default
 }
 
+static avifBool avifDecoderItemIsLayered(const avifDecoderItem * item)
+{
+    return avifPropertyArrayFind(&item->properties, "a1lx") || avifPropertyArrayFind(&item->properties, "lsel");
+}
+
 static avifResult avifDecoderItemValidateAV1(const avifDecoderItem * item, avifDiagnostics * diag, const avifStrictFlags strictFlags)
 {
     const avifProperty * av1CProp = avifPropertyArrayFind(&item->properties, "av1C");
@@ -1241,6 +1564,7 @@ static avifBool avifDecoderGenerateImageGridTiles(avifDecoder * decoder, avifIma
             if (!tile) {
                 return AVIF_FALSE;
             }
+            tile->layered = avifDecoderItemIsLayered(item);
             if (!avifCodecDecodeInputFillFromDecoderItem(tile->input,
                                                          item,
                                                          decoder->allowProgressive,
@@ -3077,11 +3401,12 @@ avifResult avifDecoderNthImageMaxExtent(const avifDecoder * decoder, uint32_t fr
     for (uint32_t currentFrameIndex = startFrameIndex; currentFrameIndex <= endFrameIndex; ++currentFrameIndex) {
         for (unsigned int tileIndex = 0; tileIndex < decoder->data->tiles.count; ++tileIndex) {
             avifTile * tile = &decoder->data->tiles.tile[tileIndex];
-            if (currentFrameIndex >= tile->input->samples.count) {
+            if (currentFrameIndex >= avifCodecDecodeInputGetSampleCount(tile->input)) {
                 return AVIF_RESULT_NO_IMAGES_REMAINING;
             }
 
-            avifDecodeSample * sample = &tile->input->samples.sample[currentFrameIndex];
+            avifDecodeSample scratch;
+            const avifDecodeSample * sample = avifCodecDecodeInputPeekSample(tile->input, currentFrameIndex, &scratch);
             avifExtent sampleExtent;
             if (sample->itemID) {
                 // The data comes from an item. Let avifDecoderItemMaxExtent() do the heavy lifting.
@@ -3167,7 +3492,11 @@ static avifResult avifDecoderPrepareSample(avifDecoder * decoder, avifDecodeSamp
     return AVIF_RESULT_OK;
 }
 
-avifResult avifDecoderParse(avifDecoder * decoder)
+static avifResult avifDecoderResetInternal(avifDecoder * decoder, avifBool createCodecs);
+
+// Parses the container and sets up the tiles. Codec instances are only created if createCodecs is
+// true; otherwise no AV1 payload is read beyond what is needed to harvest the CICP values.
+static avifResult avifDecoderParseInternal(avifDecoder * decoder, avifBool createCodecs)
 {
     avifDiagnosticsClearError(&decoder->diag);
 
@@ -3180,7 +3509,14 @@ avifResult avifDecoderParse(avifDecoder * decoder)
         return AVIF_RESULT_IO_NOT_SET;
     }
 
-    // Cleanup anything lingering in the decoder
+    // Cleanup anything lingering in the decoder, except for the codec instances of the previous
+    // file if they may be reused.
+    avifDecoderData * previousData = NULL;
+    if (decoder->reuseCodecs && decoder->data) {
+        previousData = decoder->data;
+        decoder->data = NULL;
+        avifDecoderDataResetCodec(previousData, /*keepIdle=*/AVIF_TRUE);
+    }
     avifDecoderCleanup(decoder);
 
     // -----------------------------------------------------------------------
@@ -3188,6 +3524,12 @@ avifResult avifDecoderParse(avifDecoder * decoder)
 
     decoder->data = avifDecoderDataCreate();
     decoder->data->diag = &decoder->diag;
+    if (previousData) {
+        const avifDecoderIdleCodecArray idleCodecs = decoder->data->idleCodecs;
+        decoder->data->idleCodecs = previousData->idleCodecs;
+        previousData->idleCodecs = idleCodecs;
+        avifDecoderDataDestroy(previousData);
+    }
 
     avifResult parseResult = avifParse(decoder);
     if (parseResult != AVIF_RESULT_OK) {
@@ -3239,7 +3581,17 @@ avifResult avifDecoderParse(avifDecoder * decoder)
             }
         }
     }
-    return avifDecoderReset(decoder);
+    return avifDecoderResetInternal(decoder, createCodecs);
+}
+
+avifResult avifDecoderParse(avifDecoder * decoder)
+{
+    return avifDecoderParseInternal(decoder, AVIF_TRUE);
+}
+
+avifResult avifDecoderProbe(avifDecoder * decoder)
+{
+    return avifDecoderParseInternal(decoder, AVIF_FALSE);
 }
 
 static avifCodec * avifCodecCreateInternal(avifCodecChoice choice)
@@ -3247,23 +3599,105 @@ static avifCodec * avifCodecCreateInternal(avifCodecChoice choice)
     return avifCodecCreate(choice, AVIF_CODEC_FLAG_CAN_DECODE);
 }
 
+// Returns AVIF_TRUE if all tiles can be decoded one after the other by a single codec instance.
+// Each decoded tile is copied into the grid canvas right after its decoding (see
+// avifDecoderDecodeTiles()), before the codec reuses its output buffers for the next tile.
+static avifBool avifTilesCanBeDecodedWithSameCodecInstance(const avifDecoderData * data)
+{
+    if ((data->colorTileCount == 1) && (data->alphaTileCount > 0)) {
+        // The color planes of a single tile are stolen by decoder->image, so they must not be
+        // overwritten by the decoding of the alpha tiles.
+        return AVIF_FALSE;
+    }
+    if ((data->alphaTileCount == 1) && (data->colorTileCount > 0)) {
+        // Same for the alpha plane of a single alpha tile.
+        return AVIF_FALSE;
+    }
+    const avifTile * firstTile = &data->tiles.tile[0];
+    for (unsigned int i = 0; i < data->tiles.count; ++i) {
+        const avifTile * tile = &data->tiles.tile[i];
+        // A layered cell keeps inter-layer state in its codec instance (progressive decoding or
+        // layer selection), which the decoding of the next cell would clobber.
+        if (tile->layered || tile->input->allLayers) {
+            return AVIF_FALSE;
+        }
+        if (tile->operatingPoint != firstTile->operatingPoint) {
+            return AVIF_FALSE;
+        }
+    }
+    return AVIF_TRUE;
+}
+
+// Returns an idle codec instance created with the same settings if decoder->reuseCodecs is set and
+// there is one, or a new codec instance otherwise. Returns NULL if no codec is available.
+static avifCodec * avifDecoderDataAcquireCodec(avifDecoder * decoder, uint8_t operatingPoint, avifBool allLayers)
+{
+    avifDecoderData * data = decoder->data;
+    avifCodec * codec = NULL;
+    if (decoder->reuseCodecs && !allLayers) {
+        for (uint32_t i = 0; i < data->idleCodecs.count; ++i) {
+            const avifDecoderIdleCodec * idleCodec = &data->idleCodecs.idleCodec[i];
+            if ((idleCodec->settings.codecChoice == data->codecSettings.codecChoice) &&
+                (idleCodec->settings.maxThreads == data->codecSettings.maxThreads) &&
+                (idleCodec->settings.imageSizeLimit == data->codecSettings.imageSizeLimit) &&
+                (idleCodec->settings.operatingPoint == operatingPoint)) {
+                codec = idleCodec->codec;
+                data->idleCodecs.idleCodec[i] = data->idleCodecs.idleCodec[data->idleCodecs.count - 1];
+                avifArrayPop(&data->idleCodecs);
+                break;
+            }
+        }
+    }
+    if (!codec) {
+        codec = avifCodecCreateInternal(decoder->codecChoice);
+    }
+    if (codec) {
+        codec->diag = &decoder->diag;
+        codec->operatingPoint = operatingPoint;
+        codec->allLayers = allLayers;
+    }
+    return codec;
+}
+
 static avifResult avifDecoderFlush(avifDecoder * decoder)
 {
-    avifDecoderDataResetCodec(decoder->data);
+    avifDecoderDataResetCodec(decoder->data, decoder->reuseCodecs);
+    if (!decoder->reuseCodecs) {
+        avifDecoderDataDestroyIdleCodecs(decoder->data);
+    }
+
+    decoder->data->codecSettings.codecChoice = decoder->codecChoice;
+    decoder->data->codecSettings.maxThreads = decoder->maxThreads;
+    decoder->data->codecSettings.imageSizeLimit = decoder->imageSizeLimit;
+
+    if (decoder->data->tiles.count == 0) {
+        return AVIF_RESULT_OK;
+    }
+
+    if (avifTilesCanBeDecodedWithSameCodecInstance(decoder->data)) {
+        // Grid images may contain dozens of tiles. Creating one codec instance per tile would
+        // allocate as many frame buffers and worker thread pools, so share a single one instead.
+        avifTile * firstTile = &decoder->data->tiles.tile[0];
+        avifCodec * codec = avifDecoderDataAcquireCodec(decoder, firstTile->operatingPoint, firstTile->input->allLayers);
+        for (unsigned int i = 0; i < decoder->data->tiles.count; ++i) {
+            decoder->data->tiles.tile[i].codec = codec;
+        }
+        return AVIF_RESULT_OK;
+    }
 
     for (unsigned int i = 0; i < decoder->data->tiles.count; ++i) {
         avifTile * tile = &decoder->data->tiles.tile[i];
-        tile->codec = avifCodecCreateInternal(decoder->codecChoice);
-        if (tile->codec) {
-            tile->codec->diag = &decoder->diag;
-            tile->codec->operatingPoint = tile->operatingPoint;
-            tile->codec->allLayers = tile->input->allLayers;
-        }
+        tile->codec = avifDecoderDataAcquireCodec(decoder, tile->operatingPoint, tile->input->allLayers);
     }
     return AVIF_RESULT_OK;
 }
 
 avifResult avifDecoderReset(avifDecoder * decoder)
+{
+    return avifDecoderResetInternal(decoder, AVIF_TRUE);
+}
+
+static avifResult avifDecoderResetInternal(avifDecoder * decoder, avifBool createCodecs)
 {
     avifDiagnosticsClearError(&decoder->diag);
 
@@ -3275,6 +3709,10 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
     memset(&data->colorGrid, 0, sizeof(data->colorGrid));
     memset(&data->alphaGrid, 0, sizeof(data->alphaGrid));
+    avifDecoderDataResetCodec(data, decoder->reuseCodecs);
+    avifDecoderDataClearFrameCache(data);
+    data->keyframes.count = 0;
+    data->keyframesIndexed = AVIF_FALSE;
     avifDecoderDataClearTiles(data);
 
     // Prepare / cleanup decoded image state
@@ -3282,6 +3720,8 @@ avifResult avifDecoderReset(avifDecoder * decoder)
         avifImageDestroy(decoder->image);
     }
     decoder->image = avifImageCreateEmpty();
+    decoder->image->planeAllocator = decoder->planeAllocator;
+    data->planeAllocator = decoder->planeAllocator;
     decoder->progressiveState = AVIF_PROGRESSIVE_STATE_UNAVAILABLE;
     data->cicpSet = AVIF_FALSE;
 
@@ -3413,7 +3853,7 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
         // Image sequence timing
         decoder->imageIndex = -1;
-        decoder->imageCount = colorTile->input->samples.count;
+        decoder->imageCount = (int)avifCodecDecodeInputGetSampleCount(colorTile->input);
         decoder->timescale = colorTrack->mediaTimescale;
         decoder->durationInTimescales = colorTrack->mediaDuration;
         if (colorTrack->mediaTimescale) {
@@ -3562,6 +4002,7 @@ avifResult avifDecoderReset(avifDecoder * decoder)
             if (!colorTile) {
                 return AVIF_RESULT_OUT_OF_MEMORY;
             }
+            colorTile->layered = avifDecoderItemIsLayered(colorItem);
             if (!avifCodecDecodeInputFillFromDecoderItem(colorTile->input,
                                                          colorItem,
                                                          decoder->allowProgressive,
@@ -3604,6 +4045,7 @@ avifResult avifDecoderReset(avifDecoder * decoder)
                 if (!alphaTile) {
                     return AVIF_RESULT_OUT_OF_MEMORY;
                 }
+                alphaTile->layered = avifDecoderItemIsLayered(alphaItem);
                 if (!avifCodecDecodeInputFillFromDecoderItem(alphaTile->input,
                                                              alphaItem,
                                                              decoder->allowProgressive,
@@ -3637,9 +4079,12 @@ avifResult avifDecoderReset(avifDecoder * decoder)
         }
     }
 
-    // Sanity check tiles
+    // Sanity check tiles. Samples located on demand were checked by avifCodecDecodeInputFillFromSampleTable().
     for (uint32_t tileIndex = 0; tileIndex < data->tiles.count; ++tileIndex) {
         avifTile * tile = &data->tiles.tile[tileIndex];
+        if (tile->input->sampleIndex) {
+            continue;
+        }
         for (uint32_t sampleIndex = 0; sampleIndex < tile->input->samples.count; ++sampleIndex) {
             avifDecodeSample * sample = &tile->input->samples.sample[sampleIndex];
             if (!sample->size) {
@@ -3707,8 +4152,8 @@ avifResult avifDecoderReset(avifDecoder * decoder)
 
     if (!data->cicpSet && (data->tiles.count > 0)) {
         avifTile * firstTile = &data->tiles.tile[0];
-        if (firstTile->input->samples.count > 0) {
-            avifDecodeSample * sample = &firstTile->input->samples.sample[0];
+        if (avifCodecDecodeInputGetSampleCount(firstTile->input) > 0) {
+            avifDecodeSample * sample = avifCodecDecodeInputGetSample(firstTile->input, 0);
 
             // Harvest CICP from the AV1's sequence header, which should be very close to the front
             // of the first sample. Read in successively larger chunks until we successfully parse the sequence.
@@ -3760,6 +4205,9 @@ avifResult avifDecoderReset(avifDecoder * decoder)
         return AVIF_RESULT_BMFF_PARSE_FAILED;
     }
 
+    if (!createCodecs) {
+        return AVIF_RESULT_OK;
+    }
     return avifDecoderFlush(decoder);
 }
 
@@ -3777,11 +4225,11 @@ static avifResult avifDecoderPrepareTiles(avifDecoder * decoder,
             return AVIF_RESULT_NO_CODEC_AVAILABLE;
         }
 
-        if (nextImageIndex >= tile->input->samples.count) {
+        if (nextImageIndex >= avifCodecDecodeInputGetSampleCount(tile->input)) {
             return AVIF_RESULT_NO_IMAGES_REMAINING;
         }
 
-        avifDecodeSample * sample = &tile->input->samples.sample[nextImageIndex];
+        avifDecodeSample * sample = avifCodecDecodeInputGetSample(tile->input, nextImageIndex);
         avifResult prepareResult = avifDecoderPrepareSample(decoder, sample, 0);
         if (prepareResult != AVIF_RESULT_OK) {
             return prepareResult;
@@ -3792,103 +4240,304 @@ static avifResult avifDecoderPrepareTiles(avifDecoder * decoder,
 
 static avifResult avifImageLimitedToFullAlpha(avifImage * image)
 {
-    if (image->imageOwnsAlphaPlane) {
+    if ((image->depth != 8) && (image->depth != 10) && (image->depth != 12)) {
         return AVIF_RESULT_NOT_IMPLEMENTED;
     }
 
-    uint8_t * alphaPlane = image->alphaPlane;
-    const uint32_t alphaRowBytes = image->alphaRowBytes;
+    // avifLimitedToFullY() is evaluated once per possible sample value rather than once per sample.
+    const uint32_t maxChannel = (1 << image->depth) - 1;
+    uint16_t lut[1 << 12];
+    for (uint32_t v = 0; v <= maxChannel; ++v) {
+        lut[v] = (uint16_t)avifLimitedToFullY(image->depth, (int)v);
+    }
 
-    // We cannot do the range conversion in place since it will modify the
-    // codec's internal frame buffers. Allocate memory for the conversion.
-    image->alphaPlane = NULL;
-    image->alphaRowBytes = 0;
-    const avifResult allocationResult = avifImageAllocatePlanes(image, AVIF_PLANES_A);
-    if (allocationResult != AVIF_RESULT_OK) {
-        return allocationResult;
+    uint8_t * srcPlane = image->alphaPlane;
+    const uint32_t srcRowBytes = image->alphaRowBytes;
+    if (!image->imageOwnsAlphaPlane) {
+        // We cannot do the range conversion in place since it will modify the
+        // codec's internal frame buffers. Allocate memory for the conversion.
+        image->alphaPlane = NULL;
+        image->alphaRowBytes = 0;
+        const avifResult allocationResult = avifImageAllocatePlanes(image, AVIF_PLANES_A);
+        if (allocationResult != AVIF_RESULT_OK) {
+            return allocationResult;
+        }
     }
 
     if (image->depth > 8) {
         for (uint32_t j = 0; j < image->height; ++j) {
-            uint8_t * srcRow = &alphaPlane[j * alphaRowBytes];
-            uint8_t * dstRow = &image->alphaPlane[j * image->alphaRowBytes];
+            const uint16_t * srcRow = (const uint16_t *)&srcPlane[j * srcRowBytes];
+            uint16_t * dstRow = (uint16_t *)&image->alphaPlane[j * image->alphaRowBytes];
             for (uint32_t i = 0; i < image->width; ++i) {
-                int srcAlpha = *((uint16_t *)&srcRow[i * 2]);
-                int dstAlpha = avifLimitedToFullY(image->depth, srcAlpha);
-                *((uint16_t *)&dstRow[i * 2]) = (uint16_t)dstAlpha;
+                dstRow[i] = lut[AVIF_MIN(srcRow[i], maxChannel)];
             }
         }
     } else {
         for (uint32_t j = 0; j < image->height; ++j) {
-            uint8_t * srcRow = &alphaPlane[j * alphaRowBytes];
+            const uint8_t * srcRow = &srcPlane[j * srcRowBytes];
             uint8_t * dstRow = &image->alphaPlane[j * image->alphaRowBytes];
             for (uint32_t i = 0; i < image->width; ++i) {
-                int srcAlpha = srcRow[i];
-                int dstAlpha = avifLimitedToFullY(image->depth, srcAlpha);
-                dstRow[i] = (uint8_t)dstAlpha;
+                dstRow[i] = (uint8_t)lut[srcRow[i]];
             }
         }
     }
     return AVIF_RESULT_OK;
 }
 
+// Decodes sample into tile->image, with a full range alpha plane and the dimensions of the tile.
+static avifResult avifDecoderDecodeTile(avifDecoder * decoder, avifTile * tile, const avifDecodeSample * sample)
+{
+    avifBool isLimitedRangeAlpha = AVIF_FALSE;
+    if (!tile->codec->getNextImage(tile->codec, decoder, sample, tile->input->alpha, &isLimitedRangeAlpha, tile->image)) {
+        avifDiagnosticsPrintf(&decoder->diag, "tile->codec->getNextImage() failed");
+        return tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+    }
+
+    // Alpha plane with limited range is not allowed by the latest revision
+    // of the specification. However, it was allowed in version 1.0.0 of the
+    // specification. To allow such files, simply convert the alpha plane to
+    // full range.
+    if (tile->input->alpha && isLimitedRangeAlpha) {
+        avifResult result = avifImageLimitedToFullAlpha(tile->image);
+        if (result != AVIF_RESULT_OK) {
+            avifDiagnosticsPrintf(&decoder->diag, "avifImageLimitedToFullAlpha failed");
+            return result;
+        }
+    }
+
+    // Scale the decoded image so that it corresponds to this tile's output dimensions
+    if ((tile->width != tile->image->width) || (tile->height != tile->image->height)) {
+        if (avifDimensionsTooLarge(tile->width, tile->height, decoder->imageSizeLimit, decoder->imageDimensionLimit)) {
+            avifDiagnosticsPrintf(&decoder->diag,
+                                  "avifImageScale requested dst dimensions that are too large [%ux%u]",
+                                  tile->width,
+                                  tile->height);
+            return tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+        }
+        if (avifImageScale(tile->image, tile->width, tile->height, 1, &decoder->diag) != AVIF_RESULT_OK) {
+            avifDiagnosticsPrintf(&decoder->diag, "avifImageScale() failed");
+            return tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+        }
+    }
+    return AVIF_RESULT_OK;
+}
+
+// Decodes the available tiles in [*decodedTileCount:tileCount[. If grid is not NULL, each tile is
+// copied to decoder->image as soon as it is decoded, because tiles may share a codec instance whose
+// output buffers are only valid until the next tile is decoded.
 static avifResult avifDecoderDecodeTiles(avifDecoder * decoder,
                                          uint32_t nextImageIndex,
                                          unsigned int firstTileIndex,
                                          unsigned int tileCount,
+                                         avifImageGrid * grid,
                                          unsigned int * decodedTileCount)
 {
     const unsigned int oldDecodedTileCount = *decodedTileCount;
     for (unsigned int tileIndex = oldDecodedTileCount; tileIndex < tileCount; ++tileIndex) {
         avifTile * tile = &decoder->data->tiles.tile[firstTileIndex + tileIndex];
 
-        const avifDecodeSample * sample = &tile->input->samples.sample[nextImageIndex];
+        const avifDecodeSample * sample = avifCodecDecodeInputGetSample(tile->input, nextImageIndex);
         if (sample->data.size < sample->size) {
             assert(decoder->allowIncremental);
             // Data is missing but there is no error yet. Output available pixel rows.
             return AVIF_RESULT_OK;
         }
 
-        avifBool isLimitedRangeAlpha = AVIF_FALSE;
-        if (!tile->codec->getNextImage(tile->codec, decoder, sample, tile->input->alpha, &isLimitedRangeAlpha, tile->image)) {
-            avifDiagnosticsPrintf(&decoder->diag, "tile->codec->getNextImage() failed");
-            return tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+        const avifResult decodeResult = avifDecoderDecodeTile(decoder, tile, sample);
+        if (decodeResult != AVIF_RESULT_OK) {
+            return decodeResult;
         }
 
-        // Alpha plane with limited range is not allowed by the latest revision
-        // of the specification. However, it was allowed in version 1.0.0 of the
-        // specification. To allow such files, simply convert the alpha plane to
-        // full range.
-        if (tile->input->alpha && isLimitedRangeAlpha) {
-            avifResult result = avifImageLimitedToFullAlpha(tile->image);
-            if (result != AVIF_RESULT_OK) {
-                avifDiagnosticsPrintf(&decoder->diag, "avifImageLimitedToFullAlpha failed");
-                return result;
+        if (grid) {
+            assert(tileCount == (grid->rows * grid->columns));
+            if (!avifDecoderDataFillImageGrid(decoder->data, grid, decoder->image, firstTileIndex, tileIndex, tileIndex + 1, tile->input->alpha)) {
+                return AVIF_RESULT_INVALID_IMAGE_GRID;
             }
         }
 
-        // Scale the decoded image so that it corresponds to this tile's output dimensions
-        if ((tile->width != tile->image->width) || (tile->height != tile->image->height)) {
-            if (!avifImageScale(tile->image,
-                                tile->width,
-                                tile->height,
-                                decoder->imageSizeLimit,
-                                decoder->imageDimensionLimit,
-                                &decoder->diag)) {
-                avifDiagnosticsPrintf(&decoder->diag, "avifImageScale() failed");
-                return tile->input->alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
-            }
+        ++*decodedTileCount;
+        if (decoder->progressFunc &&
+            !decoder->progressFunc(decoder->progressUserData,
+                                   decoder->data->decodedColorTileCount + decoder->data->decodedAlphaTileCount,
+                                   decoder->data->tiles.count)) {
+            return AVIF_RESULT_CANCELED;
         }
+    }
+    return AVIF_RESULT_OK;
+}
 
-        ++*decodedTileCount;
+// Returns the number of bytes of the planes of image.
+static uint64_t avifImagePlanesSize(const avifImage * image)
+{
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const uint64_t uvHeight = (image->height + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY;
+    return (uint64_t)image->yuvRowBytes[AVIF_CHAN_Y] * image->height + (uint64_t)image->yuvRowBytes[AVIF_CHAN_U] * uvHeight +
+           (uint64_t)image->yuvRowBytes[AVIF_CHAN_V] * uvHeight + (uint64_t)image->alphaRowBytes * image->height;
+}
+
+// Removes frame from the least recently used list of the frame cache.
+static void avifDecoderDataUnlinkCachedFrame(avifDecoderData * data, avifDecoderCachedFrame * frame)
+{
+    if (frame->older) {
+        frame->older->newer = frame->newer;
+    } else {
+        data->oldestCachedFrame = frame->newer;
+    }
+    if (frame->newer) {
+        frame->newer->older = frame->older;
+    } else {
+        data->newestCachedFrame = frame->older;
+    }
+    frame->older = NULL;
+    frame->newer = NULL;
+}
+
+// Moves or adds frame to the most recently used end of the list of the frame cache.
+static void avifDecoderDataLinkNewestCachedFrame(avifDecoderData * data, avifDecoderCachedFrame * frame)
+{
+    frame->older = data->newestCachedFrame;
+    frame->newer = NULL;
+    if (data->newestCachedFrame) {
+        data->newestCachedFrame->newer = frame;
+    } else {
+        data->oldestCachedFrame = frame;
+    }
+    data->newestCachedFrame = frame;
+}
+
+// Keeps a copy of the frame that was just decoded, dropping the least recently used frames to stay
+// within decoder->frameCacheSize. Failing to cache a frame is not an error.
+static void avifDecoderCacheImage(avifDecoder * decoder)
+{
+    avifDecoderData * data = decoder->data;
+    const uint32_t imageIndex = (uint32_t)decoder->imageIndex;
+    if (!data->cachedFrames) {
+        const size_t tableSize = sizeof(avifDecoderCachedFrame *) * (size_t)decoder->imageCount;
+        data->cachedFrames = (avifDecoderCachedFrame **)avifAlloc(tableSize);
+        if (!data->cachedFrames) {
+            return;
+        }
+        memset(data->cachedFrames, 0, tableSize);
+    }
+    avifDecoderCachedFrame * frame = data->cachedFrames[imageIndex];
+    if (frame) {
+        avifDecoderDataUnlinkCachedFrame(data, frame);
+        avifDecoderDataLinkNewestCachedFrame(data, frame);
+        return;
+    }
+
+    avifImage * copy = avifImageCreateEmpty();
+    if (!copy) {
+        return;
+    }
+    copy->planeAllocator = decoder->planeAllocator;
+    if (avifImageCopy(copy, decoder->image, AVIF_PLANES_ALL) != AVIF_RESULT_OK) {
+        avifImageDestroy(copy);
+        return;
+    }
+    const uint64_t size = avifImagePlanesSize(copy);
+    if (size > decoder->frameCacheSize) {
+        avifImageDestroy(copy);
+        return;
+    }
+    frame = (avifDecoderCachedFrame *)avifAlloc(sizeof(avifDecoderCachedFrame));
+    if (!frame) {
+        avifImageDestroy(copy);
+        return;
+    }
+
+    while (data->cachedFramesSize + size > decoder->frameCacheSize) {
+        avifDecoderCachedFrame * oldest = data->oldestCachedFrame;
+        avifDecoderDataUnlinkCachedFrame(data, oldest);
+        data->cachedFrames[oldest->imageIndex] = NULL;
+        data->cachedFramesSize -= oldest->size;
+        avifImageDestroy(oldest->image);
+        avifFree(oldest);
+    }
+
+    frame->imageIndex = imageIndex;
+    frame->image = copy;
+    frame->size = size;
+    avifDecoderDataLinkNewestCachedFrame(data, frame);
+    data->cachedFrames[imageIndex] = frame;
+    data->cachedFramesSize += size;
+}
+
+// Copies the cached frame at frameIndex to decoder->image, if any. *found is set to AVIF_FALSE on a
+// cache miss.
+static avifResult avifDecoderUseCachedImage(avifDecoder * decoder, uint32_t frameIndex, avifBool * found)
+{
+    avifDecoderData * data = decoder->data;
+    *found = AVIF_FALSE;
+    avifDecoderCachedFrame * frame = data->cachedFrames ? data->cachedFrames[frameIndex] : NULL;
+    if (!frame) {
+        return AVIF_RESULT_OK;
+    }
+
+    const avifResult copyResult = avifImageCopy(decoder->image, frame->image, AVIF_PLANES_ALL);
+    if (copyResult != AVIF_RESULT_OK) {
+        return copyResult;
+    }
+    avifDecoderDataUnlinkCachedFrame(data, frame);
+    avifDecoderDataLinkNewestCachedFrame(data, frame);
+    if (!data->imageFromCache) {
+        // The codec stays where it is. Remember where, for the next frame to decode.
+        data->imageFromCache = AVIF_TRUE;
+        data->codecImageIndex = decoder->imageIndex;
+    }
+    decoder->imageIndex = (int)frameIndex;
+    if (data->sourceSampleTable) {
+        const avifResult timingResult = avifDecoderNthImageTiming(decoder, frameIndex, &decoder->imageTiming);
+        if (timingResult != AVIF_RESULT_OK) {
+            return timingResult;
+        }
     }
+    *found = AVIF_TRUE;
     return AVIF_RESULT_OK;
 }
 
-avifResult avifDecoderNextImage(avifDecoder * decoder)
+// Declares the samples of the frames following firstImageIndex to a prefetching avifIO, in the order
+// they will be read, until its byte budget is reached. Only the samples not declared by the previous
+// call are declared, unless the decoder seeked since then.
+static void avifDecoderPrefetchSamples(avifDecoder * decoder, uint32_t firstImageIndex)
 {
-    avifDiagnosticsClearError(&decoder->diag);
+    avifDecoderData * data = decoder->data;
+    if (firstImageIndex != data->prefetchFirstImageIndex + 1) {
+        // The samples read ahead so far will not be read next.
+        avifIOPrefetchDiscard(decoder->io);
+        data->prefetchImageIndex = firstImageIndex;
+        data->prefetchTileIndex = 0;
+    } else if (data->prefetchImageIndex < firstImageIndex) {
+        data->prefetchImageIndex = firstImageIndex;
+        data->prefetchTileIndex = 0;
+    }
+    data->prefetchFirstImageIndex = firstImageIndex;
+
+    for (; data->tiles.count > 0; ++data->prefetchImageIndex, data->prefetchTileIndex = 0) {
+        for (; data->prefetchTileIndex < data->tiles.count; ++data->prefetchTileIndex) {
+            const avifTile * tile = &data->tiles.tile[data->prefetchTileIndex];
+            if (data->prefetchImageIndex >= avifCodecDecodeInputGetSampleCount(tile->input)) {
+                return;
+            }
+            avifDecodeSample scratch;
+            const avifDecodeSample * sample = avifCodecDecodeInputPeekSample(tile->input, data->prefetchImageIndex, &scratch);
+            if (sample->itemID || sample->data.size) {
+                // Items are read through avifDecoderItemRead(), and this sample was read already.
+                return;
+            }
+            if (!avifIOPrefetch(decoder->io, sample->offset, sample->size)) {
+                // Declared again once the samples read ahead are consumed.
+                return;
+            }
+        }
+    }
+}
 
+// Decodes the frame following the last one output by the codec. The codec and decoder->imageIndex
+// must be in sync (decoder->data->imageFromCache is false).
+static avifResult avifDecoderDecodeNextImage(avifDecoder * decoder)
+{
     if (!decoder->data) {
         // Nothing has been parsed yet
         return AVIF_RESULT_NO_CONTENT;
@@ -3930,35 +4579,39 @@ avifResult avifDecoderNextImage(avifDecoder * decoder)
         (!decoder->allowIncremental || (prepareAlphaTileResult != AVIF_RESULT_WAITING_ON_IO))) {
         return prepareAlphaTileResult;
     }
+    // Read the next samples while this one is being decoded.
+    avifDecoderPrefetchSamples(decoder, nextImageIndex + 1);
 
-    // Decode all available color tiles now, then all available alpha tiles.
+    // Decode all available color tiles now, then all available alpha tiles. Grid tiles are copied
+    // to decoder->image as they are decoded.
+    avifImageGrid * colorGrid =
+        ((decoder->data->colorGrid.rows > 0) && (decoder->data->colorGrid.columns > 0)) ? &decoder->data->colorGrid : NULL;
+    avifImageGrid * alphaGrid =
+        ((decoder->data->alphaGrid.rows > 0) && (decoder->data->alphaGrid.columns > 0)) ? &decoder->data->alphaGrid : NULL;
     const unsigned int oldDecodedColorTileCount = decoder->data->decodedColorTileCount;
-    const avifResult decodeColorTileResult =
-        avifDecoderDecodeTiles(decoder, nextImageIndex, firstColorTileIndex, decoder->data->colorTileCount, &decoder->data->decodedColorTileCount);
+    const avifResult decodeColorTileResult = avifDecoderDecodeTiles(decoder,
+                                                                    nextImageIndex,
+                                                                    firstColorTileIndex,
+                                                                    decoder->data->colorTileCount,
+                                                                    colorGrid,
+                                                                    &decoder->data->decodedColorTileCount);
     if (decodeColorTileResult != AVIF_RESULT_OK) {
         return decodeColorTileResult;
     }
     const unsigned int oldDecodedAlphaTileCount = decoder->data->decodedAlphaTileCount;
-    const avifResult decodeAlphaTileResult =
-        avifDecoderDecodeTiles(decoder, nextImageIndex, firstAlphaTileIndex, decoder->data->alphaTileCount, &decoder->data->decodedAlphaTileCount);
+    const avifResult decodeAlphaTileResult = avifDecoderDecodeTiles(decoder,
+                                                                    nextImageIndex,
+                                                                    firstAlphaTileIndex,
+                                                                    decoder->data->alphaTileCount,
+                                                                    alphaGrid,
+                                                                    &decoder->data->decodedAlphaTileCount);
     if (decodeAlphaTileResult != AVIF_RESULT_OK) {
         return decodeAlphaTileResult;
     }
 
     if (decoder->data->decodedColorTileCount > oldDecodedColorTileCount) {
         // There is at least one newly decoded color tile.
-        if ((decoder->data->colorGrid.rows > 0) && (decoder->data->colorGrid.columns > 0)) {
-            assert(decoder->data->colorTileCount == (decoder->data->colorGrid.rows * decoder->data->colorGrid.columns));
-            if (!avifDecoderDataFillImageGrid(decoder->data,
-                                              &decoder->data->colorGrid,
-                                              decoder->image,
-                                              firstColorTileIndex,
-                                              oldDecodedColorTileCount,
-                                              decoder->data->decodedColorTileCount,
-                                              AVIF_FALSE)) {
-                return AVIF_RESULT_INVALID_IMAGE_GRID;
-            }
-        } else {
+        if (!colorGrid) {
             // Normal (most common) non-grid path. Just steal the planes from the only "tile".
             assert(decoder->data->colorTileCount == 1);
             avifImage * srcColor = decoder->data->tiles.tile[0].image;
@@ -3987,18 +4640,7 @@ avifResult avifDecoderNextImage(avifDecoder * decoder)
 
     if (decoder->data->decodedAlphaTileCount > oldDecodedAlphaTileCount) {
         // There is at least one newly decoded alpha tile.
-        if ((decoder->data->alphaGrid.rows > 0) && (decoder->data->alphaGrid.columns > 0)) {
-            assert(decoder->data->alphaTileCount == (decoder->data->alphaGrid.rows * decoder->data->alphaGrid.columns));
-            if (!avifDecoderDataFillImageGrid(decoder->data,
-                                              &decoder->data->alphaGrid,
-                                              decoder->image,
-                                              firstAlphaTileIndex,
-                                              oldDecodedAlphaTileCount,
-                                              decoder->data->decodedAlphaTileCount,
-                                              AVIF_TRUE)) {
-                return AVIF_RESULT_INVALID_IMAGE_GRID;
-            }
-        } else {
+        if (!alphaGrid) {
             // Normal (most common) non-grid path. Just steal the planes from the only "tile".
             assert(decoder->data->alphaTileCount == 1);
             avifImage * srcAlpha = decoder->data->tiles.tile[decoder->data->colorTileCount].image;
@@ -4039,9 +4681,23 @@ avifResult avifDecoderNextImage(avifDecoder * decoder)
             return timingResult;
         }
     }
+    if (decoder->frameCacheSize && !decoder->allowIncremental) {
+        avifDecoderCacheImage(decoder);
+    }
     return AVIF_RESULT_OK;
 }
 
+avifResult avifDecoderNextImage(avifDecoder * decoder)
+{
+    avifDiagnosticsClearError(&decoder->diag);
+
+    if (decoder->data && decoder->data->imageFromCache) {
+        // The codec may be anywhere else in the sequence.
+        return avifDecoderNthImage(decoder, (uint32_t)(decoder->imageIndex + 1));
+    }
+    return avifDecoderDecodeNextImage(decoder);
+}
+
 avifResult avifDecoderNthImageTiming(const avifDecoder * decoder, uint32_t frameIndex, avifImageTiming * outTiming)
 {
     if (!decoder->data) {
@@ -4078,6 +4734,23 @@ avifResult avifDecoderNthImageTiming(const avifDecoder * decoder, uint32_t frame
     return AVIF_RESULT_OK;
 }
 
+// Builds avifDecoderData::keyframes, once per avifDecoderReset(). Called by avifDecoderNthImage()
+// rather than at parse time, because most decoders never seek.
+static void avifDecoderDataIndexKeyframes(avifDecoder * decoder)
+{
+    avifDecoderData * data = decoder->data;
+    if (data->keyframesIndexed) {
+        return;
+    }
+    for (uint32_t imageIndex = 0; imageIndex < (uint32_t)decoder->imageCount; ++imageIndex) {
+        if (avifDecoderIsKeyframe(decoder, imageIndex)) {
+            uint32_t * keyframe = (uint32_t *)avifArrayPushPtr(&data->keyframes);
+            *keyframe = imageIndex;
+        }
+    }
+    data->keyframesIndexed = AVIF_TRUE;
+}
+
 avifResult avifDecoderNthImage(avifDecoder * decoder, uint32_t frameIndex)
 {
     avifDiagnosticsClearError(&decoder->diag);
@@ -4093,22 +4766,47 @@ avifResult avifDecoderNthImage(avifDecoder * decoder, uint32_t frameIndex)
     }
 
     int requestedIndex = (int)frameIndex;
-    if (requestedIndex == (decoder->imageIndex + 1)) {
-        // It's just the next image (already partially decoded or not at all), nothing special here
-        return avifDecoderNextImage(decoder);
+    if (decoder->data->imageFromCache) {
+        if (requestedIndex == decoder->imageIndex) {
+            // The current image was taken from the frame cache, nothing to do
+            return AVIF_RESULT_OK;
+        }
+    } else {
+        if (requestedIndex == (decoder->imageIndex + 1)) {
+            // It's just the next image (already partially decoded or not at all), nothing special here
+            return avifDecoderDecodeNextImage(decoder);
+        }
+
+        if (requestedIndex == decoder->imageIndex) {
+            if ((decoder->data->decodedColorTileCount == decoder->data->colorTileCount) &&
+                (decoder->data->decodedAlphaTileCount == decoder->data->alphaTileCount)) {
+                // The current fully decoded image (decoder->imageIndex) is requested, nothing to do
+                return AVIF_RESULT_OK;
+            }
+            // The next image (decoder->imageIndex + 1) is partially decoded but
+            // the previous image (decoder->imageIndex) is requested.
+            // Fall through to flush and start decoding from the nearest key frame.
+        }
     }
 
-    if (requestedIndex == decoder->imageIndex) {
-        if ((decoder->data->decodedColorTileCount == decoder->data->colorTileCount) &&
-            (decoder->data->decodedAlphaTileCount == decoder->data->alphaTileCount)) {
-            // The current fully decoded image (decoder->imageIndex) is requested, nothing to do
-            return AVIF_RESULT_OK;
+    if (decoder->frameCacheSize && !decoder->allowIncremental) {
+        avifBool found;
+        const avifResult cacheResult = avifDecoderUseCachedImage(decoder, frameIndex, &found);
+        if ((cacheResult != AVIF_RESULT_OK) || found) {
+            return cacheResult;
+        }
+    }
+
+    if (decoder->data->imageFromCache) {
+        // Cache miss. Continue from the last frame output by the codec.
+        decoder->imageIndex = decoder->data->codecImageIndex;
+        decoder->data->imageFromCache = AVIF_FALSE;
+        if (requestedIndex == (decoder->imageIndex + 1)) {
+            return avifDecoderDecodeNextImage(decoder);
         }
-        // The next image (decoder->imageIndex + 1) is partially decoded but
-        // the previous image (decoder->imageIndex) is requested.
-        // Fall through to flush and start decoding from the nearest key frame.
     }
 
+    avifDecoderDataIndexKeyframes(decoder);
     int nearestKeyFrame = (int)avifDecoderNearestKeyframe(decoder, frameIndex);
     if ((nearestKeyFrame > (decoder->imageIndex + 1)) || (requestedIndex <= decoder->imageIndex)) {
         // If we get here, a decoder flush is necessary
@@ -4116,7 +4814,7 @@ avifResult avifDecoderNthImage(avifDecoder * decoder, uint32_t frameIndex)
         avifDecoderFlush(decoder);
     }
     for (;;) {
-        avifResult result = avifDecoderNextImage(decoder);
+        avifResult result = avifDecoderDecodeNextImage(decoder);
         if (result != AVIF_RESULT_OK) {
             return result;
         }
@@ -4141,7 +4839,7 @@ avifBool avifDecoderIsKeyframe(const avifDecoder * decoder, uint32_t frameIndex)
     //  decode failure.
     for (unsigned int i = 0; i < decoder->data->tiles.count; ++i) {
         const avifTile * tile = &decoder->data->tiles.tile[i];
-        if ((frameIndex >= tile->input->samples.count) || !tile->input->samples.sample[frameIndex].sync) {
+        if ((frameIndex >= avifCodecDecodeInputGetSampleCount(tile->input)) || !avifCodecDecodeInputIsSync(tile->input, frameIndex)) {
             return AVIF_FALSE;
         }
     }
@@ -4155,12 +4853,28 @@ uint32_t avifDecoderNearestKeyframe(const avifDecoder * decoder, uint32_t frameI
         return 0;
     }
 
-    for (; frameIndex != 0; --frameIndex) {
-        if (avifDecoderIsKeyframe(decoder, frameIndex)) {
-            break;
+    const avifImageIndexArray * keyframes = &decoder->data->keyframes;
+    if (!decoder->data->keyframesIndexed) {
+        for (; frameIndex != 0; --frameIndex) {
+            if (avifDecoderIsKeyframe(decoder, frameIndex)) {
+                break;
+            }
         }
+        return frameIndex;
     }
-    return frameIndex;
+
+    // Binary search of the last keyframe at or before frameIndex.
+    uint32_t lo = 0;
+    uint32_t hi = keyframes->count;
+    while (lo < hi) {
+        const uint32_t mid = lo + (hi - lo) / 2;
+        if (keyframes->imageIndex[mid] <= frameIndex) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return (lo == 0) ? 0 : keyframes->imageIndex[lo - 1];
 }
 
 // Returns the number of available rows in decoder->image given a color or alpha subimage.
@@ -4202,6 +4916,243 @@ uint32_t avifDecoderDecodedRowCount(const avifDecoder * decoder)
     return AVIF_MIN(colorRowCount, alphaRowCount);
 }
 
+// Copies the part of tileImage, placed at (tileX, tileY) on the canvas, that lies within rect to
+// dstImage, whose top-left corner is (rect->x, rect->y) on the canvas.
+static void avifImageCopyTileRegion(avifImage * dstImage,
+                                    const avifImage * tileImage,
+                                    uint32_t tileX,
+                                    uint32_t tileY,
+                                    const avifCropRect * rect,
+                                    avifBool alpha)
+{
+    const uint32_t x0 = AVIF_MAX(tileX, rect->x);
+    const uint32_t y0 = AVIF_MAX(tileY, rect->y);
+    const uint32_t x1 = AVIF_MIN(tileX + tileImage->width, rect->x + rect->width);
+    const uint32_t y1 = AVIF_MIN(tileY + tileImage->height, rect->y + rect->height);
+    const size_t pixelBytes = avifImageUsesU16(dstImage) ? 2 : 1;
+
+    if (alpha) {
+        for (uint32_t y = y0; y < y1; ++y) {
+            const uint8_t * src = &tileImage->alphaPlane[(size_t)(y - tileY) * tileImage->alphaRowBytes + (x0 - tileX) * pixelBytes];
+            uint8_t * dst = &dstImage->alphaPlane[(size_t)(y - rect->y) * dstImage->alphaRowBytes + (x0 - rect->x) * pixelBytes];
+            memcpy(dst, src, (x1 - x0) * pixelBytes);
+        }
+        return;
+    }
+
+    for (uint32_t y = y0; y < y1; ++y) {
+        const uint8_t * src =
+            &tileImage->yuvPlanes[AVIF_CHAN_Y][(size_t)(y - tileY) * tileImage->yuvRowBytes[AVIF_CHAN_Y] + (x0 - tileX) * pixelBytes];
+        uint8_t * dst = &dstImage->yuvPlanes[AVIF_CHAN_Y][(size_t)(y - rect->y) * dstImage->yuvRowBytes[AVIF_CHAN_Y] + (x0 - rect->x) * pixelBytes];
+        memcpy(dst, src, (x1 - x0) * pixelBytes);
+    }
+    if (!tileImage->yuvPlanes[AVIF_CHAN_U] || !tileImage->yuvPlanes[AVIF_CHAN_V] || !dstImage->yuvPlanes[AVIF_CHAN_U] ||
+        !dstImage->yuvPlanes[AVIF_CHAN_V]) {
+        return;
+    }
+
+    // x0, y0, the tile origin and the rect origin are all even for subsampled formats, so the
+    // chroma samples of the region start exactly on chroma sample boundaries.
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(tileImage->yuvFormat, &formatInfo);
+    const uint32_t uvWidth = ((x1 - x0) + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX;
+    const uint32_t uvHeight = ((y1 - y0) + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY;
+    const size_t srcUVX = (x0 - tileX) >> formatInfo.chromaShiftX;
+    const size_t srcUVY = (y0 - tileY) >> formatInfo.chromaShiftY;
+    const size_t dstUVX = (x0 - rect->x) >> formatInfo.chromaShiftX;
+    const size_t dstUVY = (y0 - rect->y) >> formatInfo.chromaShiftY;
+    for (int yuvPlane = AVIF_CHAN_U; yuvPlane <= AVIF_CHAN_V; ++yuvPlane) {
+        for (uint32_t j = 0; j < uvHeight; ++j) {
+            const uint8_t * src = &tileImage->yuvPlanes[yuvPlane][(srcUVY + j) * tileImage->yuvRowBytes[yuvPlane] + srcUVX * pixelBytes];
+            uint8_t * dst = &dstImage->yuvPlanes[yuvPlane][(dstUVY + j) * dstImage->yuvRowBytes[yuvPlane] + dstUVX * pixelBytes];
+            memcpy(dst, src, uvWidth * pixelBytes);
+        }
+    }
+}
+
+// Decodes the tiles of the color or alpha subimage made of the tileCount tiles starting at
+// firstTileIndex that intersect rect, and copies their pixels within rect to dstImage. A subimage
+// without grid is a single tile covering the whole canvas.
+static avifResult avifDecoderDecodeSubimageRegion(avifDecoder * decoder,
+                                                  unsigned int firstTileIndex,
+                                                  unsigned int tileCount,
+                                                  const avifImageGrid * grid,
+                                                  const avifCropRect * rect,
+                                                  avifImage * dstImage,
+                                                  avifBool alpha)
+{
+    if (tileCount == 0) {
+        return AVIF_RESULT_OK;
+    }
+    const avifTile * firstTile = &decoder->data->tiles.tile[firstTileIndex];
+    const uint32_t columns = grid ? grid->columns : 1;
+    const uint32_t rows = grid ? grid->rows : 1;
+    const uint32_t tileWidth = firstTile->width;
+    const uint32_t tileHeight = firstTile->height;
+    if (tileCount != (columns * rows)) {
+        return AVIF_RESULT_INVALID_IMAGE_GRID;
+    }
+    if (grid) {
+        // Same layout checks as avifDecoderDataFillImageGrid(), done before decoding anything.
+        if (((tileWidth * grid->columns) < grid->outputWidth) || ((tileHeight * grid->rows) < grid->outputHeight)) {
+            avifDiagnosticsPrintf(&decoder->diag,
+                                  "Grid image tiles do not completely cover the image (HEIF (ISO/IEC 23008-12:2017), Section 6.6.2.3.1)");
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+        if (((tileWidth * (grid->columns - 1)) >= grid->outputWidth) || ((tileHeight * (grid->rows - 1)) >= grid->outputHeight)) {
+            avifDiagnosticsPrintf(&decoder->diag,
+                                  "Grid image tiles in the rightmost column and bottommost row do not overlap the reconstructed image grid canvas. See MIAF (ISO/IEC 23000-22:2019), Section 7.3.11.4.2, Figure 2");
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+        if (!avifAreGridDimensionsValid(decoder->image->yuvFormat, grid->outputWidth, grid->outputHeight, tileWidth, tileHeight, &decoder->diag)) {
+            return AVIF_RESULT_INVALID_IMAGE_GRID;
+        }
+    } else if ((tileWidth < (rect->x + rect->width)) || (tileHeight < (rect->y + rect->height))) {
+        avifDiagnosticsPrintf(&decoder->diag, "Image item is smaller than the image");
+        return alpha ? AVIF_RESULT_DECODE_ALPHA_FAILED : AVIF_RESULT_DECODE_COLOR_FAILED;
+    }
+
+    const uint32_t firstColumn = rect->x / tileWidth;
+    const uint32_t lastColumn = (rect->x + rect->width - 1) / tileWidth;
+    const uint32_t firstRow = rect->y / tileHeight;
+    const uint32_t lastRow = (rect->y + rect->height - 1) / tileHeight;
+
+    // Read the samples of all the intersecting tiles first, so that AVIF_RESULT_WAITING_ON_IO can be
+    // returned before any decoding work.
+    for (uint32_t row = firstRow; row <= lastRow; ++row) {
+        for (uint32_t column = firstColumn; column <= lastColumn; ++column) {
+            avifTile * tile = &decoder->data->tiles.tile[firstTileIndex + row * columns + column];
+            if (!tile->codec) {
+                return AVIF_RESULT_NO_CODEC_AVAILABLE;
+            }
+            if (avifCodecDecodeInputGetSampleCount(tile->input) == 0) {
+                return AVIF_RESULT_NO_IMAGES_REMAINING;
+            }
+            const avifResult prepareResult = avifDecoderPrepareSample(decoder, avifCodecDecodeInputGetSample(tile->input, 0), 0);
+            if (prepareResult != AVIF_RESULT_OK) {
+                return prepareResult;
+            }
+        }
+    }
+
+    for (uint32_t row = firstRow; row <= lastRow; ++row) {
+        for (uint32_t column = firstColumn; column <= lastColumn; ++column) {
+            avifTile * tile = &decoder->data->tiles.tile[firstTileIndex + row * columns + column];
+            const avifResult decodeResult = avifDecoderDecodeTile(decoder, tile, avifCodecDecodeInputGetSample(tile->input, 0));
+            if (decodeResult != AVIF_RESULT_OK) {
+                return decodeResult;
+            }
+
+            const avifImage * tileImage = tile->image;
+            if ((tileImage->width != tileWidth) || (tileImage->height != tileHeight)) {
+                avifDiagnosticsPrintf(&decoder->diag, "Grid image contains mismatched tiles");
+                return AVIF_RESULT_INVALID_IMAGE_GRID;
+            }
+            if (alpha) {
+                if (!dstImage->yuvPlanes[AVIF_CHAN_Y] || (tileImage->depth != dstImage->depth)) {
+                    avifDiagnosticsPrintf(&decoder->diag, "Alpha plane depth does not match color plane depth");
+                    return AVIF_RESULT_DECODE_ALPHA_FAILED;
+                }
+                if (!dstImage->alphaPlane) {
+                    const avifResult allocationResult = avifImageAllocatePlanes(dstImage, AVIF_PLANES_A);
+                    if (allocationResult != AVIF_RESULT_OK) {
+                        return allocationResult;
+                    }
+                }
+            } else if (!dstImage->yuvPlanes[AVIF_CHAN_Y]) {
+                // The first decoded tile gives its format to the region.
+                dstImage->depth = tileImage->depth;
+                dstImage->yuvFormat = tileImage->yuvFormat;
+                dstImage->yuvRange = tileImage->yuvRange;
+                const avifResult allocationResult = avifImageAllocatePlanes(dstImage, AVIF_PLANES_YUV);
+                if (allocationResult != AVIF_RESULT_OK) {
+                    return allocationResult;
+                }
+            } else if ((tileImage->depth != dstImage->depth) || (tileImage->yuvFormat != dstImage->yuvFormat) ||
+                       (tileImage->yuvRange != dstImage->yuvRange)) {
+                avifDiagnosticsPrintf(&decoder->diag, "Grid image contains mismatched tiles");
+                return AVIF_RESULT_INVALID_IMAGE_GRID;
+            }
+
+            avifImageCopyTileRegion(dstImage, tileImage, column * tileWidth, row * tileHeight, rect, alpha);
+        }
+    }
+    return AVIF_RESULT_OK;
+}
+
+avifResult avifDecoderDecodeRegion(avifDecoder * decoder, const avifCropRect * rect, avifImage * image)
+{
+    avifDiagnosticsClearError(&decoder->diag);
+
+    if (!decoder->data) {
+        // Nothing has been parsed yet
+        return AVIF_RESULT_NO_CONTENT;
+    }
+    if (!decoder->io || !decoder->io->read) {
+        return AVIF_RESULT_IO_NOT_SET;
+    }
+
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(decoder->image->yuvFormat, &formatInfo);
+    if ((rect->width == 0) || (rect->height == 0) || (rect->width > decoder->image->width) ||
+        (rect->height > decoder->image->height) || (rect->x > (decoder->image->width - rect->width)) ||
+        (rect->y > (decoder->image->height - rect->height)) || (rect->x & formatInfo.chromaShiftX) ||
+        (rect->y & formatInfo.chromaShiftY)) {
+        return AVIF_RESULT_INVALID_ARGUMENT;
+    }
+
+    avifImageGrid * colorGrid =
+        ((decoder->data->colorGrid.rows > 0) && (decoder->data->colorGrid.columns > 0)) ? &decoder->data->colorGrid : NULL;
+    if (!colorGrid || (decoder->imageCount != 1)) {
+        // Only the cells of grid images can be decoded independently. Image sequences and
+        // progressive images are made of frames depending on each other.
+        const avifResult decodeResult = avifDecoderNthImage(decoder, 0);
+        if (decodeResult != AVIF_RESULT_OK) {
+            return decodeResult;
+        }
+        avifImage * view = avifImageCreateEmpty();
+        if (!view) {
+            return AVIF_RESULT_OUT_OF_MEMORY;
+        }
+        avifResult result = avifImageSetViewRect(view, decoder->image, rect);
+        if (result == AVIF_RESULT_OK) {
+            result = avifImageCopy(image, view, AVIF_PLANES_ALL);
+        }
+        avifImageDestroy(view);
+        return result;
+    }
+
+    // The grid tiles are decoded out of order with the codec instances of decoder->image, whose
+    // planes may point to their output buffers. Start again from scratch at the next
+    // avifDecoderNextImage() call.
+    avifImageFreePlanes(decoder->image, AVIF_PLANES_ALL);
+    decoder->imageIndex = -1;
+    decoder->data->decodedColorTileCount = 0;
+    decoder->data->decodedAlphaTileCount = 0;
+    decoder->data->imageFromCache = AVIF_FALSE;
+
+    avifResult result = avifImageCopy(image, decoder->image, 0);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+    image->width = rect->width;
+    image->height = rect->height;
+
+    avifImageGrid * alphaGrid =
+        ((decoder->data->alphaGrid.rows > 0) && (decoder->data->alphaGrid.columns > 0)) ? &decoder->data->alphaGrid : NULL;
+    result = avifDecoderDecodeSubimageRegion(decoder, 0, decoder->data->colorTileCount, colorGrid, rect, image, AVIF_FALSE);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+    return avifDecoderDecodeSubimageRegion(decoder,
+                                           decoder->data->colorTileCount,
+                                           decoder->data->alphaTileCount,
+                                           alphaGrid,
+                                           rect,
+                                           image,
+                                           AVIF_TRUE);
+}
+
 avifResult avifDecoderRead(avifDecoder * decoder, avifImage * image)
 {
     avifResult result = avifDecoderParse(decoder);
@@ -194,21 +194,280 @@ static int avifReformatStateUVToUNorm(avifReformatState * state, float v)
     return AVIF_CLAMP(unorm, 0, state->yuvMaxChannel);
 }
 
+// Copies one row of interleaved RGB samples to the G, B and R planes of an identity (GBR) image.
+// Called with constant channel indices so that the compiler can vectorize the de-interleaving.
+static inline void avifRGBRowToGBR8(const uint8_t * src,
+                                    uint32_t width,
+                                    uint32_t pixelBytes,
+                                    uint32_t rIndex,
+                                    uint32_t gIndex,
+                                    uint32_t bIndex,
+                                    uint8_t * dstG,
+                                    uint8_t * dstB,
+                                    uint8_t * dstR)
+{
+    for (uint32_t i = 0; i < width; ++i) {
+        dstG[i] = src[i * pixelBytes + gIndex];
+        dstB[i] = src[i * pixelBytes + bIndex];
+        dstR[i] = src[i * pixelBytes + rIndex];
+    }
+}
+
+static inline void avifRGBRowToGBR16(const uint16_t * src,
+                                     uint32_t width,
+                                     uint32_t pixelChannels,
+                                     uint32_t rIndex,
+                                     uint32_t gIndex,
+                                     uint32_t bIndex,
+                                     uint16_t * dstG,
+                                     uint16_t * dstB,
+                                     uint16_t * dstR)
+{
+    for (uint32_t i = 0; i < width; ++i) {
+        dstG[i] = src[i * pixelChannels + gIndex];
+        dstB[i] = src[i * pixelChannels + bIndex];
+        dstR[i] = src[i * pixelChannels + rIndex];
+    }
+}
+
+// Identity (GBR) matrix coefficients make the RGB to YUV conversion a channel shuffle: Y = G, U = B,
+// V = R. When the RGB and YUV depths match and the range is full, the samples are copied as they
+// are. Otherwise each sample goes through a table holding the result of the float path for every
+// possible RGB value, so the output is the same as with the generic conversion.
+static avifResult avifImageRGBToYUVIdentity(avifImage * image, const avifRGBImage * rgb, avifReformatState * state)
+{
+    uint8_t ** yuvPlanes = image->yuvPlanes;
+    const uint32_t * yuvRowBytes = image->yuvRowBytes;
+
+    if ((rgb->depth == image->depth) && (image->yuvRange == AVIF_RANGE_FULL)) {
+        for (uint32_t j = 0; j < image->height; ++j) {
+            const uint8_t * src = &rgb->pixels[j * rgb->rowBytes];
+            uint8_t * dstG = &yuvPlanes[AVIF_CHAN_Y][j * yuvRowBytes[AVIF_CHAN_Y]];
+            uint8_t * dstB = &yuvPlanes[AVIF_CHAN_U][j * yuvRowBytes[AVIF_CHAN_U]];
+            uint8_t * dstR = &yuvPlanes[AVIF_CHAN_V][j * yuvRowBytes[AVIF_CHAN_V]];
+            if (state->rgbChannelBytes > 1) {
+                const uint16_t * src16 = (const uint16_t *)src;
+                uint16_t * dstG16 = (uint16_t *)dstG;
+                uint16_t * dstB16 = (uint16_t *)dstB;
+                uint16_t * dstR16 = (uint16_t *)dstR;
+                switch (rgb->format) {
+                    case AVIF_RGB_FORMAT_RGB:
+                        avifRGBRowToGBR16(src16, image->width, 3, 0, 1, 2, dstG16, dstB16, dstR16);
+                        break;
+                    case AVIF_RGB_FORMAT_RGBA:
+                        avifRGBRowToGBR16(src16, image->width, 4, 0, 1, 2, dstG16, dstB16, dstR16);
+                        break;
+                    case AVIF_RGB_FORMAT_ARGB:
+                        avifRGBRowToGBR16(src16, image->width, 4, 1, 2, 3, dstG16, dstB16, dstR16);
+                        break;
+                    case AVIF_RGB_FORMAT_BGR:
+                        avifRGBRowToGBR16(src16, image->width, 3, 2, 1, 0, dstG16, dstB16, dstR16);
+                        break;
+                    case AVIF_RGB_FORMAT_BGRA:
+                        avifRGBRowToGBR16(src16, image->width, 4, 2, 1, 0, dstG16, dstB16, dstR16);
+                        break;
+                    case AVIF_RGB_FORMAT_ABGR:
+                        avifRGBRowToGBR16(src16, image->width, 4, 3, 2, 1, dstG16, dstB16, dstR16);
+                        break;
+                    default:
+                        return AVIF_RESULT_NOT_IMPLEMENTED;
+                }
+            } else {
+                switch (rgb->format) {
+                    case AVIF_RGB_FORMAT_RGB:
+                        avifRGBRowToGBR8(src, image->width, 3, 0, 1, 2, dstG, dstB, dstR);
+                        break;
+                    case AVIF_RGB_FORMAT_RGBA:
+                        avifRGBRowToGBR8(src, image->width, 4, 0, 1, 2, dstG, dstB, dstR);
+                        break;
+                    case AVIF_RGB_FORMAT_ARGB:
+                        avifRGBRowToGBR8(src, image->width, 4, 1, 2, 3, dstG, dstB, dstR);
+                        break;
+                    case AVIF_RGB_FORMAT_BGR:
+                        avifRGBRowToGBR8(src, image->width, 3, 2, 1, 0, dstG, dstB, dstR);
+                        break;
+                    case AVIF_RGB_FORMAT_BGRA:
+                        avifRGBRowToGBR8(src, image->width, 4, 2, 1, 0, dstG, dstB, dstR);
+                        break;
+                    case AVIF_RGB_FORMAT_ABGR:
+                        avifRGBRowToGBR8(src, image->width, 4, 3, 2, 1, dstG, dstB, dstR);
+                        break;
+                    default:
+                        return AVIF_RESULT_NOT_IMPLEMENTED;
+                }
+            }
+        }
+        return AVIF_RESULT_OK;
+    }
+
+    const uint32_t rgbMaxChannel = state->rgbMaxChannel;
+    uint16_t * lut = (uint16_t *)avifAlloc((rgbMaxChannel + 1) * sizeof(uint16_t));
+    if (!lut) {
+        return AVIF_RESULT_OUT_OF_MEMORY;
+    }
+    for (uint32_t v = 0; v <= rgbMaxChannel; ++v) {
+        lut[v] = (uint16_t)avifReformatStateYToUNorm(state, v / state->rgbMaxChannelF);
+    }
+    for (uint32_t j = 0; j < image->height; ++j) {
+        const uint8_t * src = &rgb->pixels[j * rgb->rowBytes];
+        uint8_t * dstG = &yuvPlanes[AVIF_CHAN_Y][j * yuvRowBytes[AVIF_CHAN_Y]];
+        uint8_t * dstB = &yuvPlanes[AVIF_CHAN_U][j * yuvRowBytes[AVIF_CHAN_U]];
+        uint8_t * dstR = &yuvPlanes[AVIF_CHAN_V][j * yuvRowBytes[AVIF_CHAN_V]];
+        for (uint32_t i = 0; i < image->width; ++i) {
+            const uint8_t * pixel = &src[i * state->rgbPixelBytes];
+            uint32_t r, g, b;
+            if (state->rgbChannelBytes > 1) {
+                r = AVIF_MIN(*(const uint16_t *)&pixel[state->rgbOffsetBytesR], rgbMaxChannel);
+                g = AVIF_MIN(*(const uint16_t *)&pixel[state->rgbOffsetBytesG], rgbMaxChannel);
+                b = AVIF_MIN(*(const uint16_t *)&pixel[state->rgbOffsetBytesB], rgbMaxChannel);
+            } else {
+                r = pixel[state->rgbOffsetBytesR];
+                g = pixel[state->rgbOffsetBytesG];
+                b = pixel[state->rgbOffsetBytesB];
+            }
+            if (state->yuvChannelBytes > 1) {
+                ((uint16_t *)dstG)[i] = lut[g];
+                ((uint16_t *)dstB)[i] = lut[b];
+                ((uint16_t *)dstR)[i] = lut[r];
+            } else {
+                dstG[i] = (uint8_t)lut[g];
+                dstB[i] = (uint8_t)lut[b];
+                dstR[i] = (uint8_t)lut[r];
+            }
+        }
+    }
+    avifFree(lut);
+    return AVIF_RESULT_OK;
+}
+
+// Float RGB samples are converted to 16-bit unorm samples a band of rows at a time, and each band
+// goes through the integer conversion paths. The band stays in cache and no full-size copy of the
+// image is made. The number of rows is even so that every band starts on a chroma row.
+#define AVIF_FLOAT_RGB_BAND_ROWS 16
+
+static inline uint16_t avifFloatToUNorm16(float v)
+{
+    // The comparisons are written so that NaN is clamped to 0.
+    v = (v > 0.0f) ? v : 0.0f;
+    v = (v < 1.0f) ? v : 1.0f;
+    return (uint16_t)(v * 65535.0f + 0.5f);
+}
+
+static void avifF32RowToUNorm16(const float * src, uint16_t * dst, uint32_t sampleCount)
+{
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        dst[i] = avifFloatToUNorm16(src[i]);
+    }
+}
+
+static void avifF16RowToUNorm16(const uint16_t * src, uint16_t * dst, uint32_t sampleCount)
+{
+    for (uint32_t i = 0; i < sampleCount; ++i) {
+        // Moves the exponent and mantissa of the half float into place and rebiases the exponent
+        // by multiplying with 2^112. This also handles subnormals. Negative values are clamped to
+        // 0, infinities and NaNs end up above 1 and are clamped to 1.
+        union
+        {
+            float f;
+            uint32_t u32;
+        } f32;
+        f32.u32 = (uint32_t)(src[i] & 0x7FFF) << 13;
+        const float v = f32.f * 5.192296858534828e+33f;
+        dst[i] = avifFloatToUNorm16((src[i] & 0x8000) ? 0.0f : v);
+    }
+}
+
+static avifResult avifImageFloatRGBToYUV(avifImage * image, const avifRGBImage * rgb)
+{
+    if ((rgb->depth != 16) && (rgb->depth != 32)) {
+        return AVIF_RESULT_REFORMAT_FAILED;
+    }
+
+    const avifBool hasAlpha = avifRGBFormatHasAlpha(rgb->format) && !rgb->ignoreAlpha;
+    avifResult result = avifImageAllocatePlanes(image, hasAlpha ? AVIF_PLANES_ALL : AVIF_PLANES_YUV);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+
+    avifRGBImage bandRGB = *rgb;
+    bandRGB.depth = 16;
+    bandRGB.isFloat = AVIF_FALSE;
+    bandRGB.rowBytes = rgb->width * avifRGBImagePixelSize(&bandRGB);
+    bandRGB.pixels = (uint8_t *)avifAlloc((size_t)bandRGB.rowBytes * AVIF_MIN(AVIF_FLOAT_RGB_BAND_ROWS, image->height));
+    if (!bandRGB.pixels) {
+        return AVIF_RESULT_OUT_OF_MEMORY;
+    }
+
+    avifPixelFormatInfo info;
+    avifGetPixelFormatInfo(image->yuvFormat, &info);
+    const uint32_t sampleCount = rgb->width * avifRGBFormatChannelCount(rgb->format);
+    avifBool alphaRangeKnown = AVIF_TRUE;
+    uint32_t alphaMin = (1 << image->depth) - 1;
+    uint32_t alphaMax = 0;
+    for (uint32_t y = 0; y < image->height; y += AVIF_FLOAT_RGB_BAND_ROWS) {
+        const uint32_t bandRows = AVIF_MIN(AVIF_FLOAT_RGB_BAND_ROWS, image->height - y);
+        for (uint32_t j = 0; j < bandRows; ++j) {
+            const uint8_t * src = &rgb->pixels[(size_t)(y + j) * rgb->rowBytes];
+            uint16_t * dst = (uint16_t *)&bandRGB.pixels[(size_t)j * bandRGB.rowBytes];
+            if (rgb->depth == 32) {
+                avifF32RowToUNorm16((const float *)src, dst, sampleCount);
+            } else {
+                avifF16RowToUNorm16((const uint16_t *)src, dst, sampleCount);
+            }
+        }
+        bandRGB.height = bandRows;
+
+        // A view of the rows of the band, converted in place.
+        avifImage band = *image;
+        band.height = bandRows;
+        band.yuvPlanes[AVIF_CHAN_Y] += (size_t)y * image->yuvRowBytes[AVIF_CHAN_Y];
+        if (image->yuvPlanes[AVIF_CHAN_U] && image->yuvPlanes[AVIF_CHAN_V]) {
+            band.yuvPlanes[AVIF_CHAN_U] += (size_t)(y >> info.chromaShiftY) * image->yuvRowBytes[AVIF_CHAN_U];
+            band.yuvPlanes[AVIF_CHAN_V] += (size_t)(y >> info.chromaShiftY) * image->yuvRowBytes[AVIF_CHAN_V];
+        }
+        if (image->alphaPlane) {
+            band.alphaPlane += (size_t)y * image->alphaRowBytes;
+        }
+        band.alphaRangeKnown = AVIF_FALSE;
+        result = avifImageRGBToYUV(&band, &bandRGB);
+        if (result != AVIF_RESULT_OK) {
+            break;
+        }
+        if (band.alphaRangeKnown) {
+            alphaMin = AVIF_MIN(alphaMin, band.alphaMin);
+            alphaMax = AVIF_MAX(alphaMax, band.alphaMax);
+        } else {
+            alphaRangeKnown = AVIF_FALSE;
+        }
+    }
+    avifFree(bandRGB.pixels);
+    if (result != AVIF_RESULT_OK) {
+        return result;
+    }
+
+    if (image->alphaPlane && image->alphaRowBytes) {
+        image->alphaRangeKnown = alphaRangeKnown;
+        image->alphaMin = alphaMin;
+        image->alphaMax = alphaMax;
+    }
+    return AVIF_RESULT_OK;
+}
+
 avifResult avifImageRGBToYUV(avifImage * image, const avifRGBImage * rgb)
 {
     if (!rgb->pixels || rgb->format == AVIF_RGB_FORMAT_RGB_565) {
         return AVIF_RESULT_REFORMAT_FAILED;
     }
 
+    if (rgb->isFloat) {
+        return avifImageFloatRGBToYUV(image, rgb);
+    }
+
     avifReformatState state;
     if (!avifPrepareReformatState(image, rgb, &state)) {
         return AVIF_RESULT_REFORMAT_FAILED;
     }
 
-    if (rgb->isFloat) {
-        return AVIF_RESULT_NOT_IMPLEMENTED;
-    }
-
     const avifBool hasAlpha = avifRGBFormatHasAlpha(rgb->format) && !rgb->ignoreAlpha;
     avifResult allocationResult = avifImageAllocatePlanes(image, hasAlpha ? AVIF_PLANES_ALL : AVIF_PLANES_YUV);
     if (allocationResult != AVIF_RESULT_OK) {
@@ -236,6 +495,15 @@ avifResult avifImageRGBToYUV(avifImage * image, const avifRGBImage * rgb)
         converted = AVIF_TRUE;
     }
 
+    if (!converted && (state.mode == AVIF_REFORMAT_MODE_IDENTITY) && (alphaMode == AVIF_ALPHA_MULTIPLY_MODE_NO_OP)) {
+        const avifResult identityResult = avifImageRGBToYUVIdentity(image, rgb, &state);
+        if (identityResult == AVIF_RESULT_OK) {
+            converted = AVIF_TRUE;
+        } else if (identityResult != AVIF_RESULT_NOT_IMPLEMENTED) {
+            return identityResult;
+        }
+    }
+
     if (!converted && !rgb->avoidLibYUV && (alphaMode == AVIF_ALPHA_MULTIPLY_MODE_NO_OP)) {
         avifResult libyuvResult = avifImageRGBToYUVLibYUV(image, rgb);
         if (libyuvResult == AVIF_RESULT_OK) {
@@ -452,12 +720,15 @@ avifResult avifImageRGBToYUV(avifImage * image, const avifRGBImage * rgb)
             params.srcOffsetBytes = state.rgbOffsetBytesA;
             params.srcPixelBytes = state.rgbPixelBytes;
 
-            avifReformatAlpha(&params);
+            avifReformatAlpha(&params, &image->alphaMin, &image->alphaMax);
         } else {
             // libyuv does not fill alpha when converting from RGB to YUV so
             // fill it regardless of the value of convertedWithLibYUV.
             avifFillAlpha(&params);
+            image->alphaMin = (1 << image->depth) - 1;
+            image->alphaMax = image->alphaMin;
         }
+        image->alphaRangeKnown = AVIF_TRUE;
     }
     return AVIF_RESULT_OK;
 }
@@ -1070,6 +1341,58 @@ static avifResult avifImageIdentity8ToRGB8ColorFullRange(const avifImage * image
     return AVIF_RESULT_OK;
 }
 
+// Identity (GBR) to RGB for any depth and range: every sample goes through a table holding the
+// result of the float path for each possible code point.
+static avifResult avifImageIdentityToRGBColor(const avifImage * image, avifRGBImage * rgb, avifReformatState * state)
+{
+    const uint32_t rgbPixelBytes = state->rgbPixelBytes;
+    const uint32_t yuvMaxChannel = (uint32_t)state->yuvMaxChannel;
+    const float rgbMaxChannelF = state->rgbMaxChannelF;
+
+    uint16_t lut[1 << 12];
+    for (uint32_t cp = 0; cp <= yuvMaxChannel; ++cp) {
+        const float v = AVIF_CLAMP(state->unormFloatTableY[cp], 0.0f, 1.0f);
+        lut[cp] = (uint16_t)(0.5f + (v * rgbMaxChannelF));
+    }
+
+    for (uint32_t j = 0; j < image->height; ++j) {
+        const uint8_t * const ptrY = &image->yuvPlanes[AVIF_CHAN_Y][(j * image->yuvRowBytes[AVIF_CHAN_Y])];
+        const uint8_t * const ptrU = &image->yuvPlanes[AVIF_CHAN_U][(j * image->yuvRowBytes[AVIF_CHAN_U])];
+        const uint8_t * const ptrV = &image->yuvPlanes[AVIF_CHAN_V][(j * image->yuvRowBytes[AVIF_CHAN_V])];
+        uint8_t * ptrR = &rgb->pixels[state->rgbOffsetBytesR + (j * rgb->rowBytes)];
+        uint8_t * ptrG = &rgb->pixels[state->rgbOffsetBytesG + (j * rgb->rowBytes)];
+        uint8_t * ptrB = &rgb->pixels[state->rgbOffsetBytesB + (j * rgb->rowBytes)];
+
+        for (uint32_t i = 0; i < image->width; ++i) {
+            uint32_t unormG, unormB, unormR;
+            if (image->depth == 8) {
+                unormG = ptrY[i];
+                unormB = ptrU[i];
+                unormR = ptrV[i];
+            } else {
+                // clamp incoming data to protect against bad LUT lookups
+                unormG = AVIF_MIN(((const uint16_t *)ptrY)[i], yuvMaxChannel);
+                unormB = AVIF_MIN(((const uint16_t *)ptrU)[i], yuvMaxChannel);
+                unormR = AVIF_MIN(((const uint16_t *)ptrV)[i], yuvMaxChannel);
+            }
+
+            if (rgb->depth == 8) {
+                *ptrR = (uint8_t)lut[unormR];
+                *ptrG = (uint8_t)lut[unormG];
+                *ptrB = (uint8_t)lut[unormB];
+            } else {
+                *((uint16_t *)ptrR) = lut[unormR];
+                *((uint16_t *)ptrG) = lut[unormG];
+                *((uint16_t *)ptrB) = lut[unormB];
+            }
+            ptrR += rgbPixelBytes;
+            ptrG += rgbPixelBytes;
+            ptrB += rgbPixelBytes;
+        }
+    }
+    return AVIF_RESULT_OK;
+}
+
 static avifResult avifImageYUV8ToRGB8Color(const avifImage * image, avifRGBImage * rgb, avifReformatState * state)
 {
     const float kr = state->kr;
@@ -1239,7 +1562,7 @@ avifResult avifImageYUVToRGB(const avifImage * image, avifRGBImage * rgb)
             params.srcOffsetBytes = 0;
             params.srcPixelBytes = state.yuvChannelBytes;
 
-            avifReformatAlpha(&params);
+            avifReformatAlpha(&params, NULL, NULL);
         } else {
             if (!convertedWithLibYUV) { // libyuv fills alpha for us
                 avifFillAlpha(&params);
@@ -1271,9 +1594,9 @@ avifResult avifImageYUVToRGB(const avifImage * image, avifRGBImage * rgb)
                 if ((image->depth == 8) && (rgb->depth == 8) && (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) &&
                     (image->yuvRange == AVIF_RANGE_FULL)) {
                     convertResult = avifImageIdentity8ToRGB8ColorFullRange(image, rgb, &state);
+                } else if (hasColor && (image->yuvFormat == AVIF_PIXEL_FORMAT_YUV444) && (rgb->format != AVIF_RGB_FORMAT_RGB_565)) {
+                    convertResult = avifImageIdentityToRGBColor(image, rgb, &state);
                 }
-
-                // TODO: Add more fast paths for identity
             } else if (state.mode == AVIF_REFORMAT_MODE_YUV_COEFFICIENTS) {
                 if (image->depth > 8) {
                     // yuv:u16
@@ -5,26 +5,24 @@
 
 #if !defined(AVIF_LIBYUV_ENABLED)
 
-avifBool avifImageScale(avifImage * image,
-                        uint32_t dstWidth,
-                        uint32_t dstHeight,
-                        uint32_t imageSizeLimit,
-                        uint32_t imageDimensionLimit,
-                        avifDiagnostics * diag)
+avifResult avifImageScale(avifImage * image, uint32_t dstWidth, uint32_t dstHeight, int maxThreads, avifDiagnostics * diag)
 {
     (void)image;
     (void)dstWidth;
     (void)dstHeight;
-    (void)imageSizeLimit;
-    (void)imageDimensionLimit;
+    (void)maxThreads;
     avifDiagnosticsPrintf(diag, "avifImageScale() called, but is unimplemented without libyuv!");
-    return AVIF_FALSE;
+    return AVIF_RESULT_NOT_IMPLEMENTED;
 }
 
 #else
 
 #include <limits.h>
 
+#if defined(AVIF_PTHREADS_ENABLED)
+#include <pthread.h>
+#endif
+
 #if defined(__clang__)
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wstrict-prototypes" // "this function declaration is not a prototype"
@@ -42,141 +40,264 @@ avifBool avifImageScale(avifImage * image,
 // This should be configurable and/or smarter. kFilterBox has the highest quality but is the slowest.
 #define AVIF_LIBYUV_FILTER_MODE kFilterBox
 
-avifBool avifImageScale(avifImage * image,
-                        uint32_t dstWidth,
-                        uint32_t dstHeight,
-                        uint32_t imageSizeLimit,
-                        uint32_t imageDimensionLimit,
-                        avifDiagnostics * diag)
+// Below this number of source samples, a plane is not worth a thread.
+#define AVIF_SCALE_MIN_THREAD_SAMPLES (256 * 256)
+
+// A simple conservative limit to avoid integer overflows in libyuv's ScalePlane() and
+// ScalePlane_12() functions. Larger sources are first reduced by an integer factor.
+#define AVIF_SCALE_MAX_LIBYUV_DIMENSION 16384
+
+// One plane to scale from src to dst.
+typedef struct avifScalePlaneJob
 {
-    if ((image->width == dstWidth) && (image->height == dstHeight)) {
-        // Nothing to do
-        return AVIF_TRUE;
+    uint8_t * src;
+    uint32_t srcRowBytes;
+    uint32_t srcWidth;
+    uint32_t srcHeight;
+    uint8_t * dst;
+    uint32_t dstRowBytes;
+    uint32_t dstWidth;
+    uint32_t dstHeight;
+    avifBool uses16;
+    // If not NULL, the image owning the source plane, which is released through its allocator once
+    // scaled.
+    const avifImage * srcOwner;
+} avifScalePlaneJob;
+
+static void avifScalePlane(const avifScalePlaneJob * job)
+{
+    if (job->uses16) {
+#if LIBYUV_VERSION >= 1774
+        ScalePlane_12((uint16_t *)job->src,
+                      job->srcRowBytes / 2,
+                      job->srcWidth,
+                      job->srcHeight,
+                      (uint16_t *)job->dst,
+                      job->dstRowBytes / 2,
+                      job->dstWidth,
+                      job->dstHeight,
+                      AVIF_LIBYUV_FILTER_MODE);
+#else
+        ScalePlane_16((uint16_t *)job->src,
+                      job->srcRowBytes / 2,
+                      job->srcWidth,
+                      job->srcHeight,
+                      (uint16_t *)job->dst,
+                      job->dstRowBytes / 2,
+                      job->dstWidth,
+                      job->dstHeight,
+                      AVIF_LIBYUV_FILTER_MODE);
+#endif
+    } else {
+        ScalePlane(job->src,
+                   job->srcRowBytes,
+                   job->srcWidth,
+                   job->srcHeight,
+                   job->dst,
+                   job->dstRowBytes,
+                   job->dstWidth,
+                   job->dstHeight,
+                   AVIF_LIBYUV_FILTER_MODE);
+    }
+    if (job->srcOwner) {
+        avifImageReleasePlane(job->srcOwner, job->src);
     }
+}
 
-    if ((dstWidth == 0) || (dstHeight == 0)) {
-        avifDiagnosticsPrintf(diag, "avifImageScale requested invalid dst dimensions [%ux%u]", dstWidth, dstHeight);
-        return AVIF_FALSE;
+// Averages the samples of each factor x factor block of the source plane into one sample of the
+// destination plane. The blocks of the last row and column are clipped to the source plane.
+static void avifReducePlane(const avifScalePlaneJob * job, uint32_t factor)
+{
+    for (uint32_t y = 0; y < job->dstHeight; ++y) {
+        const uint32_t srcY0 = AVIF_MIN(y * factor, job->srcHeight - 1);
+        const uint32_t srcY1 = AVIF_MIN(srcY0 + factor, job->srcHeight);
+        uint8_t * dstRow = &job->dst[(size_t)y * job->dstRowBytes];
+        for (uint32_t x = 0; x < job->dstWidth; ++x) {
+            const uint32_t srcX0 = AVIF_MIN(x * factor, job->srcWidth - 1);
+            const uint32_t srcX1 = AVIF_MIN(srcX0 + factor, job->srcWidth);
+            uint32_t sum = 0;
+            for (uint32_t j = srcY0; j < srcY1; ++j) {
+                const uint8_t * srcRow = &job->src[(size_t)j * job->srcRowBytes];
+                for (uint32_t i = srcX0; i < srcX1; ++i) {
+                    sum += job->uses16 ? ((const uint16_t *)srcRow)[i] : srcRow[i];
+                }
+            }
+            const uint32_t count = (srcY1 - srcY0) * (srcX1 - srcX0);
+            const uint32_t average = (sum + count / 2) / count;
+            if (job->uses16) {
+                ((uint16_t *)dstRow)[x] = (uint16_t)average;
+            } else {
+                dstRow[x] = (uint8_t)average;
+            }
+        }
     }
-    if (avifDimensionsTooLarge(dstWidth, dstHeight, imageSizeLimit, imageDimensionLimit)) {
-        avifDiagnosticsPrintf(diag, "avifImageScale requested dst dimensions that are too large [%ux%u]", dstWidth, dstHeight);
-        return AVIF_FALSE;
+    if (job->srcOwner) {
+        avifImageReleasePlane(job->srcOwner, job->src);
     }
+}
+
+#if defined(AVIF_PTHREADS_ENABLED)
+static void * avifScalePlaneThread(void * arg)
+{
+    avifScalePlane((const avifScalePlaneJob *)arg);
+    return NULL;
+}
+#endif
+
+// Replaces the planes of image by planes of dstWidth x dstHeight samples, scaled with libyuv, or
+// reduced with avifReducePlane() if reduceFactor is not 0.
+static avifResult avifImageResample(avifImage * image,
+                                    uint32_t dstWidth,
+                                    uint32_t dstHeight,
+                                    uint32_t reduceFactor,
+                                    int maxThreads,
+                                    avifDiagnostics * diag)
+{
+    const uint32_t srcWidth = image->width;
+    const uint32_t srcHeight = image->height;
 
-    uint8_t * srcYUVPlanes[AVIF_PLANE_COUNT_YUV];
-    uint32_t srcYUVRowBytes[AVIF_PLANE_COUNT_YUV];
+    // Detach the source planes, then allocate the destination planes.
+    avifImage src = *image;
+    image->width = dstWidth;
+    image->height = dstHeight;
+    avifPlanesFlags planes = 0;
     for (int i = 0; i < AVIF_PLANE_COUNT_YUV; ++i) {
-        srcYUVPlanes[i] = image->yuvPlanes[i];
         image->yuvPlanes[i] = NULL;
-        srcYUVRowBytes[i] = image->yuvRowBytes[i];
         image->yuvRowBytes[i] = 0;
     }
-    const avifBool srcImageOwnsYUVPlanes = image->imageOwnsYUVPlanes;
     image->imageOwnsYUVPlanes = AVIF_FALSE;
-
-    uint8_t * srcAlphaPlane = image->alphaPlane;
+    if (src.yuvPlanes[AVIF_CHAN_Y]) {
+        planes |= AVIF_PLANES_YUV;
+    }
     image->alphaPlane = NULL;
-    uint32_t srcAlphaRowBytes = image->alphaRowBytes;
     image->alphaRowBytes = 0;
-    const avifBool srcImageOwnsAlphaPlane = image->imageOwnsAlphaPlane;
     image->imageOwnsAlphaPlane = AVIF_FALSE;
-
-    const uint32_t srcWidth = image->width;
-    image->width = dstWidth;
-    const uint32_t srcHeight = image->height;
-    image->height = dstHeight;
-
-    if (srcYUVPlanes[0] || srcAlphaPlane) {
-        // A simple conservative check to avoid integer overflows in libyuv's ScalePlane() and
-        // ScalePlane_12() functions.
-        if (srcWidth > 16384) {
-            avifDiagnosticsPrintf(diag, "avifImageScale requested invalid width scale for libyuv [%u -> %u]", srcWidth, dstWidth);
-            return AVIF_FALSE;
-        }
-        if (srcHeight > 16384) {
-            avifDiagnosticsPrintf(diag, "avifImageScale requested invalid height scale for libyuv [%u -> %u]", srcHeight, dstHeight);
-            return AVIF_FALSE;
+    if (src.alphaPlane) {
+        planes |= AVIF_PLANES_A;
+    }
+    if (planes) {
+        const avifResult allocationResult = avifImageAllocatePlanes(image, planes);
+        if (allocationResult != AVIF_RESULT_OK) {
+            avifDiagnosticsPrintf(diag, "Allocation of planes failed: %s", avifResultToString(allocationResult));
+            avifImageFreePlanes(image, AVIF_PLANES_ALL);
+            *image = src;
+            return allocationResult;
         }
     }
 
-    if (srcYUVPlanes[0]) {
-        const avifResult allocationResult = avifImageAllocatePlanes(image, AVIF_PLANES_YUV);
-        if (allocationResult != AVIF_RESULT_OK) {
-            avifDiagnosticsPrintf(diag, "Allocation of YUV planes failed: %s", avifResultToString(allocationResult));
-            return AVIF_FALSE;
+    avifScalePlaneJob jobs[AVIF_PLANE_COUNT_YUV + 1];
+    int jobCount = 0;
+    avifPixelFormatInfo formatInfo;
+    avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
+    const avifBool uses16 = image->depth > 8;
+    for (int i = 0; i < AVIF_PLANE_COUNT_YUV; ++i) {
+        if (!src.yuvPlanes[i]) {
+            continue;
         }
+        const int shiftX = (i == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftX;
+        const int shiftY = (i == AVIF_CHAN_Y) ? 0 : formatInfo.chromaShiftY;
+        avifScalePlaneJob * job = &jobs[jobCount++];
+        job->src = src.yuvPlanes[i];
+        job->srcRowBytes = src.yuvRowBytes[i];
+        job->srcWidth = (srcWidth + shiftX) >> shiftX;
+        job->srcHeight = (srcHeight + shiftY) >> shiftY;
+        job->dst = image->yuvPlanes[i];
+        job->dstRowBytes = image->yuvRowBytes[i];
+        job->dstWidth = (dstWidth + shiftX) >> shiftX;
+        job->dstHeight = (dstHeight + shiftY) >> shiftY;
+        job->uses16 = uses16;
+        job->srcOwner = src.imageOwnsYUVPlanes ? &src : NULL;
+    }
+    if (src.alphaPlane) {
+        avifScalePlaneJob * job = &jobs[jobCount++];
+        job->src = src.alphaPlane;
+        job->srcRowBytes = src.alphaRowBytes;
+        job->srcWidth = srcWidth;
+        job->srcHeight = srcHeight;
+        job->dst = image->alphaPlane;
+        job->dstRowBytes = image->alphaRowBytes;
+        job->dstWidth = dstWidth;
+        job->dstHeight = dstHeight;
+        job->uses16 = uses16;
+        job->srcOwner = src.imageOwnsAlphaPlane ? &src : NULL;
+    }
 
-        avifPixelFormatInfo formatInfo;
-        avifGetPixelFormatInfo(image->yuvFormat, &formatInfo);
-        const uint32_t srcUVWidth = (srcWidth + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX;
-        const uint32_t srcUVHeight = (srcHeight + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY;
-        const uint32_t dstUVWidth = (dstWidth + formatInfo.chromaShiftX) >> formatInfo.chromaShiftX;
-        const uint32_t dstUVHeight = (dstHeight + formatInfo.chromaShiftY) >> formatInfo.chromaShiftY;
+    if (reduceFactor) {
+        for (int i = 0; i < jobCount; ++i) {
+            avifReducePlane(&jobs[i], reduceFactor);
+        }
+        return AVIF_RESULT_OK;
+    }
 
-        for (int i = 0; i < AVIF_PLANE_COUNT_YUV; ++i) {
-            if (!srcYUVPlanes[i]) {
-                continue;
+    // The first plane is scaled by the calling thread, the others by up to maxThreads-1 threads.
+    int firstSyncJob = jobCount;
+#if defined(AVIF_PTHREADS_ENABLED)
+    pthread_t threads[AVIF_PLANE_COUNT_YUV + 1];
+    int threadCount = 0;
+    if ((uint64_t)srcWidth * srcHeight >= AVIF_SCALE_MIN_THREAD_SAMPLES) {
+        while ((threadCount < jobCount - 1) && (threadCount < maxThreads - 1)) {
+            if (pthread_create(&threads[threadCount], NULL, avifScalePlaneThread, &jobs[jobCount - 1 - threadCount]) != 0) {
+                break;
             }
-
-            const uint32_t srcW = (i == AVIF_CHAN_Y) ? srcWidth : srcUVWidth;
-            const uint32_t srcH = (i == AVIF_CHAN_Y) ? srcHeight : srcUVHeight;
-            const uint32_t dstW = (i == AVIF_CHAN_Y) ? dstWidth : dstUVWidth;
-            const uint32_t dstH = (i == AVIF_CHAN_Y) ? dstHeight : dstUVHeight;
-            if (image->depth > 8) {
-                uint16_t * const srcPlane = (uint16_t *)srcYUVPlanes[i];
-                const uint32_t srcStride = srcYUVRowBytes[i] / 2;
-                uint16_t * const dstPlane = (uint16_t *)image->yuvPlanes[i];
-                const uint32_t dstStride = image->yuvRowBytes[i] / 2;
-#if LIBYUV_VERSION >= 1774
-                ScalePlane_12(srcPlane, srcStride, srcW, srcH, dstPlane, dstStride, dstW, dstH, AVIF_LIBYUV_FILTER_MODE);
+            ++threadCount;
+        }
+    }
+    firstSyncJob = jobCount - threadCount;
 #else
-                ScalePlane_16(srcPlane, srcStride, srcW, srcH, dstPlane, dstStride, dstW, dstH, AVIF_LIBYUV_FILTER_MODE);
+    (void)maxThreads;
 #endif
-            } else {
-                uint8_t * const srcPlane = srcYUVPlanes[i];
-                const uint32_t srcStride = srcYUVRowBytes[i];
-                uint8_t * const dstPlane = image->yuvPlanes[i];
-                const uint32_t dstStride = image->yuvRowBytes[i];
-                ScalePlane(srcPlane, srcStride, srcW, srcH, dstPlane, dstStride, dstW, dstH, AVIF_LIBYUV_FILTER_MODE);
-            }
+    for (int i = 0; i < firstSyncJob; ++i) {
+        avifScalePlane(&jobs[i]);
+    }
+#if defined(AVIF_PTHREADS_ENABLED)
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+#endif
+    return AVIF_RESULT_OK;
+}
 
-            if (srcImageOwnsYUVPlanes) {
-                avifFree(srcYUVPlanes[i]);
-            }
-        }
+avifResult avifImageScale(avifImage * image, uint32_t dstWidth, uint32_t dstHeight, int maxThreads, avifDiagnostics * diag)
+{
+    if ((image->width == dstWidth) && (image->height == dstHeight)) {
+        // Nothing to do
+        return AVIF_RESULT_OK;
     }
 
-    if (srcAlphaPlane) {
-        const avifResult allocationResult = avifImageAllocatePlanes(image, AVIF_PLANES_A);
-        if (allocationResult != AVIF_RESULT_OK) {
-            avifDiagnosticsPrintf(diag, "Allocation of alpha plane failed: %s", avifResultToString(allocationResult));
-            return AVIF_FALSE;
-        }
+    if ((dstWidth == 0) || (dstHeight == 0)) {
+        avifDiagnosticsPrintf(diag, "avifImageScale requested invalid dst dimensions [%ux%u]", dstWidth, dstHeight);
+        return AVIF_RESULT_INVALID_ARGUMENT;
+    }
+    if (avifDimensionsTooLarge(dstWidth, dstHeight, AVIF_DEFAULT_IMAGE_SIZE_LIMIT, AVIF_DEFAULT_IMAGE_DIMENSION_LIMIT)) {
+        avifDiagnosticsPrintf(diag, "avifImageScale requested dst dimensions that are too large [%ux%u]", dstWidth, dstHeight);
+        return AVIF_RESULT_INVALID_ARGUMENT;
+    }
 
-        if (image->depth > 8) {
-            uint16_t * const srcPlane = (uint16_t *)srcAlphaPlane;
-            const uint32_t srcStride = srcAlphaRowBytes / 2;
-            uint16_t * const dstPlane = (uint16_t *)image->alphaPlane;
-            const uint32_t dstStride = image->alphaRowBytes / 2;
-#if LIBYUV_VERSION >= 1774
-            ScalePlane_12(srcPlane, srcStride, srcWidth, srcHeight, dstPlane, dstStride, dstWidth, dstHeight, AVIF_LIBYUV_FILTER_MODE);
-#else
-            ScalePlane_16(srcPlane, srcStride, srcWidth, srcHeight, dstPlane, dstStride, dstWidth, dstHeight, AVIF_LIBYUV_FILTER_MODE);
-#endif
-        } else {
-            uint8_t * const srcPlane = srcAlphaPlane;
-            const uint32_t srcStride = srcAlphaRowBytes;
-            uint8_t * const dstPlane = image->alphaPlane;
-            const uint32_t dstStride = image->alphaRowBytes;
-            ScalePlane(srcPlane, srcStride, srcWidth, srcHeight, dstPlane, dstStride, dstWidth, dstHeight, AVIF_LIBYUV_FILTER_MODE);
+    const uint32_t srcWidth = image->width;
+    const uint32_t srcHeight = image->height;
+    if ((image->yuvPlanes[AVIF_CHAN_Y] || image->alphaPlane) &&
+        ((srcWidth > AVIF_SCALE_MAX_LIBYUV_DIMENSION) || (srcHeight > AVIF_SCALE_MAX_LIBYUV_DIMENSION))) {
+        // Too large for libyuv. Reduce by the smallest integer factor that fits, as long as the
+        // result is not smaller than the destination, which would lose detail.
+        const uint32_t largestDimension = AVIF_MAX(srcWidth, srcHeight);
+        const uint32_t factor = (largestDimension + AVIF_SCALE_MAX_LIBYUV_DIMENSION - 1) / AVIF_SCALE_MAX_LIBYUV_DIMENSION;
+        const uint32_t reducedWidth = (srcWidth + factor - 1) / factor;
+        const uint32_t reducedHeight = (srcHeight + factor - 1) / factor;
+        if ((reducedWidth < dstWidth) || (reducedHeight < dstHeight)) {
+            avifDiagnosticsPrintf(diag,
+                                  "avifImageScale requested invalid scale for libyuv [%ux%u -> %ux%u]",
+                                  srcWidth,
+                                  srcHeight,
+                                  dstWidth,
+                                  dstHeight);
+            return AVIF_RESULT_INVALID_ARGUMENT;
         }
-
-        if (srcImageOwnsAlphaPlane) {
-            avifFree(srcAlphaPlane);
+        const avifResult reduceResult = avifImageResample(image, reducedWidth, reducedHeight, factor, maxThreads, diag);
+        if ((reduceResult != AVIF_RESULT_OK) || ((reducedWidth == dstWidth) && (reducedHeight == dstHeight))) {
+            return reduceResult;
         }
     }
-
-    return AVIF_TRUE;
+    return avifImageResample(image, dstWidth, dstHeight, /*reduceFactor=*/0, maxThreads, diag);
 }
 
 #endif
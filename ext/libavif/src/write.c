@@ -7,6 +7,10 @@
 #include <string.h>
 #include <time.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
 #define MAX_ASSOCIATIONS 16
 struct ipmaArray
 {
@@ -36,7 +40,6 @@ static const size_t alphaURNSize = sizeof(alphaURN);
 static const char xmpContentType[] = AVIF_CONTENT_TYPE_XMP;
 static const size_t xmpContentTypeSize = sizeof(xmpContentType);
 
-static avifBool avifImageIsOpaque(const avifImage * image);
 static void writeConfigBox(avifRWStream * s, avifCodecConfigurationBox * cfg);
 
 // ---------------------------------------------------------------------------
@@ -216,9 +219,14 @@ typedef struct avifEncoderData
     uint16_t primaryItemID;
     avifBool singleImage; // if true, the AVIF_ADD_IMAGE_FLAG_SINGLE flag was set on the first call to avifEncoderAddImage()
     avifBool alphaPresent;
+    // Color and alpha codec instances kept by avifEncoderReset() when avifEncoder.reuseCodecs is
+    // set, and the settings they were created with.
+    avifCodec * idleCodecs[2];
+    avifEncoder idleEncoder;
 } avifEncoderData;
 
 static void avifEncoderDataDestroy(avifEncoderData * data);
+static void avifEncoderDataDropIdleCodecs(avifEncoderData * data);
 
 static avifEncoderData * avifEncoderDataCreate()
 {
@@ -282,12 +290,35 @@ static void avifEncoderDataDestroy(avifEncoderData * data)
         avifRWDataFree(&item->metadataPayload);
         avifArrayDestroy(&item->mdatFixups);
     }
+    avifEncoderDataDropIdleCodecs(data);
     avifImageDestroy(data->imageMetadata);
     avifArrayDestroy(&data->items);
     avifArrayDestroy(&data->frames);
     avifFree(data);
 }
 
+static void avifEncoderDataDropIdleCodecs(avifEncoderData * data)
+{
+    for (int i = 0; i < 2; ++i) {
+        if (data->idleCodecs[i]) {
+            avifCodecDestroy(data->idleCodecs[i]);
+            data->idleCodecs[i] = NULL;
+        }
+    }
+}
+
+// Returns the idle codec instance kept for color or alpha by avifEncoderReset(), or else a new one.
+static avifCodec * avifEncoderDataCreateItemCodec(avifEncoderData * data, avifCodecChoice codecChoice, avifBool alpha, avifBool * reused)
+{
+    avifCodec * codec = data->idleCodecs[alpha ? 1 : 0];
+    if (codec) {
+        data->idleCodecs[alpha ? 1 : 0] = NULL;
+        *reused = AVIF_TRUE;
+        return codec;
+    }
+    return avifCodecCreate(codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+}
+
 static void avifEncoderItemAddMdatFixup(avifEncoderItem * item, const avifRWStream * s)
 {
     avifOffsetFixup * fixup = (avifOffsetFixup *)avifArrayPushPtr(&item->mdatFixups);
@@ -404,6 +435,29 @@ void avifEncoderDestroy(avifEncoder * encoder)
     avifFree(encoder);
 }
 
+avifResult avifEncoderReset(avifEncoder * encoder)
+{
+    avifEncoderData * data = avifEncoderDataCreate();
+    if (!data) {
+        return AVIF_RESULT_OUT_OF_MEMORY;
+    }
+    // Keep the codec instances that can encode another single image after their flush.
+    for (uint32_t i = 0; i < encoder->data->items.count; ++i) {
+        avifEncoderItem * item = &encoder->data->items.item[i];
+        avifCodec ** idleCodec = &data->idleCodecs[item->alpha ? 1 : 0];
+        if (item->codec && item->codec->reusable && !*idleCodec) {
+            *idleCodec = item->codec;
+            item->codec = NULL;
+        }
+    }
+    data->idleEncoder = encoder->data->lastEncoder;
+    avifEncoderDataDestroy(encoder->data);
+    encoder->data = data;
+    memset(&encoder->ioStats, 0, sizeof(encoder->ioStats));
+    avifDiagnosticsClearError(&encoder->diag);
+    return AVIF_RESULT_OK;
+}
+
 void avifEncoderSetCodecSpecificOption(avifEncoder * encoder, const char * key, const char * value)
 {
     avifCodecSpecificOptionsSet(encoder->csOptions, key, value);
@@ -772,6 +826,7 @@ static void avifCopyAndPadPlane(uint8_t * dstPlane,
 static avifImage * avifImageCopyAndPad(const avifImage * srcImage, uint32_t dstWidth, uint32_t dstHeight)
 {
     avifImage * dstImage = avifImageCreate(dstWidth, dstHeight, srcImage->depth, srcImage->yuvFormat);
+    dstImage->planeAllocator = srcImage->planeAllocator;
 
     if (srcImage->yuvPlanes[AVIF_CHAN_Y]) {
         const avifResult allocationResult = avifImageAllocatePlanes(dstImage, AVIF_PLANES_YUV);
@@ -790,7 +845,7 @@ static avifImage * avifImageCopyAndPad(const avifImage * srcImage, uint32_t dstW
             if (!srcImage->yuvRowBytes[yuvPlane]) {
                 // Plane is absent. If we're copying from a source without
                 // them, mimic the source image's state by removing our copy.
-                avifFree(dstImage->yuvPlanes[yuvPlane]);
+                avifImageReleasePlane(dstImage, dstImage->yuvPlanes[yuvPlane]);
                 dstImage->yuvPlanes[yuvPlane] = NULL;
                 dstImage->yuvRowBytes[yuvPlane] = 0;
                 continue;
@@ -826,6 +881,37 @@ static avifImage * avifImageCopyAndPad(const avifImage * srcImage, uint32_t dstW
     return dstImage;
 }
 
+// Returns the wall clock time in milliseconds from a monotonic clock, to check
+// avifEncoder.frameDeadlineMs. Processor time would run faster when the codec uses several threads.
+static uint64_t avifEncoderNowMs(void)
+{
+#if defined(_WIN32)
+    return (uint64_t)GetTickCount64();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
+// Calls encoder->progressFunc, if any. Returns AVIF_FALSE if the encoding must stop.
+static avifBool avifEncoderReportProgress(const avifEncoder * encoder, uint32_t done, uint32_t total)
+{
+    return !encoder->progressFunc || encoder->progressFunc(encoder->progressUserData, done, total);
+}
+
+// Returns the number of items encoded by an AV1 codec, that is all items but the grid items.
+static uint32_t avifEncoderDataCodecCount(const avifEncoderData * data)
+{
+    uint32_t codecCount = 0;
+    for (uint32_t itemIndex = 0; itemIndex < data->items.count; ++itemIndex) {
+        if (data->items.item[itemIndex].codec) {
+            ++codecCount;
+        }
+    }
+    return codecCount;
+}
+
 static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
                                               uint32_t gridCols,
                                               uint32_t gridRows,
@@ -833,6 +919,8 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
                                               uint64_t durationInTimescales,
                                               avifAddImageFlags addImageFlags)
 {
+    const uint64_t startMs = encoder->frameDeadlineMs ? avifEncoderNowMs() : 0;
+
     // -----------------------------------------------------------------------
     // Verify encoding is possible
 
@@ -964,6 +1052,17 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
 
         // Prepare all AV1 items
 
+        // The codec instances kept by avifEncoderReset() can only encode another single image
+        // without grid, with the settings they were created with.
+        const avifEncoder * idleEncoder = &encoder->data->idleEncoder;
+        const avifBool keepCodecs = encoder->reuseCodecs && (cellCount == 1) && (addImageFlags & AVIF_ADD_IMAGE_FLAG_SINGLE);
+        if (!keepCodecs || (idleEncoder->codecChoice != encoder->codecChoice) || (idleEncoder->maxThreads != encoder->maxThreads) ||
+            (idleEncoder->speed != encoder->speed) || (idleEncoder->keyframeInterval != encoder->keyframeInterval) ||
+            (idleEncoder->timescale != encoder->timescale)) {
+            avifEncoderDataDropIdleCodecs(encoder->data);
+        }
+        avifBool reusedCodecs = AVIF_FALSE;
+
         uint16_t gridColorID = 0;
         if (cellCount > 1) {
             avifEncoderItem * gridColorItem = avifEncoderDataCreateItem(encoder->data, "grid", "Color", 6, 0);
@@ -979,13 +1078,14 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
 
         for (uint32_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
             avifEncoderItem * item = avifEncoderDataCreateItem(encoder->data, "av01", "Color", 6, cellIndex);
-            item->codec = avifCodecCreate(encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+            item->codec = avifEncoderDataCreateItemCodec(encoder->data, encoder->codecChoice, AVIF_FALSE, &reusedCodecs);
             if (!item->codec) {
                 // Just bail out early, we're not surviving this function without an encoder compiled in
                 return AVIF_RESULT_NO_CODEC_AVAILABLE;
             }
             item->codec->csOptions = encoder->csOptions;
             item->codec->diag = &encoder->diag;
+            item->codec->keepAfterFlush = keepCodecs;
 
             if (cellCount > 1) {
                 item->dimgFromID = gridColorID;
@@ -1040,12 +1140,13 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
 
             for (uint32_t cellIndex = 0; cellIndex < cellCount; ++cellIndex) {
                 avifEncoderItem * item = avifEncoderDataCreateItem(encoder->data, "av01", "Alpha", 6, cellIndex);
-                item->codec = avifCodecCreate(encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+                item->codec = avifEncoderDataCreateItemCodec(encoder->data, encoder->codecChoice, AVIF_TRUE, &reusedCodecs);
                 if (!item->codec) {
                     return AVIF_RESULT_NO_CODEC_AVAILABLE;
                 }
                 item->codec->csOptions = encoder->csOptions;
                 item->codec->diag = &encoder->diag;
+                item->codec->keepAfterFlush = keepCodecs;
                 item->alpha = AVIF_TRUE;
 
                 if (cellCount > 1) {
@@ -1065,6 +1166,14 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
             }
         }
 
+        avifEncoderDataDropIdleCodecs(encoder->data);
+        if (reusedCodecs) {
+            // The settings a reused codec instance was left with are unknown to lastEncoder.
+            encoderChanges |= AVIF_ENCODER_CHANGE_MIN_QUANTIZER | AVIF_ENCODER_CHANGE_MAX_QUANTIZER |
+                              AVIF_ENCODER_CHANGE_MIN_QUANTIZER_ALPHA | AVIF_ENCODER_CHANGE_MAX_QUANTIZER_ALPHA |
+                              AVIF_ENCODER_CHANGE_TILE_ROWS_LOG2 | AVIF_ENCODER_CHANGE_TILE_COLS_LOG2;
+        }
+
         // -----------------------------------------------------------------------
         // Create metadata items (Exif, XMP)
 
@@ -1123,9 +1232,19 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
         addImageFlags |= AVIF_ADD_IMAGE_FLAG_FORCE_KEYFRAME;
     }
 
+    const uint32_t codecCount = avifEncoderDataCodecCount(encoder->data);
+    uint32_t encodedCount = 0;
+    if (!avifEncoderReportProgress(encoder, encodedCount, codecCount)) {
+        return AVIF_RESULT_CANCELED;
+    }
+    avifBool deadlinePassed = AVIF_FALSE;
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
         if (item->codec) {
+            if (encoder->frameDeadlineMs && !deadlinePassed) {
+                deadlinePassed = (avifEncoderNowMs() - startMs) >= encoder->frameDeadlineMs;
+            }
+            const avifEncoderChanges itemChanges = encoderChanges | (deadlinePassed ? AVIF_ENCODER_CHANGE_DEADLINE_PASSED : 0);
             const avifImage * cellImage = cellImages[item->cellIndex];
             avifImage * paddedCellImage = NULL;
             if ((cellImage->width != tileWidth) || (cellImage->height != tileHeight)) {
@@ -1141,7 +1260,7 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
                                                                item->alpha,
                                                                encoder->data->tileRowsLog2,
                                                                encoder->data->tileColsLog2,
-                                                               encoderChanges,
+                                                               itemChanges,
                                                                addImageFlags,
                                                                item->encodeOutput);
             if (paddedCellImage) {
@@ -1153,6 +1272,9 @@ static avifResult avifEncoderAddImageInternal(avifEncoder * encoder,
             if (encodeResult != AVIF_RESULT_OK) {
                 return encodeResult;
             }
+            if (!avifEncoderReportProgress(encoder, ++encodedCount, codecCount)) {
+                return AVIF_RESULT_CANCELED;
+            }
         }
     }
 
@@ -1207,6 +1329,11 @@ avifResult avifEncoderFinish(avifEncoder * encoder, avifRWData * output)
     // -----------------------------------------------------------------------
     // Finish up AV1 encoding
 
+    const uint32_t codecCount = avifEncoderDataCodecCount(encoder->data);
+    uint32_t finishedCount = 0;
+    if (!avifEncoderReportProgress(encoder, finishedCount, codecCount)) {
+        return AVIF_RESULT_CANCELED;
+    }
     for (uint32_t itemIndex = 0; itemIndex < encoder->data->items.count; ++itemIndex) {
         avifEncoderItem * item = &encoder->data->items.item[itemIndex];
         if (item->codec) {
@@ -1217,6 +1344,9 @@ avifResult avifEncoderFinish(avifEncoder * encoder, avifRWData * output)
             if (item->encodeOutput->samples.count != encoder->data->frames.count) {
                 return item->alpha ? AVIF_RESULT_ENCODE_ALPHA_FAILED : AVIF_RESULT_ENCODE_COLOR_FAILED;
             }
+            if (!avifEncoderReportProgress(encoder, ++finishedCount, codecCount)) {
+                return AVIF_RESULT_CANCELED;
+            }
         }
     }
 
@@ -1861,34 +1991,6 @@ avifResult avifEncoderWrite(avifEncoder * encoder, const avifImage * image, avif
     return avifEncoderFinish(encoder, output);
 }
 
-static avifBool avifImageIsOpaque(const avifImage * image)
-{
-    if (!image->alphaPlane) {
-        return AVIF_TRUE;
-    }
-
-    int maxChannel = (1 << image->depth) - 1;
-    if (avifImageUsesU16(image)) {
-        for (uint32_t j = 0; j < image->height; ++j) {
-            for (uint32_t i = 0; i < image->width; ++i) {
-                uint16_t * p = (uint16_t *)&image->alphaPlane[(i * 2) + (j * image->alphaRowBytes)];
-                if (*p != maxChannel) {
-                    return AVIF_FALSE;
-                }
-            }
-        }
-    } else {
-        for (uint32_t j = 0; j < image->height; ++j) {
-            for (uint32_t i = 0; i < image->width; ++i) {
-                if (image->alphaPlane[i + (j * image->alphaRowBytes)] != maxChannel) {
-                    return AVIF_FALSE;
-                }
-            }
-        }
-    }
-    return AVIF_TRUE;
-}
-
 static void writeConfigBox(avifRWStream * s, avifCodecConfigurationBox * cfg)
 {
     avifBoxMarker av1C = avifRWStreamWriteBox(s, "av1C", AVIF_BOX_SIZE_TBD);
@@ -0,0 +1,146 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+// Converts a width*height RGBA image of rgb_depth bits with all alpha samples
+// equal to alpha, except the last one equal to last_alpha.
+testutil::AvifImagePtr Convert(uint32_t rgb_depth, uint32_t yuv_depth,
+                               avifRGBFormat format, uint32_t alpha,
+                               uint32_t last_alpha, bool* rgb_opaque) {
+  testutil::AvifImagePtr image(
+      avifImageCreate(33, 17, yuv_depth, AVIF_PIXEL_FORMAT_YUV444),
+      avifImageDestroy);
+  if (!image) return image;
+  avifRGBImage rgb;
+  avifRGBImageSetDefaults(&rgb, image.get());
+  rgb.depth = rgb_depth;
+  rgb.format = format;
+  avifRGBImageAllocatePixels(&rgb);
+  const uint32_t channel_count = avifRGBFormatChannelCount(format);
+  const uint32_t alpha_index =
+      (format == AVIF_RGB_FORMAT_ARGB || format == AVIF_RGB_FORMAT_ABGR)
+          ? 0
+          : 3;
+  for (uint32_t y = 0; y < rgb.height; ++y) {
+    for (uint32_t x = 0; x < rgb.width; ++x) {
+      for (uint32_t c = 0; c < channel_count; ++c) {
+        const bool is_last = (x == rgb.width - 1) && (y == rgb.height - 1);
+        const uint32_t value =
+            (c == alpha_index) ? (is_last ? last_alpha : alpha) : (x + y) % 7;
+        if (rgb_depth > 8) {
+          reinterpret_cast<uint16_t*>(
+              rgb.pixels + y * rgb.rowBytes)[x * channel_count + c] =
+              static_cast<uint16_t>(value);
+        } else {
+          rgb.pixels[y * rgb.rowBytes + x * channel_count + c] =
+              static_cast<uint8_t>(value);
+        }
+      }
+    }
+  }
+  *rgb_opaque = avifRGBImageIsOpaque(&rgb);
+  const avifResult result = avifImageRGBToYUV(image.get(), &rgb);
+  avifRGBImageFreePixels(&rgb);
+  if (result != AVIF_RESULT_OK) image.reset();
+  return image;
+}
+
+TEST(AlphaOpaqueTest, RGBImageIsOpaque) {
+  for (avifRGBFormat format : {AVIF_RGB_FORMAT_RGBA, AVIF_RGB_FORMAT_ARGB,
+                               AVIF_RGB_FORMAT_BGRA, AVIF_RGB_FORMAT_ABGR}) {
+    for (uint32_t rgb_depth : {8u, 16u}) {
+      const uint32_t max_alpha = (1u << rgb_depth) - 1;
+      bool rgb_opaque;
+      ASSERT_NE(Convert(rgb_depth, 10, format, max_alpha, max_alpha,
+                        &rgb_opaque),
+                nullptr);
+      EXPECT_TRUE(rgb_opaque);
+      ASSERT_NE(Convert(rgb_depth, 10, format, max_alpha, max_alpha - 1,
+                        &rgb_opaque),
+                nullptr);
+      EXPECT_FALSE(rgb_opaque);
+    }
+  }
+}
+
+TEST(AlphaOpaqueTest, AlphaRange) {
+  for (uint32_t yuv_depth : {8u, 10u}) {
+    const uint32_t max_alpha = (1u << yuv_depth) - 1;
+    bool rgb_opaque;
+    testutil::AvifImagePtr image =
+        Convert(8, yuv_depth, AVIF_RGB_FORMAT_RGBA, 255, 255, &rgb_opaque);
+    ASSERT_NE(image, nullptr);
+    EXPECT_TRUE(image->alphaRangeKnown);
+    EXPECT_EQ(image->alphaMin, max_alpha);
+    EXPECT_EQ(image->alphaMax, max_alpha);
+
+    image = Convert(8, yuv_depth, AVIF_RGB_FORMAT_RGBA, 255, 0, &rgb_opaque);
+    ASSERT_NE(image, nullptr);
+    EXPECT_TRUE(image->alphaRangeKnown);
+    EXPECT_EQ(image->alphaMin, 0u);
+    EXPECT_EQ(image->alphaMax, max_alpha);
+
+    avifImageFreePlanes(image.get(), AVIF_PLANES_A);
+    EXPECT_FALSE(image->alphaRangeKnown);
+  }
+}
+
+bool IsCodecAvailable() {
+  return avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) !=
+         nullptr;
+}
+
+// Returns whether the encoded image has an alpha plane once decoded.
+bool EncodesAlpha(const avifImage& image) {
+  const testutil::AvifRwData encoded =
+      testutil::Encode(&image, AVIF_SPEED_FASTEST);
+  EXPECT_NE(encoded.size, 0u);
+  const testutil::AvifImagePtr decoded =
+      testutil::Decode(encoded.data, encoded.size);
+  EXPECT_NE(decoded, nullptr);
+  return decoded && decoded->alphaPlane != nullptr;
+}
+
+TEST(AlphaOpaqueTest, OpaqueAlphaIsDropped) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  for (uint32_t yuv_depth : {8u, 10u}) {
+    for (uint32_t last_alpha : {255u, 128u}) {
+      bool rgb_opaque;
+      testutil::AvifImagePtr image = Convert(8, yuv_depth, AVIF_RGB_FORMAT_RGBA,
+                                             255, last_alpha, &rgb_opaque);
+      ASSERT_NE(image, nullptr);
+      EXPECT_EQ(EncodesAlpha(*image), last_alpha != 255u);
+    }
+  }
+}
+
+TEST(AlphaOpaqueTest, ModifiedAlphaPlaneIsEncoded) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  for (uint32_t yuv_depth : {8u, 10u}) {
+    bool rgb_opaque;
+    testutil::AvifImagePtr image = Convert(8, yuv_depth, AVIF_RGB_FORMAT_RGBA,
+                                           255, 255, &rgb_opaque);
+    ASSERT_NE(image, nullptr);
+    // The opacity is computed when encoding, so writing to the alpha plane
+    // after the conversion is taken into account.
+    uint8_t* last_row =
+        image->alphaPlane + (image->height - 1) * image->alphaRowBytes;
+    if (avifImageUsesU16(image.get())) {
+      reinterpret_cast<uint16_t*>(last_row)[image->width - 1] = 0;
+    } else {
+      last_row[image->width - 1] = 0;
+    }
+    EXPECT_TRUE(EncodesAlpha(*image));
+  }
+}
+
+}  // namespace
+}  // namespace libavif
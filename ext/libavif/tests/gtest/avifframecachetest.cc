@@ -0,0 +1,136 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+constexpr int kNumFrames = 12;
+constexpr int kKeyframeInterval = 5;
+
+// Encodes a sequence of distinct frames with a keyframe every kKeyframeInterval
+// frames.
+testutil::AvifRwData EncodeSequence() {
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) return testutil::AvifRwData();
+  encoder->speed = AVIF_SPEED_FASTEST;
+  encoder->keyframeInterval = kKeyframeInterval;
+  for (int i = 0; i < kNumFrames; ++i) {
+    testutil::AvifImagePtr image =
+        testutil::CreateImage(64, 64, 8, AVIF_PIXEL_FORMAT_YUV420,
+                              AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+    if (!image) return testutil::AvifRwData();
+    testutil::FillImageGradient(image.get());
+    // Make each frame different.
+    image->yuvPlanes[AVIF_CHAN_Y][0] = static_cast<uint8_t>(i * 16);
+    image->alphaPlane[i] = static_cast<uint8_t>(i * 16);
+    if (avifEncoderAddImage(encoder.get(), image.get(), /*durationInTimescales=*/1,
+                            AVIF_ADD_IMAGE_FLAG_NONE) != AVIF_RESULT_OK) {
+      return testutil::AvifRwData();
+    }
+  }
+  testutil::AvifRwData encoded;
+  if (avifEncoderFinish(encoder.get(), &encoded) != AVIF_RESULT_OK) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+testutil::AvifDecoderPtr CreateDecoder(const testutil::AvifRwData& encoded,
+                                       uint64_t frame_cache_size) {
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  if (!decoder) return decoder;
+  decoder->frameCacheSize = frame_cache_size;
+  if ((avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size) !=
+       AVIF_RESULT_OK) ||
+      (avifDecoderParse(decoder.get()) != AVIF_RESULT_OK)) {
+    decoder.reset();
+  }
+  return decoder;
+}
+
+TEST(FrameCacheTest, NearestKeyframe) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+      nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+  const testutil::AvifRwData encoded = EncodeSequence();
+  ASSERT_NE(encoded.size, 0u);
+  testutil::AvifDecoderPtr decoder = CreateDecoder(encoded, 0);
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(decoder->imageCount, kNumFrames);
+
+  for (uint32_t i = 0; i < kNumFrames; ++i) {
+    uint32_t expected = i;
+    while (expected != 0 && !avifDecoderIsKeyframe(decoder.get(), expected)) {
+      --expected;
+    }
+    EXPECT_EQ(avifDecoderNearestKeyframe(decoder.get(), i), expected);
+    EXPECT_EQ(avifDecoderIsKeyframe(decoder.get(), i),
+              (i % kKeyframeInterval) == 0);
+  }
+
+  // Seeking indexes the keyframes, the answers must stay the same.
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) ==
+      nullptr) {
+    return;
+  }
+  ASSERT_EQ(avifDecoderNthImage(decoder.get(), kNumFrames - 1),
+            AVIF_RESULT_OK);
+  for (uint32_t i = 0; i < kNumFrames; ++i) {
+    EXPECT_EQ(avifDecoderNearestKeyframe(decoder.get(), i),
+              i - i % kKeyframeInterval);
+  }
+}
+
+TEST(FrameCacheTest, RandomAccess) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+          nullptr ||
+      avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) ==
+          nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+  const testutil::AvifRwData encoded = EncodeSequence();
+  ASSERT_NE(encoded.size, 0u);
+
+  // Reference frames, decoded in order without any cache.
+  testutil::AvifDecoderPtr reference = CreateDecoder(encoded, 0);
+  ASSERT_NE(reference, nullptr);
+  std::vector<testutil::AvifImagePtr> frames;
+  for (int i = 0; i < kNumFrames; ++i) {
+    ASSERT_EQ(avifDecoderNextImage(reference.get()), AVIF_RESULT_OK);
+    frames.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+    ASSERT_EQ(avifImageCopy(frames.back().get(), reference->image,
+                            AVIF_PLANES_ALL),
+              AVIF_RESULT_OK);
+  }
+
+  // A cache of all frames, a cache of about three frames, and no cache.
+  const uint64_t frame_size = 64 * 64 * 5 / 2;
+  for (uint64_t frame_cache_size :
+       {frame_size * kNumFrames, frame_size * 3, uint64_t{0}}) {
+    SCOPED_TRACE(frame_cache_size);
+    testutil::AvifDecoderPtr decoder = CreateDecoder(encoded, frame_cache_size);
+    ASSERT_NE(decoder, nullptr);
+    for (uint32_t index : {7u, 2u, 8u, 7u, 11u, 3u, 4u, 9u, 1u, 0u, 6u, 7u}) {
+      ASSERT_EQ(avifDecoderNthImage(decoder.get(), index), AVIF_RESULT_OK);
+      EXPECT_EQ(decoder->imageIndex, static_cast<int>(index));
+      EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *frames[index]));
+      // The next frame must be right, wherever the codec is.
+      if (index + 1 < kNumFrames) {
+        ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+        EXPECT_EQ(decoder->imageIndex, static_cast<int>(index + 1));
+        EXPECT_TRUE(
+            testutil::AreImagesEqual(*decoder->image, *frames[index + 1]));
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libavif
@@ -0,0 +1,248 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <tuple>
+
+#include "avif/avif.h"
+#include "avifjpeg.h"
+#include "avifutil.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+using testing::Combine;
+using testing::Values;
+
+namespace libavif {
+namespace {
+
+// Used to pass the data folder path to the GoogleTest suites.
+const char* data_path = nullptr;
+
+// 4:4:4 JPEG, copied as is with the default settings.
+constexpr char kJpeg444[] = "paris_exif_xmp_icc.jpg";
+
+testutil::AvifImagePtr ReadJpeg(const std::string& path, avifPixelFormat format,
+                                int depth, avifRange range) {
+  testutil::AvifImagePtr image(avifImageCreateEmpty(), avifImageDestroy);
+  if (!image) return {nullptr, nullptr};
+  // Same as avifenc. JPEG YCbCr uses the BT.601 coefficients.
+  image->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_BT601;
+  image->yuvRange = range;
+  if (avifReadImage(path.c_str(), format,
+                    depth, AVIF_CHROMA_DOWNSAMPLING_AUTOMATIC,
+                    /*ignoreICC=*/AVIF_TRUE, /*ignoreExif=*/AVIF_TRUE,
+                    /*ignoreXMP=*/AVIF_TRUE, image.get(),
+                    /*outDepth=*/nullptr, /*sourceTiming=*/nullptr,
+                    /*frameIter=*/nullptr) != AVIF_APP_FILE_FORMAT_JPEG) {
+    return {nullptr, nullptr};
+  }
+  return image;
+}
+
+testutil::AvifImagePtr ReadJpeg(avifPixelFormat format, int depth,
+                                avifRange range) {
+  return ReadJpeg(std::string(data_path) + kJpeg444, format, depth, range);
+}
+
+uint32_t GetSample(const avifImage& image, avifChannelIndex channel,
+                   uint32_t x, uint32_t y) {
+  const uint8_t* row =
+      image.yuvPlanes[channel] + (size_t)image.yuvRowBytes[channel] * y;
+  return avifImageUsesU16(&image) ? reinterpret_cast<const uint16_t*>(row)[x]
+                                  : row[x];
+}
+
+// Returns the exact value of the 8-bit full range sample v (possibly an
+// average) at the depth and range of image, following the quantization of
+// Rec. ITU-T H.273: chroma is scaled around its midpoint. The samples must be
+// within half a step of it.
+double Expected(const avifImage& image, bool chroma, double v) {
+  const double max_value = (1 << image.depth) - 1;
+  const double mid = 1 << (image.depth - 1);
+  const double scale = 1 << (image.depth - 8);  // limited range unit
+  if (image.yuvRange == AVIF_RANGE_FULL) {
+    return chroma ? (v - 128) * max_value / 255 + mid : v * max_value / 255;
+  }
+  return chroma ? (v - 128) * 224 * scale / 255 + mid
+                : v * 219 * scale / 255 + 16 * scale;
+}
+
+class JpegTest
+    : public testing::TestWithParam<std::tuple<avifPixelFormat, int, avifRange>> {
+};
+
+// The YCbCr samples of the JPEG are scaled and resampled directly, without
+// going through RGB.
+TEST_P(JpegTest, MatchesYCbCr) {
+  const avifPixelFormat format = std::get<0>(GetParam());
+  const int depth = std::get<1>(GetParam());
+  const avifRange range = std::get<2>(GetParam());
+
+  const testutil::AvifImagePtr reference =
+      ReadJpeg(AVIF_PIXEL_FORMAT_NONE, 8, AVIF_RANGE_FULL);
+  ASSERT_NE(reference, nullptr);
+  ASSERT_EQ(reference->yuvFormat, AVIF_PIXEL_FORMAT_YUV444);
+  const testutil::AvifImagePtr image = ReadJpeg(format, depth, range);
+  ASSERT_NE(image, nullptr);
+  ASSERT_EQ(image->yuvFormat, format);
+  ASSERT_EQ(image->depth, static_cast<uint32_t>(depth));
+  ASSERT_EQ(image->yuvRange, range);
+  ASSERT_EQ(image->width, reference->width);
+  ASSERT_EQ(image->height, reference->height);
+
+  for (uint32_t y = 0; y < image->height; ++y) {
+    for (uint32_t x = 0; x < image->width; ++x) {
+      ASSERT_NEAR(GetSample(*image, AVIF_CHAN_Y, x, y),
+                  Expected(*image, /*chroma=*/false,
+                           GetSample(*reference, AVIF_CHAN_Y, x, y)),
+                  0.5);
+    }
+  }
+  if (format == AVIF_PIXEL_FORMAT_YUV400) return;
+
+  avifPixelFormatInfo info;
+  avifGetPixelFormatInfo(format, &info);
+  const uint32_t uv_width =
+      (image->width + info.chromaShiftX) >> info.chromaShiftX;
+  const uint32_t uv_height =
+      (image->height + info.chromaShiftY) >> info.chromaShiftY;
+  for (avifChannelIndex c : {AVIF_CHAN_U, AVIF_CHAN_V}) {
+    for (uint32_t y = 0; y < uv_height; ++y) {
+      for (uint32_t x = 0; x < uv_width; ++x) {
+        // Average of the 4:4:4 samples covered by this one.
+        uint32_t sum = 0;
+        uint32_t count = 0;
+        for (uint32_t j = y << info.chromaShiftY;
+             j < std::min(image->height, (y + 1) << info.chromaShiftY); ++j) {
+          for (uint32_t i = x << info.chromaShiftX;
+               i < std::min(image->width, (x + 1) << info.chromaShiftX); ++i) {
+            sum += GetSample(*reference, c, i, j);
+            ++count;
+          }
+        }
+        const double expected = std::min(
+            std::max(Expected(*image, /*chroma=*/true,
+                              static_cast<double>(sum) / count),
+                     0.0),
+            static_cast<double>((1 << depth) - 1));
+        ASSERT_NEAR(GetSample(*image, c, x, y), expected, 0.5)
+            << "channel " << c << " at " << x << "," << y;
+      }
+    }
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    All, JpegTest,
+    Combine(Values(AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV422,
+                   AVIF_PIXEL_FORMAT_YUV420, AVIF_PIXEL_FORMAT_YUV400),
+            /*depth=*/Values(8, 10, 12),
+            Values(AVIF_RANGE_FULL, AVIF_RANGE_LIMITED)));
+
+// Neutral chroma stays exactly at the midpoint at any depth, range and
+// sampling, otherwise every transcoded image gets a tint.
+TEST(JpegTest, NeutralChroma) {
+  // Gray levels, which libjpeg stores with Cb = Cr = 128.
+  testutil::AvifImagePtr gray = testutil::CreateImage(
+      64, 48, 8, AVIF_PIXEL_FORMAT_YUV444, AVIF_PLANES_YUV, AVIF_RANGE_FULL);
+  ASSERT_NE(gray, nullptr);
+  gray->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_BT601;
+  for (uint32_t y = 0; y < gray->height; ++y) {
+    for (uint32_t x = 0; x < gray->width; ++x) {
+      gray->yuvPlanes[AVIF_CHAN_Y][y * gray->yuvRowBytes[AVIF_CHAN_Y] + x] =
+          static_cast<uint8_t>(x * 4);
+      gray->yuvPlanes[AVIF_CHAN_U][y * gray->yuvRowBytes[AVIF_CHAN_U] + x] =
+          128;
+      gray->yuvPlanes[AVIF_CHAN_V][y * gray->yuvRowBytes[AVIF_CHAN_V] + x] =
+          128;
+    }
+  }
+  const std::string path = testing::TempDir() + "avifjpegtest_gray.jpg";
+  ASSERT_TRUE(avifJPEGWrite(path.c_str(), gray.get(), /*jpegQuality=*/100,
+                            AVIF_CHROMA_UPSAMPLING_AUTOMATIC));
+
+  for (avifPixelFormat format :
+       {AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV422,
+        AVIF_PIXEL_FORMAT_YUV420}) {
+    for (int depth : {8, 10, 12}) {
+      for (avifRange range : {AVIF_RANGE_FULL, AVIF_RANGE_LIMITED}) {
+        const testutil::AvifImagePtr image =
+            ReadJpeg(path, format, depth, range);
+        ASSERT_NE(image, nullptr);
+        const uint32_t mid = 1u << (depth - 1);
+        const uint32_t uv_width = (format == AVIF_PIXEL_FORMAT_YUV444)
+                                      ? image->width
+                                      : (image->width + 1) / 2;
+        const uint32_t uv_height = (format == AVIF_PIXEL_FORMAT_YUV420)
+                                       ? (image->height + 1) / 2
+                                       : image->height;
+        for (avifChannelIndex c : {AVIF_CHAN_U, AVIF_CHAN_V}) {
+          for (uint32_t y = 0; y < uv_height; ++y) {
+            for (uint32_t x = 0; x < uv_width; ++x) {
+              ASSERT_EQ(GetSample(*image, c, x, y), mid)
+                  << "format " << format << " depth " << depth << " range "
+                  << range << " channel " << c << " at " << x << "," << y;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// The direct path stays close to the former RGB round trip.
+TEST(JpegTest, CloseToRgbConversion) {
+  const testutil::AvifImagePtr reference =
+      ReadJpeg(AVIF_PIXEL_FORMAT_NONE, 8, AVIF_RANGE_FULL);
+  ASSERT_NE(reference, nullptr);
+  const testutil::AvifImagePtr image =
+      ReadJpeg(AVIF_PIXEL_FORMAT_YUV420, 10, AVIF_RANGE_LIMITED);
+  ASSERT_NE(image, nullptr);
+
+  testutil::AvifRgbImage rgb(reference.get(), 16, AVIF_RGB_FORMAT_RGB);
+  ASSERT_EQ(avifImageYUVToRGB(reference.get(), &rgb), AVIF_RESULT_OK);
+  testutil::AvifImagePtr converted =
+      testutil::CreateImage(static_cast<int>(reference->width),
+                            static_cast<int>(reference->height), 10,
+                            AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_YUV,
+                            AVIF_RANGE_LIMITED);
+  ASSERT_NE(converted, nullptr);
+  ASSERT_EQ(avifImageRGBToYUV(converted.get(), &rgb), AVIF_RESULT_OK);
+
+  for (avifChannelIndex c : {AVIF_CHAN_Y, AVIF_CHAN_U, AVIF_CHAN_V}) {
+    const uint32_t width = (c == AVIF_CHAN_Y) ? image->width
+                                              : (image->width + 1) / 2;
+    const uint32_t height = (c == AVIF_CHAN_Y) ? image->height
+                                               : (image->height + 1) / 2;
+    uint64_t total_diff = 0;
+    for (uint32_t y = 0; y < height; ++y) {
+      for (uint32_t x = 0; x < width; ++x) {
+        total_diff += std::abs(static_cast<int>(GetSample(*image, c, x, y)) -
+                               static_cast<int>(GetSample(*converted, c, x, y)));
+      }
+    }
+    // Less than half an 8-bit step on average. The RGB round trip also clamps
+    // the YCbCr samples that are out of the RGB gamut.
+    EXPECT_LT(static_cast<double>(total_diff) / (width * height), 2.0)
+        << "channel " << c;
+  }
+}
+
+}  // namespace
+}  // namespace libavif
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  if (argc != 2) {
+    std::cerr << "There must be exactly one argument containing the path to "
+                 "the test data folder"
+              << std::endl;
+    return 1;
+  }
+  libavif::data_path = argv[1];
+  return RUN_ALL_TESTS();
+}
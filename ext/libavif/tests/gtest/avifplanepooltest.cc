@@ -0,0 +1,233 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <cstdint>
+#include <memory>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+using AvifPlaneAllocatorPtr =
+    std::unique_ptr<avifPlaneAllocator, decltype(&avifPlaneAllocatorDestroy)>;
+
+AvifPlaneAllocatorPtr CreatePool(size_t max_pooled_bytes) {
+  return AvifPlaneAllocatorPtr(avifPlanePoolCreate(max_pooled_bytes),
+                               avifPlaneAllocatorDestroy);
+}
+
+testutil::AvifImagePtr CreatePooledImage(avifPlaneAllocator* pool, int width,
+                                         int height, int depth,
+                                         avifPixelFormat format) {
+  testutil::AvifImagePtr image(
+      avifImageCreate(width, height, depth, format), avifImageDestroy);
+  if (!image) return image;
+  image->planeAllocator = pool;
+  if (avifImageAllocatePlanes(image.get(), AVIF_PLANES_ALL) !=
+      AVIF_RESULT_OK) {
+    image.reset();
+  }
+  return image;
+}
+
+avifPlaneAllocatorStats GetStats(avifPlaneAllocator* pool) {
+  avifPlaneAllocatorStats stats;
+  avifPlaneAllocatorGetStats(pool, &stats);
+  return stats;
+}
+
+TEST(PlanePoolTest, AlignedAndReused) {
+  AvifPlaneAllocatorPtr pool = CreatePool(SIZE_MAX);
+  ASSERT_NE(pool, nullptr);
+  const uint8_t* planes[4];
+  {
+    testutil::AvifImagePtr image = CreatePooledImage(
+        pool.get(), 101, 33, 10, AVIF_PIXEL_FORMAT_YUV420);
+    ASSERT_NE(image, nullptr);
+    for (int c = 0; c < 3; ++c) {
+      planes[c] = image->yuvPlanes[c];
+      EXPECT_EQ(reinterpret_cast<uintptr_t>(planes[c]) % 64, 0u);
+    }
+    planes[3] = image->alphaPlane;
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(planes[3]) % 64, 0u);
+    testutil::FillImageGradient(image.get());
+  }
+  avifPlaneAllocatorStats stats = GetStats(pool.get());
+  EXPECT_EQ(stats.allocationCount, 4u);
+  EXPECT_EQ(stats.systemAllocationCount, 4u);
+  EXPECT_EQ(stats.releaseCount, 4u);
+  EXPECT_EQ(stats.reuseCount, 0u);
+  EXPECT_EQ(stats.bytesInUse, 0u);
+  EXPECT_GT(stats.bytesPooled, 0u);
+
+  // The next image of the same kind gets the same buffers.
+  testutil::AvifImagePtr image =
+      CreatePooledImage(pool.get(), 101, 33, 10, AVIF_PIXEL_FORMAT_YUV420);
+  ASSERT_NE(image, nullptr);
+  for (int c = 0; c < 3; ++c) {
+    const uint8_t* plane = image->yuvPlanes[c];
+    EXPECT_TRUE(plane == planes[0] || plane == planes[1] ||
+                plane == planes[2] || plane == planes[3]);
+  }
+  stats = GetStats(pool.get());
+  EXPECT_EQ(stats.allocationCount, 8u);
+  EXPECT_EQ(stats.systemAllocationCount, 4u);
+  EXPECT_EQ(stats.reuseCount, 4u);
+  EXPECT_EQ(stats.bytesPooled, 0u);
+  EXPECT_EQ(stats.peakBytes, stats.bytesInUse);
+}
+
+TEST(PlanePoolTest, KeyedByImageKind) {
+  AvifPlaneAllocatorPtr pool = CreatePool(SIZE_MAX);
+  ASSERT_NE(pool, nullptr);
+  CreatePooledImage(pool.get(), 64, 64, 8, AVIF_PIXEL_FORMAT_YUV444);
+  // Same plane sizes but another format or depth.
+  CreatePooledImage(pool.get(), 32, 64, 10, AVIF_PIXEL_FORMAT_YUV444);
+  CreatePooledImage(pool.get(), 64, 64, 8, AVIF_PIXEL_FORMAT_YUV400);
+  const avifPlaneAllocatorStats stats = GetStats(pool.get());
+  EXPECT_EQ(stats.reuseCount, 0u);
+  EXPECT_EQ(stats.systemAllocationCount, stats.allocationCount);
+}
+
+TEST(PlanePoolTest, MaxPooledBytes) {
+  // Room for the planes of one 64x64 8-bit 4:0:0 image with alpha.
+  AvifPlaneAllocatorPtr pool = CreatePool(2 * 64 * 64);
+  ASSERT_NE(pool, nullptr);
+  CreatePooledImage(pool.get(), 64, 64, 8, AVIF_PIXEL_FORMAT_YUV400);
+  EXPECT_EQ(GetStats(pool.get()).bytesPooled, 2u * 64 * 64);
+  // Evicts one buffer of the previous kind to make room.
+  CreatePooledImage(pool.get(), 32, 32, 8, AVIF_PIXEL_FORMAT_YUV420);
+  EXPECT_EQ(GetStats(pool.get()).bytesPooled,
+            64u * 64 + 2u * 32 * 32 + 2u * 16 * 16);
+  // Too large to be kept.
+  CreatePooledImage(pool.get(), 128, 64, 8, AVIF_PIXEL_FORMAT_YUV400);
+  const avifPlaneAllocatorStats stats = GetStats(pool.get());
+  EXPECT_LE(stats.bytesPooled, 2u * 64 * 64);
+  EXPECT_EQ(stats.bytesInUse, 0u);
+}
+
+TEST(PlanePoolTest, Copy) {
+  AvifPlaneAllocatorPtr pool = CreatePool(SIZE_MAX);
+  ASSERT_NE(pool, nullptr);
+  testutil::AvifImagePtr image =
+      CreatePooledImage(pool.get(), 50, 40, 12, AVIF_PIXEL_FORMAT_YUV422);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+
+  // Copies between images with and without allocator.
+  testutil::AvifImagePtr copy(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(copy, nullptr);
+  ASSERT_EQ(avifImageCopy(copy.get(), image.get(), AVIF_PLANES_ALL),
+            AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreImagesEqual(*image, *copy));
+  testutil::AvifImagePtr pooled_copy(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(pooled_copy, nullptr);
+  pooled_copy->planeAllocator = pool.get();
+  ASSERT_EQ(avifImageCopy(pooled_copy.get(), copy.get(), AVIF_PLANES_ALL),
+            AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreImagesEqual(*image, *pooled_copy));
+
+  // Stealing planes owned by another allocator copies them.
+  avifImageStealPlanes(copy.get(), image.get(), AVIF_PLANES_ALL);
+  EXPECT_EQ(image->yuvPlanes[AVIF_CHAN_Y], nullptr);
+  EXPECT_TRUE(copy->imageOwnsYUVPlanes);
+  EXPECT_TRUE(testutil::AreImagesEqual(*copy, *pooled_copy));
+  image.reset();
+  pooled_copy.reset();
+  EXPECT_EQ(GetStats(pool.get()).bytesInUse, 0u);
+}
+
+TEST(PlanePoolTest, Scale) {
+  {
+    testutil::AvifImagePtr probe = testutil::CreateImage(
+        2, 2, 8, AVIF_PIXEL_FORMAT_YUV400, AVIF_PLANES_YUV);
+    avifDiagnostics diag;
+    if (avifImageScale(probe.get(), 1, 1, 1, &diag) ==
+        AVIF_RESULT_NOT_IMPLEMENTED) {
+      GTEST_SKIP() << "libyuv unavailable, skip test.";
+    }
+  }
+  AvifPlaneAllocatorPtr pool = CreatePool(SIZE_MAX);
+  ASSERT_NE(pool, nullptr);
+  testutil::AvifImagePtr image =
+      CreatePooledImage(pool.get(), 300, 260, 10, AVIF_PIXEL_FORMAT_YUV420);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+  testutil::AvifImagePtr reference(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(reference, nullptr);
+  ASSERT_EQ(avifImageCopy(reference.get(), image.get(), AVIF_PLANES_ALL),
+            AVIF_RESULT_OK);
+
+  // The source planes go back to the pool, the scaled ones come from it.
+  avifDiagnostics diag;
+  ASSERT_EQ(avifImageScale(image.get(), 100, 80, /*maxThreads=*/4, &diag),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifImageScale(reference.get(), 100, 80, /*maxThreads=*/1, &diag),
+            AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreImagesEqual(*image, *reference));
+  avifPlaneAllocatorStats stats = GetStats(pool.get());
+  EXPECT_EQ(stats.releaseCount, 4u);
+  EXPECT_EQ(stats.allocationCount, 8u);
+  image.reset();
+  EXPECT_EQ(GetStats(pool.get()).bytesInUse, 0u);
+}
+
+TEST(PlanePoolTest, DecodedFrames) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+          nullptr ||
+      avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) ==
+          nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+  constexpr int kNumFrames = 6;
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->speed = AVIF_SPEED_FASTEST;
+  for (int i = 0; i < kNumFrames; ++i) {
+    testutil::AvifImagePtr image = testutil::CreateImage(
+        64, 64, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_ALL);
+    ASSERT_NE(image, nullptr);
+    testutil::FillImageGradient(image.get());
+    image->yuvPlanes[AVIF_CHAN_Y][0] = static_cast<uint8_t>(i * 16);
+    ASSERT_EQ(avifEncoderAddImage(encoder.get(), image.get(), 1,
+                                  AVIF_ADD_IMAGE_FLAG_NONE),
+              AVIF_RESULT_OK);
+  }
+  testutil::AvifRwData encoded;
+  ASSERT_EQ(avifEncoderFinish(encoder.get(), &encoded), AVIF_RESULT_OK);
+
+  AvifPlaneAllocatorPtr pool = CreatePool(SIZE_MAX);
+  ASSERT_NE(pool, nullptr);
+  {
+    testutil::AvifDecoderPtr reference(avifDecoderCreate(), avifDecoderDestroy);
+    testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+    ASSERT_NE(reference, nullptr);
+    ASSERT_NE(decoder, nullptr);
+    // The cached frames are copies, most of them evicted as the frames are
+    // decoded.
+    decoder->frameCacheSize = 2 * 64 * 64 * 3;
+    decoder->planeAllocator = pool.get();
+    ASSERT_EQ(avifDecoderSetIOMemory(reference.get(), encoded.data,
+                                     encoded.size),
+              AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size),
+              AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderParse(reference.get()), AVIF_RESULT_OK);
+    ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+    for (int i = 0; i < kNumFrames; ++i) {
+      ASSERT_EQ(avifDecoderNextImage(reference.get()), AVIF_RESULT_OK);
+      ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+      EXPECT_TRUE(testutil::AreImagesEqual(*reference->image, *decoder->image));
+    }
+    const avifPlaneAllocatorStats stats = GetStats(pool.get());
+    EXPECT_GT(stats.reuseCount, 0u);
+    EXPECT_LT(stats.systemAllocationCount, stats.allocationCount);
+  }
+  EXPECT_EQ(GetStats(pool.get()).bytesInUse, 0u);
+}
+
+}  // namespace
+}  // namespace libavif
@@ -0,0 +1,157 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+constexpr int kNumFrames = 16;
+
+// Encodes a sequence of distinct frames.
+testutil::AvifRwData EncodeSequence() {
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) return testutil::AvifRwData();
+  encoder->speed = AVIF_SPEED_FASTEST;
+  encoder->keyframeInterval = 4;
+  for (int i = 0; i < kNumFrames; ++i) {
+    testutil::AvifImagePtr image =
+        testutil::CreateImage(64, 64, 8, AVIF_PIXEL_FORMAT_YUV420,
+                              AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+    if (!image) return testutil::AvifRwData();
+    testutil::FillImageGradient(image.get());
+    image->yuvPlanes[AVIF_CHAN_Y][0] = static_cast<uint8_t>(i * 16);
+    image->alphaPlane[i] = static_cast<uint8_t>(i * 16);
+    if (avifEncoderAddImage(encoder.get(), image.get(),
+                            /*durationInTimescales=*/1,
+                            AVIF_ADD_IMAGE_FLAG_NONE) != AVIF_RESULT_OK) {
+      return testutil::AvifRwData();
+    }
+  }
+  testutil::AvifRwData encoded;
+  if (avifEncoderFinish(encoder.get(), &encoded) != AVIF_RESULT_OK) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+// avifIO reading from memory that counts the bytes read by other threads than
+// the one that created it.
+struct CountingReader {
+  avifIO io;
+  avifROData data;
+  std::thread::id owner;
+  std::mutex mutex;
+  size_t bytes_read_ahead = 0;
+};
+
+avifResult CountingReaderRead(avifIO* io, uint32_t read_flags, uint64_t offset,
+                              size_t size, avifROData* out) {
+  CountingReader* reader = reinterpret_cast<CountingReader*>(io);
+  if (read_flags != 0 || offset > reader->data.size) {
+    return AVIF_RESULT_IO_ERROR;
+  }
+  size = std::min<size_t>(size, reader->data.size - offset);
+  out->data = reader->data.data + offset;
+  out->size = size;
+  if (std::this_thread::get_id() != reader->owner) {
+    std::lock_guard<std::mutex> lock(reader->mutex);
+    reader->bytes_read_ahead += size;
+  }
+  return AVIF_RESULT_OK;
+}
+
+void CountingReaderInit(CountingReader* reader,
+                        const testutil::AvifRwData& encoded) {
+  reader->io = avifIO();
+  reader->io.read = CountingReaderRead;
+  reader->io.sizeHint = encoded.size;
+  reader->io.persistent = AVIF_FALSE;
+  reader->data.data = encoded.data;
+  reader->data.size = encoded.size;
+  reader->owner = std::this_thread::get_id();
+}
+
+std::vector<testutil::AvifImagePtr> DecodeAll(
+    const testutil::AvifRwData& encoded) {
+  std::vector<testutil::AvifImagePtr> frames;
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  if (!decoder ||
+      avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size) !=
+          AVIF_RESULT_OK ||
+      avifDecoderParse(decoder.get()) != AVIF_RESULT_OK) {
+    return frames;
+  }
+  while (avifDecoderNextImage(decoder.get()) == AVIF_RESULT_OK) {
+    frames.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+    if (avifImageCopy(frames.back().get(), decoder->image, AVIF_PLANES_ALL) !=
+        AVIF_RESULT_OK) {
+      frames.clear();
+      break;
+    }
+  }
+  return frames;
+}
+
+class PrefetchTest : public testing::TestWithParam<size_t> {};
+
+TEST_P(PrefetchTest, SameFrames) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+      nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+  const size_t byte_budget = GetParam();
+  const testutil::AvifRwData encoded = EncodeSequence();
+  ASSERT_NE(encoded.size, 0u);
+  const std::vector<testutil::AvifImagePtr> expected = DecodeAll(encoded);
+  ASSERT_EQ(expected.size(), static_cast<size_t>(kNumFrames));
+
+  CountingReader reader;
+  CountingReaderInit(&reader, encoded);
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  avifIO* prefetch_reader =
+      avifIOCreatePrefetchReader(&reader.io, byte_budget);
+  // Without thread support, there is no prefetching avifIO.
+  const bool has_threads = (prefetch_reader != nullptr);
+  avifDecoderSetIO(decoder.get(), has_threads ? prefetch_reader : &reader.io);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(decoder->imageCount, kNumFrames);
+
+  // Sequential decoding.
+  for (int i = 0; i < kNumFrames; ++i) {
+    ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+    EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *expected[i]))
+        << "frame " << i;
+  }
+  EXPECT_EQ(avifDecoderNextImage(decoder.get()),
+            AVIF_RESULT_NO_IMAGES_REMAINING);
+
+  // Seeking drops the samples read ahead for the frames that are skipped.
+  for (uint32_t i : {12u, 3u, 4u, 9u, 0u, 15u}) {
+    ASSERT_EQ(avifDecoderNthImage(decoder.get(), i), AVIF_RESULT_OK);
+    EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *expected[i]))
+        << "frame " << i;
+  }
+  decoder.reset();
+
+  std::lock_guard<std::mutex> lock(reader.mutex);
+  if (byte_budget == 0 || !has_threads) {
+    EXPECT_EQ(reader.bytes_read_ahead, 0u);
+  } else {
+    EXPECT_GT(reader.bytes_read_ahead, 0u);
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(Budgets, PrefetchTest,
+                         testing::Values(0, 1024, 1 << 20));
+
+}  // namespace
+}  // namespace libavif
@@ -0,0 +1,112 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "avif/avif.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+// Exact rounding of numerator / denominator, halves up.
+uint32_t RoundedDivision(uint64_t numerator, uint64_t denominator) {
+  return static_cast<uint32_t>((2 * numerator + denominator) /
+                               (2 * denominator));
+}
+
+class PremultiplyTest
+    : public testing::TestWithParam<std::tuple<avifRGBFormat, uint32_t>> {};
+
+TEST_P(PremultiplyTest, MatchesExactRounding) {
+  const avifRGBFormat format = std::get<0>(GetParam());
+  const uint32_t depth = std::get<1>(GetParam());
+  const uint32_t max_channel = (1u << depth) - 1;
+  const bool alpha_first =
+      format == AVIF_RGB_FORMAT_ARGB || format == AVIF_RGB_FORMAT_ABGR;
+  const uint32_t alpha_index = alpha_first ? 0 : 3;
+  if (depth == 8 && !alpha_first && avifLibYUVVersion() != 0) {
+    GTEST_SKIP() << "libyuv rounds differently, skip test.";
+  }
+
+  avifRGBImage rgb;
+  rgb.width = 257;
+  rgb.height = 3;
+  rgb.depth = depth;
+  rgb.format = format;
+  rgb.rowBytes = rgb.width * 4 * (depth > 8 ? 2 : 1);
+  std::vector<uint8_t> pixels(rgb.rowBytes * rgb.height);
+  rgb.pixels = pixels.data();
+
+  // Deterministic samples covering the transparent, opaque and intermediate
+  // alpha values, with color samples not exceeding alpha.
+  std::vector<uint32_t> samples(rgb.width * rgb.height * 4);
+  uint32_t seed = 12345;
+  for (size_t p = 0; p < samples.size() / 4; ++p) {
+    seed = seed * 1664525u + 1013904223u;
+    uint32_t alpha = (seed >> 8) % (max_channel + 1);
+    if (p % 7 == 0) alpha = 0;
+    if (p % 7 == 1) alpha = max_channel;
+    for (uint32_t c = 0; c < 4; ++c) {
+      seed = seed * 1664525u + 1013904223u;
+      samples[p * 4 + c] =
+          (c == alpha_index) ? alpha : (seed >> 8) % (alpha + 1);
+    }
+  }
+  auto write = [&](const std::vector<uint32_t>& values) {
+    for (size_t k = 0; k < values.size(); ++k) {
+      if (depth > 8) {
+        reinterpret_cast<uint16_t*>(rgb.pixels)[k] =
+            static_cast<uint16_t>(values[k]);
+      } else {
+        rgb.pixels[k] = static_cast<uint8_t>(values[k]);
+      }
+    }
+  };
+  auto read = [&](size_t k) -> uint32_t {
+    return depth > 8 ? reinterpret_cast<const uint16_t*>(rgb.pixels)[k]
+                     : rgb.pixels[k];
+  };
+
+  // Unpremultiply.
+  write(samples);
+  ASSERT_EQ(avifRGBImageUnpremultiplyAlpha(&rgb), AVIF_RESULT_OK);
+  std::vector<uint32_t> unpremultiplied(samples.size());
+  for (size_t k = 0; k < samples.size(); ++k) {
+    const uint32_t alpha = samples[k - k % 4 + alpha_index];
+    uint32_t expected = samples[k];
+    if (k % 4 != alpha_index) {
+      expected = alpha == 0 ? 0
+                            : std::min(max_channel,
+                                       RoundedDivision(uint64_t{samples[k]} *
+                                                           max_channel,
+                                                       alpha));
+    }
+    ASSERT_EQ(read(k), expected) << "sample " << k << " alpha " << alpha;
+    unpremultiplied[k] = expected;
+  }
+
+  // Premultiply.
+  ASSERT_EQ(avifRGBImagePremultiplyAlpha(&rgb), AVIF_RESULT_OK);
+  for (size_t k = 0; k < samples.size(); ++k) {
+    const uint32_t alpha = samples[k - k % 4 + alpha_index];
+    const uint32_t expected =
+        (k % 4 == alpha_index)
+            ? alpha
+            : RoundedDivision(uint64_t{unpremultiplied[k]} * alpha,
+                              max_channel);
+    ASSERT_EQ(read(k), expected) << "sample " << k << " alpha " << alpha;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    AllFormatsAndDepths, PremultiplyTest,
+    testing::Combine(testing::Values(AVIF_RGB_FORMAT_RGBA, AVIF_RGB_FORMAT_ARGB,
+                                     AVIF_RGB_FORMAT_BGRA,
+                                     AVIF_RGB_FORMAT_ABGR),
+                     testing::Values(8u, 10u, 12u, 16u)));
+
+}  // namespace
+}  // namespace libavif
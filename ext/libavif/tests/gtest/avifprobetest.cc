@@ -0,0 +1,110 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+// Encodes num_frames frames with alpha and all the metadata a probe reports.
+testutil::AvifRwData EncodeWithMetadata(int num_frames) {
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(48, 32, 10, AVIF_PIXEL_FORMAT_YUV422,
+                            AVIF_PLANES_ALL, AVIF_RANGE_LIMITED);
+  if (!image) return testutil::AvifRwData();
+  testutil::FillImageGradient(image.get());
+  image->colorPrimaries = AVIF_COLOR_PRIMARIES_BT2020;
+  image->transferCharacteristics = AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084;
+  image->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_BT2020_NCL;
+  const uint8_t icc[] = {'f', 'a', 'k', 'e', 'i', 'c', 'c'};
+  const uint8_t exif[] = {0, 0, 0, 0, 'I', 'I', 42, 0, 8, 0, 0, 0};
+  const uint8_t xmp[] = {'<', 'x', '/', '>'};
+  avifImageSetProfileICC(image.get(), icc, sizeof(icc));
+  avifImageSetMetadataExif(image.get(), exif, sizeof(exif));
+  avifImageSetMetadataXMP(image.get(), xmp, sizeof(xmp));
+
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) return testutil::AvifRwData();
+  encoder->speed = AVIF_SPEED_FASTEST;
+  for (int i = 0; i < num_frames; ++i) {
+    if (avifEncoderAddImage(encoder.get(), image.get(),
+                            /*durationInTimescales=*/1,
+                            num_frames == 1 ? AVIF_ADD_IMAGE_FLAG_SINGLE
+                                            : AVIF_ADD_IMAGE_FLAG_NONE) !=
+        AVIF_RESULT_OK) {
+      return testutil::AvifRwData();
+    }
+  }
+  testutil::AvifRwData encoded;
+  if (avifEncoderFinish(encoder.get(), &encoded) != AVIF_RESULT_OK) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+void ExpectSameProperties(const avifDecoder& probed,
+                          const avifDecoder& parsed) {
+  EXPECT_EQ(probed.imageCount, parsed.imageCount);
+  EXPECT_EQ(probed.alphaPresent, parsed.alphaPresent);
+  const avifImage& a = *probed.image;
+  const avifImage& b = *parsed.image;
+  EXPECT_EQ(a.width, b.width);
+  EXPECT_EQ(a.height, b.height);
+  EXPECT_EQ(a.depth, b.depth);
+  EXPECT_EQ(a.yuvFormat, b.yuvFormat);
+  EXPECT_EQ(a.yuvRange, b.yuvRange);
+  EXPECT_EQ(a.colorPrimaries, b.colorPrimaries);
+  EXPECT_EQ(a.transferCharacteristics, b.transferCharacteristics);
+  EXPECT_EQ(a.matrixCoefficients, b.matrixCoefficients);
+  EXPECT_TRUE(testutil::AreByteSequencesEqual(a.icc, b.icc));
+  EXPECT_TRUE(testutil::AreByteSequencesEqual(a.exif, b.exif));
+  EXPECT_TRUE(testutil::AreByteSequencesEqual(a.xmp, b.xmp));
+}
+
+class ProbeTest : public testing::TestWithParam<int> {};
+
+TEST_P(ProbeTest, SameAsParse) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+      nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+  const int num_frames = GetParam();
+  const testutil::AvifRwData encoded = EncodeWithMetadata(num_frames);
+  ASSERT_NE(encoded.size, 0u);
+
+  testutil::AvifDecoderPtr parsed(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(parsed, nullptr);
+  ASSERT_EQ(avifDecoderSetIOMemory(parsed.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(parsed.get()), AVIF_RESULT_OK);
+
+  testutil::AvifDecoderPtr probed(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(probed, nullptr);
+  ASSERT_EQ(avifDecoderSetIOMemory(probed.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderProbe(probed.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(probed->imageCount, static_cast<uint32_t>(num_frames));
+  EXPECT_TRUE(probed->alphaPresent);
+  EXPECT_EQ(probed->image->depth, 10u);
+  EXPECT_EQ(probed->image->yuvFormat, AVIF_PIXEL_FORMAT_YUV422);
+  EXPECT_EQ(probed->image->transferCharacteristics,
+            AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084);
+  ExpectSameProperties(*probed, *parsed);
+
+  // No codec was created, so nothing can be decoded before a reset.
+  EXPECT_EQ(avifDecoderNextImage(probed.get()),
+            AVIF_RESULT_NO_CODEC_AVAILABLE);
+  ASSERT_EQ(avifDecoderReset(probed.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(probed.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(parsed.get()), AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreImagesEqual(*probed->image, *parsed->image));
+}
+
+INSTANTIATE_TEST_SUITE_P(Frames, ProbeTest, testing::Values(1, 3));
+
+}  // namespace
+}  // namespace libavif
@@ -0,0 +1,185 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+constexpr uint32_t kCellSize = 128;
+constexpr uint32_t kGridCols = 2;
+constexpr uint32_t kGridRows = 1;
+// Color and alpha of each cell.
+constexpr uint32_t kCodecCount = kGridCols * kGridRows * 2;
+
+bool IsCodecAvailable() {
+  return avifCodecName(AVIF_CODEC_CHOICE_AOM, AVIF_CODEC_FLAG_CAN_ENCODE) !=
+             nullptr &&
+         avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) !=
+             nullptr;
+}
+
+// Records the calls to the progress function and stops at cancelAt calls.
+struct Progress {
+  std::vector<std::pair<uint32_t, uint32_t>> calls;
+  size_t cancelAt = 0;  // 0 to never cancel
+
+  static avifBool Report(void* userData, uint32_t done, uint32_t total) {
+    Progress* progress = static_cast<Progress*>(userData);
+    progress->calls.emplace_back(done, total);
+    return (progress->cancelAt == 0 ||
+            progress->calls.size() < progress->cancelAt)
+               ? AVIF_TRUE
+               : AVIF_FALSE;
+  }
+};
+
+std::vector<testutil::AvifImagePtr> CreateCells() {
+  std::vector<testutil::AvifImagePtr> cells;
+  for (uint32_t i = 0; i < kGridCols * kGridRows; ++i) {
+    cells.push_back(testutil::CreateImage(kCellSize, kCellSize, 8,
+                                          AVIF_PIXEL_FORMAT_YUV444,
+                                          AVIF_PLANES_ALL));
+    if (!cells.back()) break;
+    testutil::FillImageGradient(cells.back().get());
+  }
+  return cells;
+}
+
+avifResult EncodeGrid(avifEncoder* encoder,
+                      const std::vector<testutil::AvifImagePtr>& cells,
+                      testutil::AvifRwData* encoded) {
+  std::vector<const avifImage*> cell_pointers;
+  for (const testutil::AvifImagePtr& cell : cells) {
+    cell_pointers.push_back(cell.get());
+  }
+  const avifResult result =
+      avifEncoderAddImageGrid(encoder, kGridCols, kGridRows,
+                              cell_pointers.data(), AVIF_ADD_IMAGE_FLAG_SINGLE);
+  if (result != AVIF_RESULT_OK) return result;
+  return avifEncoderFinish(encoder, encoded);
+}
+
+TEST(ProgressTest, Encode) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  const std::vector<testutil::AvifImagePtr> cells = CreateCells();
+  ASSERT_EQ(cells.size(), kGridCols * kGridRows);
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->codecChoice = AVIF_CODEC_CHOICE_AOM;
+  encoder->speed = AVIF_SPEED_FASTEST;
+  Progress progress;
+  encoder->progressFunc = Progress::Report;
+  encoder->progressUserData = &progress;
+  testutil::AvifRwData encoded;
+  ASSERT_EQ(EncodeGrid(encoder.get(), cells, &encoded), AVIF_RESULT_OK);
+
+  // Once for avifEncoderAddImageGrid(), once for avifEncoderFinish().
+  std::vector<std::pair<uint32_t, uint32_t>> expected_calls;
+  for (int i = 0; i < 2; ++i) {
+    for (uint32_t done = 0; done <= kCodecCount; ++done) {
+      expected_calls.emplace_back(done, kCodecCount);
+    }
+  }
+  EXPECT_EQ(progress.calls, expected_calls);
+}
+
+TEST(ProgressTest, CancelEncode) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  const std::vector<testutil::AvifImagePtr> cells = CreateCells();
+  ASSERT_EQ(cells.size(), kGridCols * kGridRows);
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->codecChoice = AVIF_CODEC_CHOICE_AOM;
+  encoder->speed = AVIF_SPEED_FASTEST;
+  Progress progress;
+  progress.cancelAt = 3;
+  encoder->progressFunc = Progress::Report;
+  encoder->progressUserData = &progress;
+  testutil::AvifRwData encoded;
+  EXPECT_EQ(EncodeGrid(encoder.get(), cells, &encoded), AVIF_RESULT_CANCELED);
+  EXPECT_EQ(progress.calls.size(), 3u);
+
+  // The encoder can be used again once reset.
+  ASSERT_EQ(avifEncoderReset(encoder.get()), AVIF_RESULT_OK);
+  encoder->progressFunc = nullptr;
+  EXPECT_EQ(EncodeGrid(encoder.get(), cells, &encoded), AVIF_RESULT_OK);
+}
+
+TEST(ProgressTest, FrameDeadline) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  const std::vector<testutil::AvifImagePtr> cells = CreateCells();
+  ASSERT_EQ(cells.size(), kGridCols * kGridRows);
+
+  testutil::AvifRwData encoded[2];
+  for (int with_deadline = 0; with_deadline < 2; ++with_deadline) {
+    testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+    ASSERT_NE(encoder, nullptr);
+    encoder->codecChoice = AVIF_CODEC_CHOICE_AOM;
+    encoder->speed = 4;
+    encoder->minQuantizer = encoder->maxQuantizer = 20;
+    encoder->minQuantizerAlpha = encoder->maxQuantizerAlpha = 20;
+    // The first cell takes longer than that at speed 4, so the other cells
+    // are encoded at the fastest speed.
+    encoder->frameDeadlineMs = with_deadline ? 1 : 0;
+    ASSERT_EQ(EncodeGrid(encoder.get(), cells, &encoded[with_deadline]),
+              AVIF_RESULT_OK);
+  }
+  EXPECT_FALSE(encoded[0].size == encoded[1].size &&
+               std::equal(encoded[0].data, encoded[0].data + encoded[0].size,
+                          encoded[1].data));
+
+  testutil::AvifImagePtr decoded(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(decoded, nullptr);
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderReadMemory(decoder.get(), decoded.get(),
+                                  encoded[1].data, encoded[1].size),
+            AVIF_RESULT_OK);
+  EXPECT_EQ(decoded->width, kCellSize * kGridCols);
+  EXPECT_EQ(decoded->height, kCellSize * kGridRows);
+}
+
+TEST(ProgressTest, Decode) {
+  if (!IsCodecAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+  const std::vector<testutil::AvifImagePtr> cells = CreateCells();
+  ASSERT_EQ(cells.size(), kGridCols * kGridRows);
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->codecChoice = AVIF_CODEC_CHOICE_AOM;
+  encoder->speed = AVIF_SPEED_FASTEST;
+  testutil::AvifRwData encoded;
+  ASSERT_EQ(EncodeGrid(encoder.get(), cells, &encoded), AVIF_RESULT_OK);
+
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  Progress progress;
+  progress.cancelAt = 2;
+  decoder->progressFunc = Progress::Report;
+  decoder->progressUserData = &progress;
+  ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  EXPECT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_CANCELED);
+  EXPECT_EQ(progress.calls.size(), 2u);
+
+  // Decoding again from the start reports every tile.
+  ASSERT_EQ(avifDecoderReset(decoder.get()), AVIF_RESULT_OK);
+  progress.calls.clear();
+  progress.cancelAt = 0;
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  std::vector<std::pair<uint32_t, uint32_t>> expected_calls;
+  for (uint32_t done = 1; done <= kCodecCount; ++done) {
+    expected_calls.emplace_back(done, kCodecCount);
+  }
+  EXPECT_EQ(progress.calls, expected_calls);
+}
+
+}  // namespace
+}  // namespace libavif
@@ -0,0 +1,205 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+constexpr uint32_t kCellWidth = 64;
+constexpr uint32_t kCellHeight = 64;
+
+// Encodes a gradient image with alpha as a grid of columns x rows cells, or as
+// a single item if columns and rows are 1.
+testutil::AvifRwData EncodeGrid(uint32_t columns, uint32_t rows) {
+  const uint32_t width = columns * kCellWidth;
+  const uint32_t height = rows * kCellHeight;
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(width, height, 8, AVIF_PIXEL_FORMAT_YUV420,
+                            AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+  if (!image) return testutil::AvifRwData();
+  testutil::FillImageGradient(image.get());
+
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) return testutil::AvifRwData();
+  encoder->speed = AVIF_SPEED_FASTEST;
+  testutil::AvifRwData encoded;
+  if (columns == 1 && rows == 1) {
+    if (avifEncoderWrite(encoder.get(), image.get(), &encoded) !=
+        AVIF_RESULT_OK) {
+      return testutil::AvifRwData();
+    }
+    return encoded;
+  }
+
+  std::vector<testutil::AvifImagePtr> cells;
+  std::vector<const avifImage*> cell_ptrs;
+  for (uint32_t y = 0; y < rows; ++y) {
+    for (uint32_t x = 0; x < columns; ++x) {
+      const avifCropRect rect = {x * kCellWidth, y * kCellHeight, kCellWidth,
+                                 kCellHeight};
+      cells.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+      if (avifImageSetViewRect(cells.back().get(), image.get(), &rect) !=
+          AVIF_RESULT_OK) {
+        return testutil::AvifRwData();
+      }
+      cell_ptrs.push_back(cells.back().get());
+    }
+  }
+  if ((avifEncoderAddImageGrid(encoder.get(), columns, rows, cell_ptrs.data(),
+                               AVIF_ADD_IMAGE_FLAG_SINGLE) != AVIF_RESULT_OK) ||
+      (avifEncoderFinish(encoder.get(), &encoded) != AVIF_RESULT_OK)) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+// avifIO reading from memory that counts the bytes it returns.
+struct CountingReader {
+  avifIO io;
+  avifROData data;
+  size_t bytes_read = 0;
+};
+
+avifResult CountingReaderRead(avifIO* io, uint32_t read_flags, uint64_t offset,
+                              size_t size, avifROData* out) {
+  CountingReader* reader = reinterpret_cast<CountingReader*>(io);
+  if (read_flags != 0 || offset > reader->data.size) {
+    return AVIF_RESULT_IO_ERROR;
+  }
+  size = std::min<size_t>(size, reader->data.size - offset);
+  out->data = reader->data.data + offset;
+  out->size = size;
+  reader->bytes_read += size;
+  return AVIF_RESULT_OK;
+}
+
+bool HasCodecs() {
+  return avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) !=
+             nullptr &&
+         avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) !=
+             nullptr;
+}
+
+// Checks that decoding each of rects gives the same pixels as cropping the
+// whole decoded image.
+void CheckRegions(const testutil::AvifRwData& encoded,
+                  const std::vector<avifCropRect>& rects) {
+  const testutil::AvifImagePtr expected =
+      testutil::Decode(encoded.data, encoded.size);
+  ASSERT_NE(expected, nullptr);
+
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  for (const avifCropRect& rect : rects) {
+    SCOPED_TRACE(testing::Message() << rect.x << "," << rect.y << " "
+                                    << rect.width << "x" << rect.height);
+    testutil::AvifImagePtr region(avifImageCreateEmpty(), avifImageDestroy);
+    ASSERT_NE(region, nullptr);
+    ASSERT_EQ(avifDecoderDecodeRegion(decoder.get(), &rect, region.get()),
+              AVIF_RESULT_OK);
+    testutil::AvifImagePtr expected_region(avifImageCreateEmpty(),
+                                           avifImageDestroy);
+    ASSERT_NE(expected_region, nullptr);
+    ASSERT_EQ(avifImageSetViewRect(expected_region.get(), expected.get(),
+                                   &rect),
+              AVIF_RESULT_OK);
+    EXPECT_TRUE(testutil::AreImagesEqual(*region, *expected_region));
+  }
+
+  // The whole image can still be decoded afterwards.
+  ASSERT_EQ(avifDecoderNthImage(decoder.get(), 0), AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *expected));
+}
+
+TEST(RegionTest, Grid) {
+  if (!HasCodecs()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  const testutil::AvifRwData encoded = EncodeGrid(4, 3);
+  ASSERT_NE(encoded.size, 0u);
+  CheckRegions(encoded, {{0, 0, 4 * kCellWidth, 3 * kCellHeight},
+                         {0, 0, 1, 1},
+                         {kCellWidth, kCellHeight, kCellWidth, kCellHeight},
+                         {10, 20, 2 * kCellWidth + 7, kCellHeight + 3},
+                         {kCellWidth - 2, 0, 3, 3 * kCellHeight},
+                         {4 * kCellWidth - 6, 3 * kCellHeight - 4, 6, 4}});
+}
+
+TEST(RegionTest, SingleItem) {
+  if (!HasCodecs()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  const testutil::AvifRwData encoded = EncodeGrid(1, 1);
+  ASSERT_NE(encoded.size, 0u);
+  CheckRegions(encoded, {{0, 0, kCellWidth, kCellHeight}, {6, 8, 15, 17}});
+}
+
+TEST(RegionTest, OnlyIntersectingCellsAreRead) {
+  if (!HasCodecs()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  const testutil::AvifRwData encoded = EncodeGrid(4, 4);
+  ASSERT_NE(encoded.size, 0u);
+
+  CountingReader reader;
+  reader.io = avifIO();
+  reader.io.read = CountingReaderRead;
+  reader.io.sizeHint = encoded.size;
+  reader.io.persistent = AVIF_FALSE;
+  reader.data.data = encoded.data;
+  reader.data.size = encoded.size;
+
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  avifDecoderSetIO(decoder.get(), &reader.io);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+
+  // A region within a single cell needs one color and one alpha sample out of
+  // 16 each.
+  reader.bytes_read = 0;
+  const avifCropRect rect = {kCellWidth + 4, 2 * kCellHeight + 4, 16, 16};
+  testutil::AvifImagePtr region(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(region, nullptr);
+  ASSERT_EQ(avifDecoderDecodeRegion(decoder.get(), &rect, region.get()),
+            AVIF_RESULT_OK);
+  EXPECT_EQ(region->width, rect.width);
+  EXPECT_EQ(region->height, rect.height);
+  EXPECT_NE(region->alphaPlane, nullptr);
+  EXPECT_GT(reader.bytes_read, 0u);
+  EXPECT_LT(reader.bytes_read, encoded.size / 8);
+}
+
+TEST(RegionTest, InvalidRect) {
+  if (!HasCodecs()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  const testutil::AvifRwData encoded = EncodeGrid(2, 2);
+  ASSERT_NE(encoded.size, 0u);
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  testutil::AvifImagePtr region(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(region, nullptr);
+  const avifCropRect rect = {0, 0, 2, 2};
+  EXPECT_EQ(avifDecoderDecodeRegion(decoder.get(), &rect, region.get()),
+            AVIF_RESULT_NO_CONTENT);
+
+  ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  for (const avifCropRect& invalid_rect :
+       {avifCropRect{0, 0, 0, 2}, avifCropRect{1, 0, 2, 2},
+        avifCropRect{0, 1, 2, 2}, avifCropRect{0, 0, 2 * kCellWidth + 1, 2},
+        avifCropRect{2 * kCellWidth - 2, 0, 4, 2}}) {
+    EXPECT_EQ(
+        avifDecoderDecodeRegion(decoder.get(), &invalid_rect, region.get()),
+        AVIF_RESULT_INVALID_ARGUMENT);
+  }
+}
+
+}  // namespace
+}  // namespace libavif
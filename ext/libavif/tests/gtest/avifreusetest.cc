@@ -0,0 +1,263 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <cstring>
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+// Encodes a gradient image of the given dimensions, as a single item or as a
+// 2x2 grid.
+testutil::AvifRwData EncodeGradient(uint32_t width, uint32_t height,
+                                    bool use_grid) {
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(width, height, 8, AVIF_PIXEL_FORMAT_YUV444,
+                            AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+  if (!image) return testutil::AvifRwData();
+  testutil::FillImageGradient(image.get());
+
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  if (!encoder) return testutil::AvifRwData();
+  encoder->speed = AVIF_SPEED_FASTEST;
+  testutil::AvifRwData encoded;
+  if (!use_grid) {
+    if (avifEncoderWrite(encoder.get(), image.get(), &encoded) !=
+        AVIF_RESULT_OK) {
+      return testutil::AvifRwData();
+    }
+    return encoded;
+  }
+
+  std::vector<testutil::AvifImagePtr> cells;
+  std::vector<const avifImage*> cell_ptrs;
+  for (uint32_t y = 0; y < 2; ++y) {
+    for (uint32_t x = 0; x < 2; ++x) {
+      const avifCropRect rect = {x * width / 2, y * height / 2, width / 2,
+                                 height / 2};
+      cells.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+      if (avifImageSetViewRect(cells.back().get(), image.get(), &rect) !=
+          AVIF_RESULT_OK) {
+        return testutil::AvifRwData();
+      }
+      cell_ptrs.push_back(cells.back().get());
+    }
+  }
+  if ((avifEncoderAddImageGrid(encoder.get(), 2, 2, cell_ptrs.data(),
+                               AVIF_ADD_IMAGE_FLAG_SINGLE) != AVIF_RESULT_OK) ||
+      (avifEncoderFinish(encoder.get(), &encoded) != AVIF_RESULT_OK)) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+TEST(ReuseTest, DecoderReuseCodecs) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+          nullptr ||
+      avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) ==
+          nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+
+  std::vector<testutil::AvifRwData> files;
+  files.push_back(EncodeGradient(64, 64, /*use_grid=*/false));
+  files.push_back(EncodeGradient(256, 192, /*use_grid=*/true));
+  files.push_back(EncodeGradient(32, 48, /*use_grid=*/false));
+  files.push_back(EncodeGradient(256, 192, /*use_grid=*/true));
+  for (const testutil::AvifRwData& file : files) {
+    ASSERT_NE(file.size, 0u);
+  }
+
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  decoder->reuseCodecs = AVIF_TRUE;
+  // Decode each file twice in a row, then all files one after the other.
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const testutil::AvifRwData& file : files) {
+      const testutil::AvifImagePtr expected =
+          testutil::Decode(file.data, file.size);
+      ASSERT_NE(expected, nullptr);
+      for (int repetition = 0; repetition < (pass == 0 ? 2 : 1);
+           ++repetition) {
+        testutil::AvifImagePtr decoded(avifImageCreateEmpty(),
+                                       avifImageDestroy);
+        ASSERT_NE(decoded, nullptr);
+        ASSERT_EQ(avifDecoderReadMemory(decoder.get(), decoded.get(),
+                                        file.data, file.size),
+                  AVIF_RESULT_OK);
+        EXPECT_TRUE(testutil::AreImagesEqual(*decoded, *expected));
+      }
+    }
+  }
+
+  // Rewinding with avifDecoderReset() must also work with reused codecs.
+  ASSERT_EQ(avifDecoderReset(decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+  const testutil::AvifImagePtr expected =
+      testutil::Decode(files.back().data, files.back().size);
+  ASSERT_NE(expected, nullptr);
+  EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *expected));
+}
+
+// Grid cells are decoded with a single codec instance only when none of them
+// is layered. Turns the 3-channel pixi boxes of a grid into a1lx boxes of the
+// same size (a single layer, since the first layer size is 0) and checks that
+// the cells are still decoded correctly.
+TEST(ReuseTest, LayeredGridCells) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+          nullptr ||
+      avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) ==
+          nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+
+  const testutil::AvifRwData file =
+      EncodeGradient(256, 192, /*use_grid=*/true);
+  ASSERT_NE(file.size, 0u);
+  const testutil::AvifImagePtr expected =
+      testutil::Decode(file.data, file.size);
+  ASSERT_NE(expected, nullptr);
+
+  testutil::AvifRwData layered_file;
+  avifRWDataSet(&layered_file, file.data, file.size);
+  ASSERT_EQ(layered_file.size, file.size);
+  const uint8_t pixi_header[] = {0, 0, 0, 16, 'p', 'i', 'x', 'i'};
+  int num_patched_boxes = 0;
+  for (size_t i = 0; i + sizeof(pixi_header) <= layered_file.size; ++i) {
+    if (std::memcmp(layered_file.data + i, pixi_header,
+                    sizeof(pixi_header)) == 0) {
+      std::memcpy(layered_file.data + i + 4, "a1lx", 4);
+      ++num_patched_boxes;
+    }
+  }
+  ASSERT_GT(num_patched_boxes, 0);
+
+  for (avifBool allow_progressive : {AVIF_FALSE, AVIF_TRUE}) {
+    testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+    ASSERT_NE(decoder, nullptr);
+    // The pixi property is required by default.
+    decoder->strictFlags = AVIF_STRICT_DISABLED;
+    decoder->allowProgressive = allow_progressive;
+    testutil::AvifImagePtr decoded(avifImageCreateEmpty(), avifImageDestroy);
+    ASSERT_NE(decoded, nullptr);
+    ASSERT_EQ(avifDecoderReadMemory(decoder.get(), decoded.get(),
+                                    layered_file.data, layered_file.size),
+              AVIF_RESULT_OK);
+    EXPECT_TRUE(testutil::AreImagesEqual(*decoded, *expected));
+  }
+}
+
+TEST(ReuseTest, EncoderReset) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+      nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(64, 64, 8, AVIF_PIXEL_FORMAT_YUV420,
+                            AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+  testutil::AvifImagePtr other_image =
+      testutil::CreateImage(32, 16, 10, AVIF_PIXEL_FORMAT_YUV444,
+                            AVIF_PLANES_YUV, AVIF_RANGE_FULL);
+  ASSERT_NE(other_image, nullptr);
+  testutil::FillImageGradient(other_image.get());
+
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->speed = AVIF_SPEED_FASTEST;
+  testutil::AvifRwData first;
+  ASSERT_EQ(avifEncoderWrite(encoder.get(), image.get(), &first),
+            AVIF_RESULT_OK);
+
+  // Without a reset, the encoder is still bound to the previous image.
+  ASSERT_EQ(avifEncoderReset(encoder.get()), AVIF_RESULT_OK);
+  testutil::AvifRwData other;
+  ASSERT_EQ(avifEncoderWrite(encoder.get(), other_image.get(), &other),
+            AVIF_RESULT_OK);
+  const testutil::AvifImagePtr decoded_other =
+      testutil::Decode(other.data, other.size);
+  ASSERT_NE(decoded_other, nullptr);
+  EXPECT_EQ(decoded_other->width, other_image->width);
+  EXPECT_EQ(decoded_other->height, other_image->height);
+  EXPECT_EQ(decoded_other->depth, other_image->depth);
+  EXPECT_EQ(decoded_other->alphaPlane, nullptr);
+
+  // The same settings must lead to the same output after a reset.
+  ASSERT_EQ(avifEncoderReset(encoder.get()), AVIF_RESULT_OK);
+  testutil::AvifRwData second;
+  ASSERT_EQ(avifEncoderWrite(encoder.get(), image.get(), &second),
+            AVIF_RESULT_OK);
+  EXPECT_TRUE(testutil::AreByteSequencesEqual(first, second));
+}
+
+// Encodes image with a new encoder at the given quantizer.
+testutil::AvifRwData EncodeWithNewEncoder(const avifImage& image,
+                                          int quantizer) {
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  testutil::AvifRwData encoded;
+  if (!encoder) return encoded;
+  encoder->speed = AVIF_SPEED_FASTEST;
+  encoder->minQuantizer = encoder->maxQuantizer = quantizer;
+  if (avifEncoderWrite(encoder.get(), &image, &encoded) != AVIF_RESULT_OK) {
+    return testutil::AvifRwData();
+  }
+  return encoded;
+}
+
+TEST(ReuseTest, EncoderReuseCodecs) {
+  if (avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) ==
+      nullptr) {
+    GTEST_SKIP() << "Codec unavailable, skip test.";
+  }
+
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(64, 64, 8, AVIF_PIXEL_FORMAT_YUV420,
+                            AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+  testutil::AvifImagePtr other_image =
+      testutil::CreateImage(32, 16, 10, AVIF_PIXEL_FORMAT_YUV444,
+                            AVIF_PLANES_YUV, AVIF_RANGE_FULL);
+  ASSERT_NE(other_image, nullptr);
+  testutil::FillImageGradient(other_image.get());
+
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->speed = AVIF_SPEED_FASTEST;
+  encoder->reuseCodecs = AVIF_TRUE;
+
+  // A reused codec instance must give the same output as a new one, also when
+  // the quantizers change between the images.
+  for (int quantizer : {20, 20, 40, 10}) {
+    encoder->minQuantizer = encoder->maxQuantizer = quantizer;
+    testutil::AvifRwData encoded;
+    ASSERT_EQ(avifEncoderWrite(encoder.get(), image.get(), &encoded),
+              AVIF_RESULT_OK);
+    const testutil::AvifRwData expected =
+        EncodeWithNewEncoder(*image, quantizer);
+    ASSERT_NE(expected.size, 0u);
+    EXPECT_TRUE(testutil::AreByteSequencesEqual(encoded, expected))
+        << "quantizer " << quantizer;
+    ASSERT_EQ(avifEncoderReset(encoder.get()), AVIF_RESULT_OK);
+  }
+
+  // Another format needs new instances.
+  testutil::AvifRwData other;
+  ASSERT_EQ(avifEncoderWrite(encoder.get(), other_image.get(), &other),
+            AVIF_RESULT_OK);
+  const testutil::AvifImagePtr decoded_other =
+      testutil::Decode(other.data, other.size);
+  ASSERT_NE(decoded_other, nullptr);
+  EXPECT_EQ(decoded_other->width, other_image->width);
+  EXPECT_EQ(decoded_other->depth, other_image->depth);
+  EXPECT_EQ(decoded_other->yuvFormat, other_image->yuvFormat);
+}
+
+}  // namespace
+}  // namespace libavif
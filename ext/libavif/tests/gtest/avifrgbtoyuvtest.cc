@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 #include <tuple>
 
@@ -316,6 +317,149 @@ TEST_P(RGBToYUVTest, ConvertWholeBuffer) {
             min_psnr);
 }
 
+// Converting to identity (GBR) at the same bit depth in full range must copy
+// the G, B and R samples to the Y, U and V planes untouched.
+TEST(RGBToYUVTest, IdentityCopiesChannels) {
+  for (int depth : {8, 10, 12}) {
+    for (avifRGBFormat rgb_format :
+         {AVIF_RGB_FORMAT_RGB, AVIF_RGB_FORMAT_RGBA, AVIF_RGB_FORMAT_ARGB,
+          AVIF_RGB_FORMAT_BGR, AVIF_RGB_FORMAT_BGRA, AVIF_RGB_FORMAT_ABGR}) {
+      SCOPED_TRACE(testing::Message() << depth << " bits, format "
+                                      << rgb_format);
+      testutil::AvifImagePtr yuv(
+          avifImageCreate(67, 5, depth, AVIF_PIXEL_FORMAT_YUV444),
+          avifImageDestroy);
+      ASSERT_NE(yuv, nullptr);
+      yuv->matrixCoefficients = AVIF_MATRIX_COEFFICIENTS_IDENTITY;
+      yuv->yuvRange = AVIF_RANGE_FULL;
+      testutil::AvifRgbImage rgb(yuv.get(), depth, rgb_format);
+      const testutil::RgbChannelOffsets offsets =
+          testutil::GetRgbChannelOffsets(rgb_format);
+      const uint32_t channel_count = avifRGBFormatChannelCount(rgb_format);
+      const uint32_t max = (1u << depth) - 1;
+      for (uint32_t y = 0; y < rgb.height; ++y) {
+        for (uint32_t x = 0; x < rgb.width; ++x) {
+          const uint32_t values[4] = {(x * 7 + y) & max, (x * 13 + 3 * y) & max,
+                                      (x * 31 + 5 * y) & max, max};
+          const uint32_t channels[4] = {offsets.r, offsets.g, offsets.b,
+                                        offsets.a};
+          for (int c = 0; c < (channel_count == 4 ? 4 : 3); ++c) {
+            const size_t index = x * channel_count + channels[c];
+            if (depth == 8) {
+              rgb.pixels[y * rgb.rowBytes + index] =
+                  static_cast<uint8_t>(values[c]);
+            } else {
+              reinterpret_cast<uint16_t*>(rgb.pixels + y * rgb.rowBytes)[index] =
+                  static_cast<uint16_t>(values[c]);
+            }
+          }
+        }
+      }
+      ASSERT_EQ(avifImageRGBToYUV(yuv.get(), &rgb), AVIF_RESULT_OK);
+
+      for (uint32_t y = 0; y < rgb.height; ++y) {
+        for (uint32_t x = 0; x < rgb.width; ++x) {
+          const uint32_t expected[3] = {(x * 13 + 3 * y) & max,
+                                        (x * 31 + 5 * y) & max,
+                                        (x * 7 + y) & max};
+          for (int plane = AVIF_CHAN_Y; plane <= AVIF_CHAN_V; ++plane) {
+            const uint8_t* row =
+                yuv->yuvPlanes[plane] + y * yuv->yuvRowBytes[plane];
+            const uint32_t value =
+                (depth == 8) ? row[x]
+                             : reinterpret_cast<const uint16_t*>(row)[x];
+            ASSERT_EQ(value, expected[plane]);
+          }
+        }
+      }
+    }
+  }
+}
+
+// Returns the half float bits of v, which must be 0 or a normal half float
+// value without rounding.
+uint16_t ToHalf(float v) {
+  if (v == 0.f) return 0;
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  const uint32_t exponent = ((bits >> 23) & 0xFF) - 127 + 15;
+  return static_cast<uint16_t>(((bits >> 16) & 0x8000) | (exponent << 10) |
+                               ((bits >> 13) & 0x3FF));
+}
+
+// Converting float (f32 or f16) RGB samples must give the same YUV samples as
+// converting the equivalent 16-bit samples, with out-of-range values clamped.
+TEST(RGBToYUVTest, FloatInput) {
+  for (int yuv_depth : {8, 10, 12}) {
+    for (avifPixelFormat yuv_format :
+         {AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV420}) {
+      for (avifRGBFormat rgb_format :
+           {AVIF_RGB_FORMAT_RGBA, AVIF_RGB_FORMAT_BGR, AVIF_RGB_FORMAT_ARGB}) {
+        SCOPED_TRACE(testing::Message()
+                     << yuv_depth << " bits, " << yuv_format << ", format "
+                     << rgb_format);
+        // More rows than a conversion band, with an odd height.
+        testutil::AvifImagePtr expected(
+            avifImageCreate(19, 37, yuv_depth, yuv_format), avifImageDestroy);
+        ASSERT_NE(expected, nullptr);
+        testutil::AvifImagePtr from_f32(
+            avifImageCreate(19, 37, yuv_depth, yuv_format), avifImageDestroy);
+        ASSERT_NE(from_f32, nullptr);
+        testutil::AvifImagePtr from_f16(
+            avifImageCreate(19, 37, yuv_depth, yuv_format), avifImageDestroy);
+        ASSERT_NE(from_f16, nullptr);
+
+        testutil::AvifRgbImage u16(expected.get(), 16, rgb_format);
+        testutil::AvifRgbImage f32(expected.get(), 32, rgb_format);
+        f32.isFloat = AVIF_TRUE;
+        testutil::AvifRgbImage f16(expected.get(), 16, rgb_format);
+        f16.isFloat = AVIF_TRUE;
+        const uint32_t channel_count = avifRGBFormatChannelCount(rgb_format);
+        for (uint32_t y = 0; y < u16.height; ++y) {
+          uint16_t* u16_row =
+              reinterpret_cast<uint16_t*>(u16.pixels + y * u16.rowBytes);
+          float* f32_row = reinterpret_cast<float*>(f32.pixels + y * f32.rowBytes);
+          uint16_t* f16_row =
+              reinterpret_cast<uint16_t*>(f16.pixels + y * f16.rowBytes);
+          for (uint32_t i = 0; i < u16.width * channel_count; ++i) {
+            // Multiples of 1/1024 are exact in half floats.
+            const uint32_t k = (i * 37 + y * 101) % 1025;
+            const float v = k / 1024.f;
+            // Same rounding as avifImageRGBToYUV().
+            u16_row[i] = static_cast<uint16_t>(v * 65535.f + 0.5f);
+            f32_row[i] = v;
+            f16_row[i] = ToHalf(v);
+          }
+        }
+        // Out-of-range values.
+        uint16_t* u16_row = reinterpret_cast<uint16_t*>(u16.pixels);
+        float* f32_row = reinterpret_cast<float*>(f32.pixels);
+        uint16_t* f16_row = reinterpret_cast<uint16_t*>(f16.pixels);
+        u16_row[0] = 0;
+        f32_row[0] = -0.5f;
+        f16_row[0] = ToHalf(-0.5f);
+        u16_row[1] = 65535;
+        f32_row[1] = 2.f;
+        f16_row[1] = 0x7C00;  // Infinity.
+        u16_row[2] = 0;
+        f32_row[2] = std::nanf("");
+        f16_row[2] = 0x8001;  // Negative subnormal.
+
+        ASSERT_EQ(avifImageRGBToYUV(expected.get(), &u16), AVIF_RESULT_OK);
+        ASSERT_EQ(avifImageRGBToYUV(from_f32.get(), &f32), AVIF_RESULT_OK);
+        ASSERT_EQ(avifImageRGBToYUV(from_f16.get(), &f16), AVIF_RESULT_OK);
+        EXPECT_TRUE(testutil::AreImagesEqual(*from_f32, *expected));
+        EXPECT_TRUE(testutil::AreImagesEqual(*from_f16, *expected));
+        EXPECT_EQ(from_f32->alphaRangeKnown, expected->alphaRangeKnown);
+        if (expected->alphaRangeKnown) {
+          EXPECT_EQ(from_f32->alphaMin, expected->alphaMin);
+          EXPECT_EQ(from_f32->alphaMax, expected->alphaMax);
+        }
+      }
+    }
+  }
+}
+
 constexpr avifRGBFormat kAllRgbFormats[] = {
     AVIF_RGB_FORMAT_RGB, AVIF_RGB_FORMAT_RGBA, AVIF_RGB_FORMAT_ARGB,
     AVIF_RGB_FORMAT_BGR, AVIF_RGB_FORMAT_BGRA, AVIF_RGB_FORMAT_ABGR};
@@ -381,6 +525,34 @@ INSTANTIATE_TEST_SUITE_P(Identity12b, RGBToYUVTest,
                                  /*rgb_step=*/Values(401),
                                  /*max_abs_average_diff=*/Values(0.),
                                  /*min_psnr=*/Values(99.)));
+// Identity samples go through a lookup table when the range or the bit depth
+// changes. Limited range keeps enough code points at 10 and 12 bits to be
+// lossless for 8-bit input.
+INSTANTIATE_TEST_SUITE_P(IdentityLimitedRange8b, RGBToYUVTest,
+                         Combine(/*rgb_depth=*/Values(8),
+                                 /*yuv_depth=*/Values(10, 12),
+                                 ValuesIn(kAllRgbFormats),
+                                 Values(AVIF_PIXEL_FORMAT_YUV444),
+                                 Values(AVIF_RANGE_LIMITED),
+                                 Values(kMatrixCoefficientsIdentity),
+                                 Values(AVIF_CHROMA_DOWNSAMPLING_AUTOMATIC),
+                                 /*add_noise=*/Values(true),
+                                 /*rgb_step=*/Values(31),
+                                 /*max_abs_average_diff=*/Values(0.),
+                                 /*min_psnr=*/Values(99.)));
+INSTANTIATE_TEST_SUITE_P(Identity16b, RGBToYUVTest,
+                         Combine(/*rgb_depth=*/Values(16),
+                                 /*yuv_depth=*/Values(10, 12),
+                                 Values(AVIF_RGB_FORMAT_RGBA,
+                                        AVIF_RGB_FORMAT_BGR),
+                                 Values(AVIF_PIXEL_FORMAT_YUV444),
+                                 Values(AVIF_RANGE_FULL, AVIF_RANGE_LIMITED),
+                                 Values(kMatrixCoefficientsIdentity),
+                                 Values(AVIF_CHROMA_DOWNSAMPLING_AUTOMATIC),
+                                 /*add_noise=*/Values(false),
+                                 /*rgb_step=*/Values(6553),
+                                 /*max_abs_average_diff=*/Values(3.),
+                                 /*min_psnr=*/Values(70.)));
 
 // 4:4:4 and chroma subsampling have similar distortions on plain color inputs.
 INSTANTIATE_TEST_SUITE_P(
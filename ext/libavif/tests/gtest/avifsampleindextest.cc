@@ -0,0 +1,131 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <vector>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+namespace libavif {
+namespace {
+
+bool CodecsAvailable() {
+  return avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_ENCODE) !=
+             nullptr &&
+         avifCodecName(AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_FLAG_CAN_DECODE) !=
+             nullptr;
+}
+
+// More frames than the interval between two checkpoints of the sample index.
+TEST(SampleIndexTest, LongSequence) {
+  if (!CodecsAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  constexpr int kNumFrames = 300;
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->speed = AVIF_SPEED_FASTEST;
+  encoder->keyframeInterval = 50;
+  for (int i = 0; i < kNumFrames; ++i) {
+    testutil::AvifImagePtr image =
+        testutil::CreateImage(16, 16, 8, AVIF_PIXEL_FORMAT_YUV420,
+                              AVIF_PLANES_YUV, AVIF_RANGE_FULL);
+    ASSERT_NE(image, nullptr);
+    testutil::FillImageGradient(image.get());
+    image->yuvPlanes[AVIF_CHAN_Y][0] = static_cast<uint8_t>(i);
+    ASSERT_EQ(avifEncoderAddImage(encoder.get(), image.get(),
+                                  /*durationInTimescales=*/1,
+                                  AVIF_ADD_IMAGE_FLAG_NONE),
+              AVIF_RESULT_OK);
+  }
+  testutil::AvifRwData encoded;
+  ASSERT_EQ(avifEncoderFinish(encoder.get(), &encoded), AVIF_RESULT_OK);
+
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderSetIOMemory(decoder.get(), encoded.data, encoded.size),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifDecoderParse(decoder.get()), AVIF_RESULT_OK);
+  ASSERT_EQ(decoder->imageCount, kNumFrames);
+
+  std::vector<testutil::AvifImagePtr> frames;
+  std::vector<avifExtent> extents;
+  for (uint32_t i = 0; i < kNumFrames; ++i) {
+    // The samples of a single chunk are contiguous, so each frame extends the
+    // extent of the previous one, starting at the nearest keyframe.
+    extents.emplace_back();
+    ASSERT_EQ(avifDecoderNthImageMaxExtent(decoder.get(), i, &extents.back()),
+              AVIF_RESULT_OK);
+    const avifExtent& keyframe_extent =
+        extents[avifDecoderNearestKeyframe(decoder.get(), i)];
+    EXPECT_EQ(extents.back().offset, keyframe_extent.offset);
+    if (i > 0) {
+      EXPECT_GT(extents.back().offset + extents.back().size,
+                extents[i - 1].offset + extents[i - 1].size);
+    }
+    EXPECT_LE(extents.back().offset + extents.back().size, encoded.size);
+
+    ASSERT_EQ(avifDecoderNextImage(decoder.get()), AVIF_RESULT_OK);
+    frames.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+    ASSERT_EQ(
+        avifImageCopy(frames.back().get(), decoder->image, AVIF_PLANES_ALL),
+        AVIF_RESULT_OK);
+  }
+  EXPECT_EQ(avifDecoderNextImage(decoder.get()),
+            AVIF_RESULT_NO_IMAGES_REMAINING);
+
+  for (uint32_t i : {299u, 0u, 128u, 127u, 255u, 256u, 1u, 200u}) {
+    ASSERT_EQ(avifDecoderNthImage(decoder.get(), i), AVIF_RESULT_OK);
+    EXPECT_TRUE(testutil::AreImagesEqual(*decoder->image, *frames[i]));
+  }
+}
+
+// More items than the initial size of the item ID hash table.
+TEST(SampleIndexTest, ManyItems) {
+  if (!CodecsAvailable()) GTEST_SKIP() << "Codec unavailable, skip test.";
+
+  constexpr uint32_t kGridSize = 8;
+  constexpr uint32_t kCellSize = 64;
+  testutil::AvifImagePtr image = testutil::CreateImage(
+      kGridSize * kCellSize, kGridSize * kCellSize, 8, AVIF_PIXEL_FORMAT_YUV420,
+      AVIF_PLANES_ALL, AVIF_RANGE_FULL);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+
+  std::vector<testutil::AvifImagePtr> cells;
+  std::vector<const avifImage*> cell_ptrs;
+  for (uint32_t y = 0; y < kGridSize; ++y) {
+    for (uint32_t x = 0; x < kGridSize; ++x) {
+      const avifCropRect rect = {x * kCellSize, y * kCellSize, kCellSize,
+                                 kCellSize};
+      cells.emplace_back(avifImageCreateEmpty(), avifImageDestroy);
+      ASSERT_EQ(avifImageSetViewRect(cells.back().get(), image.get(), &rect),
+                AVIF_RESULT_OK);
+      cell_ptrs.push_back(cells.back().get());
+    }
+  }
+  testutil::AvifEncoderPtr encoder(avifEncoderCreate(), avifEncoderDestroy);
+  ASSERT_NE(encoder, nullptr);
+  encoder->speed = AVIF_SPEED_FASTEST;
+  testutil::AvifRwData encoded;
+  ASSERT_EQ(avifEncoderAddImageGrid(encoder.get(), kGridSize, kGridSize,
+                                    cell_ptrs.data(),
+                                    AVIF_ADD_IMAGE_FLAG_SINGLE),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifEncoderFinish(encoder.get(), &encoded), AVIF_RESULT_OK);
+
+  // 2 * 64 cells and 2 grid items.
+  testutil::AvifImagePtr decoded(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(decoded, nullptr);
+  testutil::AvifDecoderPtr decoder(avifDecoderCreate(), avifDecoderDestroy);
+  ASSERT_NE(decoder, nullptr);
+  ASSERT_EQ(avifDecoderReadMemory(decoder.get(), decoded.get(), encoded.data,
+                                  encoded.size),
+            AVIF_RESULT_OK);
+  EXPECT_EQ(decoded->width, image->width);
+  EXPECT_EQ(decoded->height, image->height);
+  EXPECT_NE(decoded->alphaPlane, nullptr);
+}
+
+}  // namespace
+}  // namespace libavif
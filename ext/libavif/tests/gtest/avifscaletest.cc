@@ -0,0 +1,206 @@
+// Copyright 2022 Google LLC. All rights reserved.
+// SPDX-License-Identifier: BSD-2-Clause
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+
+#include "avif/avif.h"
+#include "aviftest_helpers.h"
+#include "gtest/gtest.h"
+
+using testing::Bool;
+using testing::Combine;
+using testing::Values;
+
+namespace libavif {
+namespace {
+
+// Large enough for the planes to be scaled in separate threads.
+constexpr uint32_t kWidth = 300;
+constexpr uint32_t kHeight = 260;
+
+bool IsScaleImplemented() {
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(2, 2, 8, AVIF_PIXEL_FORMAT_YUV400, AVIF_PLANES_YUV);
+  avifDiagnostics diag;
+  return image && avifImageScale(image.get(), 1, 1, 1, &diag) !=
+                      AVIF_RESULT_NOT_IMPLEMENTED;
+}
+
+// Returns the largest difference between a sample of the image and the plain
+// value of its plane.
+uint32_t MaxDiffToPlain(const avifImage& image, const uint32_t yuva[4]) {
+  avifPixelFormatInfo info;
+  avifGetPixelFormatInfo(image.yuvFormat, &info);
+  constexpr int kAlpha = 3;  // index of the alpha value in yuva
+  uint32_t max_diff = 0;
+  for (int c = 0; c < 4; ++c) {
+    const uint8_t* plane =
+        (c == kAlpha) ? image.alphaPlane : image.yuvPlanes[c];
+    if (!plane) continue;
+    const uint32_t row_bytes =
+        (c == kAlpha) ? image.alphaRowBytes : image.yuvRowBytes[c];
+    const bool is_chroma = (c == AVIF_CHAN_U || c == AVIF_CHAN_V);
+    const uint32_t width =
+        is_chroma ? (image.width + info.chromaShiftX) >> info.chromaShiftX
+                  : image.width;
+    const uint32_t height =
+        is_chroma ? (image.height + info.chromaShiftY) >> info.chromaShiftY
+                  : image.height;
+    for (uint32_t y = 0; y < height; ++y) {
+      for (uint32_t x = 0; x < width; ++x) {
+        const uint8_t* row = plane + y * row_bytes;
+        const int sample =
+            avifImageUsesU16(&image)
+                ? reinterpret_cast<const uint16_t*>(row)[x]
+                : row[x];
+        max_diff = std::max<uint32_t>(
+            max_diff, std::abs(sample - static_cast<int>(yuva[c])));
+      }
+    }
+  }
+  return max_diff;
+}
+
+class ScaleTest
+    : public testing::TestWithParam<std::tuple<int, avifPixelFormat, bool>> {};
+
+TEST_P(ScaleTest, PlainImage) {
+  if (!IsScaleImplemented()) GTEST_SKIP() << "libyuv unavailable, skip test.";
+  const int depth = std::get<0>(GetParam());
+  const avifPixelFormat format = std::get<1>(GetParam());
+  const avifPlanesFlags planes =
+      std::get<2>(GetParam()) ? AVIF_PLANES_ALL : AVIF_PLANES_YUV;
+  const uint32_t yuva[] = {(1u << depth) / 3, (1u << depth) / 2,
+                           (1u << depth) / 5, (1u << depth) - 1};
+
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(kWidth, kHeight, depth, format, planes);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImagePlain(image.get(), yuva);
+
+  avifDiagnostics diag;
+  ASSERT_EQ(avifImageScale(image.get(), 101, 67, /*maxThreads=*/4, &diag),
+            AVIF_RESULT_OK);
+  EXPECT_EQ(image->width, 101u);
+  EXPECT_EQ(image->height, 67u);
+  // The fixed point box filter of libyuv may round plain values down.
+  EXPECT_LE(MaxDiffToPlain(*image, yuva), 1u);
+}
+
+TEST_P(ScaleTest, ThreadsGiveSameResult) {
+  if (!IsScaleImplemented()) GTEST_SKIP() << "libyuv unavailable, skip test.";
+  const int depth = std::get<0>(GetParam());
+  const avifPixelFormat format = std::get<1>(GetParam());
+  const avifPlanesFlags planes =
+      std::get<2>(GetParam()) ? AVIF_PLANES_ALL : AVIF_PLANES_YUV;
+
+  testutil::AvifImagePtr image =
+      testutil::CreateImage(kWidth, kHeight, depth, format, planes);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+  testutil::AvifImagePtr threaded(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(threaded, nullptr);
+  ASSERT_EQ(avifImageCopy(threaded.get(), image.get(), AVIF_PLANES_ALL),
+            AVIF_RESULT_OK);
+
+  avifDiagnostics diag;
+  ASSERT_EQ(avifImageScale(image.get(), kWidth / 3, kHeight / 4,
+                           /*maxThreads=*/1, &diag),
+            AVIF_RESULT_OK);
+  ASSERT_EQ(avifImageScale(threaded.get(), kWidth / 3, kHeight / 4,
+                           /*maxThreads=*/8, &diag),
+            AVIF_RESULT_OK);
+  EXPECT_EQ(image->width, kWidth / 3);
+  EXPECT_EQ(image->height, kHeight / 4);
+  EXPECT_TRUE(testutil::AreImagesEqual(*image, *threaded));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    All, ScaleTest,
+    Combine(/*depth=*/Values(8, 10, 12),
+            Values(AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV422,
+                   AVIF_PIXEL_FORMAT_YUV420, AVIF_PIXEL_FORMAT_YUV400),
+            /*alpha=*/Bool()));
+
+TEST(ScaleTest, PlanesNotOwned) {
+  if (!IsScaleImplemented()) GTEST_SKIP() << "libyuv unavailable, skip test.";
+  testutil::AvifImagePtr image = testutil::CreateImage(
+      kWidth, kHeight, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_ALL);
+  ASSERT_NE(image, nullptr);
+  testutil::FillImageGradient(image.get());
+  testutil::AvifImagePtr copy(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(copy, nullptr);
+  ASSERT_EQ(avifImageCopy(copy.get(), image.get(), AVIF_PLANES_ALL),
+            AVIF_RESULT_OK);
+
+  // The view does not own its planes, they must be left untouched.
+  testutil::AvifImagePtr view(avifImageCreateEmpty(), avifImageDestroy);
+  ASSERT_NE(view, nullptr);
+  const avifCropRect rect = {0, 0, kWidth, kHeight};
+  ASSERT_EQ(avifImageSetViewRect(view.get(), image.get(), &rect),
+            AVIF_RESULT_OK);
+  avifDiagnostics diag;
+  ASSERT_EQ(avifImageScale(view.get(), 64, 48, /*maxThreads=*/4, &diag),
+            AVIF_RESULT_OK);
+  EXPECT_TRUE(view->imageOwnsYUVPlanes);
+  EXPECT_TRUE(view->imageOwnsAlphaPlane);
+  EXPECT_NE(view->yuvPlanes[AVIF_CHAN_Y], image->yuvPlanes[AVIF_CHAN_Y]);
+  EXPECT_TRUE(testutil::AreImagesEqual(*image, *copy));
+}
+
+// libyuv can't scale from more than 16384 samples, such sources are reduced
+// first.
+TEST(ScaleTest, LargerThanLibyuvLimit) {
+  if (!IsScaleImplemented()) GTEST_SKIP() << "libyuv unavailable, skip test.";
+  for (int depth : {8, 12}) {
+    const uint32_t yuva[] = {(1u << depth) / 3, (1u << depth) / 2,
+                             (1u << depth) / 5, (1u << depth) - 1};
+    testutil::AvifImagePtr image = testutil::CreateImage(
+        16385 * 2 + 1, 12, depth, AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_ALL);
+    ASSERT_NE(image, nullptr);
+    testutil::FillImagePlain(image.get(), yuva);
+    avifDiagnostics diag;
+    ASSERT_EQ(avifImageScale(image.get(), 1000, 3, /*maxThreads=*/4, &diag),
+              AVIF_RESULT_OK);
+    EXPECT_EQ(image->width, 1000u);
+    EXPECT_EQ(image->height, 3u);
+    EXPECT_LE(MaxDiffToPlain(*image, yuva), 1u);
+
+    // Same for the height, down to the exact size of the reduction.
+    image = testutil::CreateImage(5, 20000, depth, AVIF_PIXEL_FORMAT_YUV422,
+                                  AVIF_PLANES_YUV);
+    ASSERT_NE(image, nullptr);
+    testutil::FillImagePlain(image.get(), yuva);
+    ASSERT_EQ(avifImageScale(image.get(), 3, 10000, /*maxThreads=*/1, &diag),
+              AVIF_RESULT_OK);
+    EXPECT_EQ(image->width, 3u);
+    EXPECT_EQ(image->height, 10000u);
+    EXPECT_EQ(MaxDiffToPlain(*image, yuva), 0u);
+  }
+}
+
+TEST(ScaleTest, InvalidDimensions) {
+  if (!IsScaleImplemented()) GTEST_SKIP() << "libyuv unavailable, skip test.";
+  testutil::AvifImagePtr image = testutil::CreateImage(
+      kWidth, kHeight, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_ALL);
+  ASSERT_NE(image, nullptr);
+  avifDiagnostics diag;
+  EXPECT_EQ(avifImageScale(image.get(), 0, 10, 1, &diag),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  EXPECT_EQ(avifImageScale(image.get(), 10, 0, 1, &diag),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  // Reducing the source below libyuv's limit would lose detail.
+  testutil::AvifImagePtr wide = testutil::CreateImage(
+      20000, 2, 8, AVIF_PIXEL_FORMAT_YUV420, AVIF_PLANES_YUV);
+  ASSERT_NE(wide, nullptr);
+  EXPECT_EQ(avifImageScale(wide.get(), 15000, 2, 1, &diag),
+            AVIF_RESULT_INVALID_ARGUMENT);
+  EXPECT_EQ(wide->width, 20000u);
+  EXPECT_EQ(image->width, kWidth);
+  EXPECT_EQ(image->height, kHeight);
+}
+
+}  // namespace
+}  // namespace libavif
@@ -51,11 +51,18 @@ INPUT_Y4M="${TESTDATA_DIR}/kodim03_yuv420_8bpc.y4m"
 ENCODED_FILE="avif_test_cmd_encoded.avif"
 ENCODED_FILE_WITH_DASH="-avif_test_cmd_encoded.avif"
 DECODED_FILE="avif_test_cmd_decoded.png"
+BATCH_DIR="avif_test_cmd_batch"
+BATCH_LIST="avif_test_cmd_batch.txt"
+BATCH_LOG="avif_test_cmd_batch.log"
+SEQUENCE_FILE="avif_test_cmd_sequence.avif"
+SEQUENCE_LOG="avif_test_cmd_sequence.log"
 
 # Cleanup
 cleanup() {
   pushd ${TMP_DIR}
     rm -- "${ENCODED_FILE}" "${ENCODED_FILE_WITH_DASH}" "${DECODED_FILE}"
+    rm -rf -- "${BATCH_DIR}" "${BATCH_LIST}" "${BATCH_LOG}"
+    rm -- "${SEQUENCE_FILE}" "${SEQUENCE_LOG}"
   popd
 }
 trap cleanup EXIT
@@ -74,6 +81,29 @@ pushd ${TMP_DIR}
   # Passing a filename starting with a dash without using -- should fail.
   "${AVIFENC}" -s 10 "${INPUT_Y4M}" "${ENCODED_FILE_WITH_DASH}" && exit 1
   "${AVIFDEC}" --info "${ENCODED_FILE_WITH_DASH}" && exit 1
+
+  # Batch mode: one output per input and one JSON line per file.
+  echo "Testing batch"
+  mkdir -p "${BATCH_DIR}"
+  echo "${TESTDATA_DIR}/paris_exif_xmp_icc.jpg" > "${BATCH_LIST}"
+  "${AVIFENC}" -s 10 -j 2 --batch-memory 16 -o "${BATCH_DIR}" --batch-list "${BATCH_LIST}" "${INPUT_Y4M}" > "${BATCH_LOG}"
+  [[ $(grep -c '"status":"ok"' "${BATCH_LOG}") -eq 2 ]] || exit 1
+  "${AVIFDEC}" --info "${BATCH_DIR}/kodim03_yuv420_8bpc.avif"
+  "${AVIFDEC}" --info "${BATCH_DIR}/paris_exif_xmp_icc.avif"
+  # A missing input fails the whole command but not the other files.
+  "${AVIFENC}" -s 10 --batch -o "${BATCH_DIR}" "${INPUT_Y4M}" "${BATCH_DIR}/missing.png" > "${BATCH_LOG}" && exit 1
+  [[ $(grep -c '"status":"ok"' "${BATCH_LOG}") -eq 1 ]] || exit 1
+  # Two inputs with the same output filename fail before any file is encoded.
+  "${AVIFENC}" -s 10 --batch -o "${BATCH_DIR}" "${INPUT_Y4M}" "${INPUT_Y4M}" > "${BATCH_LOG}" && exit 1
+  [[ $(grep -c '"status"' "${BATCH_LOG}") -eq 0 ]] || exit 1
+
+  # Image sequence: the frames after the first one are read ahead of the encoder.
+  echo "Testing sequence"
+  "${AVIFENC}" -s 10 "${INPUT_Y4M}" "${INPUT_Y4M}" "${INPUT_Y4M}" -o "${SEQUENCE_FILE}" > "${SEQUENCE_LOG}"
+  grep -q "Encoder: 2 frames" "${SEQUENCE_LOG}" || exit 1
+  "${AVIFDEC}" --info "${SEQUENCE_FILE}" | grep -q "3 frames" || exit 1
+  # A frame that does not match the first one fails.
+  "${AVIFENC}" -s 10 "${INPUT_Y4M}" "${TESTDATA_DIR}/paris_exif_xmp_icc.jpg" -o "${SEQUENCE_FILE}" > "${SEQUENCE_LOG}" && exit 1
 popd
 
 exit 0
@@ -52,6 +52,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <avif/avif.h>
 
 #include "file-avif-dialog.h"
+#include "file-avif-save.h"
 
 static void
 save_dialog_min_quantizer_changed (GObject          *config,
@@ -191,10 +192,11 @@ gboolean   save_dialog (GimpImage     *image,
   GtkWidget     *toggle;
   GtkListStore  *store;
   GtkWidget     *combo;
+  GtkWidget     *spinbutton;
 
   GtkWidget *min_quantizer_scale;
   GtkWidget *max_quantizer_scale;
-  GtkWidget *alpha_quantizer_scale;
+  GtkWidget *alpha_quantizer_scale = NULL;
   GtkWidget *speed_scale;
 
   gboolean       run;
@@ -349,6 +351,66 @@ gboolean   save_dialog (GimpImage     *image,
                             "Encoder speed:",
                             0.0, 0.5, speed_scale, 2);
 
+  /* Create combobox with the encoder profiles, only used by aom */
+  store = gimp_int_store_new ("Default",  AVIFPLUGIN_PROFILE_DEFAULT,
+                              "Fast",     AVIFPLUGIN_PROFILE_FAST,
+                              "Balanced", AVIFPLUGIN_PROFILE_BALANCED,
+                              NULL);
+  combo = gimp_prop_int_combo_box_new (config, "encoder-profile",
+                                       GIMP_INT_STORE (store));
+  g_object_unref (store);
+  gimp_grid_attach_aligned (GTK_GRID (grid), 0, row++,
+                            "Encoder profile (aom only):", 0.0, 0.5,
+                            combo, 2);
+
+  spinbutton = gimp_prop_spin_button_new (config, "time-budget",
+                                          1.0, 10.0, 1);
+  gimp_grid_attach_aligned (GTK_GRID (grid), 0, row++,
+                            "Time budget (s, 0 = off):", 0.0, 0.5,
+                            spinbutton, 1);
+
+  /* Create combobox with the quantizer search targets */
+  store = gimp_int_store_new ("Off (use quantizers)", 0,
+                              "File size",            1,
+                              "Quality (PSNR)",       2,
+                              NULL);
+  combo = gimp_prop_int_combo_box_new (config, "target-mode",
+                                       GIMP_INT_STORE (store));
+  g_object_unref (store);
+  gimp_grid_attach_aligned (GTK_GRID (grid), 0, row++,
+                            "Target:", 0.0, 0.5,
+                            combo, 2);
+
+  spinbutton = gimp_prop_spin_button_new (config, "target-size",
+                                          1.0, 10.0, 0);
+  gimp_grid_attach_aligned (GTK_GRID (grid), 0, row++,
+                            "Target size (KiB):", 0.0, 0.5,
+                            spinbutton, 1);
+
+  spinbutton = gimp_prop_spin_button_new (config, "target-psnr",
+                                          0.5, 1.0, 1);
+  gimp_grid_attach_aligned (GTK_GRID (grid), 0, row++,
+                            "Target PSNR (dB):", 0.0, 0.5,
+                            spinbutton, 1);
+
+  /* Lossless export ignores the quantizers */
+  toggle = gimp_prop_check_button_new (config, "lossless",
+                                       "Lossless");
+  gtk_box_pack_start (GTK_BOX (vbox), toggle, FALSE, FALSE, 0);
+
+  g_object_bind_property (toggle, "active",
+                          min_quantizer_scale, "sensitive",
+                          G_BINDING_SYNC_CREATE | G_BINDING_INVERT_BOOLEAN);
+  g_object_bind_property (toggle, "active",
+                          max_quantizer_scale, "sensitive",
+                          G_BINDING_SYNC_CREATE | G_BINDING_INVERT_BOOLEAN);
+  if (alpha_quantizer_scale)
+    {
+      g_object_bind_property (toggle, "active",
+                              alpha_quantizer_scale, "sensitive",
+                              G_BINDING_SYNC_CREATE | G_BINDING_INVERT_BOOLEAN);
+    }
+
   if (animation_supported)
     {
       GtkWidget *hbox1;
@@ -0,0 +1,382 @@
+/*
+ * GIMP plug-in to allow import/export in AVIF image format.
+ * Author: Daniel Novomesky
+ */
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+This software uses libavif
+URL: https://github.com/AOMediaCodec/libavif/
+
+Copyright 2019 Joe Drago. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <math.h>
+
+#include <libgimp/gimp.h>
+
+#include <avif/avif.h>
+
+#include "file-avif-hdr.h"
+
+/* PQ (SMPTE ST 2084) and HLG (ARIB STD-B67) images are imported as linear
+ * display light floats, with the reference white of ITU-R BT.2408 (203 cd/m2)
+ * mapped to 1.0. Brighter highlights are above 1.0. HLG signals are scene
+ * light, they are rendered with the reference OOTF of ITU-R BT.2100 for a
+ * 1000 cd/m2 display, where 75% signal is the reference white. */
+#define PQ_REFERENCE_WHITE 203.0
+#define HLG_DISPLAY_PEAK 1000.0
+#define HLG_SYSTEM_GAMMA 1.2
+
+/* Each job converts at least this many rows. */
+#define HDR_MIN_THREAD_ROWS 16
+/* Rows converted to RGB at once by a job, even to start on a chroma row, and
+ * few so that the linearization reads them from the cache. */
+#define HDR_CHUNK_ROWS 8
+
+struct _AvifpluginHdr
+{
+  gint         depth;
+  gboolean     loadalpha;
+  gfloat       alpha_scale;
+  gfloat      *lut;         /* 1 << depth entries, non-linear sample -> linear */
+  gboolean     hlg;         /* lut gives scene light, the OOTF is applied per pixel */
+  gfloat       luma[3];     /* luminance of linear R, G and B for the OOTF */
+  gfloat       ootf_scale;
+
+  GThreadPool *pool;        /* max_threads - 1 workers, created on first use */
+  GMutex       mutex;
+  GCond        cond;
+  gint         pending;     /* jobs pushed to pool and not done yet */
+};
+
+/* SMPTE ST 2084 EOTF, returns cd/m2 */
+static gdouble
+pq_eotf (gdouble e)
+{
+  const gdouble m1 = 2610.0 / 16384.0;
+  const gdouble m2 = 2523.0 / 4096.0 * 128.0;
+  const gdouble c1 = 3424.0 / 4096.0;
+  const gdouble c2 = 2413.0 / 4096.0 * 32.0;
+  const gdouble c3 = 2392.0 / 4096.0 * 32.0;
+  gdouble       p = pow (CLAMP (e, 0.0, 1.0), 1.0 / m2);
+
+  return 10000.0 * pow (MAX (p - c1, 0.0) / (c2 - c3 * p), 1.0 / m1);
+}
+
+/* ARIB STD-B67 inverse OETF, returns scene linear light in [0, 1] */
+static gdouble
+hlg_inverse_oetf (gdouble e)
+{
+  const gdouble a = 0.17883277;
+  const gdouble b = 1.0 - 4.0 * a;
+  const gdouble c = 0.5 - a * log (4.0 * a);
+
+  e = CLAMP (e, 0.0, 1.0);
+  if (e <= 0.5)
+    {
+      return e * e / 3.0;
+    }
+  return (exp ( (e - c) / a) + b) / 12.0;
+}
+
+AvifpluginHdr *
+avifplugin_hdr_new (const avifImage *avif,
+                    gboolean         loadalpha)
+{
+  AvifpluginHdr *hdr;
+  const gint     max_value = (1 << avif->depth) - 1;
+  gint           i;
+
+#if AVIF_VERSION < 110000
+  /* no avifImageSetViewRect() to split the conversion between threads */
+  return NULL;
+#endif
+
+  if (avif->transferCharacteristics != 16 /* AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084 */ &&
+      avif->transferCharacteristics != 18 /* AVIF_TRANSFER_CHARACTERISTICS_HLG */)
+    {
+      return NULL;
+    }
+
+  hdr = g_new0 (AvifpluginHdr, 1);
+  hdr->depth = avif->depth;
+  hdr->loadalpha = loadalpha;
+  hdr->alpha_scale = 1.0f / max_value;
+  hdr->lut = g_new (gfloat, max_value + 1);
+  g_mutex_init (&hdr->mutex);
+  g_cond_init (&hdr->cond);
+
+  if (avif->transferCharacteristics == 16)
+    {
+      for (i = 0; i <= max_value; i++)
+        {
+          hdr->lut[i] = (gfloat) (pq_eotf ( (gdouble) i / max_value) / PQ_REFERENCE_WHITE);
+        }
+    }
+  else
+    {
+      for (i = 0; i <= max_value; i++)
+        {
+          hdr->lut[i] = (gfloat) hlg_inverse_oetf ( (gdouble) i / max_value);
+        }
+
+      hdr->hlg = TRUE;
+      hdr->ootf_scale = (gfloat) (HLG_DISPLAY_PEAK / PQ_REFERENCE_WHITE);
+      if (avif->colorPrimaries == 9 /* AVIF_COLOR_PRIMARIES_BT2020 */)
+        {
+          hdr->luma[0] = 0.2627f;
+          hdr->luma[1] = 0.6780f;
+          hdr->luma[2] = 0.0593f;
+        }
+      else /* HLG is meant for BT.2020, BT.709 luminance for anything else */
+        {
+          hdr->luma[0] = 0.2126f;
+          hdr->luma[1] = 0.7152f;
+          hdr->luma[2] = 0.0722f;
+        }
+    }
+
+  return hdr;
+}
+
+void
+avifplugin_hdr_free (AvifpluginHdr *hdr)
+{
+  if (hdr)
+    {
+      if (hdr->pool)
+        {
+          g_thread_pool_free (hdr->pool, FALSE, TRUE);
+        }
+      g_cond_clear (&hdr->cond);
+      g_mutex_clear (&hdr->mutex);
+      g_free (hdr->lut);
+      g_free (hdr);
+    }
+}
+
+typedef struct
+{
+  const AvifpluginHdr *hdr;
+  const avifImage     *avif;
+  gint                 first_row;
+  gint                 last_row;
+  gfloat              *pixels;
+} HdrJob;
+
+/* BT.2100 HLG OOTF on a row of scene linear RGB(A): the luminance of each
+ * pixel is raised to the system gamma, the colors keep their ratios. */
+static void
+avifplugin_hdr_ootf_row (const AvifpluginHdr *hdr,
+                         gfloat              *row,
+                         gint                 width,
+                         gint                 channels)
+{
+  gint x;
+
+  for (x = 0; x < width * channels; x += channels)
+    {
+      gfloat y = hdr->luma[0] * row[x] + hdr->luma[1] * row[x + 1] + hdr->luma[2] * row[x + 2];
+      gfloat scale = (y > 0.0f) ? hdr->ootf_scale * powf (y, (gfloat) (HLG_SYSTEM_GAMMA - 1.0)) : 0.0f;
+
+      row[x] *= scale;
+      row[x + 1] *= scale;
+      row[x + 2] *= scale;
+    }
+}
+
+/* YUV to non-linear RGB at the depth of the image, HDR_CHUNK_ROWS rows at a
+ * time, each chunk linearized through the table while it is in cache. */
+static void
+avifplugin_hdr_job (HdrJob *job)
+{
+#if AVIF_VERSION >= 110000
+  const AvifpluginHdr *hdr = job->hdr;
+  const gint          channels = hdr->loadalpha ? 4 : 3;
+  const gint          width = job->avif->width;
+  avifImage          *view = avifImageCreateEmpty ();
+  avifRGBImage        rgb;
+  uint8_t            *rgb_pixels;
+  gsize               rgb_row_bytes;
+  avifResult          res;
+  gint                chunk_row, x, y;
+
+  rgb_row_bytes = (gsize) width * channels * (hdr->depth > 8 ? 2 : 1);
+  rgb_pixels = g_malloc (rgb_row_bytes * HDR_CHUNK_ROWS);
+
+  for (chunk_row = job->first_row; chunk_row < job->last_row; chunk_row += HDR_CHUNK_ROWS)
+    {
+      const gint   rows = MIN (HDR_CHUNK_ROWS, job->last_row - chunk_row);
+      avifCropRect rect = { 0, chunk_row, width, rows };
+
+      res = avifImageSetViewRect (view, job->avif, &rect);
+      if (res != AVIF_RESULT_OK)
+        {
+          g_printerr ("%s: avifImageSetViewRect failed: %s\n", G_STRFUNC, avifResultToString (res));
+          break;
+        }
+
+      avifRGBImageSetDefaults (&rgb, view);
+      rgb.format = hdr->loadalpha ? AVIF_RGB_FORMAT_RGBA : AVIF_RGB_FORMAT_RGB;
+      rgb.depth = hdr->depth;
+      rgb.pixels = rgb_pixels;
+      rgb.rowBytes = (uint32_t) rgb_row_bytes;
+
+      res = avifImageYUVToRGB (view, &rgb);
+      if (res != AVIF_RESULT_OK)
+        {
+          g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (res));
+        }
+
+      for (y = 0; y < rows; y++)
+        {
+          gfloat *dst = job->pixels + (gsize) (chunk_row - job->first_row + y) * width * channels;
+
+          if (hdr->depth > 8)
+            {
+              const uint16_t *src = (const uint16_t *) (rgb_pixels + y * rgb_row_bytes);
+
+              for (x = 0; x < width * channels; x += channels)
+                {
+                  dst[x] = hdr->lut[src[x]];
+                  dst[x + 1] = hdr->lut[src[x + 1]];
+                  dst[x + 2] = hdr->lut[src[x + 2]];
+                  if (hdr->loadalpha)
+                    {
+                      dst[x + 3] = src[x + 3] * hdr->alpha_scale;
+                    }
+                }
+            }
+          else
+            {
+              const uint8_t *src = rgb_pixels + y * rgb_row_bytes;
+
+              for (x = 0; x < width * channels; x += channels)
+                {
+                  dst[x] = hdr->lut[src[x]];
+                  dst[x + 1] = hdr->lut[src[x + 1]];
+                  dst[x + 2] = hdr->lut[src[x + 2]];
+                  if (hdr->loadalpha)
+                    {
+                      dst[x + 3] = src[x + 3] * hdr->alpha_scale;
+                    }
+                }
+            }
+
+          if (hdr->hlg)
+            {
+              avifplugin_hdr_ootf_row (hdr, dst, width, channels);
+            }
+        }
+    }
+
+  g_free (rgb_pixels);
+  avifImageDestroy (view);
+#endif
+}
+
+static void
+avifplugin_hdr_worker (gpointer data,
+                       gpointer user_data)
+{
+  AvifpluginHdr *hdr = user_data;
+
+  avifplugin_hdr_job (data);
+
+  g_mutex_lock (&hdr->mutex);
+  if (--hdr->pending == 0)
+    {
+      g_cond_signal (&hdr->cond);
+    }
+  g_mutex_unlock (&hdr->mutex);
+}
+
+void
+avifplugin_hdr_convert_rows (AvifpluginHdr   *hdr,
+                             const avifImage *avif,
+                             gint             first_row,
+                             gint             last_row,
+                             gint             max_threads,
+                             gfloat          *pixels)
+{
+  const gint channels = hdr->loadalpha ? 4 : 3;
+  const gint rows = last_row - first_row;
+  HdrJob    *jobs;
+  gint       n_jobs, rows_per_job, j;
+
+  n_jobs = CLAMP (rows / HDR_MIN_THREAD_ROWS, 1, MAX (max_threads, 1));
+  /* even, so that the rows of each job start on a chroma row */
+  rows_per_job = ( (rows + n_jobs - 1) / n_jobs + 1) & ~1;
+  n_jobs = (rows + rows_per_job - 1) / rows_per_job;
+
+  /* the workers are kept for all the bands of the image */
+  if (n_jobs > 1 && ! hdr->pool)
+    {
+      hdr->pool = g_thread_pool_new (avifplugin_hdr_worker, hdr, MAX (max_threads, 2) - 1, FALSE, NULL);
+    }
+
+  jobs = g_new (HdrJob, n_jobs);
+
+  for (j = 0; j < n_jobs; j++)
+    {
+      jobs[j].hdr = hdr;
+      jobs[j].avif = avif;
+      jobs[j].first_row = first_row + j * rows_per_job;
+      jobs[j].last_row = MIN (last_row, jobs[j].first_row + rows_per_job);
+      jobs[j].pixels = pixels + (gsize) j * rows_per_job * avif->width * channels;
+    }
+
+  hdr->pending = n_jobs - 1;
+  for (j = 1; j < n_jobs; j++)
+    {
+      g_thread_pool_push (hdr->pool, &jobs[j], NULL);
+    }
+
+  avifplugin_hdr_job (&jobs[0]);
+
+  g_mutex_lock (&hdr->mutex);
+  while (hdr->pending > 0)
+    {
+      g_cond_wait (&hdr->cond, &hdr->mutex);
+    }
+  g_mutex_unlock (&hdr->mutex);
+
+  g_free (jobs);
+}
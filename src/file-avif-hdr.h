@@ -0,0 +1,24 @@
+
+
+#ifndef __AVIF_HDR_H__
+#define __AVIF_HDR_H__
+
+typedef struct _AvifpluginHdr AvifpluginHdr;
+
+
+/* NULL when the image is not PQ nor HLG, or the libavif is too old */
+AvifpluginHdr *avifplugin_hdr_new          (const avifImage     *avif,
+                                            gboolean             loadalpha);
+void           avifplugin_hdr_free         (AvifpluginHdr       *hdr);
+
+/* Converts the rows [first_row, last_row[ of avif to linear light RGB(A)
+ * floats in pixels, split between up to max_threads threads. The worker
+ * threads are kept in hdr for the next rows. */
+void           avifplugin_hdr_convert_rows (AvifpluginHdr       *hdr,
+                                            const avifImage     *avif,
+                                            gint                 first_row,
+                                            gint                 last_row,
+                                            gint                 max_threads,
+                                            gfloat              *pixels);
+
+#endif /* __AVIF_HDR_H__ */
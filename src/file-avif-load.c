@@ -84,6 +84,7 @@ DEALINGS IN THE SOFTWARE.
 #include <glib/gstdio.h>
 
 #include "file-avif-load.h"
+#include "file-avif-hdr.h"
 
 #include "hlgCurveBinary.h"
 #include "pqCurveBinary.h"
@@ -98,6 +99,96 @@ typedef enum clProfileCurveType
   CL_PCT_PARAMETRIC_REC709
 } clProfileCurveType;
 
+#if defined(AVIF_HAVE_PLANE_ALLOCATOR)
+/* Released planes kept for the next frames of animations and the next files */
+#define AVIFPLUGIN_PLANE_POOL_BYTES (128 * 1024 * 1024)
+
+/* The decoded planes (grid frames, alpha range conversions, regions) are
+ * recycled from frame to frame instead of being allocated and freed each time.
+ * The pool lives as long as the plug-in process, like the cached decoder. */
+static avifPlaneAllocator *plane_pool = NULL;
+
+static avifPlaneAllocator *
+avifplugin_plane_pool_get (void)
+{
+  if (!plane_pool)
+    {
+      plane_pool = avifPlanePoolCreate (AVIFPLUGIN_PLANE_POOL_BYTES);
+    }
+
+  return plane_pool;
+}
+#endif
+
+#if defined(AVIF_HAVE_DECODER_REUSE_CODECS)
+static avifDecoder *cached_decoder = NULL;
+/* Decoders of the loaded preloads, kept warm for the next ones. At most two
+ * preloads exist at once, see avif_load_batch(). */
+static GSList      *idle_preload_decoders = NULL;
+#endif
+
+/* The decoder is kept for the whole life of the plug-in process, so that
+ * loading many files in a row (batch processing) reuses the already
+ * initialized AV1 decoder instead of setting up a new one for each file. */
+static avifDecoder *
+avifplugin_decoder_get (void)
+{
+  avifDecoder *decoder;
+
+#if defined(AVIF_HAVE_DECODER_REUSE_CODECS)
+  if (!cached_decoder)
+    {
+      cached_decoder = avifDecoderCreate ();
+      cached_decoder->reuseCodecs = AVIF_TRUE;
+    }
+
+  decoder = cached_decoder;
+#else
+  decoder = avifDecoderCreate ();
+#endif
+
+#if defined(AVIF_HAVE_PLANE_ALLOCATOR)
+  decoder->planeAllocator = avifplugin_plane_pool_get ();
+#endif
+  return decoder;
+}
+
+#if defined(AVIF_HAVE_IMAGE_SCALE)
+/* avifImageScale() is only implemented when libavif is built with libyuv */
+static gboolean
+avifplugin_can_scale (void)
+{
+  avifImage      *probe = avifImageCreate (2, 2, 8, AVIF_PIXEL_FORMAT_YUV400);
+  avifDiagnostics diag;
+  gboolean        can_scale;
+
+  can_scale = avifImageScale (probe, 1, 1, 1, &diag) != AVIF_RESULT_NOT_IMPLEMENTED;
+  avifImageDestroy (probe);
+  return can_scale;
+}
+#endif
+
+/* Releases the decoder of avifplugin_decoder_get() or of a preload. */
+static void
+avifplugin_decoder_release (avifDecoder *decoder)
+{
+#if defined(AVIF_HAVE_DECODER_REUSE_CODECS)
+  /* The input buffer is freed by the caller, forget it. Decoded pixels are not
+   * needed anymore either, only the codec instances are kept warm. */
+  avifDecoderSetIO (decoder, NULL);
+  if (decoder->image)
+    {
+      avifImageFreePlanes (decoder->image, AVIF_PLANES_ALL);
+    }
+  if (decoder != cached_decoder)
+    {
+      idle_preload_decoders = g_slist_prepend (idle_preload_decoders, decoder);
+    }
+#else
+  avifDecoderDestroy (decoder);
+#endif
+}
+
 static cmsHPROFILE _create_lcms_profile_from_NCLX (const char *description_suffix, const avifColorPrimaries colour_primaries,
     const clProfileCurveType trctype, const float gamma, const int maxLuminance)
 {
@@ -216,34 +307,75 @@ static cmsHPROFILE _create_lcms_profile_from_NCLX (const char *description_suffi
   return profile;
 }
 
-GimpImage *load_image (GFile       *file,
-                       gboolean     interactive,
-                       GError     **error)
+/* The file is read in chunks while it is decoded. Bytes that were not read
+ * yet are reported as AVIF_RESULT_WAITING_ON_IO, so the decoder returns
+ * what it could decode so far (rows of grid images) and the caller reads
+ * the next chunk. */
+#define AVIFPLUGIN_READ_CHUNK (1024 * 1024)
+
+typedef struct
 {
-  GimpImage        *image;
-  GimpLayer        *layer;
-  GeglBuffer       *buffer;
+  avifIO   io;
+  FILE    *file;
+  guint8  *data;
+  gsize    size;        /* file size, data is allocated for all of it */
+  gsize    available;   /* bytes read into data so far */
+} AvifpluginGrowingIO;
+
+static void
+avifplugin_growing_io_destroy (avifIO *io)
+{
+  AvifpluginGrowingIO *gio = (AvifpluginGrowingIO *) io;
 
-  gboolean          loadalpha;
-  gboolean          loadgray;
-  gboolean          loadlinear;
+  if (gio->file)
+    {
+      fclose (gio->file);
+    }
+  g_free (gio->data);
+  g_free (gio);
+}
 
-  GimpColorProfile *profile = NULL;
-  GimpMetadata     *metadata = NULL;
+static avifResult
+avifplugin_growing_io_read (avifIO      *io,
+                            uint32_t     readFlags,
+                            uint64_t     offset,
+                            size_t       size,
+                            avifROData  *out)
+{
+  AvifpluginGrowingIO *gio = (AvifpluginGrowingIO *) io;
 
-  FILE *inputFile = g_fopen (g_file_peek_path (file), "rb");
+  if (readFlags != 0 || offset > gio->size)
+    {
+      return AVIF_RESULT_IO_ERROR;
+    }
 
-  size_t            inputFileSize;
-  avifRWData        raw = AVIF_DATA_EMPTY;
-  avifDecoder      *decoder = NULL;
-  avifResult        decodeResult;
-  avifImage        *avif;
+  if (size > gio->size - offset)
+    {
+      size = gio->size - offset;
+    }
 
-  gint              final_width, final_height;
+  if (offset + size > gio->available)
+    {
+      return AVIF_RESULT_WAITING_ON_IO;
+    }
+
+  out->data = gio->data + offset;
+  out->size = size;
+  return AVIF_RESULT_OK;
+}
+
+static AvifpluginGrowingIO *
+avifplugin_growing_io_open (GFile   *file,
+                            GError **error)
+{
+  AvifpluginGrowingIO *gio;
+  FILE                *inputFile = g_fopen (g_file_peek_path (file), "rb");
+  long                 inputFileSize;
 
   if (!inputFile)
     {
-      g_message ("Cannot open file for read: %s\n", g_file_peek_path (file));
+      g_set_error (error, G_FILE_ERROR, 0, "Cannot open file for read: %s",
+                   g_file_peek_path (file));
       return NULL;
     }
 
@@ -253,63 +385,571 @@ GimpImage *load_image (GFile       *file,
 
   if (inputFileSize < 1)
     {
-      g_message ("File too small: %s\n", g_file_peek_path (file));
+      g_set_error (error, G_FILE_ERROR, 0, "File too small: %s",
+                   g_file_peek_path (file));
       fclose (inputFile);
       return NULL;
     }
 
-  avifRWDataRealloc (&raw, inputFileSize);
-  if (fread (raw.data, 1, inputFileSize, inputFile) != inputFileSize)
+  gio = g_new0 (AvifpluginGrowingIO, 1);
+  gio->io.destroy = avifplugin_growing_io_destroy;
+  gio->io.read = avifplugin_growing_io_read;
+  gio->io.sizeHint = inputFileSize;
+  /* data is never reallocated and the bytes read never change */
+  gio->io.persistent = AVIF_TRUE;
+  gio->file = inputFile;
+  gio->data = g_malloc (inputFileSize);
+  gio->size = inputFileSize;
+  return gio;
+}
+
+/* Reads the next chunk of the file, returns FALSE at the end of the file
+ * or on error. */
+static gboolean
+avifplugin_growing_io_feed (AvifpluginGrowingIO *gio)
+{
+  gsize chunk;
+
+  if (gio->available >= gio->size)
     {
-      g_message ("Failed to read %zu bytes: %s\n", inputFileSize, g_file_peek_path (file));
-      fclose (inputFile);
-      avifRWDataFree (&raw);
-      return NULL;
+      return FALSE;
     }
 
-  fclose (inputFile);
-  inputFile = NULL;
+  chunk = MIN (AVIFPLUGIN_READ_CHUNK, gio->size - gio->available);
+  if (fread (gio->data + gio->available, 1, chunk, gio->file) != chunk)
+    {
+      return FALSE;
+    }
+  gio->available += chunk;
 
-  if (avifPeekCompatibleFileType ( (avifROData *) &raw) == AVIF_FALSE)
+  if (gio->available == gio->size)
     {
-      g_message ("File %s is probably not in AVIF format!\n", g_file_peek_path (file));
-      avifRWDataFree (&raw);
-      return NULL;
+      fclose (gio->file);
+      gio->file = NULL;
     }
+  return TRUE;
+}
 
-  decoder = avifDecoderCreate();
+/* Writes the rows [first_row, last_row[ of the Y plane (and alpha) of a
+ * grayscale image into pixels, in the format of the GIMP layer. */
+static void
+avifplugin_gray_rows (const avifImage *avif,
+                      gboolean         loadalpha,
+                      gint             first_row,
+                      gint             last_row,
+                      gpointer         pixels)
+{
+  const gint width = avif->width;
+  gint       x, y;
 
-#if AVIF_VERSION >= 90100
-  decoder->strictFlags = AVIF_STRICT_DISABLED;
+  if (avifImageUsesU16 (avif))     /* 10 and 12 bit depth import */
+    {
+      const float max_value = (avif->depth == 10) ? 1023.0f : 4095.0f;
+      uint16_t   *gray16_pixel = pixels;
+      int         tmp_pixelval;
+
+      for (y = first_row; y < last_row; y++)
+        {
+          const uint16_t *gray16_src = (const uint16_t *) (y * avif->yuvRowBytes[0] + avif->yuvPlanes[0]);
+          const uint16_t *alpha16_src = (const uint16_t *) (y * avif->alphaRowBytes + avif->alphaPlane);
+
+          for (x = 0; x < width; x++)
+            {
+              uint16_t tmpval16 = gray16_src[x];
+
+              if (avif->yuvRange == AVIF_RANGE_LIMITED)
+                {
+                  tmpval16 = avifLimitedToFullY (avif->depth, tmpval16);
+                }
+
+              tmp_pixelval = (int) ( ( (float) tmpval16 / max_value) * 65535.0f + 0.5f);
+              *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
+              gray16_pixel++;
+
+              if (loadalpha)
+                {
+                  tmp_pixelval = (int) ( ( (float) alpha16_src[x] / max_value) * 65535.0f + 0.5f);
+                  *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
+                  gray16_pixel++;
+                }
+            }
+        }
+    }
+  else /* 8 bit depth import */
+    {
+      uint8_t *gray8_pixel = pixels;
+
+      for (y = first_row; y < last_row; y++)
+        {
+          const uint8_t *gray8_src = y * avif->yuvRowBytes[0] + avif->yuvPlanes[0];
+          const uint8_t *alpha8_src = y * avif->alphaRowBytes + avif->alphaPlane;
+
+          for (x = 0; x < width; x++)
+            {
+              if (avif->yuvRange == AVIF_RANGE_FULL)
+                {
+                  *gray8_pixel = gray8_src[x];
+                }
+              else
+                {
+                  *gray8_pixel = avifLimitedToFullY (8, gray8_src[x]);
+                }
+              gray8_pixel++;
+
+              if (loadalpha)
+                {
+                  *gray8_pixel = alpha8_src[x];
+                  gray8_pixel++;
+                }
+            }
+        }
+    }
+}
+
+/* Converts decoded rows to the layer format and writes them to the layer
+ * buffer in bands of GIMP tile height, through one band buffer reused for
+ * the whole image, so that no full size RGB copy of the image is needed. */
+typedef struct
+{
+  GeglBuffer    *buffer;
+  gboolean       loadgray;
+  gboolean       loadalpha;
+  AvifpluginHdr *hdr;         /* linear float import of PQ/HLG, or NULL */
+  gint           max_threads;
+  gint           band_rows;
+  gsize          pixel_bytes;
+  gpointer       band_pixels;
+} AvifpluginUploader;
+
+static void
+avifplugin_uploader_init (AvifpluginUploader *uploader,
+                          const avifImage    *avif,
+                          GeglBuffer         *buffer,
+                          gboolean            loadgray,
+                          gboolean            loadalpha,
+                          AvifpluginHdr      *hdr,
+                          gint                max_threads)
+{
+  gint channels;
+
+  if (loadgray)
+    {
+      channels = loadalpha ? 2 : 1;
+    }
+  else
+    {
+      channels = loadalpha ? 4 : 3;
+    }
+
+  uploader->buffer = buffer;
+  uploader->loadgray = loadgray;
+  uploader->loadalpha = loadalpha;
+  uploader->hdr = hdr;
+  uploader->max_threads = max_threads;
+  if (hdr)
+    {
+      uploader->pixel_bytes = channels * sizeof (gfloat);
+    }
+  else
+    {
+      uploader->pixel_bytes = channels * (avifImageUsesU16 (avif) ? 2 : 1);
+    }
+
+#if AVIF_VERSION >= 110000
+  /* even, so that bands start on a chroma row of 4:2:0 images */
+  uploader->band_rows = MIN ( (gint) avif->height, (gimp_tile_height () + 1) & ~1);
+#else
+  /* no avifImageSetViewRect(), the image is converted at once */
+  uploader->band_rows = avif->height;
 #endif
 
-  decodeResult = avifDecoderSetIOMemory (decoder, raw.data, raw.size);
-  if (decodeResult != AVIF_RESULT_OK)
+  uploader->band_pixels = g_malloc_n (uploader->band_rows, avif->width * uploader->pixel_bytes);
+}
+
+static void
+avifplugin_uploader_free (AvifpluginUploader *uploader)
+{
+  g_free (uploader->band_pixels);
+  uploader->band_pixels = NULL;
+}
+
+/* Converts the rows [first_row, last_row[ of avif into the band buffer. */
+static void
+avifplugin_convert_rows (AvifpluginUploader *uploader,
+                         avifImage          *avif,
+                         gint                first_row,
+                         gint                last_row)
+{
+  const gint    rows = last_row - first_row;
+  avifImage    *rows_image = avif;
+  avifRGBImage  rgb;
+  avifResult    res;
+#if AVIF_VERSION >= 110000
+  avifImage    *view = NULL;
+#endif
+
+  if (uploader->loadgray)   /* grayscale */
     {
-      g_message ("ERROR: avifDecoderSetIOMemory failed: %s\n", avifResultToString (decodeResult));
+      avifplugin_gray_rows (avif, uploader->loadalpha, first_row, last_row, uploader->band_pixels);
+      return;
+    }
 
-      avifDecoderDestroy (decoder);
-      avifRWDataFree (&raw);
+  if (uploader->hdr)   /* YUV to linear light in one pass */
+    {
+      avifplugin_hdr_convert_rows (uploader->hdr, avif, first_row, last_row,
+                                   uploader->max_threads, uploader->band_pixels);
+      return;
+    }
+
+  /* loading colors, YUV to RGB conversion */
+#if AVIF_VERSION >= 110000
+  if (rows != (gint) avif->height)
+    {
+      avifCropRect rect = { 0, first_row, avif->width, rows };
+
+      view = avifImageCreateEmpty ();
+      res = avifImageSetViewRect (view, avif, &rect);
+      if (res != AVIF_RESULT_OK)
+        {
+          g_printerr ("%s: avifImageSetViewRect failed: %s\n", G_STRFUNC, avifResultToString (res));
+        }
+      rows_image = view;
+    }
+#endif
+
+  avifRGBImageSetDefaults (&rgb, rows_image);
+
+#if AVIF_VERSION >= 1000000
+  rgb.maxThreads = uploader->max_threads;
+#endif
+
+  rgb.format = uploader->loadalpha ? AVIF_RGB_FORMAT_RGBA : AVIF_RGB_FORMAT_RGB;
+  rgb.depth = avifImageUsesU16 (avif) ? 16 : 8;
+  rgb.rowBytes = rgb.width * uploader->pixel_bytes;
+  rgb.pixels = uploader->band_pixels;
+
+  res = avifImageYUVToRGB (rows_image, &rgb);
+  if (res != AVIF_RESULT_OK)
+    {
+      g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (res));
+    }
+
+#if AVIF_VERSION >= 110000
+  if (view)
+    {
+      avifImageDestroy (view);
+    }
+#endif
+}
+
+/* Uploads the rows [first_row, last_row[ of the decoded image. Bands end
+ * on multiples of band_rows, so they cover whole GEGL tiles. */
+static void
+avifplugin_upload_rows (AvifpluginUploader *uploader,
+                        avifImage          *avif,
+                        gint                first_row,
+                        gint                last_row)
+{
+  gint y = first_row;
+
+  while (y < last_row)
+    {
+      gint band_end = MIN (last_row, (y / uploader->band_rows + 1) * uploader->band_rows);
+
+      avifplugin_convert_rows (uploader, avif, y, band_end);
+      gegl_buffer_set (uploader->buffer, GEGL_RECTANGLE (0, y, avif->width, band_end - y), 0,
+                       NULL, uploader->band_pixels, GEGL_AUTO_ROWSTRIDE);
+      y = band_end;
+    }
+}
+
+/* Decoded planes of a preloaded file above this are decoded when the file is
+ * loaded into GIMP instead, so that at most two big images are in memory. */
+#define AVIFPLUGIN_PRELOAD_BYTES (256 * 1024 * 1024)
+
+struct _AvifpluginPreload
+{
+  GFile               *file;
+  GThread             *thread;
+  AvifpluginGrowingIO *gio;            /* owned by decoder once read */
+  avifDecoder         *decoder;
+  gint                 max_threads;
+  avifResult           parse_result;
+  gboolean             decoded;        /* decode_result is set */
+  avifResult           decode_result;
+  GError              *error;
+};
+
+/* Runs on a worker thread: reads the whole file, then parses and decodes
+ * it with a decoder of its own. No libgimp call is made here. */
+static gpointer
+avifplugin_preload_run (gpointer data)
+{
+  AvifpluginPreload  *preload = data;
+  avifROData          header;
+  avifImage          *avif;
+  avifPixelFormatInfo format_info;
+  guint64             plane_bytes;
+
+  preload->gio = avifplugin_growing_io_open (preload->file, &preload->error);
+  if (!preload->gio)
+    {
       return NULL;
     }
 
-  decodeResult = avifDecoderParse (decoder);
-  if (decodeResult != AVIF_RESULT_OK)
+  while (avifplugin_growing_io_feed (preload->gio))
     {
-      g_message ("ERROR: Failed to parse input: %s\n", avifResultToString (decodeResult));
+    }
+  if (preload->gio->available != preload->gio->size)
+    {
+      g_set_error (&preload->error, G_FILE_ERROR, 0, "Failed to read %zu bytes: %s",
+                   preload->gio->size, g_file_peek_path (preload->file));
+    }
+  else
+    {
+      header.data = preload->gio->data;
+      header.size = preload->gio->available;
+      if (avifPeekCompatibleFileType (&header) == AVIF_FALSE)
+        {
+          g_set_error (&preload->error, G_FILE_ERROR, 0, "File %s is probably not in AVIF format!",
+                       g_file_peek_path (preload->file));
+        }
+    }
+  if (preload->error)
+    {
+      avifplugin_growing_io_destroy (&preload->gio->io);
+      preload->gio = NULL;
+      return NULL;
+    }
 
-      avifDecoderDestroy (decoder);
-      avifRWDataFree (&raw);
+  preload->decoder->maxThreads = preload->max_threads;
+#if AVIF_VERSION >= 90100
+  preload->decoder->strictFlags = AVIF_STRICT_DISABLED;
+#endif
+  /* the decoder owns gio from now on */
+  avifDecoderSetIO (preload->decoder, &preload->gio->io);
+
+  preload->parse_result = avifDecoderParse (preload->decoder);
+  if (preload->parse_result != AVIF_RESULT_OK)
+    {
       return NULL;
     }
 
-  decodeResult = avifDecoderNextImage (decoder);
+  avif = preload->decoder->image;
+  avifGetPixelFormatInfo (avif->yuvFormat, &format_info);
+  plane_bytes = (guint64) avif->width * avif->height *
+                (avifImageUsesU16 (avif) ? 2 : 1) *
+                (format_info.monochrome ? 2 : 4);
+  if (plane_bytes <= AVIFPLUGIN_PRELOAD_BYTES)
+    {
+      preload->decode_result = avifDecoderNextImage (preload->decoder);
+      preload->decoded = TRUE;
+    }
+  return NULL;
+}
+
+AvifpluginPreload *
+preload_image_start (GFile *file,
+                     gint   max_threads)
+{
+  AvifpluginPreload *preload = g_new0 (AvifpluginPreload, 1);
+
+  preload->file = g_object_ref (file);
+  preload->max_threads = CLAMP (max_threads, 1, 64);
+
+  /* The decoders are taken and given back on this thread only. */
+#if defined(AVIF_HAVE_DECODER_REUSE_CODECS)
+  if (idle_preload_decoders)
+    {
+      preload->decoder = idle_preload_decoders->data;
+      idle_preload_decoders = g_slist_delete_link (idle_preload_decoders, idle_preload_decoders);
+    }
+  else
+    {
+      preload->decoder = avifDecoderCreate ();
+      preload->decoder->reuseCodecs = AVIF_TRUE;
+    }
+#else
+  preload->decoder = avifDecoderCreate ();
+#endif
+#if defined(AVIF_HAVE_PLANE_ALLOCATOR)
+  /* the pool is created here, it is thread-safe */
+  preload->decoder->planeAllocator = avifplugin_plane_pool_get ();
+#endif
+  preload->thread = g_thread_new ("avif-preload", avifplugin_preload_run, preload);
+  return preload;
+}
+
+static GimpImage *load_image_internal (GFile               *file,
+                                       gboolean             interactive,
+                                       const GeglRectangle *region,
+                                       gboolean             hdr_linear,
+                                       gint                 proxy_size,
+                                       AvifpluginPreload   *preload,
+                                       GError             **error);
+
+GimpImage *
+load_preloaded_image (AvifpluginPreload *preload,
+                      GError           **error)
+{
+  GimpImage *image = NULL;
+
+  g_thread_join (preload->thread);
+
+  if (preload->error)
+    {
+      g_propagate_error (error, preload->error);
+      preload->error = NULL;
+      avifplugin_decoder_release (preload->decoder);
+    }
+  else
+    {
+      /* releases preload->decoder */
+      image = load_image_internal (preload->file, FALSE, NULL, FALSE, 0, preload, error);
+    }
+
+  g_object_unref (preload->file);
+  g_free (preload);
+  return image;
+}
+
+void
+preload_image_cleanup (void)
+{
+#if defined(AVIF_HAVE_DECODER_REUSE_CODECS)
+  g_slist_free_full (idle_preload_decoders, (GDestroyNotify) avifDecoderDestroy);
+  idle_preload_decoders = NULL;
+  /* It holds planes of the pool too, and is created again when needed. */
+  if (cached_decoder)
+    {
+      avifDecoderDestroy (cached_decoder);
+      cached_decoder = NULL;
+    }
+#endif
+
+#if defined(AVIF_HAVE_PLANE_ALLOCATOR)
+  if (plane_pool)
+    {
+      avifPlaneAllocatorDestroy (plane_pool);
+      plane_pool = NULL;
+    }
+#endif
+}
+
+GimpImage *load_image (GFile               *file,
+                       gboolean             interactive,
+                       const GeglRectangle *region,
+                       gboolean             hdr_linear,
+                       gint                 proxy_size,
+                       GError             **error)
+{
+  return load_image_internal (file, interactive, region, hdr_linear, proxy_size, NULL, error);
+}
+
+/* preload is NULL, or a preload_image_start() whose thread was joined */
+static GimpImage *load_image_internal (GFile               *file,
+                                       gboolean             interactive,
+                                       const GeglRectangle *region,
+                                       gboolean             hdr_linear,
+                                       gint                 proxy_size,
+                                       AvifpluginPreload   *preload,
+                                       GError             **error)
+{
+  GimpImage        *image;
+  GimpLayer        *layer;
+  GeglBuffer       *buffer;
+
+  gboolean          loadalpha;
+  gboolean          loadgray;
+  gboolean          loadlinear;
+
+  GimpColorProfile *profile = NULL;
+  GimpMetadata     *metadata = NULL;
+
+  AvifpluginGrowingIO *gio;
+  avifROData        header;
+  avifDecoder      *decoder = NULL;
+  avifResult        decodeResult;
+  avifImage        *avif;
+  GimpPrecision     precision;
+  GimpImageType     layer_type;
+  gint              rows_done = 0;
+  AvifpluginUploader uploader;
+  AvifpluginHdr    *hdr = NULL;
+#if defined(AVIF_HAVE_DECODER_REGION)
+  avifImage        *region_image = NULL;
+  avifCropRect      region_rect;
+#endif
+
+  gint              image_width, image_height;
+  gint              proxy_width = 0, proxy_height = 0;
+  gdouble           proxy_scale = 1.0;
+  gint              final_width, final_height;
+
+  gimp_progress_init_printf ("Opening '%s'", gimp_file_get_utf8_name (file));
+
+  if (preload)
+    {
+      /* read, parsed and maybe decoded by avifplugin_preload_run() */
+      gio = preload->gio;
+      decoder = preload->decoder;
+      decodeResult = preload->parse_result;
+    }
+  else
+    {
+      gio = avifplugin_growing_io_open (file, error);
+      if (!gio)
+        {
+          return NULL;
+        }
+
+      if (! avifplugin_growing_io_feed (gio))
+        {
+          g_set_error (error, G_FILE_ERROR, 0, "Failed to read %zu bytes: %s",
+                       gio->size, g_file_peek_path (file));
+          avifplugin_growing_io_destroy (&gio->io);
+          return NULL;
+        }
+
+      header.data = gio->data;
+      header.size = gio->available;
+      if (avifPeekCompatibleFileType (&header) == AVIF_FALSE)
+        {
+          g_set_error (error, G_FILE_ERROR, 0, "File %s is probably not in AVIF format!",
+                       g_file_peek_path (file));
+          avifplugin_growing_io_destroy (&gio->io);
+          return NULL;
+        }
+
+      decoder = avifplugin_decoder_get ();
+      decoder->maxThreads = CLAMP (gimp_get_num_processors (), 1, 64);
+
+#if AVIF_VERSION >= 90100
+      decoder->strictFlags = AVIF_STRICT_DISABLED;
+#endif
+
+#if AVIF_VERSION >= 110000
+      decoder->allowIncremental = AVIF_TRUE;
+#endif
+
+      /* the decoder owns gio from now on */
+      avifDecoderSetIO (decoder, &gio->io);
+
+      while ( (decodeResult = avifDecoderParse (decoder)) == AVIF_RESULT_WAITING_ON_IO)
+        {
+          if (! avifplugin_growing_io_feed (gio))
+            {
+              break;
+            }
+        }
+    }
+
   if (decodeResult != AVIF_RESULT_OK)
     {
-      g_message ("ERROR: Failed to decode image: %s\n", avifResultToString (decodeResult));
+      g_set_error (error, G_FILE_ERROR, 0, "Failed to parse input: %s",
+                   avifResultToString (decodeResult));
 
-      avifDecoderDestroy (decoder);
-      avifRWDataFree (&raw);
+      avifplugin_decoder_release (decoder);
       return NULL;
     }
 
@@ -410,43 +1050,56 @@ GimpImage *load_image (GFile       *file,
               trc_to_load = avif->transferCharacteristics;
             }
 
-          switch (trc_to_load)
+          if (hdr_linear && avif->icc.size == 0)
+            {
+              hdr = avifplugin_hdr_new (avif, decoder->alphaPresent ? TRUE : FALSE);
+            }
+
+          if (hdr)   /* PQ/HLG converted to linear light while loading */
             {
-            /* AVIF_TRANSFER_CHARACTERISTICS_HLG */
-            case 18:
-              lcms_profile = _create_lcms_profile_from_NCLX ("HLG RGB", primaries_to_load, CL_PCT_HLG, 0, 0);
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084 */
-            case 16:
-              lcms_profile = _create_lcms_profile_from_NCLX ("PQ RGB", primaries_to_load, CL_PCT_PQ, 0, 10000);
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_BT470M */
-            case 4:
-              lcms_profile = _create_lcms_profile_from_NCLX ("Gamma2.2 RGB", primaries_to_load, CL_PCT_GAMMA, 2.2f, 0);
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_BT470BG */
-            case 5:
-              lcms_profile = _create_lcms_profile_from_NCLX ("Gamma2.8 RGB", primaries_to_load, CL_PCT_GAMMA, 2.8f, 0);
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_LINEAR */
-            case 8:
               lcms_profile = _create_lcms_profile_from_NCLX ("linear RGB", primaries_to_load, CL_PCT_GAMMA, 1.0f, 0);
               loadlinear = TRUE;
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_SRGB */
-            case 13:
-              lcms_profile = _create_lcms_profile_from_NCLX ("sRGB-TRC RGB", primaries_to_load, CL_PCT_PARAMETRIC_SRGB, 0, 0);
-              break;
-            /* AVIF_TRANSFER_CHARACTERISTICS_BT709 */
-            case 1:
-              lcms_profile = _create_lcms_profile_from_NCLX ("Rec709 RGB", primaries_to_load, CL_PCT_PARAMETRIC_REC709, 0, 0);
-              break;
-            default:
-              /* missing implementation, showing a debug message so far */
-              g_message ("CICP colorPrimaries: %d, transferCharacteristics: %d\nPlease, report file to the plug-in author.", avif->colorPrimaries, avif->transferCharacteristics);
-              profile = NULL;
-              lcms_profile = NULL;
-              break;
+            }
+          else
+            {
+              switch (trc_to_load)
+                {
+                /* AVIF_TRANSFER_CHARACTERISTICS_HLG */
+                case 18:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("HLG RGB", primaries_to_load, CL_PCT_HLG, 0, 0);
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_SMPTE2084 */
+                case 16:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("PQ RGB", primaries_to_load, CL_PCT_PQ, 0, 10000);
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_BT470M */
+                case 4:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("Gamma2.2 RGB", primaries_to_load, CL_PCT_GAMMA, 2.2f, 0);
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_BT470BG */
+                case 5:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("Gamma2.8 RGB", primaries_to_load, CL_PCT_GAMMA, 2.8f, 0);
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_LINEAR */
+                case 8:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("linear RGB", primaries_to_load, CL_PCT_GAMMA, 1.0f, 0);
+                  loadlinear = TRUE;
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_SRGB */
+                case 13:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("sRGB-TRC RGB", primaries_to_load, CL_PCT_PARAMETRIC_SRGB, 0, 0);
+                  break;
+                /* AVIF_TRANSFER_CHARACTERISTICS_BT709 */
+                case 1:
+                  lcms_profile = _create_lcms_profile_from_NCLX ("Rec709 RGB", primaries_to_load, CL_PCT_PARAMETRIC_REC709, 0, 0);
+                  break;
+                default:
+                  /* missing implementation, showing a debug message so far */
+                  g_message ("CICP colorPrimaries: %d, transferCharacteristics: %d\nPlease, report file to the plug-in author.", avif->colorPrimaries, avif->transferCharacteristics);
+                  profile = NULL;
+                  lcms_profile = NULL;
+                  break;
+                }
             }
 
           if (lcms_profile)
@@ -462,388 +1115,229 @@ GimpImage *load_image (GFile       *file,
         }
     }
 
-  if (avif->alphaPlane)
-    {
-      loadalpha = TRUE;
-    }
-  else
-    {
-      loadalpha = FALSE;
-    }
+  loadalpha = decoder->alphaPresent ? TRUE : FALSE;
 
-  if (loadgray)   /* grayscale */
+  if (region && (region->width > 0) && (region->height > 0))
     {
-      const gint grayimg_width = avif->width;
-      const gint grayimg_height = avif->height;
-      gint x, y;
-      gpointer pixels;
+#if defined(AVIF_HAVE_DECODER_REGION)
+      GeglRectangle       bounds = { 0, 0, avif->width, avif->height };
+      GeglRectangle       clipped;
+      avifPixelFormatInfo format_info;
 
-      if (avifImageUsesU16 (avif))     /* 10 and 12 bit depth import */
+      if (gegl_rectangle_intersect (&clipped, region, &bounds))
         {
-          uint16_t *gray16_pixel;
-          const uint16_t *alpha16_src;
-          const uint16_t *gray16_src;
-          uint16_t tmpval16, tmp16_alpha;
-          int tmp_pixelval;
-
-          if (loadlinear)
-            {
-              image = gimp_image_new_with_precision (grayimg_width, grayimg_height, GIMP_GRAY, GIMP_PRECISION_U16_LINEAR);
-            }
-          else
-            {
-              image = gimp_image_new_with_precision (grayimg_width, grayimg_height, GIMP_GRAY, GIMP_PRECISION_U16_NON_LINEAR);
-            }
-
-          if (profile)
-            {
-              if (gimp_color_profile_is_gray (profile))
-                {
-                  gimp_image_set_color_profile (image, profile);
-                }
-            }
-
-          if (loadalpha)
-            {
-              pixels = g_malloc_n (grayimg_height, grayimg_width * 4);
-
-              gray16_pixel = pixels;
-              for (y = 0; y < grayimg_height; y++)
-                {
-                  gray16_src = (const uint16_t *) (y * avif->yuvRowBytes[0] + avif->yuvPlanes[0]);
-                  alpha16_src = (const uint16_t *) (y * avif->alphaRowBytes + avif->alphaPlane);
-                  for (x = 0; x < grayimg_width; x++)
-                    {
-                      tmpval16 = *gray16_src;
-                      tmp16_alpha = *alpha16_src;
-                      gray16_src++;
-                      alpha16_src++;
-
-                      if (avif->depth == 10)   /* 10 bit depth */
-                        {
-                          if (avif->yuvRange == AVIF_RANGE_LIMITED)
-                            {
-                              tmpval16 = avifLimitedToFullY (10, tmpval16);
-                            }
-
-                          tmp_pixelval = (int) ( ( (float) tmpval16 / 1023.0f) * 65535.0f + 0.5f);
-                          *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
-                          gray16_pixel++;
-
-                          tmp_pixelval = (int) ( ( (float) tmp16_alpha / 1023.0f) * 65535.0f + 0.5f);
-                          *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
-                        }
-                      else /* 12 bit depth */
-                        {
-                          if (avif->yuvRange == AVIF_RANGE_LIMITED)
-                            {
-                              tmpval16 = avifLimitedToFullY (12, tmpval16);
-                            }
-
-                          tmp_pixelval = (int) ( ( (float) tmpval16 / 4095.0f) * 65535.0f + 0.5f);
-                          *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
-                          gray16_pixel++;
-
-                          tmp_pixelval = (int) ( ( (float) tmp16_alpha / 4095.0f) * 65535.0f + 0.5f);
-                          *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
-                        }
-
-                      gray16_pixel++;
-                    }
-                }
-
-              layer = gimp_layer_new (image, "Background",
-                                      grayimg_width, grayimg_height,
-                                      GIMP_GRAYA_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
-          else /* no alpha */
-            {
-              pixels = g_malloc_n (grayimg_height, grayimg_width * 2);
-
-              gray16_pixel = pixels;
-              for (y = 0; y < grayimg_height; y++)
-                {
-                  gray16_src = (const uint16_t *) (y * avif->yuvRowBytes[0] + avif->yuvPlanes[0]);
-                  for (x = 0; x < grayimg_width; x++)
-                    {
-                      tmpval16 = *gray16_src;
-                      gray16_src++;
-
-                      if (avif->depth == 10)   /* 10 bit depth */
-                        {
-                          if (avif->yuvRange == AVIF_RANGE_LIMITED)
-                            {
-                              tmpval16 = avifLimitedToFullY (10, tmpval16);
-                            }
-
-                          tmp_pixelval = (int) ( ( (float) tmpval16 / 1023.0f) * 65535.0f + 0.5f);
-                        }
-                      else /* 12 bit depth */
-                        {
-                          if (avif->yuvRange == AVIF_RANGE_LIMITED)
-                            {
-                              tmpval16 = avifLimitedToFullY (12, tmpval16);
-                            }
-
-                          tmp_pixelval = (int) ( ( (float) tmpval16 / 4095.0f) * 65535.0f + 0.5f);
-                        }
-
-                      *gray16_pixel = CLAMP (tmp_pixelval, 0, 65535);
-                      gray16_pixel++;
-
-                    }
-                }
-
-              layer = gimp_layer_new (image, "Background",
-                                      grayimg_width, grayimg_height,
-                                      GIMP_GRAY_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
+          /* the region has to start on a chroma sample */
+          avifGetPixelFormatInfo (avif->yuvFormat, &format_info);
+          region_rect.x = clipped.x & ~format_info.chromaShiftX;
+          region_rect.y = clipped.y & ~format_info.chromaShiftY;
+          region_rect.width = clipped.width + (clipped.x - region_rect.x);
+          region_rect.height = clipped.height + (clipped.y - region_rect.y);
+
+          /* only the properties for now, the pixels are decoded below */
+          region_image = avifImageCreateEmpty ();
+#if defined(AVIF_HAVE_PLANE_ALLOCATOR)
+          region_image->planeAllocator = decoder->planeAllocator;
+#endif
+          avifImageCopy (region_image, avif, 0);
+          region_image->width = region_rect.width;
+          region_image->height = region_rect.height;
+          avif = region_image;
         }
-      else /* 8 bit depth import */
+      else
         {
-          uint8_t *gray8_pixel;
-          const uint8_t *alpha8_src;
-          const uint8_t *gray8_src;
-
-          if (loadlinear)
-            {
-              image = gimp_image_new_with_precision (grayimg_width, grayimg_height, GIMP_GRAY, GIMP_PRECISION_U8_LINEAR);
-            }
-          else
-            {
-              image = gimp_image_new_with_precision (grayimg_width, grayimg_height, GIMP_GRAY, GIMP_PRECISION_U8_NON_LINEAR);
-            }
-
-          if (profile)
-            {
-              if (gimp_color_profile_is_gray (profile))
-                {
-                  gimp_image_set_color_profile (image, profile);
-                }
-            }
-
-          if (loadalpha)
-            {
-              pixels = g_malloc_n (grayimg_height, grayimg_width * 2);
-
-              gray8_pixel = pixels;
-              for (y = 0; y < grayimg_height; y++)
-                {
-                  gray8_src =  y * avif->yuvRowBytes[0] + avif->yuvPlanes[0];
-                  alpha8_src =  y * avif->alphaRowBytes + avif->alphaPlane;
-                  for (x = 0; x < grayimg_width; x++)
-                    {
-                      if (avif->yuvRange == AVIF_RANGE_FULL)
-                        {
-                          *gray8_pixel = *gray8_src;
-                        }
-                      else
-                        {
-                          *gray8_pixel = avifLimitedToFullY (8, *gray8_src);
-                        }
-                      gray8_pixel++;
-                      gray8_src++;
-
-                      *gray8_pixel = *alpha8_src;
-                      gray8_pixel++;
-                      alpha8_src++;
-                    }
-                }
-
-              layer = gimp_layer_new (image, "Background",
-                                      grayimg_width, grayimg_height,
-                                      GIMP_GRAYA_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
-          else /* no alpha */
-            {
-              pixels = g_malloc_n (grayimg_height, grayimg_width);
-
-              gray8_pixel = pixels;
-              for (y = 0; y < grayimg_height; y++)
-                {
-                  gray8_src =  y * avif->yuvRowBytes[0] + avif->yuvPlanes[0];
-                  for (x = 0; x < grayimg_width; x++)
-                    {
-                      if (avif->yuvRange == AVIF_RANGE_FULL)
-                        {
-                          *gray8_pixel = *gray8_src;
-                        }
-                      else
-                        {
-                          *gray8_pixel = avifLimitedToFullY (8, *gray8_src);
-                        }
-                      gray8_pixel++;
-                      gray8_src++;
-                    }
-                }
-
-              layer = gimp_layer_new (image, "Background",
-                                      grayimg_width, grayimg_height,
-                                      GIMP_GRAY_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
+          g_message ("The region is outside of the image, loading the whole image.\n");
         }
-
-      gimp_image_insert_layer (image, layer, NULL, 0);
-
-      buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
-
-      gegl_buffer_set (buffer, GEGL_RECTANGLE (0, 0, grayimg_width, grayimg_height), 0,
-                       NULL, pixels, GEGL_AUTO_ROWSTRIDE);
-
-      g_object_unref (buffer);
-      g_free (pixels);
-
+#else
+      g_message ("Loading a region needs a newer libavif, loading the whole image.\n");
+#endif
     }
-  else /* loading colors, YUV to RGB conversion */
-    {
-      avifRGBImage rgb;
-      avifRGBImageSetDefaults (&rgb, avif);
 
-#if AVIF_VERSION >= 1000000
-      rgb.maxThreads = decoder->maxThreads;
-#endif
+  image_width = avif->width;
+  image_height = avif->height;
 
-      if (loadalpha)
+  if (proxy_size > 0 && MAX (image_width, image_height) > proxy_size)
+    {
+#if defined(AVIF_HAVE_IMAGE_SCALE)
+      if (avifplugin_can_scale ())
         {
-          rgb.format = AVIF_RGB_FORMAT_RGBA;
+          /* The whole image is decoded, then downscaled in YUV, so only the
+           * small image is converted to RGB and uploaded to GIMP. */
+          proxy_scale = (gdouble) proxy_size / MAX (image_width, image_height);
+          proxy_width = MAX (1, (gint) (image_width * proxy_scale + 0.5));
+          proxy_height = MAX (1, (gint) (image_height * proxy_scale + 0.5));
+          image_width = proxy_width;
+          image_height = proxy_height;
         }
       else
         {
-          rgb.format = AVIF_RGB_FORMAT_RGB;
+          g_message ("Loading a downscaled image needs libavif built with libyuv, loading the whole image.\n");
         }
+#else
+      g_message ("Loading a downscaled image needs a newer libavif, loading the whole image.\n");
+#endif
+    }
 
+  if (hdr)
+    {
+      precision = GIMP_PRECISION_FLOAT_LINEAR;
+    }
+  else if (avifImageUsesU16 (avif))     /* 10 and 12 bit depth import */
+    {
+      precision = loadlinear ? GIMP_PRECISION_U16_LINEAR : GIMP_PRECISION_U16_NON_LINEAR;
+    }
+  else
+    {
+      precision = loadlinear ? GIMP_PRECISION_U8_LINEAR : GIMP_PRECISION_U8_NON_LINEAR;
+    }
 
+  if (loadgray)   /* grayscale */
+    {
+      image = gimp_image_new_with_precision (image_width, image_height, GIMP_GRAY, precision);
 
-      if (avifImageUsesU16 (avif))     /* 10 and 12 bit depth import */
+      if (profile)
         {
-
-          if (loadlinear)
+          if (gimp_color_profile_is_gray (profile))
             {
-              image = gimp_image_new_with_precision (rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U16_LINEAR);
-            }
-          else
-            {
-              image = gimp_image_new_with_precision (rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U16_NON_LINEAR);
+              gimp_image_set_color_profile (image, profile);
             }
+        }
 
-          if (profile)
-            {
-              if (gimp_color_profile_is_rgb (profile))
-                {
-                  gimp_image_set_color_profile (image, profile);
-                }
-            }
+      layer_type = loadalpha ? GIMP_GRAYA_IMAGE : GIMP_GRAY_IMAGE;
+    }
+  else /* loading colors, YUV to RGB conversion */
+    {
+      image = gimp_image_new_with_precision (image_width, image_height, GIMP_RGB, precision);
 
-          rgb.depth = 16;
-          if (loadalpha)   /* RGBA */
+      if (profile)
+        {
+          if (gimp_color_profile_is_rgb (profile))
             {
-              rgb.rowBytes = rgb.width * 8;
-              rgb.pixels = g_malloc_n (rgb.height, rgb.rowBytes);
-
-              decodeResult = avifImageYUVToRGB (avif, &rgb);
-              if (decodeResult != AVIF_RESULT_OK)
-                {
-                  g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (decodeResult));
-                }
-
-              layer = gimp_layer_new (image, "Background",
-                                      rgb.width, rgb.height,
-                                      GIMP_RGBA_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
+              gimp_image_set_color_profile (image, profile);
             }
-          else /* RGB */
-            {
-              rgb.rowBytes = rgb.width * 6;
-              rgb.pixels = g_malloc_n (rgb.height, rgb.rowBytes);
+        }
 
-              decodeResult = avifImageYUVToRGB (avif, &rgb);
-              if (decodeResult != AVIF_RESULT_OK)
-                {
-                  g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (decodeResult));
-                }
+      layer_type = loadalpha ? GIMP_RGBA_IMAGE : GIMP_RGB_IMAGE;
+    }
 
-              layer = gimp_layer_new (image, "Background",
-                                      rgb.width, rgb.height,
-                                      GIMP_RGB_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
-        }
-      else /* 8 bit depth import */
-        {
+  layer = gimp_layer_new (image, "Background",
+                          image_width, image_height,
+                          layer_type, 100,
+                          gimp_image_get_default_new_layer_mode (image));
+  gimp_image_insert_layer (image, layer, NULL, 0);
 
-          if (loadlinear)
-            {
-              image = gimp_image_new_with_precision (rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U8_LINEAR);
-            }
-          else
-            {
-              image = gimp_image_new_with_precision (rgb.width, rgb.height, GIMP_RGB, GIMP_PRECISION_U8_NON_LINEAR);
-            }
+  buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+  /* sized for the decoded rows, which is enough for the downscaled ones too */
+  avifplugin_uploader_init (&uploader, avif, buffer, loadgray, loadalpha, hdr, decoder->maxThreads);
 
-          if (profile)
+  if (preload && preload->decoded)
+    {
+      /* decoded by avifplugin_preload_run() while the previous file loaded */
+      decodeResult = preload->decode_result;
+    }
+  else
+#if defined(AVIF_HAVE_DECODER_REGION)
+  if (region_image)
+    {
+      /* only the grid cells intersecting the region are read and decoded */
+      while ( (decodeResult = avifDecoderDecodeRegion (decoder, &region_rect, region_image)) == AVIF_RESULT_WAITING_ON_IO)
+        {
+          if (! avifplugin_growing_io_feed (gio))
             {
-              if (gimp_color_profile_is_rgb (profile))
-                {
-                  gimp_image_set_color_profile (image, profile);
-                }
+              break;
             }
+        }
+    }
+  else
+#endif
+  /* Rows are converted and uploaded as soon as the decoder has them, while
+   * the rest of the file is read. Only grid images are decoded in parts. */
+  while ( (decodeResult = avifDecoderNextImage (decoder)) == AVIF_RESULT_WAITING_ON_IO)
+    {
+#if AVIF_VERSION >= 110000
+      /* keep the first row of the next upload on a chroma row */
+      gint rows = avifDecoderDecodedRowCount (decoder) & ~1u;
 
-          rgb.depth = 8;
-          if (loadalpha)   /* RGBA */
-            {
-              rgb.rowBytes = rgb.width * 4;
-              rgb.pixels = g_malloc_n (rgb.height, rgb.rowBytes);
-
-              decodeResult = avifImageYUVToRGB (avif, &rgb);
-              if (decodeResult != AVIF_RESULT_OK)
-                {
-                  g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (decodeResult));
-                }
+      /* a downscaled image is uploaded once scaled */
+      if (rows > rows_done && !proxy_width)
+        {
+          avifplugin_upload_rows (&uploader, decoder->image, rows_done, rows);
+          rows_done = rows;
+          gimp_progress_update ( (gdouble) rows_done / avif->height);
+        }
+#endif
 
-              layer = gimp_layer_new (image, "Background",
-                                      rgb.width, rgb.height,
-                                      GIMP_RGBA_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
-          else /* RGB */
-            {
-              rgb.rowBytes = rgb.width * 3;
-              rgb.pixels = g_malloc_n (rgb.height, rgb.rowBytes);
+      if (! avifplugin_growing_io_feed (gio))
+        {
+          break;
+        }
+    }
 
-              decodeResult = avifImageYUVToRGB (avif, &rgb);
-              if (decodeResult != AVIF_RESULT_OK)
-                {
-                  g_printerr ("YUVToRGB conversion failed: %s\n", avifResultToString (decodeResult));
-                }
+#if defined(AVIF_HAVE_IMAGE_SCALE)
+  if (proxy_width && decodeResult == AVIF_RESULT_OK)
+    {
+      avifImage *decoded = decoder->image;
 
-              layer = gimp_layer_new (image, "Background",
-                                      rgb.width, rgb.height,
-                                      GIMP_RGB_IMAGE, 100,
-                                      gimp_image_get_default_new_layer_mode (image));
-            }
+#if defined(AVIF_HAVE_DECODER_REGION)
+      if (region_image)
+        {
+          decoded = region_image;
         }
+#endif
+      /* planes owned by the codec are kept, the scaled ones are owned by
+       * the image and freed with it below */
+      decodeResult = avifImageScale (decoded, proxy_width, proxy_height,
+                                     decoder->maxThreads, &decoder->diag);
+    }
+#endif
 
-      gimp_image_insert_layer (image, layer, NULL, 0);
+  if (decodeResult != AVIF_RESULT_OK)
+    {
+      g_set_error (error, G_FILE_ERROR, 0, "Failed to decode image: %s",
+                   avifResultToString (decodeResult));
 
-      buffer = gimp_drawable_get_buffer (GIMP_DRAWABLE (layer));
+      avifplugin_uploader_free (&uploader);
+      avifplugin_hdr_free (hdr);
+      g_object_unref (buffer);
+      gimp_image_delete (image);
+      g_clear_object (&profile);
+      g_clear_object (&metadata);
+#if defined(AVIF_HAVE_DECODER_REGION)
+      if (region_image)
+        {
+          avifImageDestroy (region_image);
+        }
+#endif
+      avifplugin_decoder_release (decoder);
+      return NULL;
+    }
 
-      gegl_buffer_set (buffer, GEGL_RECTANGLE (0, 0, rgb.width, rgb.height), 0,
-                       NULL, rgb.pixels, GEGL_AUTO_ROWSTRIDE);
+#if defined(AVIF_HAVE_DECODER_REGION)
+  if (region_image)
+    {
+      /* the clean aperture is relative to the whole image, ignore it */
+      avif = region_image;
+      avif->transformFlags &= ~AVIF_TRANSFORM_CLAP;
+    }
+  else
+#endif
+    {
+      avif = decoder->image;
+    }
+  avifplugin_upload_rows (&uploader, avif, rows_done, avif->height);
+  avifplugin_uploader_free (&uploader);
+  avifplugin_hdr_free (hdr);
+  g_object_unref (buffer);
 
-      g_object_unref (buffer);
-      g_free (rgb.pixels);
+  /* The decoded planes are not needed anymore, free them before GIMP
+   * transforms the image. Planes owned by the codec are kept by it. */
+  avifImageFreePlanes (avif, AVIF_PLANES_ALL);
+  gimp_progress_update (1.0);
 
-      if (profile)
+  if (profile && !loadgray)
+    {
+      if (gimp_color_profile_is_gray (profile))     /* image was loaded as RGB but ICC profile indicate grayscale */
         {
-          if (gimp_color_profile_is_gray (profile) && image)     /* image was loaded as RGB but ICC profile indicate grayscale */
-            {
-              gimp_image_convert_grayscale (image);
-            }
-
+          gimp_image_convert_grayscale (image);
         }
     }
 
@@ -868,13 +1362,14 @@ GimpImage *load_image (GFile       *file,
           const gint avif_height = avif->height;
           gint  new_width, new_height, offx, offy;
 
-          new_width = (gint) ( (double) (avif->clap.widthN)  / (avif->clap.widthD) + 0.5);
+          /* the clean aperture is in the coordinates of the full size image */
+          new_width = (gint) ( (double) (avif->clap.widthN)  / (avif->clap.widthD) * proxy_scale + 0.5);
           if (new_width > avif_width)
             {
               new_width = avif_width;
             }
 
-          new_height = (gint) ( (double) (avif->clap.heightN) / (avif->clap.heightD) + 0.5);
+          new_height = (gint) ( (double) (avif->clap.heightN) / (avif->clap.heightD) * proxy_scale + 0.5);
           if (new_height > avif_height)
             {
               new_height = avif_height;
@@ -883,7 +1378,7 @@ GimpImage *load_image (GFile       *file,
           if (new_width > 0 && new_height > 0)
             {
 
-              offx = ( (double) ( (int32_t) avif->clap.horizOffN)) / (avif->clap.horizOffD) +
+              offx = ( (double) ( (int32_t) avif->clap.horizOffN)) / (avif->clap.horizOffD) * proxy_scale +
                      (avif_width - new_width) / 2.0 + 0.5;
               if (offx < 0)
                 {
@@ -894,7 +1389,7 @@ GimpImage *load_image (GFile       *file,
                   offx = avif_width - new_width;
                 }
 
-              offy = ( (double) ( (int32_t) avif->clap.vertOffN)) / (avif->clap.vertOffD) +
+              offy = ( (double) ( (int32_t) avif->clap.vertOffN)) / (avif->clap.vertOffD) * proxy_scale +
                      (avif_height - new_height) / 2.0 + 0.5;
               if (offy < 0)
                 {
@@ -972,8 +1467,71 @@ GimpImage *load_image (GFile       *file,
       gimp_image_metadata_load_finish (image, "image/avif", metadata, flags);
     }
 
+#if defined(AVIF_HAVE_DECODER_REGION)
+  if (region_image)
+    {
+      avifImageDestroy (region_image);
+    }
+#endif
 
-  avifDecoderDestroy (decoder);
-  avifRWDataFree (&raw);
+  avifplugin_decoder_release (decoder);
   return image;
 }
+
+/* Reads the image properties from the container boxes only. The file is
+ * accessed through avifIO, so only the byte ranges of the boxes are read
+ * and no AV1 decoder is set up. */
+gboolean
+probe_image (GFile               *file,
+             AvifpluginProbeInfo *info,
+             GError             **error)
+{
+  avifDecoder *decoder;
+  avifResult   result;
+  avifImage   *avif;
+
+  decoder = avifDecoderCreate ();
+#if AVIF_VERSION >= 90100
+  decoder->strictFlags = AVIF_STRICT_DISABLED;
+#endif
+
+  result = avifDecoderSetIOFile (decoder, g_file_peek_path (file));
+  if (result != AVIF_RESULT_OK)
+    {
+      g_set_error (error, G_FILE_ERROR, 0, "Cannot open file for read: %s",
+                   g_file_peek_path (file));
+      avifDecoderDestroy (decoder);
+      return FALSE;
+    }
+
+#if defined(AVIF_HAVE_DECODER_PROBE)
+  result = avifDecoderProbe (decoder);
+#else
+  result = avifDecoderParse (decoder);
+#endif
+  if (result != AVIF_RESULT_OK)
+    {
+      g_set_error (error, G_FILE_ERROR, 0, "Failed to parse input: %s",
+                   avifResultToString (result));
+      avifDecoderDestroy (decoder);
+      return FALSE;
+    }
+
+  avif = decoder->image;
+  info->width                    = avif->width;
+  info->height                   = avif->height;
+  info->bit_depth                = avif->depth;
+  info->pixel_format             = avif->yuvFormat;
+  info->color_primaries          = avif->colorPrimaries;
+  info->transfer_characteristics = avif->transferCharacteristics;
+  info->matrix_coefficients      = avif->matrixCoefficients;
+  info->full_range               = (avif->yuvRange == AVIF_RANGE_FULL);
+  info->has_alpha                = decoder->alphaPresent ? TRUE : FALSE;
+  info->has_icc                  = (avif->icc.size > 0);
+  info->has_exif                 = (avif->exif.size > 0);
+  info->has_xmp                  = (avif->xmp.size > 0);
+  info->num_frames               = decoder->imageCount;
+
+  avifDecoderDestroy (decoder);
+  return TRUE;
+}
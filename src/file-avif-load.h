@@ -4,9 +4,51 @@
 #define __AVIF_LOAD_H__
 
 
-GimpImage *load_image (GFile       *file,
-                       gboolean     interactive,
-                       GError     **error);
+/* region can be NULL or empty to load the whole image, hdr_linear loads
+ * PQ/HLG images as linear light floats, a proxy_size above 0 downscales
+ * the loaded image (or region) to fit proxy_size x proxy_size */
+GimpImage *load_image (GFile               *file,
+                       gboolean             interactive,
+                       const GeglRectangle *region,
+                       gboolean             hdr_linear,
+                       gint                 proxy_size,
+                       GError             **error);
+
+/* A file read, parsed and decoded on a worker thread while the previous
+ * file is loaded into GIMP, for batch loading. The decoder uses max_threads
+ * threads. Huge images are only parsed, and decoded by
+ * load_preloaded_image(), which waits for the worker and frees preload. */
+typedef struct _AvifpluginPreload AvifpluginPreload;
+
+AvifpluginPreload *preload_image_start  (GFile              *file,
+                                         gint                max_threads);
+GimpImage         *load_preloaded_image (AvifpluginPreload  *preload,
+                                         GError            **error);
+/* Frees the decoders and the decoded planes kept for the next preloads, once
+ * all the preloads are loaded. */
+void               preload_image_cleanup (void);
+
+/* What probe_image() finds out without decoding any pixel. */
+typedef struct
+{
+  gint     width;
+  gint     height;
+  gint     bit_depth;
+  gint     pixel_format;              /* avifPixelFormat */
+  gint     color_primaries;
+  gint     transfer_characteristics;
+  gint     matrix_coefficients;
+  gboolean full_range;
+  gboolean has_alpha;
+  gboolean has_icc;
+  gboolean has_exif;
+  gboolean has_xmp;
+  gint     num_frames;
+} AvifpluginProbeInfo;
+
+gboolean   probe_image (GFile               *file,
+                        AvifpluginProbeInfo *info,
+                        GError             **error);
 
 
 #endif /* __AVIF_LOAD_H__ */
@@ -55,6 +55,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <sys/time.h>
 
 #include "file-avif-save.h"
+#include "file-avif-speed.h"
+#include "file-avif-target.h"
 
 #define MAX_TILE_WIDTH  4096
 #define MAX_TILE_AREA  (4096 * 2304)
@@ -200,6 +202,163 @@ ColorPrimariesBestMatch (const float inPrimaries[8])
   return winner;
 }
 
+/* Part of the progress bar filled by the encoding of one frame, or by
+ * avifEncoderFinish (). */
+typedef struct
+{
+  gdouble start;
+  gdouble span;
+} AvifpluginProgress;
+
+#if defined(AVIF_HAVE_PROGRESS)
+/* Called by libavif before and after each encoded cell (color, then alpha).
+ * GIMP closes the plug-in when the export is canceled from its progress bar,
+ * so the encoder is only stopped here when the progress can't be updated
+ * anymore, instead of encoding for minutes a file nobody waits for. */
+static avifBool
+avifplugin_encode_progress (void     *user_data,
+                            uint32_t  done,
+                            uint32_t  total)
+{
+  const AvifpluginProgress *progress = user_data;
+
+  if (total == 0)
+    {
+      return AVIF_TRUE;
+    }
+
+  return gimp_progress_update (progress->start + progress->span * done / total) ? AVIF_TRUE : AVIF_FALSE;
+}
+#endif
+
+/* libaom options of each encoder profile, NULL keeps the libaom default.
+ * fast and balanced turn off the costliest intra tools. Encode time and file
+ * size at equal PSNR against the default profile, measured with avifenc on
+ * kodim03 and kodim23 at quantizers 12 to 42 with one thread:
+ *
+ *   speed  profile    time    size
+ *   6      balanced   -19%   +1.7%
+ *   6      fast       -32%   +7.6%
+ *   3      balanced   -64%   +3.8%
+ *   3      fast       -80%  +11.7%
+ *
+ * Speed 7 takes 44% less time than speed 6 for an 11.6% larger file, so at
+ * speed 6 both profiles give a better trade than the next speed. At speed 3
+ * they don't: speed 5 takes 61% less time for a 3.5% larger file. Turning off loop
+ * restoration, CDEF or all the intra tools with auto-intra-tools-off saved
+ * no time at equal size, and quantization matrices or delta q made the file
+ * 2 to 6% larger at equal PSNR, so no profile uses them. */
+typedef struct
+{
+  const gchar *key;
+  const gchar *value[AVIFPLUGIN_PROFILE_COUNT];
+} AvifpluginProfileOption;
+
+static const AvifpluginProfileOption profile_options[] =
+{
+  /* key                       default  fast  balanced */
+  { "enable-tx64",            { NULL,    "0",  "0"  } },
+  { "enable-rect-partitions", { NULL,    "0",  "0"  } },
+  { "enable-filter-intra",    { NULL,    "0",  "0"  } },
+  { "enable-ab-partitions",   { NULL,    "0",  NULL } },
+  { "enable-1to4-partitions", { NULL,    "0",  NULL } },
+  { "enable-smooth-intra",    { NULL,    "0",  NULL } },
+  { "enable-paeth-intra",     { NULL,    "0",  NULL } },
+  { "enable-angle-delta",     { NULL,    "0",  NULL } },
+  { "enable-intrabc",         { NULL,    "0",  NULL } }
+};
+
+/* Sets the codec specific options of the profile. Other encoders than
+ * libaom don't know these options, they always get the default profile. */
+void
+avifplugin_set_profile (avifEncoder       *encoder,
+                        AvifpluginProfile  profile)
+{
+  const char *codec_name = avifCodecName (encoder->codecChoice, AVIF_CODEC_FLAG_CAN_ENCODE);
+  gsize       i;
+
+  if (profile < AVIFPLUGIN_PROFILE_DEFAULT || profile >= AVIFPLUGIN_PROFILE_COUNT ||
+      !codec_name || strcmp (codec_name, "aom") != 0)
+    {
+      profile = AVIFPLUGIN_PROFILE_DEFAULT;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (profile_options); i++)
+    {
+      avifEncoderSetCodecSpecificOption (encoder, profile_options[i].key,
+                                         profile_options[i].value[profile]);
+    }
+}
+
+/* Returns TRUE when every layer is fully opaque at the exported bit depth,
+ * so that no alpha plane has to be allocated, converted and encoded. Only
+ * the alpha channel is fetched, one band of tile rows at a time, and the
+ * scan stops at the first band that is not opaque. Rows are reduced with
+ * a bitwise AND or a minimum, which compilers vectorize. */
+static gboolean
+avifplugin_drawables_are_opaque (gint           n_drawables,
+                                 GimpDrawable **drawables,
+                                 gint           width,
+                                 gint           height,
+                                 gint           bit_depth)
+{
+  /* 10 and 12 bit exports rescale from 16 bit, so values that round to the
+   * maximum there are opaque as well. */
+  const guint16 threshold = (bit_depth == 10) ? 65503 : 65527;
+  const gint    band_rows = MAX (1, MIN (height, gimp_tile_height ()));
+  const Babl   *format = babl_format ((bit_depth == 8) ? "A u8" : "A u16");
+  const gsize   sample_bytes = (bit_depth == 8) ? 1 : 2;
+  guchar       *alpha = g_malloc ((gsize) width * band_rows * sample_bytes);
+  gboolean      opaque = TRUE;
+  gint          frame_index, band_y, i, j;
+
+  for (frame_index = 0; opaque && frame_index < n_drawables; frame_index++)
+    {
+      GeglBuffer *buffer = gimp_drawable_get_buffer (drawables[frame_index]);
+
+      for (band_y = 0; opaque && band_y < height; band_y += band_rows)
+        {
+          const gint rows = MIN (band_rows, height - band_y);
+
+          gegl_buffer_get (buffer, GEGL_RECTANGLE (0, band_y, width, rows), 1.0,
+                           format, alpha,
+                           GEGL_AUTO_ROWSTRIDE, GEGL_ABYSS_NONE);
+
+          for (j = 0; opaque && j < rows; j++)
+            {
+              if (bit_depth == 8)
+                {
+                  const guint8 *row = alpha + (gsize) j * width;
+                  guint8        row_and = 0xFF;
+
+                  for (i = 0; i < width; i++)
+                    {
+                      row_and &= row[i];
+                    }
+                  opaque = (row_and == 0xFF);
+                }
+              else
+                {
+                  const guint16 *row = (const guint16 *) alpha + (gsize) j * width;
+                  guint16        row_min = 0xFFFF;
+
+                  for (i = 0; i < width; i++)
+                    {
+                      row_min = MIN (row_min, row[i]);
+                    }
+                  opaque = (row_min >= threshold);
+                }
+            }
+        }
+
+      g_object_unref (buffer);
+    }
+
+  g_free (alpha);
+
+  return opaque;
+}
+
 gboolean   save_layers (GFile         *file,
                         GimpImage     *image,
                         gint           n_drawables,
@@ -217,12 +376,26 @@ gboolean   save_layers (GFile         *file,
   gint            drawable_height;
   gint            save_bit_depth = 8;
   gboolean        out_linear, save_alpha, is_gray;
+  gboolean        in_float = FALSE;
+  gboolean        in_half = FALSE;
   guchar         *pixels;
 
   GimpColorProfile *profile = NULL;
   gint            min_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
   gint            max_quantizer = 40;
   gint            alpha_quantizer = AVIF_QUANTIZER_BEST_QUALITY;
+  gint            target_mode = AVIFPLUGIN_TARGET_NONE;
+  gint            target_size = 0;
+  gdouble         target_psnr = 40.0;
+  gint            target_quantizer = -1;
+  gsize           trial_size = 0;
+  gdouble         trial_psnr = 0.0;
+  gboolean        lossless = FALSE;
+  gint            encoder_profile = AVIFPLUGIN_PROFILE_DEFAULT;
+  gdouble         time_budget = 0.0;
+  gdouble         predicted_time = 0.0;
+  gint64          encode_start;
+  AvifpluginProgress progress = { 0.0, 0.0 };
 
   avifPixelFormat pixel_format = AVIF_PIXEL_FORMAT_YUV420;
   avifCodecChoice codec_choice = AVIF_CODEC_CHOICE_AUTO;
@@ -255,7 +428,8 @@ gboolean   save_layers (GFile         *file,
         {
           if (drawable_width != gimp_drawable_get_width (drawables[i]) || drawable_height != gimp_drawable_get_height (drawables[i]))
             {
-              g_warning ("Can't save animation. Layers have different width or height!\n");
+              g_set_error (error, G_FILE_ERROR, 0,
+                           "Can't save animation. Layers have different width or height!");
               return FALSE;
             }
         }
@@ -278,6 +452,12 @@ gboolean   save_layers (GFile         *file,
                 "save-color-profile", &save_icc_profile,
                 "save-exif", &save_exif,
                 "save-xmp", &save_xmp,
+                "target-mode", &target_mode,
+                "target-size", &target_size,
+                "target-psnr", &target_psnr,
+                "time-budget", &time_budget,
+                "lossless", &lossless,
+                "encoder-profile", &encoder_profile,
                 NULL);
 
   num_threads = gimp_get_num_processors();
@@ -297,17 +477,31 @@ gboolean   save_layers (GFile         *file,
 
     case GIMP_PRECISION_U16_LINEAR:
     case GIMP_PRECISION_U32_LINEAR:
+      out_linear = TRUE;
+      break;
     case GIMP_PRECISION_HALF_LINEAR:
+      out_linear = TRUE;
+      in_float = TRUE;
+      in_half = TRUE;
+      break;
     case GIMP_PRECISION_FLOAT_LINEAR:
     case GIMP_PRECISION_DOUBLE_LINEAR:
       out_linear = TRUE;
+      in_float = TRUE;
       break;
     case GIMP_PRECISION_U16_NON_LINEAR:
     case GIMP_PRECISION_U32_NON_LINEAR:
+      out_linear = FALSE;
+      break;
     case GIMP_PRECISION_HALF_NON_LINEAR:
+      out_linear = FALSE;
+      in_float = TRUE;
+      in_half = TRUE;
+      break;
     case GIMP_PRECISION_FLOAT_NON_LINEAR:
     case GIMP_PRECISION_DOUBLE_NON_LINEAR:
       out_linear = FALSE;
+      in_float = TRUE;
       break;
 
     default:
@@ -321,6 +515,24 @@ gboolean   save_layers (GFile         *file,
         }
     }
 
+  if (lossless)
+    {
+      GimpPrecision precision = gimp_image_get_precision (image);
+
+      /* 8-bit samples are stored as they are; higher precisions are rounded
+       * to the selected bit depth. */
+      if (precision == GIMP_PRECISION_U8_LINEAR || precision == GIMP_PRECISION_U8_NON_LINEAR)
+        {
+          save_bit_depth = 8;
+        }
+
+      pixel_format = AVIF_PIXEL_FORMAT_YUV444;
+      min_quantizer = AVIF_QUANTIZER_LOSSLESS;
+      max_quantizer = AVIF_QUANTIZER_LOSSLESS;
+      alpha_quantizer = AVIF_QUANTIZER_LOSSLESS;
+      target_mode = AVIFPLUGIN_TARGET_NONE;
+    }
+
   space = gimp_color_profile_get_space (profile,
                                         GIMP_COLOR_RENDERING_INTENT_RELATIVE_COLORIMETRIC,
                                         error);
@@ -457,8 +669,42 @@ gboolean   save_layers (GFile         *file,
         }
     }
 
+  /* Identity matrix: G, B and R are coded in the Y, U and V planes without any
+   * conversion, so that avifImageRGBToYUV() copies the samples. */
+  if (lossless && pixel_format == AVIF_PIXEL_FORMAT_YUV444)
+    {
+      avif->matrixCoefficients = (avifMatrixCoefficients) 0;   /* AVIF_MATRIX_COEFFICIENTS_IDENTITY */
+    }
+
   g_object_unref (profile);
 
+  /* Export opaque animations without alpha channel. They are checked as a
+   * whole before encoding because all frames must have the same planes.
+   * Still images are checked by the conversion to YUV or by the encoder. */
+  if (n_drawables > 1 &&
+      (drawable_type == GIMP_RGBA_IMAGE || drawable_type == GIMP_GRAYA_IMAGE) &&
+      avifplugin_drawables_are_opaque (n_drawables, drawables,
+                                        drawable_width, drawable_height, save_bit_depth))
+    {
+      drawable_type = (drawable_type == GIMP_RGBA_IMAGE) ? GIMP_RGB_IMAGE : GIMP_GRAY_IMAGE;
+    }
+
+#if defined(AVIF_HAVE_RGB_FLOAT_INPUT)
+  /* Float images are passed to avifImageRGBToYUV() as they are, instead of
+   * being quantized to u16 by babl and then rescaled by libavif. Half float
+   * images are fetched as half float, at half the memory of float. */
+  if (save_bit_depth == 8 || drawable_type == GIMP_GRAYA_IMAGE || drawable_type == GIMP_GRAY_IMAGE)
+    {
+      in_float = FALSE;
+    }
+#else
+  in_float = FALSE;
+#endif
+  if (!in_float)
+    {
+      in_half = FALSE;
+    }
+
   switch (drawable_type)
     {
     case GIMP_RGBA_IMAGE:
@@ -477,6 +723,30 @@ gboolean   save_layers (GFile         *file,
               file_format = babl_format_with_space ("R'G'B'A u8", space);
             }
         }
+      else if (in_half)
+        {
+          pixels = g_new (guchar, (gsize) drawable_width * drawable_height * 8);
+          if (out_linear)
+            {
+              file_format = babl_format_with_space ("RGBA half", space);
+            }
+          else
+            {
+              file_format = babl_format_with_space ("R'G'B'A half", space);
+            }
+        }
+      else if (in_float)
+        {
+          pixels = g_new (guchar, (gsize) drawable_width * drawable_height * 16);
+          if (out_linear)
+            {
+              file_format = babl_format_with_space ("RGBA float", space);
+            }
+          else
+            {
+              file_format = babl_format_with_space ("R'G'B'A float", space);
+            }
+        }
       else
         {
           pixels = g_new (guchar, drawable_width * drawable_height * 8);
@@ -506,6 +776,30 @@ gboolean   save_layers (GFile         *file,
               file_format = babl_format_with_space ("R'G'B' u8", space);
             }
         }
+      else if (in_half)
+        {
+          pixels = g_new (guchar, (gsize) drawable_width * drawable_height * 6);
+          if (out_linear)
+            {
+              file_format = babl_format_with_space ("RGB half", space);
+            }
+          else
+            {
+              file_format = babl_format_with_space ("R'G'B' half", space);
+            }
+        }
+      else if (in_float)
+        {
+          pixels = g_new (guchar, (gsize) drawable_width * drawable_height * 12);
+          if (out_linear)
+            {
+              file_format = babl_format_with_space ("RGB float", space);
+            }
+          else
+            {
+              file_format = babl_format_with_space ("R'G'B' float", space);
+            }
+        }
       else
         {
           pixels = g_new (guchar, drawable_width * drawable_height * 6);
@@ -688,12 +982,41 @@ gboolean   save_layers (GFile         *file,
       encoder_speed = AVIF_SPEED_FASTEST;
     }
 
-  encoder = avifEncoderCreate();
+  if (time_budget > 0.0)   /* automatic speed */
+    {
+      gint auto_speed = avifplugin_speed_for_budget (codec_choice, (AvifpluginProfile) encoder_profile,
+                                                     num_threads, drawable_width, drawable_height,
+                                                     save_bit_depth, pixel_format, save_alpha,
+                                                     n_drawables, time_budget, &predicted_time);
+      if (auto_speed >= 0)
+        {
+          encoder_speed = auto_speed;
+          gimp_progress_set_text_printf ("Exporting '%s' at speed %d, about %.1f s",
+                                         gimp_file_get_utf8_name (file), encoder_speed, predicted_time);
+        }
+      else
+        {
+          g_printerr ("%s: can't measure encoder speed, using speed %d\n", G_STRFUNC, encoder_speed);
+          time_budget = 0.0;
+          gimp_progress_set_text_printf ("Exporting '%s'. Wait, it is slow.", gimp_file_get_utf8_name (file));
+        }
+    }
+
+  encoder = avifEncoderCreate ();
   encoder->maxThreads = num_threads;
   encoder->minQuantizer = min_quantizer;
   encoder->maxQuantizer = max_quantizer;
   encoder->speed = encoder_speed;
   encoder->codecChoice = codec_choice;
+  avifplugin_set_profile (encoder, encoder_profile);
+#if defined(AVIF_HAVE_ENCODER_REUSE_CODECS)
+  /* a still image may be encoded again to meet the target */
+  encoder->reuseCodecs = (n_drawables == 1 && target_mode != AVIFPLUGIN_TARGET_NONE);
+#endif
+#if defined(AVIF_HAVE_PROGRESS)
+  encoder->progressFunc = avifplugin_encode_progress;
+  encoder->progressUserData = &progress;
+#endif
 
   if (save_alpha)
     {
@@ -715,6 +1038,10 @@ gboolean   save_layers (GFile         *file,
     {
       encoder->timescale = animation_timescale;
     }
+  else
+    {
+      encoder->timescale = 1;
+    }
 
   avifplugin_set_tiles (drawable_width, drawable_height, encoder);
   /* debug info to print encoder parameters
@@ -732,6 +1059,8 @@ gboolean   save_layers (GFile         *file,
       avifImageAllocatePlanes (avif, AVIF_PLANES_YUV);
     }
 
+  encode_start = g_get_monotonic_time ();
+
   for (frame_index = n_drawables - 1; frame_index >= 0; frame_index--)
     {
       /* fetch the image */
@@ -876,6 +1205,26 @@ gboolean   save_layers (GFile         *file,
           avifRGBImageSetDefaults (&rgb, avif);
           rgb.pixels = pixels;
 
+#if defined(AVIF_HAVE_RGB_FLOAT_INPUT)
+          if (in_float)     /* 10 and 12 bit depth export from half float or float samples */
+            {
+              const uint32_t sample_bytes = in_half ? 2 : 4;
+
+              rgb.depth = in_half ? 16 : 32;
+              rgb.isFloat = AVIF_TRUE;
+              if (save_alpha)
+                {
+                  rgb.format = AVIF_RGB_FORMAT_RGBA;
+                  rgb.rowBytes = rgb.width * 4 * sample_bytes;
+                }
+              else
+                {
+                  rgb.format = AVIF_RGB_FORMAT_RGB;
+                  rgb.rowBytes = rgb.width * 3 * sample_bytes;
+                }
+            }
+          else
+#endif
           if (avifImageUsesU16 (avif))     /* 10 and 12 bit depth export */
             {
               rgb.depth = 16;
@@ -910,26 +1259,180 @@ gboolean   save_layers (GFile         *file,
             {
               g_message ("ERROR in avifImageRGBToYUV: %s\n", avifResultToString (res));
             }
+
+#if defined(AVIF_HAVE_ALPHA_RANGE)
+          /* the conversion recorded the range of the alpha samples, an opaque
+           * still image is encoded without its alpha plane */
+          if (n_drawables == 1 && save_alpha && avif->alphaRangeKnown &&
+              avif->alphaMin == (uint32_t) ( (1 << avif->depth) - 1))
+            {
+              avifImageFreePlanes (avif, AVIF_PLANES_A);
+            }
+#endif
         }
 
+      /* the search needs the final YUV image, so it is done for still images only */
+      if (n_drawables == 1 && target_mode != AVIFPLUGIN_TARGET_NONE)
+        {
+          gimp_progress_set_text_printf ("Searching quantizer for '%s'", gimp_file_get_utf8_name (file));
+          target_quantizer = avifplugin_target_search (avif, encoder, (AvifpluginTarget) target_mode,
+                                                       (AvifpluginProfile) encoder_profile,
+                                                       (gsize) target_size * 1024, target_psnr,
+                                                       num_threads, &trial_size, &trial_psnr);
+          if (target_quantizer >= 0)
+            {
+              encoder->minQuantizer = target_quantizer;
+              encoder->maxQuantizer = target_quantizer;
+            }
+          else
+            {
+              g_message ("Quantizer search failed, using Quantizer (Min) and (Max).\n");
+            }
+
+          gimp_progress_set_text_printf ("Exporting '%s'. Wait, it is slow.", gimp_file_get_utf8_name (file));
+        }
+
+      /* the frames are encoded from the last one */
+      progress.start = 0.7 * (n_drawables - 1 - frame_index) / n_drawables;
+      progress.span = 0.7 / n_drawables;
       res = avifEncoderAddImage (encoder, avif, animation_frame_duration, (n_drawables == 1) ? AVIF_ADD_IMAGE_FLAG_SINGLE : AVIF_ADD_IMAGE_FLAG_NONE);
       if (res != AVIF_RESULT_OK)
         {
-          g_message ("ERROR in avifEncoderAddImage: %s\n", avifResultToString (res));
+          g_set_error (error, G_FILE_ERROR, 0, "ERROR in avifEncoderAddImage: %s",
+                       avifResultToString (res));
           g_free (pixels);
           avifImageDestroy (avif);
           avifEncoderDestroy (encoder);
           return FALSE;
         }
 
-      gimp_progress_update (0.5 * frame_index / n_drawables);
+      gimp_progress_update (0.7 * (n_drawables - frame_index) / n_drawables);
     }
 
   g_free (pixels);
-  avifImageDestroy (avif);
+  progress.start = 0.7;
+  progress.span = 0.05;
   res = avifEncoderFinish (encoder,  &raw);
+
+  if (target_quantizer >= 0 && res == AVIF_RESULT_OK)
+    {
+      gdouble  final_psnr = avifplugin_target_measure_psnr (avif, &raw, num_threads);
+      gboolean reached = (target_mode == AVIFPLUGIN_TARGET_SIZE) ?
+                         raw.size <= (gsize) target_size * 1024 : final_psnr >= target_psnr;
+
+#if defined(AVIF_HAVE_ENCODER_RESET)
+      /* the trials ran faster and with fewer threads, so the final file may
+       * still miss the target; it is encoded once more with the target moved
+       * by the difference observed between its trial and the final encode,
+       * and the better of both files is kept */
+      if (!reached && trial_size > 0)
+        {
+          avifRWData first = raw;
+          gsize      correction_size = 0;
+          gdouble    correction_psnr = 0.0;
+          gint       correction_quantizer;
+          gdouble    first_psnr = final_psnr;
+
+          gimp_progress_set_text_printf ("Correcting quantizer for '%s'", gimp_file_get_utf8_name (file));
+          if (target_mode == AVIFPLUGIN_TARGET_SIZE)
+            {
+              correction_quantizer = avifplugin_target_search (avif, encoder, (AvifpluginTarget) target_mode,
+                                                               (AvifpluginProfile) encoder_profile,
+                                                               (gsize) ((gdouble) target_size * 1024 * trial_size / raw.size),
+                                                               target_psnr, num_threads,
+                                                               &correction_size, &correction_psnr);
+              correction_quantizer = MAX (correction_quantizer, target_quantizer + 1);
+            }
+          else
+            {
+              correction_quantizer = avifplugin_target_search (avif, encoder, (AvifpluginTarget) target_mode,
+                                                               (AvifpluginProfile) encoder_profile,
+                                                               (gsize) target_size * 1024,
+                                                               target_psnr + trial_psnr - final_psnr, num_threads,
+                                                               &correction_size, &correction_psnr);
+              correction_quantizer = (correction_quantizer < 0) ? target_quantizer - 1 :
+                                     MIN (correction_quantizer, target_quantizer - 1);
+            }
+          correction_quantizer = CLAMP (correction_quantizer, AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY);
+
+          raw.data = NULL;
+          raw.size = 0;
+          if (correction_quantizer != target_quantizer)
+            {
+              gimp_progress_set_text_printf ("Exporting '%s' again with quantizer %d", gimp_file_get_utf8_name (file),
+                                             correction_quantizer);
+              encoder->minQuantizer = correction_quantizer;
+              encoder->maxQuantizer = correction_quantizer;
+              res = avifEncoderReset (encoder);
+              /* the codec specific options are consumed by each encode */
+              avifplugin_set_profile (encoder, encoder_profile);
+              if (res == AVIF_RESULT_OK)
+                {
+                  progress.start = 0.0;
+                  progress.span = 0.7;
+                  res = avifEncoderAddImage (encoder, avif, animation_frame_duration, AVIF_ADD_IMAGE_FLAG_SINGLE);
+                }
+              if (res == AVIF_RESULT_OK)
+                {
+                  progress.start = 0.7;
+                  progress.span = 0.05;
+                  res = avifEncoderFinish (encoder,  &raw);
+                }
+            }
+
+          if (res == AVIF_RESULT_OK && raw.size > 0)
+            {
+              final_psnr = avifplugin_target_measure_psnr (avif, &raw, num_threads);
+              reached = (target_mode == AVIFPLUGIN_TARGET_SIZE) ?
+                        raw.size <= (gsize) target_size * 1024 : final_psnr >= target_psnr;
+            }
+
+          /* without a usable second file the first one is kept; otherwise the
+           * second one, unless it is further from the target */
+          if (res != AVIF_RESULT_OK || raw.size == 0 ||
+              (target_mode == AVIFPLUGIN_TARGET_SIZE ? raw.size > first.size : final_psnr < first_psnr))
+            {
+              avifRWDataFree (&raw);
+              raw = first;
+              final_psnr = first_psnr;
+              reached = FALSE;
+              res = AVIF_RESULT_OK;
+            }
+          else
+            {
+              avifRWDataFree (&first);
+              target_quantizer = correction_quantizer;
+            }
+        }
+#endif
+
+      g_printerr ("%s: '%s' exported with quantizer %d: %.1f KiB, PSNR %.2f dB\n",
+                  G_STRFUNC, gimp_file_get_utf8_name (file), target_quantizer,
+                  raw.size / 1024.0, final_psnr);
+
+      if (!reached)
+        {
+          if (target_mode == AVIFPLUGIN_TARGET_SIZE)
+            {
+              g_message ("Can't fit the image in %d KiB, exported in %.1f KiB.\n", target_size, raw.size / 1024.0);
+            }
+          else
+            {
+              g_message ("Can't reach PSNR %.2f dB, exported with %.2f dB.\n", target_psnr, final_psnr);
+            }
+        }
+    }
+
+  avifImageDestroy (avif);
   avifEncoderDestroy (encoder);
 
+  if (time_budget > 0.0 && res == AVIF_RESULT_OK)
+    {
+      g_printerr ("%s: '%s' encoded at speed %d in %.1f s (predicted %.1f s, budget %.1f s)\n",
+                  G_STRFUNC, gimp_file_get_utf8_name (file), encoder_speed,
+                  (g_get_monotonic_time () - encode_start) / 1e6, predicted_time, time_budget);
+    }
+
   if (res == AVIF_RESULT_OK)
     {
       gimp_progress_update (0.75);
@@ -937,7 +1440,8 @@ gboolean   save_layers (GFile         *file,
       outfile = g_fopen (g_file_peek_path (file), "wb");
       if (!outfile)
         {
-          g_message ("Could not open '%s' for writing!\n", g_file_peek_path (file));
+          g_set_error (error, G_FILE_ERROR, 0, "Could not open '%s' for writing!",
+                       g_file_peek_path (file));
           avifRWDataFree (&raw);
           return FALSE;
         }
@@ -952,7 +1456,8 @@ gboolean   save_layers (GFile         *file,
     }
   else
     {
-      g_message ("ERROR: Failed to encode: %s\n", avifResultToString (res));
+      g_set_error (error, G_FILE_ERROR, 0, "ERROR: Failed to encode: %s",
+                   avifResultToString (res));
     }
 
   return FALSE;
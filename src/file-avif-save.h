@@ -3,6 +3,16 @@
 #ifndef __AVIF_SAVE_H__
 #define __AVIF_SAVE_H__
 
+typedef enum
+{
+  AVIFPLUGIN_PROFILE_DEFAULT = 0,   /* libaom defaults for the speed */
+  AVIFPLUGIN_PROFILE_FAST,          /* fewest intra tools */
+  AVIFPLUGIN_PROFILE_BALANCED,      /* costliest tools off */
+  AVIFPLUGIN_PROFILE_COUNT
+} AvifpluginProfile;
+
+void       avifplugin_set_profile (avifEncoder       *encoder,
+                                   AvifpluginProfile  profile);
 
 gboolean   save_layers (GFile         *file,
                         GimpImage     *image,
@@ -0,0 +1,451 @@
+/*
+ * GIMP plug-in to allow import/export in AVIF image format.
+ * Author: Daniel Novomesky
+ */
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+This software uses libavif
+URL: https://github.com/AOMediaCodec/libavif/
+
+Copyright 2019 Joe Drago. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <libgimp/gimp.h>
+
+#include <avif/avif.h>
+#include <glib/gstdio.h>
+
+#include "file-avif-save.h"
+#include "file-avif-speed.h"
+
+/* The calibration encodes a synthetic image of CALIBRATION_SIZE pixels
+ * squared, and one of CALIBRATION_SMALL_SIZE pixels squared, at a speed.
+ * The cost of an encode is modeled as a fixed cost (encoder setup, headers)
+ * plus a cost per pixel; the two sizes separate them, so that the per-pixel
+ * cost is not dominated by the setup. Each speed is measured the first time
+ * a budget needs it, from the fastest to the slowest, and cached per codec
+ * version, profile and thread count. An export thus only measures the speeds
+ * down to the first one that does not fit its budget, which takes about as
+ * long as the budget for the slowest speeds. */
+#define CALIBRATION_SIZE       320
+#define CALIBRATION_SMALL_SIZE 64
+/* the speed at which the cost of 10 bit encodes is compared to 8 bit ones */
+#define CALIBRATION_DEPTH_SPEED 6
+#define CALIBRATION_FILE "speed-calibration.ini"
+#define SPEED_COUNT (AVIF_SPEED_FASTEST - AVIF_SPEED_SLOWEST + 1)
+
+/* Measured costs of the encoder, negative or 0 when not measured yet */
+typedef struct
+{
+  gdouble fixed_ms[SPEED_COUNT];
+  gdouble ns_per_pixel[SPEED_COUNT];
+  gdouble high_depth_factor;      /* cost per pixel of 10 bit relative to 8 bit */
+} AvifpluginSpeedCosts;
+
+/* The costs of one codec, profile and thread count in the cache file */
+typedef struct
+{
+  avifCodecChoice      codec_choice;
+  AvifpluginProfile    profile;
+  gint                 num_threads;
+  const char          *codec_name;
+  char                 codec_versions[256];
+  gchar               *path;
+  gchar               *group;
+  GKeyFile            *key_file;
+  gboolean             changed;
+  AvifpluginSpeedCosts costs;
+} AvifpluginSpeedCache;
+
+static gchar *
+avifplugin_speed_cache_path (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), "gimp-avif-plugin", CALIBRATION_FILE, NULL);
+}
+
+/* Returns a 4:2:0 image of size x size pixels */
+static avifImage *
+avifplugin_speed_image_new (gint size,
+                            gint depth)
+{
+  avifImage *image = avifImageCreate (size, size, depth, AVIF_PIXEL_FORMAT_YUV420);
+  guint32    state = 0x9E3779B9;
+  guint32    x, y;
+  gint       plane;
+
+  avifImageAllocatePlanes (image, AVIF_PLANES_YUV);
+
+  for (plane = 0; plane < 3; plane++)
+    {
+      guint32 width = (plane == AVIF_CHAN_Y) ? image->width : (image->width + 1) >> 1;
+      guint32 height = (plane == AVIF_CHAN_Y) ? image->height : (image->height + 1) >> 1;
+
+      for (y = 0; y < height; y++)
+        {
+          guint8 *row = image->yuvPlanes[plane] + (gsize) y * image->yuvRowBytes[plane];
+
+          for (x = 0; x < width; x++)
+            {
+              /* gradient with some noise, to look a bit like a photo */
+              guint32 value;
+
+              state ^= state << 13;
+              state ^= state >> 17;
+              state ^= state << 5;
+              value = ( (x + y) * 255 / (width + height)) ^ (state & 0x0F);
+              if (depth > 8)
+                {
+                  ( (guint16 *) row)[x] = (guint16) (value << (depth - 8));
+                }
+              else
+                {
+                  row[x] = (guint8) value;
+                }
+            }
+        }
+    }
+  return image;
+}
+
+/* Returns the time in milliseconds to encode image at speed, or a negative
+ * value on error. */
+static gdouble
+avifplugin_speed_measure (avifCodecChoice    codec_choice,
+                          AvifpluginProfile  profile,
+                          gint               num_threads,
+                          gint               speed,
+                          const avifImage   *image)
+{
+  avifEncoder *encoder = avifEncoderCreate ();
+  avifRWData   raw = AVIF_DATA_EMPTY;
+  gint64       start;
+  gdouble      ms = -1.0;
+
+  encoder->codecChoice  = codec_choice;
+  encoder->maxThreads   = num_threads;
+  encoder->speed        = speed;
+  encoder->minQuantizer = AVIF_QUANTIZER_BEST_QUALITY;
+  encoder->maxQuantizer = 40;
+  avifplugin_set_profile (encoder, profile);
+
+  gimp_progress_pulse ();
+  start = g_get_monotonic_time ();
+  if (avifEncoderWrite (encoder, image, &raw) == AVIF_RESULT_OK)
+    {
+      ms = (g_get_monotonic_time () - start) / 1000.0;
+    }
+
+  avifRWDataFree (&raw);
+  avifEncoderDestroy (encoder);
+  return ms;
+}
+
+/* Loads the costs measured so far from the cache file. Calibrations of
+ * another codec version are dropped. */
+static gboolean
+avifplugin_speed_cache_open (AvifpluginSpeedCache *cache,
+                             avifCodecChoice       codec_choice,
+                             AvifpluginProfile     profile,
+                             gint                  num_threads)
+{
+  gchar   *stored_versions;
+  gdouble *stored_fixed;
+  gdouble *stored_costs;
+  gsize    stored_fixed_count = 0;
+  gsize    stored_count = 0;
+  gint     i;
+
+  memset (cache, 0, sizeof (AvifpluginSpeedCache));
+  cache->codec_name = avifCodecName (codec_choice, AVIF_CODEC_FLAG_CAN_ENCODE);
+  if (! cache->codec_name)
+    {
+      return FALSE;
+    }
+
+  cache->codec_choice = codec_choice;
+  cache->profile = profile;
+  cache->num_threads = num_threads;
+  avifCodecVersions (cache->codec_versions);
+  cache->path = avifplugin_speed_cache_path ();
+  /* the default profile keeps the group of the calibrations without profile */
+  if (profile == AVIFPLUGIN_PROFILE_DEFAULT)
+    {
+      cache->group = g_strdup_printf ("%s threads=%d", cache->codec_name, num_threads);
+    }
+  else
+    {
+      cache->group = g_strdup_printf ("%s threads=%d profile=%d", cache->codec_name, num_threads, (gint) profile);
+    }
+  cache->key_file = g_key_file_new ();
+  g_key_file_load_from_file (cache->key_file, cache->path, G_KEY_FILE_KEEP_COMMENTS, NULL);
+
+  for (i = 0; i < SPEED_COUNT; i++)
+    {
+      cache->costs.fixed_ms[i] = -1.0;
+      cache->costs.ns_per_pixel[i] = -1.0;
+    }
+
+  /* calibrations of older versions of the plug-in have no fixed-ms */
+  stored_versions = g_key_file_get_string (cache->key_file, cache->group, "codec-versions", NULL);
+  stored_fixed = g_key_file_get_double_list (cache->key_file, cache->group, "fixed-ms", &stored_fixed_count, NULL);
+  stored_costs = g_key_file_get_double_list (cache->key_file, cache->group, "ns-per-pixel", &stored_count, NULL);
+
+  if (stored_versions && stored_fixed && stored_costs &&
+      stored_fixed_count == SPEED_COUNT && stored_count == SPEED_COUNT &&
+      ! strcmp (stored_versions, cache->codec_versions))
+    {
+      memcpy (cache->costs.fixed_ms, stored_fixed, sizeof (gdouble) * SPEED_COUNT);
+      memcpy (cache->costs.ns_per_pixel, stored_costs, sizeof (gdouble) * SPEED_COUNT);
+      cache->costs.high_depth_factor = g_key_file_get_double (cache->key_file, cache->group, "high-depth-factor", NULL);
+    }
+
+  g_free (stored_costs);
+  g_free (stored_fixed);
+  g_free (stored_versions);
+  return TRUE;
+}
+
+/* Stores the costs measured by this export, if any. */
+static void
+avifplugin_speed_cache_close (AvifpluginSpeedCache *cache)
+{
+  if (cache->changed)
+    {
+      gchar *dir = g_path_get_dirname (cache->path);
+
+      g_key_file_set_string (cache->key_file, cache->group, "codec-versions", cache->codec_versions);
+      g_key_file_set_double_list (cache->key_file, cache->group, "fixed-ms", cache->costs.fixed_ms, SPEED_COUNT);
+      g_key_file_set_double_list (cache->key_file, cache->group, "ns-per-pixel", cache->costs.ns_per_pixel, SPEED_COUNT);
+      g_key_file_set_double (cache->key_file, cache->group, "high-depth-factor", cache->costs.high_depth_factor);
+
+      if (g_mkdir_with_parents (dir, 0755) != 0 ||
+          ! g_key_file_save_to_file (cache->key_file, cache->path, NULL))
+        {
+          g_printerr ("%s: can't save speed calibration to '%s'\n", G_STRFUNC, cache->path);
+        }
+
+      g_free (dir);
+    }
+
+  if (cache->key_file)
+    {
+      g_key_file_free (cache->key_file);
+    }
+  g_free (cache->group);
+  g_free (cache->path);
+}
+
+/* Measures the fixed and per-pixel costs of speed, unless known. */
+static gboolean
+avifplugin_speed_cache_measure (AvifpluginSpeedCache *cache,
+                                gint                  speed)
+{
+  const gdouble pixels = (gdouble) CALIBRATION_SIZE * CALIBRATION_SIZE;
+  const gdouble small_pixels = (gdouble) CALIBRATION_SMALL_SIZE * CALIBRATION_SMALL_SIZE;
+  const gint    i = speed - AVIF_SPEED_SLOWEST;
+  avifImage    *image;
+  avifImage    *small_image;
+  gdouble       ms, small_ms;
+
+  if (cache->costs.ns_per_pixel[i] >= 0.0)
+    {
+      return TRUE;
+    }
+
+  gimp_progress_set_text_printf ("Measuring %s encoder speed %d (only done once)", cache->codec_name, speed);
+
+  image = avifplugin_speed_image_new (CALIBRATION_SIZE, 8);
+  small_image = avifplugin_speed_image_new (CALIBRATION_SMALL_SIZE, 8);
+  small_ms = avifplugin_speed_measure (cache->codec_choice, cache->profile, cache->num_threads, speed, small_image);
+  ms = avifplugin_speed_measure (cache->codec_choice, cache->profile, cache->num_threads, speed, image);
+  avifImageDestroy (small_image);
+  avifImageDestroy (image);
+
+  if (small_ms < 0.0 || ms < 0.0)
+    {
+      return FALSE;
+    }
+
+  /* timing noise can make the small encode look relatively slower */
+  cache->costs.ns_per_pixel[i] = MAX (ms - small_ms, ms * 0.1) * 1e6 / (pixels - small_pixels);
+  cache->costs.fixed_ms[i] = MAX (ms - cache->costs.ns_per_pixel[i] * pixels / 1e6, 0.0);
+  cache->changed = TRUE;
+  return TRUE;
+}
+
+/* Measures the cost of 10 bit encodes relative to 8 bit ones, unless known. */
+static gboolean
+avifplugin_speed_cache_measure_depth (AvifpluginSpeedCache *cache)
+{
+  const gdouble pixels = (gdouble) CALIBRATION_SIZE * CALIBRATION_SIZE;
+  const gint    i = CALIBRATION_DEPTH_SPEED - AVIF_SPEED_SLOWEST;
+  avifImage    *image;
+  gdouble       ms;
+
+  if (cache->costs.high_depth_factor >= 1.0)
+    {
+      return TRUE;
+    }
+
+  if (! avifplugin_speed_cache_measure (cache, CALIBRATION_DEPTH_SPEED))
+    {
+      return FALSE;
+    }
+
+  gimp_progress_set_text_printf ("Measuring %s encoder speed at 10 bit (only done once)", cache->codec_name);
+
+  image = avifplugin_speed_image_new (CALIBRATION_SIZE, 10);
+  ms = avifplugin_speed_measure (cache->codec_choice, cache->profile, cache->num_threads,
+                                 CALIBRATION_DEPTH_SPEED, image);
+  avifImageDestroy (image);
+
+  if (ms < 0.0)
+    {
+      return FALSE;
+    }
+
+  cache->costs.high_depth_factor = 1.0;
+  if (cache->costs.ns_per_pixel[i] > 0.0)
+    {
+      cache->costs.high_depth_factor =
+        CLAMP ( (ms - cache->costs.fixed_ms[i]) * 1e6 / pixels / cache->costs.ns_per_pixel[i], 1.0, 4.0);
+    }
+  cache->changed = TRUE;
+  return TRUE;
+}
+
+/* Returns the slowest speed whose predicted encode time fits the budget
+ * (in seconds), AVIF_SPEED_FASTEST when none does, or -1 when the encoder
+ * could not be calibrated. predicted is set to the predicted time of the
+ * returned speed. The prediction is the fixed cost of the speed
+ * plus its cost per pixel, scaled by the number of coded samples relative
+ * to the 8 bit YUV420 calibration image and by the measured high bit depth
+ * factor. */
+gint
+avifplugin_speed_for_budget (avifCodecChoice    codec_choice,
+                             AvifpluginProfile  profile,
+                             gint               num_threads,
+                             gint               width,
+                             gint               height,
+                             gint               depth,
+                             avifPixelFormat    pixel_format,
+                             gboolean           alpha,
+                             gint               frames,
+                             gdouble            budget,
+                             gdouble           *predicted)
+{
+  AvifpluginSpeedCache cache;
+  gdouble              samples_per_pixel;
+  gdouble              scale;
+  gint                 speed;
+  gint                 chosen = -1;
+
+  if (! avifplugin_speed_cache_open (&cache, codec_choice, profile, num_threads))
+    {
+      return -1;
+    }
+
+  switch (pixel_format)
+    {
+    case AVIF_PIXEL_FORMAT_YUV444:
+      samples_per_pixel = 3.0;
+      break;
+    case AVIF_PIXEL_FORMAT_YUV422:
+      samples_per_pixel = 2.0;
+      break;
+    case AVIF_PIXEL_FORMAT_YUV400:
+      samples_per_pixel = 1.0;
+      break;
+    default:
+      samples_per_pixel = 1.5;
+      break;
+    }
+
+  if (alpha)
+    {
+      samples_per_pixel += 1.0; /* alpha is coded as a separate monochrome image */
+    }
+
+  /* the number of pixels of the 4:2:0 calibration image coding as many
+   * samples; the cost is assumed to be proportional to the samples */
+  scale = (gdouble) width * height * MAX (frames, 1) * samples_per_pixel / 1.5;
+  if (depth > 8)
+    {
+      if (! avifplugin_speed_cache_measure_depth (&cache))
+        {
+          avifplugin_speed_cache_close (&cache);
+          return -1;
+        }
+      scale *= cache.costs.high_depth_factor;
+    }
+
+  /* slower speeds cost more, so the search stops at the first one missing
+   * the budget and the slower ones are never measured */
+  for (speed = AVIF_SPEED_FASTEST; speed >= AVIF_SPEED_SLOWEST; speed--)
+    {
+      gint    i = speed - AVIF_SPEED_SLOWEST;
+      gdouble seconds;
+
+      if (! avifplugin_speed_cache_measure (&cache, speed))
+        {
+          break;
+        }
+
+      seconds = cache.costs.fixed_ms[i] / 1e3 + cache.costs.ns_per_pixel[i] * scale / 1e9;
+      if (seconds > budget && chosen >= 0)
+        {
+          break;
+        }
+
+      chosen = speed;
+      if (predicted)
+        {
+          *predicted = seconds;
+        }
+
+      if (seconds > budget)
+        {
+          break;
+        }
+    }
+
+  avifplugin_speed_cache_close (&cache);
+  return chosen;
+}
@@ -0,0 +1,19 @@
+
+
+#ifndef __AVIF_SPEED_H__
+#define __AVIF_SPEED_H__
+
+
+gint       avifplugin_speed_for_budget (avifCodecChoice    codec_choice,
+                                        AvifpluginProfile  profile,
+                                        gint               num_threads,
+                                        gint               width,
+                                        gint               height,
+                                        gint               depth,
+                                        avifPixelFormat    pixel_format,
+                                        gboolean           alpha,
+                                        gint               frames,
+                                        gdouble            budget,
+                                        gdouble           *predicted);
+
+#endif /* __AVIF_SPEED_H__ */
@@ -0,0 +1,377 @@
+/*
+ * GIMP plug-in to allow import/export in AVIF image format.
+ * Author: Daniel Novomesky
+ */
+
+/*
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/*
+This software uses libavif
+URL: https://github.com/AOMediaCodec/libavif/
+
+Copyright 2019 Joe Drago. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice,
+this list of conditions and the following disclaimer in the documentation
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <math.h>
+
+#include <libgimp/gimp.h>
+
+#include <avif/avif.h>
+
+#include "file-avif-save.h"
+#include "file-avif-target.h"
+
+/* At most this many trial encodes run at the same time. The processors are
+ * shared among them, so that a round of trials costs about the same wall
+ * time as a single encode using all of them. */
+#define MAX_PARALLEL_TRIALS 4
+
+/* Reported for a lossless trial, like aom_dsp does. */
+#define MAX_PSNR 100.0
+
+/* The trials run at least at this speed, so that the whole search costs
+ * about as much as the final encode. A slower final encode gives a smaller
+ * file and a better PSNR at the same quantizer, so the quantizer found this
+ * way errs on the safe side. */
+#define TRIAL_SPEED 8
+
+typedef struct
+{
+  const avifImage   *image;
+  const avifEncoder *settings;
+  AvifpluginProfile  profile;
+  gboolean           measure_psnr;
+  gint               speed;
+  gint               max_threads;
+  gint               quantizer;
+  avifResult         result;
+  gsize              size;
+  gdouble            psnr;
+} TargetTrial;
+
+/* PSNR over all the YUV samples of both images, which must have been
+ * encoded and decoded with the same depth and pixel format. */
+static gdouble
+avifplugin_target_psnr (const avifImage *source,
+                        const avifImage *decoded)
+{
+  avifPixelFormatInfo info;
+  gdouble             peak = (gdouble) ( (1 << source->depth) - 1);
+  gdouble             sse = 0.0;
+  guint64             samples = 0;
+  gint                plane_count;
+  gint                plane;
+
+  if (decoded->width != source->width || decoded->height != source->height ||
+      decoded->depth != source->depth || decoded->yuvFormat != source->yuvFormat)
+    {
+      return 0.0;
+    }
+
+  avifGetPixelFormatInfo (source->yuvFormat, &info);
+  plane_count = info.monochrome ? 1 : 3;
+
+  for (plane = 0; plane < plane_count; plane++)
+    {
+      guint32 width = source->width;
+      guint32 height = source->height;
+      guint32 x, y;
+
+      if (plane > AVIF_CHAN_Y)
+        {
+          width = (width + info.chromaShiftX) >> info.chromaShiftX;
+          height = (height + info.chromaShiftY) >> info.chromaShiftY;
+        }
+
+      for (y = 0; y < height; y++)
+        {
+          const guint8 *source_row = source->yuvPlanes[plane] + (gsize) y * source->yuvRowBytes[plane];
+          const guint8 *decoded_row = decoded->yuvPlanes[plane] + (gsize) y * decoded->yuvRowBytes[plane];
+          gint64        row_sse = 0;
+
+          if (source->depth > 8)
+            {
+              const guint16 *source_row16 = (const guint16 *) source_row;
+              const guint16 *decoded_row16 = (const guint16 *) decoded_row;
+
+              for (x = 0; x < width; x++)
+                {
+                  gint64 diff = (gint64) source_row16[x] - decoded_row16[x];
+                  row_sse += diff * diff;
+                }
+            }
+          else
+            {
+              for (x = 0; x < width; x++)
+                {
+                  gint64 diff = (gint64) source_row[x] - decoded_row[x];
+                  row_sse += diff * diff;
+                }
+            }
+
+          sse += (gdouble) row_sse;
+        }
+
+      samples += (guint64) width * height;
+    }
+
+  if (sse <= 0.0)
+    {
+      return MAX_PSNR;
+    }
+
+  return MIN (MAX_PSNR, 10.0 * log10 (peak * peak * (gdouble) samples / sse));
+}
+
+/* Decodes the encoded file and compares it with the YUV image it was
+ * encoded from. Returns -1 when the file can't be decoded. */
+gdouble
+avifplugin_target_measure_psnr (const avifImage  *image,
+                                const avifRWData *encoded,
+                                gint              num_threads)
+{
+  avifDecoder *decoder = avifDecoderCreate ();
+  avifImage   *decoded = avifImageCreateEmpty ();
+  gdouble      psnr = -1.0;
+
+  decoder->maxThreads = num_threads;
+  if (avifDecoderReadMemory (decoder, decoded, encoded->data, encoded->size) == AVIF_RESULT_OK)
+    {
+      psnr = avifplugin_target_psnr (image, decoded);
+    }
+
+  avifImageDestroy (decoded);
+  avifDecoderDestroy (decoder);
+  return psnr;
+}
+
+static gpointer
+avifplugin_target_trial (gpointer data)
+{
+  TargetTrial *trial = data;
+  avifEncoder *encoder;
+  avifRWData   raw = AVIF_DATA_EMPTY;
+
+  encoder = avifEncoderCreate ();
+  encoder->codecChoice       = trial->settings->codecChoice;
+  encoder->tileRowsLog2      = trial->settings->tileRowsLog2;
+  encoder->tileColsLog2      = trial->settings->tileColsLog2;
+  encoder->minQuantizerAlpha = trial->settings->minQuantizerAlpha;
+  encoder->maxQuantizerAlpha = trial->settings->maxQuantizerAlpha;
+  encoder->minQuantizer      = trial->quantizer;
+  encoder->maxQuantizer      = trial->quantizer;
+  encoder->maxThreads        = trial->max_threads;
+  encoder->speed             = trial->speed;
+  avifplugin_set_profile (encoder, trial->profile);
+
+  trial->result = avifEncoderWrite (encoder, trial->image, &raw);
+  avifEncoderDestroy (encoder);
+
+  if (trial->result == AVIF_RESULT_OK)
+    {
+      trial->size = raw.size;
+
+      if (trial->measure_psnr)
+        {
+          trial->psnr = avifplugin_target_measure_psnr (trial->image, &raw, trial->max_threads);
+          if (trial->psnr < 0.0)
+            {
+              trial->result = AVIF_RESULT_DECODE_COLOR_FAILED;
+            }
+        }
+    }
+
+  avifRWDataFree (&raw);
+  return NULL;
+}
+
+/* runs the trials concurrently, returns the first failure */
+static avifResult
+avifplugin_target_run (TargetTrial *trials,
+                       gint         count)
+{
+  GThread *threads[MAX_PARALLEL_TRIALS];
+  gint     j;
+
+  for (j = 1; j < count; j++)
+    {
+      threads[j] = g_thread_new ("avif-target", avifplugin_target_trial, &trials[j]);
+    }
+
+  avifplugin_target_trial (&trials[0]);
+
+  for (j = 1; j < count; j++)
+    {
+      g_thread_join (threads[j]);
+    }
+
+  for (j = 0; j < count; j++)
+    {
+      if (trials[j].result != AVIF_RESULT_OK)
+        {
+          return trials[j].result;
+        }
+    }
+
+  return AVIF_RESULT_OK;
+}
+
+/* Searches the quantizer meeting the target with trial encodes of the YUV
+ * image, using the settings and profile of the final encode at no less than
+ * TRIAL_SPEED. The search runs over steps 0..63, ordered so that a larger
+ * step always gives a smaller file and a better PSNR is reached with a
+ * smaller step: step is the quantizer for the size target and
+ * 63 - quantizer for the quality target. We look for the lowest passing
+ * step, assuming the last one passes. Each round tests up to
+ * MAX_PARALLEL_TRIALS steps evenly spread over the unknown range at once, so
+ * the 64 quantizers are resolved in a handful of rounds.
+ *
+ * Returns the quantizer and stores the size of its trial, and its PSNR for
+ * the quality target, or returns -1 when a trial failed. The final encode is
+ * slower, so it usually beats the trial, but it has to be checked by the
+ * caller. */
+gint
+avifplugin_target_search (const avifImage   *image,
+                          const avifEncoder *settings,
+                          AvifpluginTarget   target,
+                          AvifpluginProfile  profile,
+                          gsize              target_size,
+                          gdouble            target_psnr,
+                          gint               num_threads,
+                          gsize             *found_size,
+                          gdouble           *found_psnr)
+{
+  TargetTrial trials[MAX_PARALLEL_TRIALS];
+  gint        steps[MAX_PARALLEL_TRIALS];
+  gint        parallel = CLAMP (num_threads, 1, MAX_PARALLEL_TRIALS);
+  gint        speed = TRIAL_SPEED;
+  gint        lo = AVIF_QUANTIZER_BEST_QUALITY - 1;   /* highest step known to fail */
+  gint        hi = AVIF_QUANTIZER_WORST_QUALITY;      /* lowest step known or assumed to pass */
+  gboolean    hi_measured = FALSE;
+  avifResult  res;
+  gint        count;
+  gint        first_pass;
+  gint        j;
+
+  *found_size = 0;
+  *found_psnr = 0.0;
+
+  if (target == AVIFPLUGIN_TARGET_NONE)
+    {
+      return -1;
+    }
+
+  if (settings->speed != AVIF_SPEED_DEFAULT)
+    {
+      speed = MAX (settings->speed, TRIAL_SPEED);
+    }
+
+  /* the last round measures the assumed step alone when no trial passed */
+  while (hi - lo > 1 || !hi_measured)
+    {
+      gint span = hi - lo;
+
+      if (span > 1)
+        {
+          count = MIN (parallel, span - 1);
+          for (j = 0; j < count; j++)
+            {
+              steps[j] = lo + (j + 1) * span / (count + 1);
+            }
+        }
+      else
+        {
+          count = 1;
+          steps[0] = hi;
+        }
+
+      for (j = 0; j < count; j++)
+        {
+          trials[j].image        = image;
+          trials[j].settings     = settings;
+          trials[j].profile      = profile;
+          trials[j].measure_psnr = (target == AVIFPLUGIN_TARGET_QUALITY);
+          trials[j].speed        = speed;
+          trials[j].max_threads  = MAX (1, num_threads / count);
+          trials[j].quantizer    = (target == AVIFPLUGIN_TARGET_SIZE) ? steps[j] : AVIF_QUANTIZER_WORST_QUALITY - steps[j];
+          trials[j].result       = AVIF_RESULT_UNKNOWN_ERROR;
+          trials[j].size         = 0;
+          trials[j].psnr         = 0.0;
+        }
+
+      gimp_progress_pulse ();
+      res = avifplugin_target_run (trials, count);
+      if (res != AVIF_RESULT_OK)
+        {
+          g_printerr ("%s: trial encode failed: %s\n", G_STRFUNC, avifResultToString (res));
+          return -1;
+        }
+
+      if (span <= 1)
+        {
+          *found_size = trials[0].size;
+          *found_psnr = trials[0].psnr;
+          break;
+        }
+
+      for (first_pass = 0; first_pass < count; first_pass++)
+        {
+          if (target == AVIFPLUGIN_TARGET_SIZE ?
+              trials[first_pass].size <= target_size :
+              trials[first_pass].psnr >= target_psnr)
+            {
+              break;
+            }
+        }
+
+      if (first_pass < count)
+        {
+          hi = steps[first_pass];
+          hi_measured = TRUE;
+          *found_size = trials[first_pass].size;
+          *found_psnr = trials[first_pass].psnr;
+        }
+
+      if (first_pass > 0)
+        {
+          lo = steps[first_pass - 1];
+        }
+    }
+
+  return (target == AVIFPLUGIN_TARGET_SIZE) ? hi : AVIF_QUANTIZER_WORST_QUALITY - hi;
+}
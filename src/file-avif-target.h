@@ -0,0 +1,28 @@
+
+
+#ifndef __AVIF_TARGET_H__
+#define __AVIF_TARGET_H__
+
+typedef enum
+{
+  AVIFPLUGIN_TARGET_NONE = 0,   /* use min-quantizer and max-quantizer */
+  AVIFPLUGIN_TARGET_SIZE,       /* smallest quantizer fitting a byte budget */
+  AVIFPLUGIN_TARGET_QUALITY     /* highest quantizer reaching a PSNR */
+} AvifpluginTarget;
+
+
+gint       avifplugin_target_search (const avifImage   *image,
+                                     const avifEncoder *settings,
+                                     AvifpluginTarget   target,
+                                     AvifpluginProfile  profile,
+                                     gsize              target_size,
+                                     gdouble            target_psnr,
+                                     gint               num_threads,
+                                     gsize             *found_size,
+                                     gdouble           *found_psnr);
+
+gdouble    avifplugin_target_measure_psnr (const avifImage  *image,
+                                           const avifRWData *encoded,
+                                           gint              num_threads);
+
+#endif /* __AVIF_TARGET_H__ */
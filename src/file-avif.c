@@ -56,8 +56,11 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "file-avif-load.h"
 
 
-#define LOAD_PROC      "file-avif-load"
-#define SAVE_PROC      "file-avif-save"
+#define LOAD_PROC       "file-avif-load"
+#define SAVE_PROC       "file-avif-save"
+#define LOAD_BATCH_PROC "file-avif-load-batch"
+#define SAVE_BATCH_PROC "file-avif-save-batch"
+#define PROBE_PROC      "file-avif-probe"
 #define PLUG_IN_BINARY "file-avif"
 #define PLUG_IN_ROLE   "gimp-file-avif"
 
@@ -97,6 +100,15 @@ static GimpValueArray *avif_save (GimpProcedure        *procedure,
                                   GFile                *file,
                                   const GimpValueArray *args,
                                   gpointer              run_data);
+static GimpValueArray *avif_load_batch (GimpProcedure        *procedure,
+                                        const GimpValueArray *args,
+                                        gpointer              run_data);
+static GimpValueArray *avif_save_batch (GimpProcedure        *procedure,
+                                        const GimpValueArray *args,
+                                        gpointer              run_data);
+static GimpValueArray *avif_probe (GimpProcedure        *procedure,
+                                   const GimpValueArray *args,
+                                   gpointer              run_data);
 
 
 G_DEFINE_TYPE (Avif, avif, GIMP_TYPE_PLUG_IN)
@@ -126,10 +138,140 @@ avif_query_procedures (GimpPlugIn *plug_in)
 
   list = g_list_append (list, g_strdup (LOAD_PROC));
   list = g_list_append (list, g_strdup (SAVE_PROC));
+  list = g_list_append (list, g_strdup (LOAD_BATCH_PROC));
+  list = g_list_append (list, g_strdup (SAVE_BATCH_PROC));
+  list = g_list_append (list, g_strdup (PROBE_PROC));
 
   return list;
 }
 
+/* Export options, shared by the save and the batch save procedures. */
+static void
+avif_add_save_arguments (GimpProcedure *procedure)
+{
+  GIMP_PROC_ARG_INT (procedure, "min-quantizer",
+                     "Quantizer (Min)",
+                     "Set higher values to limit/reduce image quality",
+                     AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, AVIF_QUANTIZER_BEST_QUALITY,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "max-quantizer",
+                     "Quantizer (Max)",
+                     "AVIF quality parameter: 0 - highest quality, 63 - smallest file",
+                     AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, 40,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "alpha-quantizer",
+                     "Quantizer (Alpha)",
+                     "AVIF quality parameter: 0 - highest quality (recommended!) , 63 - smallest file",
+                     AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, AVIF_QUANTIZER_BEST_QUALITY,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "target-mode",
+                     "Target",
+                     "Search the quantizer by trial encodes: 0 - off, 1 - file size, 2 - quality (PSNR)",
+                     0, 2, 0,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "target-size",
+                     "Target size",
+                     "Maximal file size (in KiB) when target is file size",
+                     1, 1048576, 100,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_DOUBLE (procedure, "target-psnr",
+                        "Target PSNR",
+                        "Minimal PSNR (in dB) when target is quality",
+                        20.0, 60.0, 40.0,
+                        G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "pixel-format",
+                     "Pixel Format",
+                     "YUV444 (needs lot of RAM), YUV422, YUV420, Grayscale",
+                     AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV400,
+                     AVIF_PIXEL_FORMAT_YUV420,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "save-bit-depth",
+                     "Bit depth",
+                     "Bit depth of exported image",
+                     8, 12, 8,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "av1-encoder",
+                     "AV1 encoder",
+                     "Select encoder for AV1 stream",
+                     AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_CHOICE_SVT, AVIF_CODEC_CHOICE_AUTO,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "encoder-speed",
+                     "Encoder speed",
+                     "Speed of export: 0 - very slow, 5 - medium, 10 - fastest",
+                     AVIF_SPEED_SLOWEST, AVIF_SPEED_FASTEST, 6, /* speed 6 is default for rav1e */
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_DOUBLE (procedure, "time-budget",
+                        "Time budget",
+                        "Encode time (in seconds) used to select the encoder speed automatically, 0 - use Encoder speed. "
+                        "The speeds are measured on first use, the chosen speed and the encode time are printed on the console",
+                        0.0, 3600.0, 0.0,
+                        G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "save-alpha-channel",
+                         "Save Alpha channel",
+                         "Save information about transparent pixels when possible",
+                         TRUE,
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "animation",
+                         "Animation",
+                         "Use layers for animation",
+                         FALSE,
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "animation-timescale",
+                     "Timescale",
+                     "timescale of the media (Hz)",
+                     1, 60, 1,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "animation-frame-duration",
+                     "Frame duration",
+                     "Frame duration (in timescales)",
+                     1, 1000, 1,
+                     G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "save-color-profile",
+                         "Save color profle",
+                         "Enable to save ICC color profile, disable to save NCLX information",
+                         FALSE,
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "save-exif",
+                         "Save Exif",
+                         "Toggle saving Exif data",
+                         gimp_export_exif (),
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "save-xmp",
+                         "Save XMP",
+                         "Toggle saving XMP data",
+                         gimp_export_xmp (),
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_BOOLEAN (procedure, "lossless",
+                         "Lossless",
+                         "Export without any loss: YUV444 with identity (GBR) matrix, lossless AV1 coding, quantizers are ignored",
+                         FALSE,
+                         G_PARAM_READWRITE);
+
+  GIMP_PROC_ARG_INT (procedure, "encoder-profile",
+                     "Encoder profile",
+                     "Coding tools of the aom encoder, other encoders ignore it: 0 - default, 1 - fast, 2 - balanced",
+                     AVIFPLUGIN_PROFILE_DEFAULT, AVIFPLUGIN_PROFILE_BALANCED, AVIFPLUGIN_PROFILE_DEFAULT,
+                     G_PARAM_READWRITE);
+}
+
 static GimpProcedure *
 avif_create_procedure (GimpPlugIn  *plug_in,
                        const gchar *name)
@@ -159,6 +301,42 @@ avif_create_procedure (GimpPlugIn  *plug_in,
                                           "avif,avifs");
       gimp_file_procedure_set_magics (GIMP_FILE_PROCEDURE (procedure),
                                       "4,string,ftypavif,4,string,ftypavis");
+
+      GIMP_PROC_ARG_INT (procedure, "region-x",
+                         "Region X",
+                         "Left edge of the region to load",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_INT (procedure, "region-y",
+                         "Region Y",
+                         "Top edge of the region to load",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_INT (procedure, "region-width",
+                         "Region width",
+                         "Width of the region to load, 0 loads the whole image",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_INT (procedure, "region-height",
+                         "Region height",
+                         "Height of the region to load, 0 loads the whole image",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_BOOLEAN (procedure, "hdr-linear",
+                             "HDR as linear light",
+                             "Load PQ and HLG images as linear light floats, with the HDR reference white at 1.0",
+                             FALSE,
+                             G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_INT (procedure, "proxy-size",
+                         "Proxy size",
+                         "Downscale the image to fit this width and height, 0 - load at full size",
+                         0, 65535, 0,
+                         G_PARAM_READWRITE);
     }
   else if (! strcmp (name, SAVE_PROC))
     {
@@ -186,91 +364,253 @@ avif_create_procedure (GimpPlugIn  *plug_in,
       gimp_file_procedure_set_extensions (GIMP_FILE_PROCEDURE (procedure),
                                           "avif");
 
-      GIMP_PROC_ARG_INT (procedure, "min-quantizer",
-                         "Quantizer (Min)",
-                         "Set higher values to limit/reduce image quality",
-                         AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, AVIF_QUANTIZER_BEST_QUALITY,
+      avif_add_save_arguments (procedure);
+    }
+  else if (! strcmp (name, LOAD_BATCH_PROC))
+    {
+      procedure = gimp_procedure_new (plug_in, name,
+                                      GIMP_PDB_PROC_TYPE_PLUGIN,
+                                      avif_load_batch, NULL, NULL);
+
+      gimp_procedure_set_documentation (procedure,
+                                        "Loads many AVIF files in one plug-in run",
+                                        "Loads all the given files and all the files "
+                                        "of 'directory' matching 'pattern'. Each file "
+                                        "is read and decoded on a worker thread while "
+                                        "the previous one is added to GIMP. The AV1 "
+                                        "decoders are kept from file to file.",
+                                        name);
+      gimp_procedure_set_attribution (procedure,
+                                      "Daniel Novomesky",
+                                      "(C) 2020 Daniel Novomesky",
+                                      "2020");
+
+      GIMP_PROC_ARG_ENUM (procedure, "run-mode",
+                          "Run mode",
+                          "The run mode",
+                          GIMP_TYPE_RUN_MODE,
+                          GIMP_RUN_NONINTERACTIVE,
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_STRV (procedure, "files",
+                          "Files",
+                          "Paths of the files to load",
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_STRING (procedure, "directory",
+                            "Directory",
+                            "Directory to load the files from, or empty",
+                            "",
+                            G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_STRING (procedure, "pattern",
+                            "Pattern",
+                            "Glob pattern of the file names to load from 'directory'",
+                            "*.avif",
+                            G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "num-images",
+                         "Number of images",
+                         "Number of successfully loaded images",
+                         0, G_MAXINT, 0,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "max-quantizer",
-                         "Quantizer (Max)",
-                         "AVIF quality parameter: 0 - highest quality, 63 - smallest file",
-                         AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, 40,
+      GIMP_PROC_VAL_OBJECT_ARRAY (procedure, "images",
+                                  "Images",
+                                  "The successfully loaded images, in the order of the files",
+                                  GIMP_TYPE_IMAGE,
+                                  G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_STRV (procedure, "files",
+                          "Files",
+                          "Paths of all the processed files",
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_STRV (procedure, "statuses",
+                          "Statuses",
+                          "\"OK\" or the error message, for each file",
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "num-timings",
+                         "Number of timings",
+                         "Number of processed files",
+                         0, G_MAXINT, 0,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "alpha-quantizer",
-                         "Quantizer (Alpha)",
-                         "AVIF quality parameter: 0 - highest quality (recommended!) , 63 - smallest file",
-                         AVIF_QUANTIZER_BEST_QUALITY, AVIF_QUANTIZER_WORST_QUALITY, AVIF_QUANTIZER_BEST_QUALITY,
+      GIMP_PROC_VAL_FLOAT_ARRAY (procedure, "timings",
+                                 "Timings",
+                                 "Load time in seconds, for each file",
+                                 G_PARAM_READWRITE);
+    }
+  else if (! strcmp (name, SAVE_BATCH_PROC))
+    {
+      procedure = gimp_procedure_new (plug_in, name,
+                                      GIMP_PDB_PROC_TYPE_PLUGIN,
+                                      avif_save_batch, NULL, NULL);
+
+      gimp_procedure_set_documentation (procedure,
+                                        "Exports many images to AVIF in one plug-in run",
+                                        "Exports images[i] to files[i] with the same "
+                                        "export options. The visible layers are merged, "
+                                        "unless 'animation' is set. The images are "
+                                        "processed one after the other, each encode "
+                                        "using all the processors.",
+                                        name);
+      gimp_procedure_set_attribution (procedure,
+                                      "Daniel Novomesky",
+                                      "(C) 2020 Daniel Novomesky",
+                                      "2020");
+
+      GIMP_PROC_ARG_ENUM (procedure, "run-mode",
+                          "Run mode",
+                          "The run mode",
+                          GIMP_TYPE_RUN_MODE,
+                          GIMP_RUN_NONINTERACTIVE,
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_INT (procedure, "num-images",
+                         "Number of images",
+                         "Number of images to export",
+                         0, G_MAXINT, 0,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "pixel-format",
-                         "Pixel Format",
-                         "YUV444 (needs lot of RAM), YUV422, YUV420, Grayscale",
-                         AVIF_PIXEL_FORMAT_YUV444, AVIF_PIXEL_FORMAT_YUV400,
-                         AVIF_PIXEL_FORMAT_YUV420,
+      GIMP_PROC_ARG_OBJECT_ARRAY (procedure, "images",
+                                  "Images",
+                                  "The images to export",
+                                  GIMP_TYPE_IMAGE,
+                                  G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_STRV (procedure, "files",
+                          "Files",
+                          "Destination path for each image",
+                          G_PARAM_READWRITE);
+
+      avif_add_save_arguments (procedure);
+
+      GIMP_PROC_VAL_STRV (procedure, "statuses",
+                          "Statuses",
+                          "\"OK\" or the error message, for each image",
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "num-timings",
+                         "Number of timings",
+                         "Number of processed images",
+                         0, G_MAXINT, 0,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "save-bit-depth",
+      GIMP_PROC_VAL_FLOAT_ARRAY (procedure, "timings",
+                                 "Timings",
+                                 "Export time in seconds, for each image",
+                                 G_PARAM_READWRITE);
+    }
+  else if (! strcmp (name, PROBE_PROC))
+    {
+      procedure = gimp_procedure_new (plug_in, name,
+                                      GIMP_PDB_PROC_TYPE_PLUGIN,
+                                      avif_probe, NULL, NULL);
+
+      gimp_procedure_set_documentation (procedure,
+                                        "Returns the properties of an AVIF file without loading it",
+                                        "Reads only the container boxes of the file. "
+                                        "No pixel is decoded and no AV1 decoder is set "
+                                        "up, which makes it suitable for cataloging "
+                                        "many files.",
+                                        name);
+      gimp_procedure_set_attribution (procedure,
+                                      "Daniel Novomesky",
+                                      "(C) 2020 Daniel Novomesky",
+                                      "2020");
+
+      GIMP_PROC_ARG_ENUM (procedure, "run-mode",
+                          "Run mode",
+                          "The run mode",
+                          GIMP_TYPE_RUN_MODE,
+                          GIMP_RUN_NONINTERACTIVE,
+                          G_PARAM_READWRITE);
+
+      GIMP_PROC_ARG_STRING (procedure, "filename",
+                            "Filename",
+                            "Path of the file to probe",
+                            "",
+                            G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "width",
+                         "Width",
+                         "Width of the image",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "height",
+                         "Height",
+                         "Height of the image",
+                         0, G_MAXINT, 0,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "bit-depth",
                          "Bit depth",
-                         "Bit depth of exported image",
-                         8, 12, 8,
+                         "Bits per sample: 8, 10 or 12",
+                         0, 16, 8,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "av1-encoder",
-                         "AV1 encoder",
-                         "Select encoder for AV1 stream",
-                         AVIF_CODEC_CHOICE_AUTO, AVIF_CODEC_CHOICE_SVT, AVIF_CODEC_CHOICE_AUTO,
+      GIMP_PROC_VAL_INT (procedure, "pixel-format",
+                         "Pixel format",
+                         "0 = unknown, 1 = YUV444, 2 = YUV422, 3 = YUV420, 4 = YUV400",
+                         0, 4, 0,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "encoder-speed",
-                         "Encoder speed",
-                         "Speed of export: 0 - very slow, 5 - medium, 10 - fastest",
-                         AVIF_SPEED_SLOWEST, AVIF_SPEED_FASTEST, 6, /* speed 6 is default for rav1e */
+      GIMP_PROC_VAL_INT (procedure, "color-primaries",
+                         "Color primaries",
+                         "CICP color primaries (ISO/IEC 23091-4)",
+                         0, 255, 2,
                          G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_BOOLEAN (procedure, "save-alpha-channel",
-                             "Save Alpha channel",
-                             "Save information about transparent pixels when possible",
+      GIMP_PROC_VAL_INT (procedure, "transfer-characteristics",
+                         "Transfer characteristics",
+                         "CICP transfer characteristics (ISO/IEC 23091-4)",
+                         0, 255, 2,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_INT (procedure, "matrix-coefficients",
+                         "Matrix coefficients",
+                         "CICP matrix coefficients (ISO/IEC 23091-4)",
+                         0, 255, 2,
+                         G_PARAM_READWRITE);
+
+      GIMP_PROC_VAL_BOOLEAN (procedure, "full-range",
+                             "Full range",
+                             "Whether the YUV samples use the full range",
                              TRUE,
                              G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_BOOLEAN (procedure, "animation",
-                             "Animation",
-                             "Use layers for animation",
+      GIMP_PROC_VAL_BOOLEAN (procedure, "has-alpha",
+                             "Has alpha",
+                             "Whether the image has an alpha channel",
                              FALSE,
                              G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_INT (procedure, "animation-timescale",
-                         "Timescale",
-                         "timescale of the media (Hz)",
-                         1, 60, 1,
-                         G_PARAM_READWRITE);
-
-      GIMP_PROC_ARG_INT (procedure, "animation-frame-duration",
-                         "Frame duration",
-                         "Frame duration (in timescales)",
-                         1, 1000, 1,
-                         G_PARAM_READWRITE);
-
-      GIMP_PROC_ARG_BOOLEAN (procedure, "save-color-profile",
-                             "Save color profle",
-                             "Enable to save ICC color profile, disable to save NCLX information",
+      GIMP_PROC_VAL_BOOLEAN (procedure, "has-color-profile",
+                             "Has color profile",
+                             "Whether an ICC profile is embedded",
                              FALSE,
                              G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_BOOLEAN (procedure, "save-exif",
-                             "Save Exif",
-                             "Toggle saving Exif data",
-                             gimp_export_exif (),
+      GIMP_PROC_VAL_BOOLEAN (procedure, "has-exif",
+                             "Has Exif",
+                             "Whether Exif metadata is embedded",
+                             FALSE,
                              G_PARAM_READWRITE);
 
-      GIMP_PROC_ARG_BOOLEAN (procedure, "save-xmp",
-                             "Save XMP",
-                             "Toggle saving XMP data",
-                             gimp_export_xmp (),
+      GIMP_PROC_VAL_BOOLEAN (procedure, "has-xmp",
+                             "Has XMP",
+                             "Whether XMP metadata is embedded",
+                             FALSE,
                              G_PARAM_READWRITE);
 
+      GIMP_PROC_VAL_INT (procedure, "num-frames",
+                         "Number of frames",
+                         "Number of frames, 1 for a still image",
+                         0, G_MAXINT, 1,
+                         G_PARAM_READWRITE);
     }
 
   return procedure;
@@ -285,12 +625,20 @@ avif_load (GimpProcedure        *procedure,
 {
   GimpValueArray *return_vals;
   GimpImage      *image;
+  GeglRectangle   region;
   GError         *error = NULL;
 
 
   gegl_init (NULL, NULL);
 
-  image = load_image (file, FALSE, &error);
+  /* the pixels of grid images outside of the region are not even decoded */
+  region.x      = GIMP_VALUES_GET_INT (args, 0);
+  region.y      = GIMP_VALUES_GET_INT (args, 1);
+  region.width  = GIMP_VALUES_GET_INT (args, 2);
+  region.height = GIMP_VALUES_GET_INT (args, 3);
+
+  image = load_image (file, FALSE, &region, GIMP_VALUES_GET_BOOLEAN (args, 4),
+                      GIMP_VALUES_GET_INT (args, 5), &error);
 
   if (! image)
     return gimp_procedure_new_return_values (procedure,
@@ -401,3 +749,343 @@ avif_save (GimpProcedure        *procedure,
 
   return gimp_procedure_new_return_values (procedure, status, error);
 }
+
+static gint
+avif_batch_compare_paths (gconstpointer a,
+                          gconstpointer b)
+{
+  return g_strcmp0 (* (const gchar * const *) a, * (const gchar * const *) b);
+}
+
+/* Returns the paths of the given files followed by the sorted paths of the
+ * files of directory matching pattern. */
+static GPtrArray *
+avif_batch_collect_files (const gchar **filenames,
+                          const gchar  *directory,
+                          const gchar  *pattern)
+{
+  GPtrArray *paths = g_ptr_array_new_with_free_func (g_free);
+  gint       i;
+
+  if (filenames)
+    {
+      for (i = 0; filenames[i]; i++)
+        {
+          g_ptr_array_add (paths, g_strdup (filenames[i]));
+        }
+    }
+
+  if (directory && directory[0])
+    {
+      GDir        *dir = g_dir_open (directory, 0, NULL);
+      GPtrArray   *dir_paths;
+      const gchar *name;
+
+      if (! dir)
+        {
+          g_message ("Cannot open directory: %s\n", directory);
+          return paths;
+        }
+
+      dir_paths = g_ptr_array_new ();
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          if (! pattern || ! pattern[0] || g_pattern_match_simple (pattern, name))
+            {
+              g_ptr_array_add (dir_paths, g_build_filename (directory, name, NULL));
+            }
+        }
+      g_dir_close (dir);
+
+      g_ptr_array_sort (dir_paths, (GCompareFunc) avif_batch_compare_paths);
+      for (i = 0; i < (gint) dir_paths->len; i++)
+        {
+          g_ptr_array_add (paths, g_ptr_array_index (dir_paths, i));
+        }
+      g_ptr_array_free (dir_paths, TRUE);
+    }
+
+  return paths;
+}
+
+static GimpValueArray *
+avif_load_batch (GimpProcedure        *procedure,
+                 const GimpValueArray *args,
+                 gpointer              run_data)
+{
+  GimpValueArray        *return_vals;
+  GPtrArray             *paths;
+  GimpImage            **images;
+  gchar                **files;
+  gchar                **statuses;
+  gdouble               *timings;
+  gint                   n_images = 0;
+  gint                   i;
+  AvifpluginPreload     *next = NULL;
+  gint                   preload_threads;
+  GimpMessageHandlerType message_handler;
+
+  gegl_init (NULL, NULL);
+
+  paths = avif_batch_collect_files (GIMP_VALUES_GET_STRV (args, 1),
+                                    GIMP_VALUES_GET_STRING (args, 2),
+                                    GIMP_VALUES_GET_STRING (args, 3));
+
+  images   = g_new0 (GimpImage *, paths->len);
+  files    = g_new0 (gchar *, paths->len + 1);
+  statuses = g_new0 (gchar *, paths->len + 1);
+  timings  = g_new0 (gdouble, paths->len);
+
+  /* Warnings about single files go to the console instead of opening one
+   * dialog per file; errors are in the statuses. */
+  message_handler = gimp_message_get_handler ();
+  gimp_message_set_handler (GIMP_CONSOLE);
+
+  /* libgimp can't be used from several threads, so the files are added to
+   * GIMP one after the other. Meanwhile, the next file is read and decoded
+   * on a worker thread. At most two files are decoded at once, each with
+   * half of the processors. */
+  preload_threads = MAX (1, gimp_get_num_processors () / 2);
+  if (paths->len > 0)
+    {
+      GFile *file = g_file_new_for_path (g_ptr_array_index (paths, 0));
+
+      next = preload_image_start (file, preload_threads);
+      g_object_unref (file);
+    }
+
+  for (i = 0; i < (gint) paths->len; i++)
+    {
+      const gchar       *path    = g_ptr_array_index (paths, i);
+      AvifpluginPreload *preload = next;
+      GError            *error   = NULL;
+      gint64             start   = g_get_monotonic_time ();
+      GimpImage         *image;
+
+      next = NULL;
+      if (i + 1 < (gint) paths->len)
+        {
+          GFile *file = g_file_new_for_path (g_ptr_array_index (paths, i + 1));
+
+          next = preload_image_start (file, preload_threads);
+          g_object_unref (file);
+        }
+
+      image = load_preloaded_image (preload, &error);
+
+      timings[i] = (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+      files[i] = g_strdup (path);
+      if (image)
+        {
+          images[n_images++] = image;
+          statuses[i] = g_strdup ("OK");
+        }
+      else
+        {
+          statuses[i] = g_strdup (error ? error->message : "Failed to load the file");
+        }
+
+      g_clear_error (&error);
+    }
+
+  preload_image_cleanup ();
+  gimp_message_set_handler (message_handler);
+
+  return_vals = gimp_procedure_new_return_values (procedure,
+                GIMP_PDB_SUCCESS,
+                NULL);
+
+  GIMP_VALUES_SET_INT (return_vals, 1, n_images);
+  GIMP_VALUES_TAKE_OBJECT_ARRAY (return_vals, 2, GIMP_TYPE_IMAGE, images, n_images);
+  GIMP_VALUES_TAKE_STRV (return_vals, 3, files);
+  GIMP_VALUES_TAKE_STRV (return_vals, 4, statuses);
+  GIMP_VALUES_SET_INT (return_vals, 5, paths->len);
+  GIMP_VALUES_TAKE_FLOAT_ARRAY (return_vals, 6, timings, paths->len);
+
+  g_ptr_array_free (paths, TRUE);
+
+  return return_vals;
+}
+
+/* Prepares a copy of image the way the export dialog would and exports it. */
+static gboolean
+avif_save_batch_image (GimpImage  *image,
+                       GFile      *file,
+                       GObject    *config,
+                       GError    **error)
+{
+  GimpImage            *duplicate;
+  GimpLayer           **layers;
+  gint32                n_layers;
+  GimpMetadata         *metadata;
+  GimpMetadataSaveFlags metadata_flags;
+  gboolean              animation;
+  avifPixelFormat       pixel_format = AVIF_PIXEL_FORMAT_YUV420;
+  gboolean              success;
+
+  g_object_get (config,
+                "animation", &animation,
+                "pixel-format", &pixel_format,
+                NULL);
+
+  duplicate = gimp_image_duplicate (image);
+  gimp_image_undo_disable (duplicate);
+
+  if (pixel_format == AVIF_PIXEL_FORMAT_YUV400)
+    {
+      if (gimp_image_get_base_type (duplicate) != GIMP_GRAY)
+        gimp_image_convert_grayscale (duplicate);
+    }
+  else if (gimp_image_get_base_type (duplicate) == GIMP_INDEXED)
+    {
+      gimp_image_convert_rgb (duplicate);
+    }
+
+  if (! animation)
+    gimp_image_merge_visible_layers (duplicate, GIMP_CLIP_TO_IMAGE);
+
+  layers = gimp_image_get_layers (duplicate, &n_layers);
+
+  metadata = gimp_image_metadata_save_prepare (image, "image/avif", &metadata_flags);
+  success = save_layers (file, duplicate, n_layers, (GimpDrawable **) layers,
+                         config, metadata, error);
+
+  if (metadata)
+    {
+      g_object_unref (metadata);
+    }
+  g_free (layers);
+  gimp_image_delete (duplicate);
+
+  return success;
+}
+
+static GimpValueArray *
+avif_save_batch (GimpProcedure        *procedure,
+                 const GimpValueArray *args,
+                 gpointer              run_data)
+{
+  GimpValueArray       *return_vals;
+  GimpProcedureConfig  *config;
+  GimpPDBStatusType     status = GIMP_PDB_SUCCESS;
+  gint                  n_images;
+  const GimpImage     **images;
+  const gchar         **filenames;
+  gchar               **statuses;
+  gdouble              *timings;
+  gint                  i;
+  GimpMessageHandlerType message_handler;
+
+  n_images  = GIMP_VALUES_GET_INT (args, 1);
+  images    = (const GimpImage **) GIMP_VALUES_GET_OBJECT_ARRAY (args, 2);
+  filenames = GIMP_VALUES_GET_STRV (args, 3);
+
+  if ((filenames ? g_strv_length ((gchar **) filenames) : 0) != (guint) n_images)
+    {
+      GError *error = g_error_new_literal (G_FILE_ERROR, 0,
+                                           "There must be exactly one file per image");
+
+      return gimp_procedure_new_return_values (procedure,
+             GIMP_PDB_CALLING_ERROR,
+             error);
+    }
+
+  gegl_init (NULL, NULL);
+
+  config = gimp_procedure_create_config (procedure);
+  gimp_procedure_config_begin_run (config, NULL, GIMP_RUN_NONINTERACTIVE, args);
+
+  statuses = g_new0 (gchar *, n_images + 1);
+  timings  = g_new0 (gdouble, n_images);
+
+  /* As on load, warnings go to the console and errors to the statuses. */
+  message_handler = gimp_message_get_handler ();
+  gimp_message_set_handler (GIMP_CONSOLE);
+
+  /* The pixels are fetched through libgimp, so the images are exported one
+   * after the other, each encode using all the processors. */
+  for (i = 0; i < n_images; i++)
+    {
+      GFile  *file  = g_file_new_for_path (filenames[i]);
+      GError *error = NULL;
+      gint64  start = g_get_monotonic_time ();
+
+      if (avif_save_batch_image ((GimpImage *) images[i], file, G_OBJECT (config), &error))
+        {
+          statuses[i] = g_strdup ("OK");
+        }
+      else
+        {
+          statuses[i] = g_strdup (error ? error->message : "Failed to export the image");
+        }
+      timings[i] = (g_get_monotonic_time () - start) / (gdouble) G_USEC_PER_SEC;
+
+      g_clear_error (&error);
+      g_object_unref (file);
+    }
+
+  gimp_message_set_handler (message_handler);
+
+  gimp_procedure_config_end_run (config, status);
+  g_object_unref (config);
+
+  return_vals = gimp_procedure_new_return_values (procedure, status, NULL);
+
+  GIMP_VALUES_TAKE_STRV (return_vals, 1, statuses);
+  GIMP_VALUES_SET_INT (return_vals, 2, n_images);
+  GIMP_VALUES_TAKE_FLOAT_ARRAY (return_vals, 3, timings, n_images);
+
+  return return_vals;
+}
+
+static GimpValueArray *
+avif_probe (GimpProcedure        *procedure,
+            const GimpValueArray *args,
+            gpointer              run_data)
+{
+  GimpValueArray     *return_vals;
+  const gchar        *filename;
+  GFile              *file;
+  GError             *error = NULL;
+  AvifpluginProbeInfo info;
+
+  filename = GIMP_VALUES_GET_STRING (args, 1);
+  if (! filename || ! filename[0])
+    {
+      error = g_error_new_literal (G_FILE_ERROR, 0, "No file to probe");
+
+      return gimp_procedure_new_return_values (procedure,
+             GIMP_PDB_CALLING_ERROR,
+             error);
+    }
+
+  file = g_file_new_for_path (filename);
+  if (! probe_image (file, &info, &error))
+    {
+      g_object_unref (file);
+      return gimp_procedure_new_return_values (procedure,
+             GIMP_PDB_EXECUTION_ERROR,
+             error);
+    }
+  g_object_unref (file);
+
+  return_vals = gimp_procedure_new_return_values (procedure,
+                GIMP_PDB_SUCCESS,
+                NULL);
+
+  GIMP_VALUES_SET_INT (return_vals, 1, info.width);
+  GIMP_VALUES_SET_INT (return_vals, 2, info.height);
+  GIMP_VALUES_SET_INT (return_vals, 3, info.bit_depth);
+  GIMP_VALUES_SET_INT (return_vals, 4, info.pixel_format);
+  GIMP_VALUES_SET_INT (return_vals, 5, info.color_primaries);
+  GIMP_VALUES_SET_INT (return_vals, 6, info.transfer_characteristics);
+  GIMP_VALUES_SET_INT (return_vals, 7, info.matrix_coefficients);
+  GIMP_VALUES_SET_BOOLEAN (return_vals, 8, info.full_range);
+  GIMP_VALUES_SET_BOOLEAN (return_vals, 9, info.has_alpha);
+  GIMP_VALUES_SET_BOOLEAN (return_vals, 10, info.has_icc);
+  GIMP_VALUES_SET_BOOLEAN (return_vals, 11, info.has_exif);
+  GIMP_VALUES_SET_BOOLEAN (return_vals, 12, info.has_xmp);
+  GIMP_VALUES_SET_INT (return_vals, 13, info.num_frames);
+
+  return return_vals;
+}